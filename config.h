@@ -230,6 +230,7 @@
 #define HAVE_GSM_H 0
 #define HAVE_IO_H 0
 #define HAVE_LINUX_DMA_BUF_H 0
+#define HAVE_LINUX_IO_URING_H 1
 #define HAVE_LINUX_PERF_EVENT_H 1
 #define HAVE_MACHINE_IOCTL_BT848_H 0
 #define HAVE_MACHINE_IOCTL_METEOR_H 0
@@ -326,6 +327,7 @@
 #define HAVE_PEEKNAMEDPIPE 0
 #define HAVE_POSIX_MEMALIGN 1
 #define HAVE_PRCTL 1
+#define HAVE_PREAD 1
 #define HAVE_PTHREAD_CANCEL 1
 #define HAVE_SCHED_GETAFFINITY 1
 #define HAVE_SECITEMIMPORT 0
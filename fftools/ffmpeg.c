@@ -104,6 +104,7 @@
 
 #include "ffmpeg.h"
 #include "cmdutils.h"
+#include "objpool.h"
 #include "sync_queue.h"
 
 #include "third_party/ffmpeg/libavutil/avassert.h"
@@ -130,15 +131,40 @@ static int trigger_fix_sub_duration_heartbeat(OutputStream *ost, const AVPacket
 static BenchmarkTimeStamps get_benchmark_time_stamps(void);
 static int64_t getmaxrss(void);
 static int ifilter_has_all_input_formats(FilterGraph *fg);
-
-static int64_t nb_frames_dup = 0;
-static uint64_t dup_warning = 1000;
-static int64_t nb_frames_drop = 0;
-static int64_t decode_error_stat[2];
-unsigned nb_output_dumped = 0;
+static int filter_thread_stop(FilterGraph *fg, int flush);
+static int enc_thread_stop(OutputStream *ost, int flush);
+/* maximum lag of the output of a decoding thread behind the input, see
+ * dec_thread_sync() */
+#define DEC_THREAD_MAX_LAG AV_TIME_BASE
+
+static void dec_thread_stop(InputStream *ist);
+static int ist_can_thread(const InputStream *ist);
+static int dec_thread_start(InputStream *ist);
+
+static atomic_int_least64_t  nb_frames_dup  = ATOMIC_VAR_INIT(0);
+static atomic_uint_least64_t dup_warning    = ATOMIC_VAR_INIT(1000);
+static atomic_int_least64_t  nb_frames_drop = ATOMIC_VAR_INIT(0);
+static atomic_int_least64_t decode_error_stat[2];
+atomic_uint nb_output_dumped = ATOMIC_VAR_INIT(0);
+
+
+/* serializes output stream initialization and filtergraph (re)configuration
+ * between the main thread and the filtering threads */
+static AVMutex init_lock  = AV_MUTEX_INITIALIZER;
+/* protects the statistics files which may be shared between encoders and the
+ * per-stream statistics shown by print_report() */
+static AVMutex stats_lock = AV_MUTEX_INITIALIZER;
+/* first fatal error returned by a filtering or an encoding thread */
+static atomic_int pipeline_error = ATOMIC_VAR_INIT(0);
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *stats_json_avio = NULL;
+
+/* -benchmark_stages profiles, printed at exit */
+static StageProfile **stage_profiles[STAGE_NB];
+static int         nb_stage_profiles[STAGE_NB];
+static StageProfile  *main_profile;
 
 InputFile   **input_files   = NULL;
 int        nb_input_files   = 0;
@@ -499,6 +525,57 @@ static int decode_interrupt_cb(void *ctx)
 
 const AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
 
+StageProfile *stage_profile_alloc(enum StageType type, const char *fmt, ...)
+{
+    StageProfile *sp;
+    char name[64];
+    va_list vl;
+
+    if (!do_benchmark_stages)
+        return NULL;
+
+    va_start(vl, fmt);
+    vsnprintf(name, sizeof(name), fmt, vl);
+    va_end(vl);
+
+    sp = sp_alloc(name);
+    if (!sp)
+        report_and_exit(AVERROR(ENOMEM));
+
+    GROW_ARRAY(stage_profiles[type], nb_stage_profiles[type]);
+    stage_profiles[type][nb_stage_profiles[type] - 1] = sp;
+
+    return sp;
+}
+
+/* must be called once all the threads have terminated */
+static void stage_profiles_print(void)
+{
+    av_log(NULL, AV_LOG_INFO, "Pipeline stages:\n");
+    sp_log(NULL, NULL, AV_LOG_INFO);
+    for (int type = 0; type < STAGE_NB; type++)
+        for (int i = 0; i < nb_stage_profiles[type]; i++)
+            sp_log(stage_profiles[type][i], NULL, AV_LOG_INFO);
+
+    av_log(NULL, AV_LOG_INFO, "Pipeline threads:\n");
+    sp_log_thread(NULL, NULL, AV_LOG_INFO);
+    sp_log_thread(main_profile, NULL, AV_LOG_INFO);
+    for (int type = 0; type < STAGE_NB; type++)
+        for (int i = 0; i < nb_stage_profiles[type]; i++)
+            sp_log_thread(stage_profiles[type][i], NULL, AV_LOG_INFO);
+}
+
+static void stage_profiles_free(void)
+{
+    for (int type = 0; type < STAGE_NB; type++) {
+        for (int i = 0; i < nb_stage_profiles[type]; i++)
+            sp_free(&stage_profiles[type][i]);
+        av_freep(&stage_profiles[type]);
+        nb_stage_profiles[type] = 0;
+    }
+    sp_free(&main_profile);
+}
+
 static void ffmpeg_cleanup(int ret)
 {
     int i, j;
@@ -508,8 +585,29 @@ static void ffmpeg_cleanup(int ret)
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
     }
 
+    /* terminate the pipeline threads before anything they use is freed */
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *ifile = input_files[i];
+        if (!ifile)
+            continue;
+        for (j = 0; j < ifile->nb_streams; j++)
+            if (ifile->streams[j])
+                dec_thread_stop(ifile->streams[j]);
+    }
+    for (i = 0; i < nb_filtergraphs; i++)
+        filter_thread_stop(filtergraphs[i], 0);
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+        if (!of)
+            continue;
+        for (j = 0; j < of->nb_streams; j++)
+            if (of->streams[j])
+                enc_thread_stop(of->streams[j], 0);
+    }
+
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
+        filtergraph_collect_stats(fg);
         avfilter_graph_free(&fg->graph);
         for (j = 0; j < fg->nb_inputs; j++) {
             InputFilter *ifilter = fg->inputs[j];
@@ -555,6 +653,13 @@ static void ffmpeg_cleanup(int ret)
     for (i = 0; i < nb_input_files; i++)
         ifile_close(&input_files[i]);
 
+    /* all the threads have been joined now */
+    if (main_profile) {
+        sp_thread_stop(main_profile);
+        stage_profiles_print();
+    }
+    stage_profiles_free();
+
     if (vstats_file) {
         if (fclose(vstats_file))
             av_log(NULL, AV_LOG_ERROR,
@@ -565,6 +670,7 @@ static void ffmpeg_cleanup(int ret)
     of_enc_stats_close();
 
     av_freep(&filter_nbthreads);
+    av_freep(&filter_thread_type);
 
     av_freep(&input_files);
     av_freep(&output_files);
@@ -664,7 +770,7 @@ static void update_benchmark(const char *fmt, ...)
 static void close_output_stream(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
-    ost->finished |= ENCODER_FINISHED;
+    atomic_fetch_or(&ost->finished, ENCODER_FINISHED);
 
     if (ost->sq_idx_encode >= 0)
         sq_send(of->sq_encode, ost->sq_idx_encode, SQFRAME(NULL));
@@ -733,10 +839,12 @@ static int init_output_stream_wrapper(OutputStream *ost, AVFrame *frame,
     int ret = AVERROR_BUG;
     char error[1024] = {0};
 
-    if (ost->initialized)
+    if (atomic_load(&ost->initialized))
         return 0;
 
+    ff_mutex_lock(&init_lock);
     ret = init_output_stream(ost, frame, error, sizeof(error));
+    ff_mutex_unlock(&init_lock);
     if (ret < 0) {
         av_log(ost, AV_LOG_ERROR, "Error initializing output stream: %s\n",
                error);
@@ -748,12 +856,23 @@ static int init_output_stream_wrapper(OutputStream *ost, AVFrame *frame,
     return ret;
 }
 
+static int fg_configure(FilterGraph *fg)
+{
+    int ret;
+
+    ff_mutex_lock(&init_lock);
+    ret = configure_filtergraph(fg);
+    ff_mutex_unlock(&init_lock);
+
+    return ret;
+}
+
 static double psnr(double d)
 {
     return -10.0 * log10(d);
 }
 
-static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write_vstats)
+static int update_video_stats(OutputStream *ost, const AVPacket *pkt, int write_vstats)
 {
     const uint8_t *sd = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS,
                                                 NULL);
@@ -761,6 +880,9 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     int64_t frame_number;
     double ti1, bitrate, avg_bitrate;
 
+    /* read by print_report() on the main thread */
+    ff_mutex_lock(&stats_lock);
+
     ost->quality   = sd ? AV_RL32(sd) : -1;
     ost->pict_type = sd ? sd[4] : AV_PICTURE_TYPE_NONE;
 
@@ -771,15 +893,19 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
             ost->error[i] = -1;
     }
 
-    if (!write_vstats)
-        return;
+    if (!write_vstats) {
+        ff_mutex_unlock(&stats_lock);
+        return 0;
+    }
 
     /* this is executed just the first time update_video_stats is called */
     if (!vstats_file) {
         vstats_file = fopen(vstats_filename, "w");
         if (!vstats_file) {
+            int err = AVERROR(errno);
+            ff_mutex_unlock(&stats_lock);
             perror("fopen");
-            exit_program(1);
+            return err;
         }
     }
 
@@ -806,6 +932,10 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     fprintf(vstats_file, "s_size= %8.0fkB time= %0.3f br= %7.1fkbits/s avg_br= %7.1fkbits/s ",
            (double)ost->data_size_enc / 1024, ti1, bitrate, avg_bitrate);
     fprintf(vstats_file, "type= %c\n", av_get_picture_type_char(ost->pict_type));
+
+    ff_mutex_unlock(&stats_lock);
+
+    return 0;
 }
 
 void enc_stats_write(OutputStream *ost, EncStats *es,
@@ -827,6 +957,8 @@ void enc_stats_write(OutputStream *ost, EncStats *es,
         ptsi = fd->pts;
     }
 
+    ff_mutex_lock(&stats_lock);
+
     for (size_t i = 0; i < es->nb_components; i++) {
         const EncStatsComponent *c = &es->components[i];
 
@@ -872,6 +1004,8 @@ void enc_stats_write(OutputStream *ost, EncStats *es,
     }
     avio_w8(io, '\n');
     avio_flush(io);
+
+    ff_mutex_unlock(&stats_lock);
 }
 
 static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
@@ -885,9 +1019,9 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     if (frame) {
         if (ost->enc_stats_pre.io)
             enc_stats_write(ost, &ost->enc_stats_pre, frame, NULL,
-                            ost->frames_encoded);
+                            atomic_load(&ost->frames_encoded));
 
-        ost->frames_encoded++;
+        atomic_fetch_add(&ost->frames_encoded, 1);
         ost->samples_encoded += frame->nb_samples;
 
         if (debug_ts) {
@@ -900,6 +1034,7 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     }
 
     update_benchmark(NULL);
+    sp_start(ost->enc_profile);
 
     ret = avcodec_send_frame(enc, frame);
     if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
@@ -909,9 +1044,12 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     }
 
     while (1) {
+        int64_t mux_start;
+
         ret = avcodec_receive_packet(enc, pkt);
         update_benchmark("%s_%s %d.%d", action, type_desc,
                          ost->file_index, ost->index);
+        sp_stop(ost->enc_profile);
 
         pkt->time_base = enc->time_base;
 
@@ -921,6 +1059,7 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
 
         if (ret == AVERROR(EAGAIN)) {
             av_assert0(frame); // should never happen during flushing
+            sp_frame_done(ost->enc_profile);
             return 0;
         } else if (ret == AVERROR_EOF) {
             of_output_packet(of, pkt, ost, 1);
@@ -930,8 +1069,11 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
             return ret;
         }
 
-        if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
-            update_video_stats(ost, pkt, !!vstats_filename);
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+            ret = update_video_stats(ost, pkt, !!vstats_filename);
+            if (ret < 0)
+                return ret;
+        }
         if (ost->enc_stats_post.io)
             enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
                             ost->packets_encoded);
@@ -970,17 +1112,195 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
 
         ost->packets_encoded++;
 
+        /* waiting for room in the muxing queue */
+        mux_start = av_gettime_relative();
         of_output_packet(of, pkt, ost, 0);
+        sp_add_wait(ost->enc_profile, av_gettime_relative() - mux_start);
+
+        sp_start(ost->enc_profile);
     }
 
     av_assert0(0);
 }
 
+static void pipeline_fail(int err)
+{
+    int expected = 0;
+    atomic_compare_exchange_strong(&pipeline_error, &expected, err);
+}
+
+/* account the time elapsed since start, e.g. spent blocked on a queue */
+static int64_t time_add(atomic_int_least64_t *total, int64_t start)
+{
+    int64_t elapsed = av_gettime_relative() - start;
+    atomic_fetch_add(total, elapsed);
+    return elapsed;
+}
+
+static void frame_move(void *dst, void *src)
+{
+    av_frame_move_ref(dst, src);
+}
+
+/* whether the output stream may be encoded outside of the main thread */
+static int ost_can_thread(const OutputStream *ost)
+{
+    if (!pipeline_threads || do_benchmark_all || exit_on_error)
+        return 0;
+
+    return ost->enc_ctx &&
+           (ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO ||
+            ost->enc_ctx->codec_type == AVMEDIA_TYPE_AUDIO) &&
+           ost->sq_idx_encode < 0 && !ost->fix_sub_duration_heartbeat;
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream   *ost = arg;
+    OutputFile      *of = output_files[ost->file_index];
+    AVCodecContext *enc = ost->enc_ctx;
+    AVFrame      *frame = NULL;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "enc%d:%d:%s", ost->file_index, ost->index,
+             enc->codec->name);
+    ff_thread_setname(name);
+    sp_thread_start(ost->enc_profile, name);
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int64_t wait_start = av_gettime_relative();
+        int stream_idx;
+
+        ret = tq_receive(ost->enc_tq, &stream_idx, frame);
+        sp_add_wait(ost->enc_profile, time_add(&ost->enc_input_wait, wait_start));
+        if (stream_idx < 0) {
+            /* aborted, do not drain the encoder */
+            ret = 0;
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            ret = encode_frame(of, ost, NULL);
+            break;
+        }
+
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO && !ost->frame_aspect_ratio.num)
+            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+        ret = encode_frame(of, ost, frame);
+        av_frame_unref(frame);
+        if (ret < 0)
+            break;
+    }
+
+finish:
+    tq_receive_finish(ost->enc_tq, 0);
+    av_frame_free(&frame);
+    sp_thread_stop(ost->enc_profile);
+
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    if (ret < 0) {
+        av_log(ost, AV_LOG_ERROR, "Error in the encoding thread: %s\n",
+               av_err2str(ret));
+        pipeline_fail(ret);
+    }
+
+    return (void*)(intptr_t)ret;
+}
+
+static int enc_thread_start(OutputStream *ost)
+{
+    ObjPool *op;
+    int ret;
+
+    ost->enc_frame = av_frame_alloc();
+    if (!ost->enc_frame)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    ost->enc_tq = tq_alloc(1, pipeline_queue_size, op, frame_move);
+    if (!ost->enc_tq) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_create(&ost->enc_thread, NULL, encoder_thread, ost);
+    if (ret) {
+        tq_free(&ost->enc_tq);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+/**
+ * Wait for the encoding thread to terminate.
+ *
+ * @param flush when zero, the frames still queued are discarded and the
+ *              encoder is not drained
+ */
+static int enc_thread_stop(OutputStream *ost, int flush)
+{
+    void *ret;
+
+    if (!ost->enc_tq)
+        return 0;
+
+    if (!flush)
+        tq_receive_finish(ost->enc_tq, 0);
+    tq_send_finish(ost->enc_tq, 0);
+
+    pthread_join(ost->enc_thread, &ret);
+
+    tq_free(&ost->enc_tq);
+
+    return (int)(intptr_t)ret;
+}
+
+/**
+ * Pass a frame to the encoding thread. The frame data is moved to the queue,
+ * so frame is reset on return.
+ */
+static int enc_thread_send(OutputStream *ost, AVFrame *frame)
+{
+    int64_t send_start;
+    int ret;
+
+    if (!frame) {
+        ret = enc_thread_stop(ost, 1);
+        return ret < 0 ? ret : AVERROR_EOF;
+    }
+
+    send_start = av_gettime_relative();
+    ret = tq_send(ost->enc_tq, 0, frame);
+    /* the filtergraph waits for the encoder */
+    sp_add_wait(ost->filter->graph->profile,
+                time_add(&ost->enc_send_wait, send_start));
+    if (ret < 0)
+        av_frame_unref(frame);
+
+    return ret;
+}
+
+/* With an encoding thread, frame is reset on return. */
 static int submit_encode_frame(OutputFile *of, OutputStream *ost,
                                AVFrame *frame)
 {
     int ret;
 
+    if (ost->enc_tq)
+        return enc_thread_send(ost, frame);
+
     if (ost->sq_idx_encode < 0)
         return encode_frame(of, ost, frame);
 
@@ -1022,8 +1342,8 @@ static int submit_encode_frame(OutputFile *of, OutputStream *ost,
     }
 }
 
-static void do_audio_out(OutputFile *of, OutputStream *ost,
-                         AVFrame *frame)
+static int do_audio_out(OutputFile *of, OutputStream *ost,
+                        AVFrame *frame)
 {
     AVCodecContext *enc = ost->enc_ctx;
     int ret;
@@ -1039,13 +1359,12 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
     frame->time_base = enc->time_base;
 
     if (!check_recording_time(ost, frame->pts, frame->time_base))
-        return;
+        return 0;
 
     ost->next_pts = frame->pts + frame->nb_samples;
 
     ret = submit_encode_frame(of, ost, frame);
-    if (ret < 0 && ret != AVERROR_EOF)
-        exit_program(1);
+    return ret == AVERROR_EOF ? 0 : ret;
 }
 
 static void do_subtitle_out(OutputFile *of,
@@ -1097,7 +1416,7 @@ static void do_subtitle_out(OutputFile *of,
         if (i == 1)
             sub->num_rects = 0;
 
-        ost->frames_encoded++;
+        atomic_fetch_add(&ost->frames_encoded, 1);
 
         subtitle_out_size = avcodec_encode_subtitle(enc, pkt->data, pkt->size, sub);
         if (i == 1)
@@ -1250,9 +1569,9 @@ force_keyframe:
 }
 
 /* May modify/reset next_picture */
-static void do_video_out(OutputFile *of,
-                         OutputStream *ost,
-                         AVFrame *next_picture)
+static int do_video_out(OutputFile *of,
+                        OutputStream *ost,
+                        AVFrame *next_picture)
 {
     int ret;
     AVCodecContext *enc = ost->enc_ctx;
@@ -1262,7 +1581,9 @@ static void do_video_out(OutputFile *of,
     InputStream *ist = ost->ist;
     AVFilterContext *filter = ost->filter->filter;
 
-    init_output_stream_wrapper(ost, next_picture, 1);
+    ret = init_output_stream_wrapper(ost, next_picture, 0);
+    if (ret < 0)
+        return ret;
 
     frame_rate = av_buffersink_get_frame_rate(filter);
     if (frame_rate.num > 0 && frame_rate.den > 0)
@@ -1296,22 +1617,27 @@ static void do_video_out(OutputFile *of,
     ost->last_nb0_frames[0] = nb_frames_prev;
 
     if (nb_frames_prev == 0 && ost->last_dropped) {
-        nb_frames_drop++;
+        atomic_fetch_add(&nb_frames_drop, 1);
         av_log(ost, AV_LOG_VERBOSE,
                "*** dropping frame %"PRId64" at ts %"PRId64"\n",
                ost->vsync_frame_number, ost->last_frame->pts);
     }
     if (nb_frames > (nb_frames_prev && ost->last_dropped) + (nb_frames > nb_frames_prev)) {
+        int64_t nb_dup;
+        uint64_t dup_warn;
+
         if (nb_frames > dts_error_threshold * 30) {
             av_log(ost, AV_LOG_ERROR, "%"PRId64" frame duplication too large, skipping\n", nb_frames - 1);
-            nb_frames_drop++;
-            return;
+            atomic_fetch_add(&nb_frames_drop, 1);
+            return 0;
         }
-        nb_frames_dup += nb_frames - (nb_frames_prev && ost->last_dropped) - (nb_frames > nb_frames_prev);
+        nb_dup  = nb_frames - (nb_frames_prev && ost->last_dropped) - (nb_frames > nb_frames_prev);
+        nb_dup += atomic_fetch_add(&nb_frames_dup, nb_dup);
         av_log(ost, AV_LOG_VERBOSE, "*** %"PRId64" dup!\n", nb_frames - 1);
-        if (nb_frames_dup > dup_warning) {
-            av_log(ost, AV_LOG_WARNING, "More than %"PRIu64" frames duplicated\n", dup_warning);
-            dup_warning *= 10;
+        dup_warn = atomic_load(&dup_warning);
+        if (nb_dup > dup_warn) {
+            av_log(ost, AV_LOG_WARNING, "More than %"PRIu64" frames duplicated\n", dup_warn);
+            atomic_compare_exchange_strong(&dup_warning, &dup_warn, dup_warn * 10);
         }
     }
     ost->last_dropped = nb_frames == nb_frames_prev && next_picture;
@@ -1327,21 +1653,31 @@ static void do_video_out(OutputFile *of,
             in_picture = next_picture;
 
         if (!in_picture)
-            return;
+            return 0;
 
         in_picture->pts = ost->next_pts;
 
         if (!check_recording_time(ost, in_picture->pts, ost->enc_ctx->time_base))
-            return;
+            return 0;
 
         in_picture->quality = enc->global_quality;
         in_picture->pict_type = forced_kf_apply(ost, &ost->kf, enc->time_base, in_picture, i);
 
+        /* the encoding thread takes the frame data, so pass it a new
+         * reference when the picture may be duplicated later on */
+        if (ost->enc_tq &&
+            (ost->vsync_method == VSYNC_CFR || ost->vsync_method == VSYNC_VSCFR)) {
+            ret = av_frame_ref(ost->enc_frame, in_picture);
+            if (ret < 0)
+                return ret;
+            in_picture = ost->enc_frame;
+        }
+
         ret = submit_encode_frame(of, ost, in_picture);
         if (ret == AVERROR_EOF)
             break;
         else if (ret < 0)
-            exit_program(1);
+            return ret;
 
         ost->next_pts++;
         ost->vsync_frame_number++;
@@ -1350,97 +1686,132 @@ static void do_video_out(OutputFile *of,
     av_frame_unref(ost->last_frame);
     if (next_picture)
         av_frame_move_ref(ost->last_frame, next_picture);
+
+    return 0;
 }
 
 /**
- * Get and encode new output from any of the filtergraphs, without causing
- * activity.
+ * Get and encode new output from the buffer sink of an output stream, without
+ * causing activity.
  *
  * @return  0 for success, <0 for severe errors
  */
-static int reap_filters(int flush)
+static int reap_ost(OutputStream *ost, int flush)
 {
+    OutputFile    *of = output_files[ost->file_index];
     AVFrame *filtered_frame = NULL;
+    AVFilterContext *filter;
+    AVCodecContext *enc = ost->enc_ctx;
+    int ret = 0;
 
-    /* Reap all buffers present in the buffer sinks */
-    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
-        OutputFile    *of = output_files[ost->file_index];
-        AVFilterContext *filter;
-        AVCodecContext *enc = ost->enc_ctx;
-        int ret = 0;
+    if (!ost->filter || !ost->filter->graph->graph)
+        return 0;
+    filter = ost->filter->filter;
+
+    /*
+     * Unlike video, with audio the audio frame size matters.
+     * Currently we are fully reliant on the lavfi filter chain to
+     * do the buffering deed for us, and thus the frame size parameter
+     * needs to be set accordingly. Where does one get the required
+     * frame size? From the initialized AVCodecContext of an audio
+     * encoder. Thus, if we have gotten to an audio stream, initialize
+     * the encoder earlier than receiving the first AVFrame.
+     */
+    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_AUDIO) {
+        ret = init_output_stream_wrapper(ost, NULL, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    filtered_frame = ost->filtered_frame;
 
-        if (!ost->filter || !ost->filter->graph->graph)
+    while (1) {
+        ret = av_buffersink_get_frame_flags(filter, filtered_frame,
+                                           AV_BUFFERSINK_FLAG_NO_REQUEST);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                av_log(NULL, AV_LOG_WARNING,
+                       "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
+            } else if (flush && ret == AVERROR_EOF) {
+                if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
+                    return do_video_out(of, ost, NULL);
+            }
+            break;
+        }
+        if (atomic_load(&ost->finished)) {
+            av_frame_unref(filtered_frame);
             continue;
-        filter = ost->filter->filter;
+        }
 
-        /*
-         * Unlike video, with audio the audio frame size matters.
-         * Currently we are fully reliant on the lavfi filter chain to
-         * do the buffering deed for us, and thus the frame size parameter
-         * needs to be set accordingly. Where does one get the required
-         * frame size? From the initialized AVCodecContext of an audio
-         * encoder. Thus, if we have gotten to an audio stream, initialize
-         * the encoder earlier than receiving the first AVFrame.
-         */
-        if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_AUDIO)
-            init_output_stream_wrapper(ost, NULL, 1);
+        if (filtered_frame->pts != AV_NOPTS_VALUE) {
+            AVRational tb = av_buffersink_get_time_base(filter);
+            atomic_store(&ost->last_filter_pts,
+                         av_rescale_q(filtered_frame->pts, tb, AV_TIME_BASE_Q));
+            filtered_frame->time_base = tb;
+
+            if (debug_ts)
+                av_log(NULL, AV_LOG_INFO, "filter_raw -> pts:%s pts_time:%s time_base:%d/%d\n",
+                       av_ts2str(filtered_frame->pts),
+                       av_ts2timestr(filtered_frame->pts, &tb),
+                       tb.num, tb.den);
+        }
 
-        filtered_frame = ost->filtered_frame;
+        switch (av_buffersink_get_type(filter)) {
+        case AVMEDIA_TYPE_VIDEO:
+            /* the encoding thread takes the aspect ratio from the frames */
+            if (!ost->frame_aspect_ratio.num && !ost->enc_tq)
+                enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
 
-        while (1) {
-            ret = av_buffersink_get_frame_flags(filter, filtered_frame,
-                                               AV_BUFFERSINK_FLAG_NO_REQUEST);
-            if (ret < 0) {
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
-                    av_log(NULL, AV_LOG_WARNING,
-                           "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
-                } else if (flush && ret == AVERROR_EOF) {
-                    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
-                        do_video_out(of, ost, NULL);
-                }
+            ret = do_video_out(of, ost, filtered_frame);
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (!(enc->codec->capabilities & AV_CODEC_CAP_PARAM_CHANGE) &&
+                enc->ch_layout.nb_channels != filtered_frame->ch_layout.nb_channels) {
+                av_log(NULL, AV_LOG_ERROR,
+                       "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
                 break;
             }
-            if (ost->finished) {
-                av_frame_unref(filtered_frame);
-                continue;
-            }
+            ret = do_audio_out(of, ost, filtered_frame);
+            break;
+        default:
+            // TODO support subtitle filters
+            av_assert0(0);
+        }
 
-            if (filtered_frame->pts != AV_NOPTS_VALUE) {
-                AVRational tb = av_buffersink_get_time_base(filter);
-                ost->last_filter_pts = av_rescale_q(filtered_frame->pts, tb,
-                                                    AV_TIME_BASE_Q);
-                filtered_frame->time_base = tb;
-
-                if (debug_ts)
-                    av_log(NULL, AV_LOG_INFO, "filter_raw -> pts:%s pts_time:%s time_base:%d/%d\n",
-                           av_ts2str(filtered_frame->pts),
-                           av_ts2timestr(filtered_frame->pts, &tb),
-                           tb.num, tb.den);
-            }
+        av_frame_unref(filtered_frame);
+        if (ret < 0)
+            return ret;
+    }
 
-            switch (av_buffersink_get_type(filter)) {
-            case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
-                    enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
+    return 0;
+}
 
-                do_video_out(of, ost, filtered_frame);
-                break;
-            case AVMEDIA_TYPE_AUDIO:
-                if (!(enc->codec->capabilities & AV_CODEC_CAP_PARAM_CHANGE) &&
-                    enc->ch_layout.nb_channels != filtered_frame->ch_layout.nb_channels) {
-                    av_log(NULL, AV_LOG_ERROR,
-                           "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
-                    break;
-                }
-                do_audio_out(of, ost, filtered_frame);
-                break;
-            default:
-                // TODO support subtitle filters
-                av_assert0(0);
-            }
+static int reap_filtergraph(FilterGraph *fg, int flush)
+{
+    for (int i = 0; i < fg->nb_outputs; i++) {
+        int ret = reap_ost(fg->outputs[i]->ost, flush);
+        if (ret < 0)
+            return ret;
+    }
 
-            av_frame_unref(filtered_frame);
-        }
+    return 0;
+}
+
+/**
+ * Get and encode new output from any of the filtergraphs run by the main
+ * thread, without causing activity.
+ *
+ * @return  0 for success, <0 for severe errors
+ */
+static int reap_filters(int flush)
+{
+    /* Reap all buffers present in the buffer sinks */
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+        if (!ost->filter || ost->filter->graph->tq)
+            continue;
+
+        if (reap_ost(ost, flush) < 0)
+            exit_program(1);
     }
 
     return 0;
@@ -1541,7 +1912,7 @@ static void print_final_stats(int64_t total_size)
                    i, j, av_get_media_type_string(type));
             if (ost->enc_ctx) {
                 av_log(NULL, AV_LOG_VERBOSE, "%"PRIu64" frames encoded",
-                       ost->frames_encoded);
+                       atomic_load(&ost->frames_encoded));
                 if (type == AVMEDIA_TYPE_AUDIO)
                     av_log(NULL, AV_LOG_VERBOSE, " (%"PRIu64" samples)", ost->samples_encoded);
                 av_log(NULL, AV_LOG_VERBOSE, "; ");
@@ -1566,6 +1937,116 @@ static void print_final_stats(int64_t total_size)
     }
 }
 
+/* write one line of JSON describing the state of every pipeline stage */
+static void print_stats_json(int is_last_report, float t)
+{
+    AVBPrint buf;
+    int nb, ret;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    av_bprintf(&buf, "{\"time\":%.3f,\"final\":%s,\"inputs\":[", t,
+               is_last_report ? "true" : "false");
+    for (int i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+        uint64_t packets = 0, bytes = 0;
+
+        for (int j = 0; j < f->nb_streams; j++) {
+            packets += f->streams[j]->nb_packets;
+            bytes   += f->streams[j]->data_size;
+        }
+
+        av_bprintf(&buf, "%s{\"file\":%d,\"packets\":%"PRIu64",\"bytes\":%"PRIu64","
+                   "\"packets_per_sec\":%.2f,\"bytes_per_sec\":%.0f,\"queue\":%d,"
+                   "\"decoders\":[", i ? "," : "", i, packets, bytes,
+                   t > 0 ? packets / t : 0.0, t > 0 ? bytes / t : 0.0,
+                   ifile_queue_fill(f));
+
+        nb = 0;
+        for (int j = 0; j < f->nb_streams; j++) {
+            InputStream *ist = f->streams[j];
+
+            if (!ist->decoding_needed)
+                continue;
+
+            av_bprintf(&buf, "%s{\"stream\":%d,\"codec\":\"%s\",\"queue\":%"SIZE_SPECIFIER","
+                       "\"input_wait_ms\":%.3f,\"output_wait_ms\":%.3f}",
+                       nb++ ? "," : "", j, ist->dec->name,
+                       ist->dec_frame_tq ? tq_fill_level(ist->dec_frame_tq) : 0,
+                       atomic_load(&ist->dec_input_wait)  / 1000.0,
+                       atomic_load(&ist->dec_output_wait) / 1000.0);
+        }
+        av_bprintf(&buf, "]}");
+    }
+
+    av_bprintf(&buf, "],\"filtergraphs\":[");
+    for (int i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+        uint64_t frames  = atomic_load(&fg->frames_filtered);
+        int64_t     busy = atomic_load(&fg->busy_time);
+        int64_t out_wait = 0;
+
+        for (int j = 0; j < fg->nb_outputs; j++) {
+            if (fg->outputs[j]->ost)
+                out_wait += atomic_load(&fg->outputs[j]->ost->enc_send_wait);
+        }
+        /* the filtering thread also waits for the encoders to take its output */
+        busy = FFMAX(busy - out_wait, 0);
+
+        av_bprintf(&buf, "%s{\"index\":%d,\"frames\":%"PRIu64",\"busy_ms\":%.3f,",
+                   i ? "," : "", i, frames, busy / 1000.0);
+        /* only measured for graphs running in their own thread */
+        if (frames)
+            av_bprintf(&buf, "\"busy_ms_per_frame\":%.3f,", busy / 1000.0 / frames);
+        else
+            av_bprintf(&buf, "\"busy_ms_per_frame\":null,");
+        av_bprintf(&buf, "\"queue\":%"SIZE_SPECIFIER",\"input_wait_ms\":%.3f,\"output_wait_ms\":%.3f}",
+                   fg->tq ? tq_fill_level(fg->tq) : 0,
+                   atomic_load(&fg->input_wait) / 1000.0, out_wait / 1000.0);
+    }
+
+    av_bprintf(&buf, "],\"encoders\":[");
+    nb = 0;
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+        uint64_t frames;
+
+        if (!ost->enc_ctx)
+            continue;
+
+        frames = atomic_load(&ost->frames_encoded);
+        av_bprintf(&buf, "%s{\"file\":%d,\"stream\":%d,\"codec\":\"%s\","
+                   "\"frames\":%"PRIu64",\"fps\":%.2f,\"input_wait_ms\":%.3f,"
+                   "\"backpressure_ms\":%.3f,\"output_wait_ms\":%.3f}",
+                   nb++ ? "," : "", ost->file_index, ost->index,
+                   ost->enc_ctx->codec->name, frames, t > 0 ? frames / t : 0.0,
+                   atomic_load(&ost->enc_input_wait) / 1000.0,
+                   atomic_load(&ost->enc_send_wait)  / 1000.0,
+                   of_queue_wait_time(ost) / 1000.0);
+    }
+
+    av_bprintf(&buf, "],\"outputs\":[");
+    for (int i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        av_bprintf(&buf, "%s{\"file\":%d,\"bytes\":%"PRId64",\"queue\":%"SIZE_SPECIFIER"}",
+                   i ? "," : "", i, FFMAX(of_filesize(of), 0), of_queue_fill(of));
+    }
+    av_bprintf(&buf, "]}\n");
+
+    if (av_bprint_is_complete(&buf)) {
+        avio_write(stats_json_avio, buf.str, buf.len);
+        avio_flush(stats_json_avio);
+    }
+    av_bprint_finalize(&buf, NULL);
+
+    if (is_last_report) {
+        if ((ret = avio_closep(&stats_json_avio)) < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing stats log, loss of information possible: %s\n",
+                   av_err2str(ret));
+    }
+}
+
 static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time)
 {
     AVBPrint buf, buf_script;
@@ -1577,12 +2058,15 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     static int64_t last_time = -1;
     static int first_report = 1;
     static int qp_histogram[52];
+    static uint64_t last_frame_allocs;
+    static float last_t;
     int hours, mins, secs, us;
     const char *hours_sign;
+    int64_t nb_dup, nb_drop;
     int ret;
     float t;
 
-    if (!print_stats && !is_last_report && !progress_avio)
+    if (!print_stats && !is_last_report && !progress_avio && !stats_json_avio)
         return;
 
     if (!is_last_report) {
@@ -1590,7 +2074,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
             last_time = cur_time;
         }
         if (((cur_time - last_time) < stats_period && !first_report) ||
-            (first_report && nb_output_dumped < nb_output_files))
+            (first_report && atomic_load(&nb_output_dumped) < nb_output_files))
             return;
         last_time = cur_time;
     }
@@ -1602,7 +2086,18 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     av_bprint_init(&buf_script, 0, AV_BPRINT_SIZE_AUTOMATIC);
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
         const AVCodecContext * const enc = ost->enc_ctx;
-        const float q = enc ? ost->quality / (float) FF_QP2LAMBDA : -1;
+        int64_t frame_error[FF_ARRAY_ELEMS(ost->error)];
+        int quality, pict_type;
+        float q;
+
+        /* the encoder threads update these concurrently */
+        ff_mutex_lock(&stats_lock);
+        quality   = ost->quality;
+        pict_type = ost->pict_type;
+        memcpy(frame_error, ost->error, sizeof(frame_error));
+        ff_mutex_unlock(&stats_lock);
+
+        q = enc ? quality / (float) FF_QP2LAMBDA : -1;
 
         if (vid && ost->st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             av_bprintf(&buf, "q=%2.1f ", q);
@@ -1632,7 +2127,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
             }
 
             if (enc && (enc->flags & AV_CODEC_FLAG_PSNR) &&
-                (ost->pict_type != AV_PICTURE_TYPE_NONE || is_last_report)) {
+                (pict_type != AV_PICTURE_TYPE_NONE || is_last_report)) {
                 int j;
                 double error, error_sum = 0;
                 double scale, scale_sum = 0;
@@ -1644,7 +2139,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
                         error = enc->error[j];
                         scale = enc->width * enc->height * 255.0 * 255.0 * frame_number;
                     } else {
-                        error = ost->error[j];
+                        error = frame_error[j];
                         scale = enc->width * enc->height * 255.0 * 255.0;
                     }
                     if (j)
@@ -1664,8 +2159,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
             vid = 1;
         }
         /* compute min output value */
-        if (ost->last_mux_dts != AV_NOPTS_VALUE) {
-            pts = FFMAX(pts, ost->last_mux_dts);
+        if (atomic_load(&ost->last_mux_dts) != AV_NOPTS_VALUE) {
+            pts = FFMAX(pts, atomic_load(&ost->last_mux_dts));
             if (copy_ts) {
                 if (copy_ts_first_pts == AV_NOPTS_VALUE && pts > 1)
                     copy_ts_first_pts = pts;
@@ -1675,7 +2170,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
 
         if (is_last_report)
-            nb_frames_drop += ost->last_dropped;
+            atomic_fetch_add(&nb_frames_drop, ost->last_dropped);
     }
 
     secs = FFABS(pts) / AV_TIME_BASE;
@@ -1719,10 +2214,41 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
                    hours_sign, hours, mins, secs, us);
     }
 
-    if (nb_frames_dup || nb_frames_drop)
-        av_bprintf(&buf, " dup=%"PRId64" drop=%"PRId64, nb_frames_dup, nb_frames_drop);
-    av_bprintf(&buf_script, "dup_frames=%"PRId64"\n", nb_frames_dup);
-    av_bprintf(&buf_script, "drop_frames=%"PRId64"\n", nb_frames_drop);
+    nb_dup  = atomic_load(&nb_frames_dup);
+    nb_drop = atomic_load(&nb_frames_drop);
+    if (nb_dup || nb_drop)
+        av_bprintf(&buf, " dup=%"PRId64" drop=%"PRId64, nb_dup, nb_drop);
+    av_bprintf(&buf_script, "dup_frames=%"PRId64"\n", nb_dup);
+    av_bprintf(&buf_script, "drop_frames=%"PRId64"\n", nb_drop);
+
+    /* how many items wait in the queues filled by the decoding threads */
+    for (InputStream *ist = ist_iter(NULL); ist; ist = ist_iter(ist)) {
+        int fill;
+
+        if (!ist->dec_frame_tq)
+            continue;
+
+        fill = tq_fill_level(ist->dec_frame_tq);
+        av_bprintf(&buf, " dec%d:%d=%d/%d", ist->file_index, ist->st->index,
+                   fill, pipeline_queue_size);
+        av_bprintf(&buf_script, "dec_queue_%d_%d=%d\n", ist->file_index,
+                   ist->st->index, fill);
+    }
+
+    /* frames allocated for passing data between threads since the previous
+     * report; with warmed up pools this should stay at zero */
+    if (pipeline_threads) {
+        uint64_t frame_allocs = objpool_frames_allocated();
+        float allocs_rate = t > last_t ?
+                            (frame_allocs - last_frame_allocs) / (t - last_t) : 0;
+
+        av_bprintf(&buf, " allocs=%.0f/s", allocs_rate);
+        av_bprintf(&buf_script, "frame_allocs=%"PRIu64"\n", frame_allocs);
+        av_bprintf(&buf_script, "frame_allocs_per_sec=%.2f\n", allocs_rate);
+
+        last_frame_allocs = frame_allocs;
+        last_t            = t;
+    }
 
     if (speed < 0) {
         av_bprintf(&buf, " speed=N/A");
@@ -1757,6 +2283,9 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
     }
 
+    if (stats_json_avio)
+        print_stats_json(is_last_report, t);
+
     first_report = 0;
 
     if (is_last_report)
@@ -1800,7 +2329,7 @@ static void flush_encoders(void)
 
         // Try to enable encoding with no input frames.
         // Maybe we should just let encoding fail instead.
-        if (!ost->initialized) {
+        if (!atomic_load(&ost->initialized)) {
             FilterGraph *fg = ost->filter->graph;
 
             av_log(ost, AV_LOG_WARNING,
@@ -1820,7 +2349,7 @@ static void flush_encoders(void)
                 if (!ifilter_has_all_input_formats(fg))
                     continue;
 
-                ret = configure_filtergraph(fg);
+                ret = fg_configure(fg);
                 if (ret < 0) {
                     av_log(ost, AV_LOG_ERROR, "Error configuring filter graph\n");
                     exit_program(1);
@@ -1851,7 +2380,7 @@ static int check_output_constraints(InputStream *ist, OutputStream *ost)
     if (ost->ist != ist)
         return 0;
 
-    if (ost->finished & MUXER_FINISHED)
+    if (atomic_load(&ost->finished) & MUXER_FINISHED)
         return 0;
 
     if (of->start_time != AV_NOPTS_VALUE && ist->pts < of->start_time)
@@ -1947,7 +2476,7 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
 static void check_decode_result(InputStream *ist, int *got_output, int ret)
 {
     if (*got_output || ret<0)
-        decode_error_stat[ret<0] ++;
+        atomic_fetch_add(&decode_error_stat[ret<0], 1);
 
     if (ret < 0 && exit_on_error)
         exit_program(1);
@@ -2031,20 +2560,23 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_ref
             return ret;
         }
 
-        ret = reap_filters(1);
+        ret = fg->tq ? reap_filtergraph(fg, 1) : reap_filters(1);
         if (ret < 0 && ret != AVERROR_EOF) {
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
             return ret;
         }
 
-        ret = configure_filtergraph(fg);
+        ret = fg_configure(fg);
         if (ret < 0) {
             av_log(NULL, AV_LOG_ERROR, "Error reinitializing filters!\n");
             return ret;
         }
     }
 
+    sp_start(fg->profile);
     ret = av_buffersrc_add_frame_flags(ifilter->filter, frame, buffersrc_flags);
+    sp_stop(fg->profile);
+    sp_frame_done(fg->profile);
     if (ret < 0) {
         if (ret != AVERROR_EOF)
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
@@ -2061,7 +2593,9 @@ static int ifilter_send_eof(InputFilter *ifilter, int64_t pts)
     ifilter->eof = 1;
 
     if (ifilter->filter) {
+        sp_start(ifilter->graph->profile);
         ret = av_buffersrc_close(ifilter->filter, pts, AV_BUFFERSRC_FLAG_PUSH);
+        sp_stop(ifilter->graph->profile);
         if (ret < 0)
             return ret;
     } else {
@@ -2080,6 +2614,232 @@ static int ifilter_send_eof(InputFilter *ifilter, int64_t pts)
     return 0;
 }
 
+static int fg_outputs_finished(FilterGraph *fg)
+{
+    for (int i = 0; i < fg->nb_outputs; i++)
+        if (!atomic_load(&fg->outputs[i]->ost->finished))
+            return 0;
+    return 1;
+}
+
+/**
+ * Run the filtergraph of a filtering thread until it needs more input.
+ *
+ * @return 0 when more input is needed, 1 when no more output can or should be
+ *         produced, <0 on error
+ */
+static int filter_thread_run(FilterGraph *fg)
+{
+    int ret;
+
+    /* see transcode_step() for why audio encoders are initialized first */
+    for (int i = 0; i < fg->nb_outputs; i++) {
+        OutputStream *ost = fg->outputs[i]->ost;
+
+        if (av_buffersink_get_type(ost->filter->filter) == AVMEDIA_TYPE_AUDIO) {
+            ret = init_output_stream_wrapper(ost, NULL, 0);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    while (1) {
+        int req;
+
+        sp_start(fg->profile);
+        req = avfilter_graph_request_oldest(fg->graph);
+        sp_stop(fg->profile);
+        if (req == AVERROR_EOF) {
+            ret = reap_filtergraph(fg, 1);
+            for (int i = 0; i < fg->nb_outputs; i++)
+                close_output_stream(fg->outputs[i]->ost);
+            return ret < 0 ? ret : 1;
+        } else if (req < 0 && req != AVERROR(EAGAIN))
+            return req;
+
+        ret = reap_filtergraph(fg, 0);
+        if (ret < 0)
+            return ret;
+
+        if (fg_outputs_finished(fg))
+            return 1;
+        if (req == AVERROR(EAGAIN))
+            return 0;
+    }
+}
+
+static void *filter_thread(void *arg)
+{
+    FilterGraph      *fg = arg;
+    InputFilter *ifilter = fg->inputs[0];
+    AVFrame       *frame = NULL;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "filter%d", fg->index);
+    ff_thread_setname(name);
+    sp_thread_start(fg->profile, name);
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int64_t start = av_gettime_relative();
+        int input_idx;
+
+        ret = tq_receive(fg->tq, &input_idx, frame);
+        sp_add_wait(fg->profile, time_add(&fg->input_wait, start));
+        if (input_idx < 0) {
+            /* aborted */
+            ret = 0;
+            break;
+        }
+
+        start = av_gettime_relative();
+        pthread_mutex_lock(&fg->lock);
+
+        if (ret == AVERROR_EOF) {
+            ret = ifilter_send_eof(ifilter, ifilter->eof_pts);
+            if (ret >= 0 && !fg->graph && ifilter_has_all_input_formats(fg))
+                ret = fg_configure(fg);
+        } else {
+            ret = ifilter_send_frame(ifilter, frame, 0);
+            av_frame_unref(frame);
+            if (ret == AVERROR_EOF)
+                ret = 0;
+            atomic_fetch_add(&fg->frames_filtered, 1);
+        }
+
+        if (ret >= 0 && fg->graph)
+            ret = filter_thread_run(fg);
+
+        pthread_mutex_unlock(&fg->lock);
+        time_add(&fg->busy_time, start);
+
+        if (ret)
+            break;
+    }
+
+finish:
+    tq_receive_finish(fg->tq, 0);
+    av_frame_free(&frame);
+    sp_thread_stop(fg->profile);
+
+    if (ret > 0)
+        ret = 0;
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error in the filtering thread for graph %d: %s\n",
+               fg->index, av_err2str(ret));
+        pipeline_fail(ret);
+    }
+
+    return (void*)(intptr_t)ret;
+}
+
+/* whether the filtergraph may run in a separate thread */
+static int fg_can_thread(FilterGraph *fg)
+{
+    if (!pipeline_threads || fg->nb_inputs != 1 ||
+        (fg->inputs[0]->type != AVMEDIA_TYPE_VIDEO &&
+         fg->inputs[0]->type != AVMEDIA_TYPE_AUDIO))
+        return 0;
+
+    /* filtered frames are sent to the encoders directly from the thread */
+    for (int i = 0; i < fg->nb_outputs; i++)
+        if (!ost_can_thread(fg->outputs[i]->ost))
+            return 0;
+
+    return 1;
+}
+
+static int filter_thread_start(FilterGraph *fg)
+{
+    ObjPool *op;
+    int ret;
+
+    fg->frame = av_frame_alloc();
+    if (!fg->frame)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    fg->tq = tq_alloc(1, pipeline_queue_size, op, frame_move);
+    if (!fg->tq) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_mutex_init(&fg->lock, NULL);
+    if (ret) {
+        tq_free(&fg->tq);
+        return AVERROR(ret);
+    }
+
+    ret = pthread_create(&fg->thread, NULL, filter_thread, fg);
+    if (ret) {
+        pthread_mutex_destroy(&fg->lock);
+        tq_free(&fg->tq);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+/**
+ * Wait for the filtering thread to terminate. Afterwards the filtergraph is
+ * only accessed from the main thread.
+ *
+ * @param flush when zero, the frames still queued are discarded and the
+ *              filtergraph is not drained
+ */
+static int filter_thread_stop(FilterGraph *fg, int flush)
+{
+    void *ret;
+
+    if (!fg->tq)
+        return 0;
+
+    if (!flush)
+        tq_receive_finish(fg->tq, 0);
+    tq_send_finish(fg->tq, 0);
+
+    pthread_join(fg->thread, &ret);
+
+    tq_free(&fg->tq);
+    pthread_mutex_destroy(&fg->lock);
+    av_frame_free(&fg->frame);
+
+    return (int)(intptr_t)ret;
+}
+
+static int filter_thread_send(InputFilter *ifilter, AVFrame *frame,
+                              int keep_reference)
+{
+    FilterGraph *fg = ifilter->graph;
+    int ret;
+
+    if (keep_reference) {
+        ret = av_frame_ref(fg->frame, frame);
+        if (ret < 0)
+            return ret;
+        frame = fg->frame;
+    }
+
+    ret = tq_send(fg->tq, 0, frame);
+    /* once the thread stopped receiving, only the first send returns EOF */
+    if (ret == AVERROR(EINVAL))
+        ret = AVERROR_EOF;
+    if (ret < 0 && keep_reference)
+        av_frame_unref(frame);
+
+    return ret;
+}
+
 // This does not quite work like avcodec_decode_audio4/avcodec_decode_video2.
 // There is the following difference: if you got a frame, you must call
 // it again with pkt=NULL. pkt==NULL is treated differently from pkt->size==0
@@ -2091,18 +2851,25 @@ static int decode(InputStream *ist, AVCodecContext *avctx,
 
     *got_frame = 0;
 
+    sp_start(ist->dec_profile);
+
     if (pkt) {
         ret = avcodec_send_packet(avctx, pkt);
         // In particular, we don't expect AVERROR(EAGAIN), because we read all
         // decoded frames with avcodec_receive_frame() until done.
-        if (ret < 0 && ret != AVERROR_EOF)
+        if (ret < 0 && ret != AVERROR_EOF) {
+            sp_stop(ist->dec_profile);
             return ret;
+        }
     }
 
     ret = avcodec_receive_frame(avctx, frame);
+    sp_stop(ist->dec_profile);
     if (ret < 0 && ret != AVERROR(EAGAIN))
         return ret;
     if (ret >= 0) {
+        sp_frame_done(ist->dec_profile);
+
         if (ist->want_frame_data) {
             FrameData *fd;
 
@@ -2124,13 +2891,19 @@ static int decode(InputStream *ist, AVCodecContext *avctx,
     return 0;
 }
 
-static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
+static int filters_send_frame(InputStream *ist, AVFrame *decoded_frame)
 {
     int i, ret;
 
     av_assert1(ist->nb_filters > 0); /* ensure ret is initialized */
     for (i = 0; i < ist->nb_filters; i++) {
-        ret = ifilter_send_frame(ist->filters[i], decoded_frame, i < ist->nb_filters - 1);
+        InputFilter *ifilter = ist->filters[i];
+        int keep_reference   = i < ist->nb_filters - 1;
+
+        if (ifilter->graph->tq)
+            ret = filter_thread_send(ifilter, decoded_frame, keep_reference);
+        else
+            ret = ifilter_send_frame(ifilter, decoded_frame, keep_reference);
         if (ret == AVERROR_EOF)
             ret = 0; /* ignore */
         if (ret < 0) {
@@ -2142,6 +2915,25 @@ static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
     return ret;
 }
 
+static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
+{
+    int64_t send_start;
+    int ret;
+
+    if (!ist->dec_frame_tq)
+        return filters_send_frame(ist, decoded_frame);
+
+    /* running in the decoding thread, the frame is filtered by the main thread */
+    send_start = av_gettime_relative();
+    ret = tq_send(ist->dec_frame_tq, 0, decoded_frame);
+    sp_add_wait(ist->dec_profile, time_add(&ist->dec_output_wait, send_start));
+    /* the main thread does not want any more frames; only the first send
+     * after it stopped receiving returns EOF */
+    if (ret == AVERROR_EOF || ret == AVERROR(EINVAL))
+        return 0;
+    return ret;
+}
+
 static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
                         int *decode_failed)
 {
@@ -2537,11 +3329,29 @@ static int send_filter_eof(InputStream *ist)
 {
     int i, ret;
     /* TODO keep pts also in stream time base to avoid converting back */
-    int64_t pts = av_rescale_q_rnd(ist->pts, AV_TIME_BASE_Q, ist->st->time_base,
-                                   AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+    int64_t pts;
+
+    if (ist->dec_frame_tq) {
+        /* running in the decoding thread, the main thread will send the EOF
+         * once it received all the frames */
+        tq_send_finish(ist->dec_frame_tq, 0);
+        return 0;
+    }
+
+    pts = av_rescale_q_rnd(ist->pts, AV_TIME_BASE_Q, ist->st->time_base,
+                           AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
 
     for (i = 0; i < ist->nb_filters; i++) {
-        ret = ifilter_send_eof(ist->filters[i], pts);
+        InputFilter *ifilter = ist->filters[i];
+
+        if (ifilter->graph->tq) {
+            /* read by the filtering thread once it receives the EOF */
+            ifilter->eof_pts = pts;
+            tq_send_finish(ifilter->graph->tq, 0);
+            continue;
+        }
+
+        ret = ifilter_send_eof(ifilter, pts);
         if (ret < 0)
             return ret;
     }
@@ -2558,6 +3368,9 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
 
     AVPacket *avpkt = ist->pkt;
 
+    if (pkt)
+        ist->last_pkt_repeat_pict = (intptr_t)pkt->opaque;
+
     if (!ist->saw_first_ts) {
         ist->first_dts =
         ist->dts = ist->st->avg_frame_rate.num ? - ist->dec_ctx->has_b_frames * AV_TIME_BASE / av_q2d(ist->st->avg_frame_rate) : 0;
@@ -2659,12 +3472,20 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
                 av_log(NULL, AV_LOG_FATAL, "Error while processing the decoded "
                        "data for stream #%d:%d\n", ist->file_index, ist->st->index);
             }
-            if (!decode_failed || exit_on_error)
+            if (!decode_failed || exit_on_error) {
+                /* in the decoding thread, let the main thread exit */
+                if (ist->dec_frame_tq) {
+                    pipeline_fail(ret);
+                    break;
+                }
                 exit_program(1);
+            }
             break;
         }
 
-        if (got_output)
+        /* with a decoding thread, the main thread sets it once it receives
+         * the frame */
+        if (got_output && !ist->dec_frame_tq)
             ist->got_output = 1;
 
         if (!got_output)
@@ -3208,6 +4029,7 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
     if (ost->enc_ctx) {
         const AVCodec *codec = ost->enc_ctx->codec;
         InputStream *ist = ost->ist;
+        const AVDictionaryEntry *t;
 
         ret = init_output_stream_encode(ost, frame);
         if (ret < 0)
@@ -3243,7 +4065,10 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
             !(codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
             av_buffersink_set_frame_size(ost->filter->filter,
                                             ost->enc_ctx->frame_size);
-        assert_avoptions(ost->encoder_opts);
+        if ((t = av_dict_get(ost->encoder_opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
+            snprintf(error, error_len, "Option %s not found.", t->key);
+            return AVERROR_OPTION_NOT_FOUND;
+        }
         if (ost->enc_ctx->bit_rate && ost->enc_ctx->bit_rate < 1000 &&
             ost->enc_ctx->codec_id != AV_CODEC_ID_CODEC2 /* don't complain about 700 bit/s modes */)
             av_log(ost, AV_LOG_WARNING, "The bitrate parameter is set too low."
@@ -3251,9 +4076,9 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
 
         ret = avcodec_parameters_from_context(ost->st->codecpar, ost->enc_ctx);
         if (ret < 0) {
-            av_log(ost, AV_LOG_FATAL,
-                   "Error initializing the output stream codec context.\n");
-            exit_program(1);
+            snprintf(error, error_len,
+                     "Error initializing the output stream codec context.");
+            return ret;
         }
 
         if (ost->enc_ctx->nb_coded_side_data) {
@@ -3309,6 +4134,15 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
     if (ret < 0)
         return ret;
 
+    if (ost_can_thread(ost)) {
+        ret = enc_thread_start(ost);
+        if (ret < 0) {
+            snprintf(error, error_len, "Could not start the encoding thread "
+                     "for output stream #%d:%d", ost->file_index, ost->index);
+            return ret;
+        }
+    }
+
     return ret;
 }
 
@@ -3317,6 +4151,12 @@ static int transcode_init(void)
     int ret = 0;
     char error[1024] = {0};
 
+    if (pipeline_queue_size < 1) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid pipeline queue size: %d\n",
+               pipeline_queue_size);
+        return AVERROR(EINVAL);
+    }
+
     /* init framerate emulation */
     for (int i = 0; i < nb_input_files; i++) {
         InputFile *ifile = input_files[i];
@@ -3446,6 +4286,33 @@ static int transcode_init(void)
         return ret;
     }
 
+    for (InputStream *ist = ist_iter(NULL); ist; ist = ist_iter(ist)) {
+        if (!ist_can_thread(ist))
+            continue;
+
+        ret = dec_thread_start(ist);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not start the decoding thread for "
+                   "input stream #%d:%d: %s\n", ist->file_index, ist->st->index,
+                   av_err2str(ret));
+            return ret;
+        }
+    }
+
+    for (int i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        if (!fg_can_thread(fg))
+            continue;
+
+        ret = filter_thread_start(fg);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not start the filtering thread "
+                   "for graph %d: %s\n", fg->index, av_err2str(ret));
+            return ret;
+        }
+    }
+
     atomic_store(&transcode_init_done, 1);
 
     return 0;
@@ -3455,7 +4322,7 @@ static int transcode_init(void)
 static int need_output(void)
 {
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
-        if (ost->finished)
+        if (atomic_load(&ost->finished))
             continue;
 
         return 1;
@@ -3475,23 +4342,27 @@ static OutputStream *choose_output(void)
     OutputStream *ost_min = NULL;
 
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+        int64_t last_filter_pts = atomic_load(&ost->last_filter_pts);
+        int64_t last_mux_dts    = atomic_load(&ost->last_mux_dts);
+        int initialized         = atomic_load(&ost->initialized);
+        int finished            = atomic_load(&ost->finished);
         int64_t opts;
 
-        if (ost->filter && ost->last_filter_pts != AV_NOPTS_VALUE) {
-            opts = ost->last_filter_pts;
+        if (ost->filter && last_filter_pts != AV_NOPTS_VALUE) {
+            opts = last_filter_pts;
         } else {
-            opts = ost->last_mux_dts == AV_NOPTS_VALUE ?
-                   INT64_MIN : ost->last_mux_dts;
-            if (ost->last_mux_dts == AV_NOPTS_VALUE)
+            opts = last_mux_dts == AV_NOPTS_VALUE ?
+                   INT64_MIN : last_mux_dts;
+            if (last_mux_dts == AV_NOPTS_VALUE)
                 av_log(ost, AV_LOG_DEBUG,
                     "cur_dts is invalid [init:%d i_done:%d finish:%d] (this is harmless if it occurs once at the start per stream)\n",
-                    ost->initialized, ost->inputs_done, ost->finished);
+                    initialized, ost->inputs_done, finished);
         }
 
-        if (!ost->initialized && !ost->inputs_done)
+        if (!initialized && !ost->inputs_done)
             return ost->unavailable ? NULL : ost;
 
-        if (!ost->finished && opts < opts_min) {
+        if (!finished && opts < opts_min) {
             opts_min = opts;
             ost_min  = ost->unavailable ? NULL : ost;
         }
@@ -3549,6 +4420,8 @@ static int check_keyboard_interaction(int64_t cur_time)
                    target, time, command, arg);
             for (i = 0; i < nb_filtergraphs; i++) {
                 FilterGraph *fg = filtergraphs[i];
+                if (fg->tq)
+                    pthread_mutex_lock(&fg->lock);
                 if (fg->graph) {
                     if (time < 0) {
                         ret = avfilter_graph_send_command(fg->graph, target, command, arg, buf, sizeof(buf),
@@ -3563,6 +4436,8 @@ static int check_keyboard_interaction(int64_t cur_time)
                             fprintf(stderr, "Queuing command failed with error %s\n", av_err2str(ret));
                     }
                 }
+                if (fg->tq)
+                    pthread_mutex_unlock(&fg->lock);
             }
         } else {
             av_log(NULL, AV_LOG_ERROR,
@@ -3729,7 +4604,10 @@ static void ts_discontinuity_detect(InputFile *ifile, InputStream *ist,
         }
     }
 
-    ifile->last_ts = av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
+    /* only needed with discontinuities, which rules out decoding threads
+     * updating it concurrently */
+    if (fmt_is_discont)
+        ifile->last_ts = av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
 }
 
 static void ts_discontinuity_process(InputFile *ifile, InputStream *ist,
@@ -3752,6 +4630,317 @@ static void ts_discontinuity_process(InputFile *ifile, InputStream *ist,
         ts_discontinuity_detect(ifile, ist, pkt);
 }
 
+static void packet_ts_process(InputFile *ifile, InputStream *ist, AVPacket *pkt)
+{
+    // detect and try to correct for timestamp discontinuities
+    ts_discontinuity_process(ifile, ist, pkt);
+
+    if (debug_ts) {
+        av_log(NULL, AV_LOG_INFO, "demuxer+ffmpeg -> ist_index:%d:%d type:%s pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s duration:%s duration_time:%s off:%s off_time:%s\n",
+               ifile->index, pkt->stream_index,
+               av_get_media_type_string(ist->par->codec_type),
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &ist->st->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &ist->st->time_base),
+               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &ist->st->time_base),
+               av_ts2str(ifile->ts_offset),
+               av_ts2timestr(ifile->ts_offset, &AV_TIME_BASE_Q));
+    }
+}
+
+/* whether the input stream may be decoded outside of the main thread */
+static int ist_can_thread(const InputStream *ist)
+{
+    const InputFile *ifile = input_files[ist->file_index];
+
+    if (!pipeline_threads || do_benchmark_all || exit_on_error)
+        return 0;
+
+    if (!ist->decoding_needed ||
+        (ist->par->codec_type != AVMEDIA_TYPE_VIDEO &&
+         ist->par->codec_type != AVMEDIA_TYPE_AUDIO))
+        return 0;
+
+    /* the main thread must not need the timestamps tracked by the decoding
+     * thread, nor reset the decoder */
+    if (ifile->stream_loop || ifile->readrate || ifile->rate_emu ||
+        (ifile->ctx->iformat->flags & AVFMT_TS_DISCONT))
+        return 0;
+
+    /* sub2video heartbeats use the timestamps of the other streams */
+    for (int i = 0; i < ifile->nb_streams; i++) {
+        const InputStream *ist1 = ifile->streams[i];
+        if (ist1->decoding_needed && ist1->par->codec_type == AVMEDIA_TYPE_SUBTITLE)
+            return 0;
+    }
+
+    /* streamcopy shares the timestamp state with decoding */
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost))
+        if (ost->ist == ist && !ost->enc_ctx)
+            return 0;
+
+    return 1;
+}
+
+static void pkt_move(void *dst, void *src)
+{
+    av_packet_move_ref(dst, src);
+}
+
+static void *decoder_thread(void *arg)
+{
+    InputStream *ist = arg;
+    InputFile *ifile = input_files[ist->file_index];
+    AVPacket    *pkt = NULL;
+    AVFrame  *marker = NULL;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "dec%d:%d", ist->file_index, ist->st->index);
+    ff_thread_setname(name);
+    sp_thread_start(ist->dec_profile, name);
+
+    pkt    = av_packet_alloc();
+    marker = av_frame_alloc();
+    if (!pkt || !marker) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int64_t wait_start = av_gettime_relative();
+        int stream_idx;
+
+        ret = tq_receive(ist->dec_pkt_tq, &stream_idx, pkt);
+        sp_add_wait(ist->dec_profile, time_add(&ist->dec_input_wait, wait_start));
+        if (stream_idx < 0) {
+            /* aborted */
+            ret = 0;
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            /* flush the decoder, this sends the EOF to the main thread */
+            while (process_input_packet(ist, NULL, 0) > 0 &&
+                   !atomic_load(&pipeline_error))
+                ;
+            ret = 0;
+            break;
+        }
+
+        packet_ts_process(ifile, ist, pkt);
+        process_input_packet(ist, pkt, 0);
+        av_packet_unref(pkt);
+        if (atomic_load(&pipeline_error))
+            break;
+
+        /* tell the main thread all the output for this packet was sent */
+        wait_start = av_gettime_relative();
+        ret = tq_send(ist->dec_frame_tq, 0, marker);
+        sp_add_wait(ist->dec_profile, time_add(&ist->dec_output_wait, wait_start));
+        if (ret < 0) {
+            /* the main thread stopped receiving */
+            if (ret == AVERROR_EOF || ret == AVERROR(EINVAL))
+                ret = 0;
+            break;
+        }
+    }
+
+finish:
+    tq_receive_finish(ist->dec_pkt_tq, 0);
+    tq_send_finish(ist->dec_frame_tq, 0);
+
+    av_packet_free(&pkt);
+    av_frame_free(&marker);
+    sp_thread_stop(ist->dec_profile);
+
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error in the decoding thread for stream "
+               "#%d:%d: %s\n", ist->file_index, ist->st->index, av_err2str(ret));
+        pipeline_fail(ret);
+    }
+
+    return NULL;
+}
+
+static void dec_thread_stop(InputStream *ist)
+{
+    if (!ist->dec_pkt_tq)
+        return;
+
+    /* a thread still running stops after the packet it is decoding */
+    tq_receive_finish(ist->dec_frame_tq, 0);
+    tq_receive_finish(ist->dec_pkt_tq, 0);
+    tq_send_finish(ist->dec_pkt_tq, 0);
+
+    pthread_join(ist->dec_thread, NULL);
+
+    tq_free(&ist->dec_pkt_tq);
+    tq_free(&ist->dec_frame_tq);
+    av_frame_free(&ist->dec_frame);
+    ist->dec_pkts_queued = 0;
+}
+
+static int dec_thread_start(InputStream *ist)
+{
+    ObjPool *op;
+    int ret;
+
+    ist->dec_frame = av_frame_alloc();
+    if (!ist->dec_frame)
+        return AVERROR(ENOMEM);
+    ist->dec_last_dts = AV_NOPTS_VALUE;
+
+    op = objpool_alloc_packets();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    ist->dec_pkt_tq = tq_alloc(1, pipeline_queue_size, op, pkt_move);
+    if (!ist->dec_pkt_tq) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    op = objpool_alloc_frames();
+    if (!op)
+        goto fail;
+
+    ist->dec_frame_tq = tq_alloc(1, pipeline_queue_size, op, frame_move);
+    if (!ist->dec_frame_tq) {
+        objpool_free(&op);
+        goto fail;
+    }
+
+    ret = pthread_create(&ist->dec_thread, NULL, decoder_thread, ist);
+    if (ret) {
+        tq_free(&ist->dec_pkt_tq);
+        tq_free(&ist->dec_frame_tq);
+        return AVERROR(ret);
+    }
+
+    return 0;
+fail:
+    tq_free(&ist->dec_pkt_tq);
+    return AVERROR(ENOMEM);
+}
+
+/**
+ * Process the next item sent by the decoding thread.
+ *
+ * @return 1 when a decoded frame was sent to the filters, 0 when all the
+ *         output for a packet was processed, AVERROR_EOF when the decoding
+ *         thread terminated
+ */
+static int dec_thread_receive(InputStream *ist)
+{
+    int stream_idx, ret;
+
+    ret = tq_receive(ist->dec_frame_tq, &stream_idx, ist->dec_frame);
+    if (ret == AVERROR_EOF) {
+        /* the stream state is owned by the main thread again */
+        dec_thread_stop(ist);
+
+        ret = send_filter_eof(ist);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "Error marking filters as finished\n");
+            exit_program(1);
+        }
+        return AVERROR_EOF;
+    }
+
+    if (!ist->dec_frame->buf[0]) {
+        ist->dec_pkts_queued--;
+        return 0;
+    }
+
+    ist->got_output = 1;
+
+    ret = filters_send_frame(ist, ist->dec_frame);
+    av_frame_unref(ist->dec_frame);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Error while processing the decoded "
+               "data for stream #%d:%d\n", ist->file_index, ist->st->index);
+        exit_program(1);
+    }
+
+    return 1;
+}
+
+/**
+ * Send a packet to the decoding thread. The output of a packet is processed
+ * once pipeline_queue_size newer packets were sent, so that it does not depend
+ * on how fast the decoder runs.
+ */
+static int dec_thread_send_packet(InputStream *ist, AVPacket *pkt)
+{
+    int ret;
+
+    while (ist->dec_pkts_queued >= pipeline_queue_size) {
+        ret = dec_thread_receive(ist);
+        /* the thread failed, the error is handled by the main loop */
+        if (ret == AVERROR_EOF)
+            return 0;
+    }
+
+    ist->dec_last_dts = pkt->dts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+                        av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
+
+    ret = tq_send(ist->dec_pkt_tq, 0, pkt);
+    if (ret < 0)
+        return ret;
+    ist->dec_pkts_queued++;
+
+    return 0;
+}
+
+/**
+ * Process the whole output held for the other streams of the input file when
+ * the packet read is more than DEC_THREAD_MAX_LAG newer than their last
+ * packet, so that the output of sparse streams is not delayed until
+ * pipeline_queue_size newer packets of the same stream arrive. This only
+ * depends on the interleaving of the input, not on how fast the decoders run.
+ */
+static void dec_thread_sync(InputFile *ifile, const InputStream *cur,
+                            const AVPacket *pkt)
+{
+    int64_t dts;
+
+    if (pkt->dts == AV_NOPTS_VALUE)
+        return;
+    dts = av_rescale_q(pkt->dts, cur->st->time_base, AV_TIME_BASE_Q);
+
+    for (int i = 0; i < ifile->nb_streams; i++) {
+        InputStream *ist = ifile->streams[i];
+
+        if (ist == cur || !ist->dec_pkt_tq || ist->dec_last_dts == AV_NOPTS_VALUE ||
+            dts - ist->dec_last_dts <= DEC_THREAD_MAX_LAG)
+            continue;
+
+        while (ist->dec_pkts_queued > 0) {
+            /* the thread failed, the error is handled by the main loop */
+            if (dec_thread_receive(ist) == AVERROR_EOF)
+                break;
+        }
+    }
+}
+
+/**
+ * Drain the decoding thread at the end of the input.
+ *
+ * @return 1 when a decoded frame was sent to the filters, 0 when the decoder
+ *         is drained and the filters were sent the EOF
+ */
+static int dec_thread_flush(InputStream *ist)
+{
+    tq_send_finish(ist->dec_pkt_tq, 0);
+
+    while (1) {
+        int ret = dec_thread_receive(ist);
+        if (ret == AVERROR_EOF)
+            return 0;
+        if (ret > 0)
+            return 1;
+    }
+}
+
 /*
  * Return
  * - 0 -- one packet was read and processed
@@ -3789,7 +4978,8 @@ static int process_input(int file_index)
         for (i = 0; i < ifile->nb_streams; i++) {
             ist = ifile->streams[i];
             if (ist->processing_needed) {
-                ret = process_input_packet(ist, NULL, 0);
+                ret = ist->dec_pkt_tq ? dec_thread_flush(ist) :
+                                        process_input_packet(ist, NULL, 0);
                 if (ret>0)
                     return 0;
             }
@@ -3838,20 +5028,22 @@ static int process_input(int file_index)
         }
     }
 
-    // detect and try to correct for timestamp discontinuities
-    ts_discontinuity_process(ifile, ist, pkt);
+    dec_thread_sync(ifile, ist, pkt);
 
-    if (debug_ts) {
-        av_log(NULL, AV_LOG_INFO, "demuxer+ffmpeg -> ist_index:%d:%d type:%s pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s duration:%s duration_time:%s off:%s off_time:%s\n",
-               ifile->index, pkt->stream_index,
-               av_get_media_type_string(ist->par->codec_type),
-               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &ist->st->time_base),
-               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &ist->st->time_base),
-               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &ist->st->time_base),
-               av_ts2str(input_files[ist->file_index]->ts_offset),
-               av_ts2timestr(input_files[ist->file_index]->ts_offset, &AV_TIME_BASE_Q));
+    if (ist->dec_pkt_tq) {
+        /* timestamps are processed by the decoding thread */
+        ret = dec_thread_send_packet(ist, pkt);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "Error sending a packet to the decoding "
+                   "thread for stream #%d:%d: %s\n", ist->file_index,
+                   ist->st->index, av_err2str(ret));
+            exit_program(1);
+        }
+        goto discard_packet;
     }
 
+    packet_ts_process(ifile, ist, pkt);
+
     sub2video_heartbeat(ist, pkt->pts);
 
     process_input_packet(ist, pkt, 0);
@@ -3877,7 +5069,9 @@ static int transcode_from_filter(FilterGraph *graph, InputStream **best_ist)
     InputStream *ist;
 
     *best_ist = NULL;
+    sp_start(graph->profile);
     ret = avfilter_graph_request_oldest(graph->graph);
+    sp_stop(graph->profile);
     if (ret >= 0)
         return reap_filters(0);
 
@@ -3932,9 +5126,19 @@ static int transcode_step(void)
         return AVERROR_EOF;
     }
 
+    if (ost->filter && ost->filter->graph->tq) {
+        /* the filtergraph is run by its own thread, it only needs to be fed */
+        ist = ost->filter->graph->inputs[0]->ist;
+        if (input_files[ist->file_index]->eof_reached) {
+            /* everything was sent, wait until the graph is drained */
+            return filter_thread_stop(ost->filter->graph, 1);
+        }
+        goto read_input;
+    }
+
     if (ost->filter && !ost->filter->graph->graph) {
         if (ifilter_has_all_input_formats(ost->filter->graph)) {
-            ret = configure_filtergraph(ost->filter->graph);
+            ret = fg_configure(ost->filter->graph);
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR, "Error reinitializing filters!\n");
                 return ret;
@@ -3989,6 +5193,7 @@ static int transcode_step(void)
         av_assert0(ist);
     }
 
+read_input:
     ret = process_input(ist->file_index);
     if (ret == AVERROR(EAGAIN)) {
         if (input_files[ist->file_index]->eagain)
@@ -4012,6 +5217,13 @@ static int transcode(void)
     int64_t timer_start;
     int64_t total_packets_written = 0;
 
+    if (do_benchmark_stages) {
+        main_profile = sp_alloc("main");
+        if (!main_profile)
+            return AVERROR(ENOMEM);
+        sp_thread_start(main_profile, "main");
+    }
+
     ret = transcode_init();
     if (ret < 0)
         goto fail;
@@ -4036,6 +5248,10 @@ static int transcode(void)
             break;
         }
 
+        /* a filtering or encoding thread failed */
+        if (atomic_load(&pipeline_error))
+            break;
+
         ret = transcode_step();
         if (ret < 0 && ret != AVERROR_EOF) {
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
@@ -4046,12 +5262,28 @@ static int transcode(void)
         print_report(0, timer_start, cur_time);
     }
 
+    ret = atomic_load(&pipeline_error);
+    if (ret < 0)
+        goto fail;
+
     /* at the end of stream, we must flush the decoder buffers */
     for (ist = ist_iter(NULL); ist; ist = ist_iter(ist)) {
         if (!input_files[ist->file_index]->eof_reached) {
+            dec_thread_stop(ist);
             process_input_packet(ist, NULL, 0);
         }
     }
+
+    /* drain the filtergraphs run by their own threads */
+    for (i = 0; i < nb_filtergraphs; i++) {
+        ret = filter_thread_stop(filtergraphs[i], 1);
+        if (ret < 0)
+            pipeline_fail(ret);
+    }
+    ret = atomic_load(&pipeline_error);
+    if (ret < 0)
+        goto fail;
+
     flush_encoders();
 
     term_exit();
@@ -4138,6 +5370,7 @@ static int64_t getmaxrss(void)
 int main(int argc, char **argv)
 {
     int ret;
+    uint64_t nb_decoded, nb_dec_errors;
     BenchmarkTimeStamps ti;
 
     init_dynload();
@@ -4186,9 +5419,21 @@ int main(int argc, char **argv)
                "bench: utime=%0.3fs stime=%0.3fs rtime=%0.3fs\n",
                utime / 1000000.0, stime / 1000000.0, rtime / 1000000.0);
     }
+    if (use_hugepages) {
+        AVBufferHugepageStats hs;
+
+        av_buffer_hugepage_stats(&hs);
+        av_log(NULL, do_benchmark ? AV_LOG_INFO : AV_LOG_VERBOSE,
+               "hugepages: hugetlb=%"PRIu64" thp=%"PRIu64" fallback=%"PRIu64" "
+               "numa_bound=%"PRIu64" peak=%0.1fMiB\n",
+               hs.nb_hugetlb, hs.nb_thp, hs.nb_fallback, hs.nb_numa_bound,
+               hs.mapped_bytes_peak / (1024.0 * 1024.0));
+    }
+    nb_decoded    = atomic_load(&decode_error_stat[0]);
+    nb_dec_errors = atomic_load(&decode_error_stat[1]);
     av_log(NULL, AV_LOG_DEBUG, "%"PRIu64" frames successfully decoded, %"PRIu64" decoding errors\n",
-           decode_error_stat[0], decode_error_stat[1]);
-    if ((decode_error_stat[0] + decode_error_stat[1]) * max_error_rate < decode_error_stat[1])
+           nb_decoded, nb_dec_errors);
+    if ((nb_decoded + nb_dec_errors) * max_error_rate < nb_dec_errors)
         exit_program(69);
 
     exit_program(received_nb_signals ? 255 : main_return_code);
@@ -27,7 +27,9 @@
 #include <signal.h>
 
 #include "cmdutils.h"
+#include "stage_profile.h"
 #include "sync_queue.h"
+#include "thread_queue.h"
 
 #include "third_party/ffmpeg/libavutil/avformat.h"
 #include "third_party/ffmpeg/libavutil/avio.h"
@@ -290,6 +292,8 @@ typedef struct InputFilter {
     int32_t *displaymatrix;
 
     int eof;
+    // pts passed to ifilter_send_eof() when the graph runs in its own thread
+    int64_t eof_pts;
 } InputFilter;
 
 typedef struct OutputFilter {
@@ -330,6 +334,23 @@ typedef struct FilterGraph {
     int          nb_inputs;
     OutputFilter **outputs;
     int         nb_outputs;
+
+    /* filtering thread, only used with -pipeline_threads */
+    pthread_t        thread;
+    ThreadQueue     *tq;
+    // serializes access to graph between the filtering thread and
+    // commands sent from the keyboard
+    pthread_mutex_t  lock;
+    // used by the main thread to pass frames it keeps a reference to
+    AVFrame         *frame;
+    // time the filtering thread spent waiting for frames and filtering them,
+    // in microseconds, and the number of frames it filtered
+    atomic_int_least64_t  input_wait;
+    atomic_int_least64_t  busy_time;
+    atomic_uint_least64_t frames_filtered;
+
+    /* only allocated with -benchmark_stages */
+    StageProfile    *profile;
 } FilterGraph;
 
 typedef struct InputStream {
@@ -440,6 +461,27 @@ typedef struct InputStream {
     int nb_dts_buffer;
 
     int got_output;
+
+    /* decoding thread, only used with -pipeline_threads */
+    pthread_t    dec_thread;
+    // packets sent to the decoding thread
+    ThreadQueue *dec_pkt_tq;
+    // decoded frames, and an empty frame after each packet, sent back to
+    // the main thread
+    ThreadQueue *dec_frame_tq;
+    AVFrame     *dec_frame;
+    // number of packets sent to the decoding thread whose output was not
+    // retrieved yet
+    int          dec_pkts_queued;
+    // dts of the last packet sent to the decoding thread, in AV_TIME_BASE
+    int64_t      dec_last_dts;
+    // time the decoding thread spent waiting for packets and sending frames,
+    // in microseconds
+    atomic_int_least64_t dec_input_wait;
+    atomic_int_least64_t dec_output_wait;
+
+    /* only allocated with -benchmark_stages */
+    StageProfile *dec_profile;
 } InputStream;
 
 typedef struct LastFrameDuration {
@@ -477,11 +519,15 @@ typedef struct InputFile {
     int rate_emu;
     float readrate;
     int accurate_seek;
+    int stream_loop;      /* true if the input is looped with -stream_loop */
 
     /* when looping the input file, this queue is used by decoders to report
      * the last frame duration back to the demuxer thread */
     AVThreadMessageQueue *audio_duration_queue;
     int                   audio_duration_queue_size;
+
+    /* demuxing, only allocated with -benchmark_stages */
+    StageProfile *profile;
 } InputFile;
 
 enum forced_keyframes_const {
@@ -577,9 +623,9 @@ typedef struct OutputStream {
      * audio/video encoding only */
     int64_t next_pts;
     /* dts of the last packet sent to the muxing queue, in AV_TIME_BASE_Q */
-    int64_t last_mux_dts;
+    atomic_int_least64_t last_mux_dts;
     /* pts of the last frame received from the filters, in AV_TIME_BASE_Q */
-    int64_t last_filter_pts;
+    atomic_int_least64_t last_filter_pts;
 
     // timestamp from which the streamcopied streams should start,
     // in AV_TIME_BASE_Q;
@@ -637,13 +683,13 @@ typedef struct OutputStream {
     AVDictionary *sws_dict;
     AVDictionary *swr_opts;
     char *apad;
-    OSTFinished finished;        /* no more packets should be written for this stream */
+    atomic_int finished;         /* OSTFinished flags: no more packets should be written for this stream */
     int unavailable;                     /* true if the steram is unavailable (possibly temporarily) */
 
     // init_output_stream() has been called for this stream
     // The encoder and the bitstream filters have been initialized and the stream
     // parameters are set in the AVStream.
-    int initialized;
+    atomic_int initialized;
 
     int inputs_done;
 
@@ -662,12 +708,13 @@ typedef struct OutputStream {
     // number of packets send to the muxer
     atomic_uint_least64_t packets_written;
     // number of frames/samples sent to the encoder
-    uint64_t frames_encoded;
+    atomic_uint_least64_t frames_encoded;
     uint64_t samples_encoded;
     // number of packets received from the encoder
     uint64_t packets_encoded;
 
-    /* packet quality factor */
+    /* packet quality factor, this and the two following fields are
+     * protected by stats_lock in ffmpeg.c */
     int quality;
 
     /* packet picture type */
@@ -687,6 +734,18 @@ typedef struct OutputStream {
      * subtitles utilizing fix_sub_duration at random access points.
      */
     unsigned int fix_sub_duration_heartbeat;
+
+    /* encoding thread, only used with -pipeline_threads */
+    pthread_t    enc_thread;
+    ThreadQueue *enc_tq;
+    AVFrame     *enc_frame;  /* new reference to a frame that is duplicated */
+    /* time the encoding thread spent waiting for frames, and the time spent
+     * sending frames to it, in microseconds */
+    atomic_int_least64_t enc_input_wait;
+    atomic_int_least64_t enc_send_wait;
+
+    /* only allocated with -benchmark_stages */
+    StageProfile *enc_profile;
 } OutputStream;
 
 typedef struct OutputFile {
@@ -707,6 +766,9 @@ typedef struct OutputFile {
 
     int shortest;
     int bitexact;
+
+    /* muxing, only allocated with -benchmark_stages */
+    StageProfile *profile;
 } OutputFile;
 
 extern InputFile   **input_files;
@@ -729,6 +791,8 @@ extern enum VideoSyncMethod video_sync_method;
 extern float frame_drop_threshold;
 extern int do_benchmark;
 extern int do_benchmark_all;
+extern int do_benchmark_stages;
+extern int use_hugepages;
 extern int do_hex_dump;
 extern int do_pkt_dump;
 extern int copy_ts;
@@ -742,10 +806,14 @@ extern int64_t stats_period;
 extern int qp_hist;
 extern int stdin_interaction;
 extern AVIOContext *progress_avio;
+extern AVIOContext *stats_json_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
+extern char *filter_thread_type;
 extern int filter_complex_nbthreads;
+extern int pipeline_threads;
+extern int pipeline_queue_size;
 extern int vstats_version;
 extern int auto_conversion_filters;
 
@@ -754,7 +822,7 @@ extern const AVIOInterruptCB int_cb;
 extern const OptionDef options[];
 extern HWDevice *filter_hw_device;
 
-extern unsigned nb_output_dumped;
+extern atomic_uint nb_output_dumped;
 extern int main_return_code;
 
 extern int ignore_unknown_streams;
@@ -784,6 +852,11 @@ int parse_and_set_vsync(const char *arg, int *vsync_var, int file_idx, int st_id
 int configure_filtergraph(FilterGraph *fg);
 void check_filter_outputs(void);
 int filtergraph_is_simple(FilterGraph *fg);
+/**
+ * Add the statistics gathered by the filters of the graph to its profile,
+ * must be called before freeing the graph.
+ */
+void filtergraph_collect_stats(FilterGraph *fg);
 int init_simple_filtergraph(InputStream *ist, OutputStream *ost);
 int init_complex_filtergraph(FilterGraph *fg);
 
@@ -833,6 +906,11 @@ void of_enc_stats_close(void);
  */
 void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof);
 int64_t of_filesize(OutputFile *of);
+/* number of packets waiting in the queue of the muxing thread */
+size_t  of_queue_fill(OutputFile *of);
+/* time in microseconds spent sending packets for the given stream to the
+ * queue of the muxing thread, i.e. mostly waiting for room in it */
+int64_t of_queue_wait_time(OutputStream *ost);
 
 int ifile_open(const OptionsContext *o, const char *filename);
 void ifile_close(InputFile **f);
@@ -848,6 +926,24 @@ void ifile_close(InputFile **f);
  * - a negative error code on failure
  */
 int ifile_get_packet(InputFile *f, AVPacket **pkt);
+/* number of packets waiting in the queue of the demuxing thread */
+int ifile_queue_fill(InputFile *f);
+
+enum StageType {
+    STAGE_DEMUX,
+    STAGE_DECODE,
+    STAGE_FILTER,
+    STAGE_ENCODE,
+    STAGE_MUX,
+    STAGE_NB,
+};
+
+/**
+ * Allocate the profile of a pipeline stage, which is printed and freed at
+ * exit. Returns NULL when -benchmark_stages is not used.
+ */
+StageProfile *stage_profile_alloc(enum StageType type, const char *fmt, ...)
+              av_printf_format(2, 3);
 
 /* iterate over all input streams in all input files;
  * pass NULL to start iteration */
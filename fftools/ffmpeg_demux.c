@@ -232,6 +232,7 @@ static void thread_set_name(InputFile *f)
     char name[16];
     snprintf(name, sizeof(name), "dmx%d:%s", f->index, f->ctx->iformat->name);
     ff_thread_setname(name);
+    sp_thread_start(f->profile, name);
 }
 
 static void *input_thread(void *arg)
@@ -252,8 +253,11 @@ static void *input_thread(void *arg)
 
     while (1) {
         DemuxMsg msg = { NULL };
+        int64_t send_start;
 
+        sp_start(f->profile);
         ret = av_read_frame(f->ctx, pkt);
+        sp_stop(f->profile);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -314,6 +318,9 @@ static void *input_thread(void *arg)
             break;
         }
         av_packet_move_ref(msg.pkt, pkt);
+        sp_frame_done(f->profile);
+
+        send_start = av_gettime_relative();
         ret = av_thread_message_queue_send(d->in_thread_queue, &msg, flags);
         if (flags && ret == AVERROR(EAGAIN)) {
             flags = 0;
@@ -323,6 +330,7 @@ static void *input_thread(void *arg)
                    "thread_queue_size option (current value: %d)\n",
                    d->thread_queue_size);
         }
+        sp_add_wait(f->profile, av_gettime_relative() - send_start);
         if (ret < 0) {
             if (ret != AVERROR_EOF)
                 av_log(f->ctx, AV_LOG_ERROR,
@@ -338,6 +346,7 @@ finish:
     av_thread_message_queue_set_err_recv(d->in_thread_queue, ret);
 
     av_packet_free(&pkt);
+    sp_thread_stop(f->profile);
 
     av_log(NULL, AV_LOG_VERBOSE, "Terminating demuxer thread %d\n", f->index);
 
@@ -410,7 +419,6 @@ fail:
 int ifile_get_packet(InputFile *f, AVPacket **pkt)
 {
     Demuxer *d = demuxer_from_ifile(f);
-    InputStream *ist;
     DemuxMsg msg;
     int ret;
 
@@ -447,13 +455,21 @@ int ifile_get_packet(InputFile *f, AVPacket **pkt)
     if (msg.looping)
         return 1;
 
-    ist = f->streams[msg.pkt->stream_index];
-    ist->last_pkt_repeat_pict = msg.repeat_pict;
+    /* passed along with the packet, as it may be decoded in another thread */
+    msg.pkt->opaque = (void*)(intptr_t)msg.repeat_pict;
 
     *pkt = msg.pkt;
     return 0;
 }
 
+int ifile_queue_fill(InputFile *f)
+{
+    Demuxer *d = demuxer_from_ifile(f);
+
+    return d->in_thread_queue ?
+           av_thread_message_queue_nb_elems(d->in_thread_queue) : 0;
+}
+
 static void ist_free(InputStream **pist)
 {
     InputStream *ist = *pist;
@@ -612,6 +628,8 @@ static void add_input_streams(const OptionsContext *o, Demuxer *d)
         ist = ALLOC_ARRAY_ELEM(f->streams, f->nb_streams);
         ist->st = st;
         ist->file_index = f->index;
+        ist->dec_profile = stage_profile_alloc(STAGE_DECODE, "dec#%d:%d",
+                                               f->index, st->index);
         ist->discard = 1;
         st->discard  = AVDISCARD_ALL;
         ist->nb_samples = 0;
@@ -1054,6 +1072,7 @@ int ifile_open(const OptionsContext *o, const char *filename)
 
     f->ctx        = ic;
     f->index      = nb_input_files - 1;
+    f->profile    = stage_profile_alloc(STAGE_DEMUX, "demux#%d", f->index);
     f->start_time = start_time;
     f->recording_time = recording_time;
     f->input_sync_ref = o->input_sync_ref;
@@ -1061,6 +1080,7 @@ int ifile_open(const OptionsContext *o, const char *filename)
     f->ts_offset  = o->input_ts_offset - (copy_ts ? (start_at_zero && ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0) : timestamp);
     f->rate_emu   = o->rate_emu;
     f->accurate_seek = o->accurate_seek;
+    f->stream_loop   = !!o->loop;
     d->loop = o->loop;
     d->duration = 0;
     d->time_base = (AVRational){ 1, 1 };
@@ -184,7 +184,8 @@ int init_simple_filtergraph(InputStream *ist, OutputStream *ost)
 
     if (!fg)
         report_and_exit(AVERROR(ENOMEM));
-    fg->index = nb_filtergraphs;
+    fg->index   = nb_filtergraphs;
+    fg->profile = stage_profile_alloc(STAGE_FILTER, "filter#%d", fg->index);
 
     ofilter = ALLOC_ARRAY_ELEM(fg->outputs, fg->nb_outputs);
     ofilter->ost    = ost;
@@ -474,6 +475,8 @@ int init_complex_filtergraph(FilterGraph *fg)
 
     /* this graph is only used for determining the kinds of inputs
      * and outputs we have, and is discarded on exit from this function */
+    fg->profile = stage_profile_alloc(STAGE_FILTER, "filter#%d", fg->index);
+
     graph = avfilter_graph_alloc();
     if (!graph)
         return AVERROR(ENOMEM);
@@ -1077,9 +1080,36 @@ static int configure_input_filter(FilterGraph *fg, InputFilter *ifilter,
     }
 }
 
+void filtergraph_collect_stats(FilterGraph *fg)
+{
+    if (!fg->profile || !fg->graph)
+        return;
+
+    for (unsigned i = 0; i < fg->graph->nb_filters; i++) {
+        AVFilterContext *f = fg->graph->filters[i];
+        const AVFilterStats *stats = avfilter_get_stats(f);
+        int ret;
+
+        if (!stats)
+            continue;
+
+        ret = sp_add_part(fg->profile, f->name,
+                          f->nb_inputs ? stats->frames_in : stats->frames_out,
+                          stats->activate_time);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_WARNING, "Error storing filter statistics: %s\n",
+                   av_err2str(ret));
+            return;
+        }
+    }
+}
+
 static void cleanup_filtergraph(FilterGraph *fg)
 {
     int i;
+
+    filtergraph_collect_stats(fg);
+
     for (i = 0; i < fg->nb_outputs; i++)
         fg->outputs[i]->filter = (AVFilterContext *)NULL;
     for (i = 0; i < fg->nb_inputs; i++)
@@ -1121,6 +1151,7 @@ int configure_filtergraph(FilterGraph *fg)
     cleanup_filtergraph(fg);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fg->graph->enable_stats = !!fg->profile;
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -1156,6 +1187,12 @@ int configure_filtergraph(FilterGraph *fg)
         fg->graph->nb_threads = filter_complex_nbthreads;
     }
 
+    if (filter_thread_type) {
+        ret = av_opt_set(fg->graph, "thread_type", filter_thread_type, 0);
+        if (ret < 0)
+            goto fail;
+    }
+
     if ((ret = graph_parse(fg->graph, graph_desc, &inputs, &outputs)) < 0)
         goto fail;
 
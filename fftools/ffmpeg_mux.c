@@ -32,6 +32,7 @@
 #include "third_party/ffmpeg/libavutil/mem.h"
 #include "third_party/ffmpeg/libavutil/timestamp.h"
 #include "third_party/ffmpeg/libavutil/thread.h"
+#include "third_party/ffmpeg/libavutil/time.h"
 
 #include "third_party/ffmpeg/libavcodec/packet.h"
 
@@ -40,6 +41,9 @@
 
 int want_sdp = 1;
 
+/* protects the muxing queues and Muxer.tq until the muxer thread is started */
+static AVMutex queue_lock = AV_MUTEX_INITIALIZER;
+
 static Muxer *mux_from_of(OutputFile *of)
 {
     return (Muxer*)of;
@@ -193,6 +197,7 @@ static void thread_set_name(OutputFile *of)
     char name[16];
     snprintf(name, sizeof(name), "mux%d:%s", of->index, of->format->name);
     ff_thread_setname(name);
+    sp_thread_start(of->profile, name);
 }
 
 static void *muxer_thread(void *arg)
@@ -212,9 +217,11 @@ static void *muxer_thread(void *arg)
 
     while (1) {
         OutputStream *ost;
-        int stream_idx, stream_eof = 0;
+        int stream_idx, stream_eof = 0, got_pkt;
+        int64_t wait_start = av_gettime_relative();
 
         ret = tq_receive(mux->tq, &stream_idx, pkt);
+        sp_add_wait(of->profile, av_gettime_relative() - wait_start);
         if (stream_idx < 0) {
             av_log(mux, AV_LOG_VERBOSE, "All streams finished\n");
             ret = 0;
@@ -222,7 +229,12 @@ static void *muxer_thread(void *arg)
         }
 
         ost = of->streams[stream_idx];
-        ret = sync_queue_process(mux, ost, ret < 0 ? NULL : pkt, &stream_eof);
+        got_pkt = ret >= 0;
+        sp_start(of->profile);
+        ret = sync_queue_process(mux, ost, got_pkt ? pkt : NULL, &stream_eof);
+        sp_stop(of->profile);
+        if (got_pkt)
+            sp_frame_done(of->profile);
         av_packet_unref(pkt);
         if (ret == AVERROR_EOF && stream_eof)
             tq_receive_finish(mux->tq, stream_idx);
@@ -238,6 +250,8 @@ finish:
     for (unsigned int i = 0; i < mux->fc->nb_streams; i++)
         tq_receive_finish(mux->tq, i);
 
+    sp_thread_stop(of->profile);
+
     av_log(mux, AV_LOG_VERBOSE, "Terminating muxer thread\n");
 
     return (void*)(intptr_t)ret;
@@ -245,12 +259,16 @@ finish:
 
 static int thread_submit_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
 {
+    int64_t send_start;
     int ret = 0;
 
-    if (!pkt || ost->finished & MUXER_FINISHED)
+    if (!pkt || atomic_load(&ost->finished) & MUXER_FINISHED)
         goto finish;
 
+    send_start = av_gettime_relative();
     ret = tq_send(mux->tq, ost->index, pkt);
+    atomic_fetch_add(&ms_from_ost(ost)->queue_wait,
+                     av_gettime_relative() - send_start);
     if (ret < 0)
         goto finish;
 
@@ -260,7 +278,7 @@ finish:
     if (pkt)
         av_packet_unref(pkt);
 
-    ost->finished |= MUXER_FINISHED;
+    atomic_fetch_or(&ost->finished, MUXER_FINISHED);
     tq_send_finish(mux->tq, ost->index);
     return ret == AVERROR_EOF ? 0 : ret;
 }
@@ -311,19 +329,23 @@ static int submit_packet(Muxer *mux, AVPacket *pkt, OutputStream *ost)
 {
     int ret;
 
-    if (mux->tq) {
+    if (atomic_load(&mux->started))
         return thread_submit_packet(mux, ost, pkt);
+
+    ff_mutex_lock(&queue_lock);
+
+    if (mux->tq) {
+        ret = thread_submit_packet(mux, ost, pkt);
     } else {
         /* the muxer is not initialized yet, buffer the packet */
         ret = queue_packet(mux, ost, pkt);
-        if (ret < 0) {
-            if (pkt)
-                av_packet_unref(pkt);
-            return ret;
-        }
+        if (ret < 0 && pkt)
+            av_packet_unref(pkt);
     }
 
-    return 0;
+    ff_mutex_unlock(&queue_lock);
+
+    return ret;
 }
 
 void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
@@ -334,7 +356,8 @@ void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
     int ret = 0;
 
     if (!eof && pkt->dts != AV_NOPTS_VALUE)
-        ost->last_mux_dts = av_rescale_q(pkt->dts, pkt->time_base, AV_TIME_BASE_Q);
+        atomic_store(&ost->last_mux_dts,
+                     av_rescale_q(pkt->dts, pkt->time_base, AV_TIME_BASE_Q));
 
     /* apply the output bitstream filters */
     if (ms->bsf_ctx) {
@@ -411,16 +434,20 @@ static int thread_start(Muxer *mux)
     if (!op)
         return AVERROR(ENOMEM);
 
+    ff_mutex_lock(&queue_lock);
+
     mux->tq = tq_alloc(fc->nb_streams, mux->thread_queue_size, op, pkt_move);
     if (!mux->tq) {
         objpool_free(&op);
-        return AVERROR(ENOMEM);
+        ret = AVERROR(ENOMEM);
+        goto finish;
     }
 
     ret = pthread_create(&mux->thread, NULL, muxer_thread, (void*)mux);
     if (ret) {
         tq_free(&mux->tq);
-        return AVERROR(ret);
+        ret = AVERROR(ret);
+        goto finish;
     }
 
     /* flush the muxing queues */
@@ -440,11 +467,17 @@ static int thread_start(Muxer *mux)
                 av_packet_free(&pkt);
             }
             if (ret < 0)
-                return ret;
+                goto finish;
         }
     }
 
-    return 0;
+    /* packets may now be sent to the muxer thread without taking the lock,
+     * everything queued before has been flushed above */
+    atomic_store(&mux->started, 1);
+
+finish:
+    ff_mutex_unlock(&queue_lock);
+    return ret;
 }
 
 static int print_sdp(void)
@@ -511,7 +544,7 @@ int mux_check_init(Muxer *mux)
 
     for (i = 0; i < fc->nb_streams; i++) {
         OutputStream *ost = of->streams[i];
-        if (!ost->initialized)
+        if (!atomic_load(&ost->initialized))
             return 0;
     }
 
@@ -525,7 +558,7 @@ int mux_check_init(Muxer *mux)
     mux->header_written = 1;
 
     av_dump_format(fc, of->index, fc->url, 1);
-    nb_output_dumped++;
+    atomic_fetch_add(&nb_output_dumped, 1);
 
     if (sdp_filename || want_sdp) {
         ret = print_sdp();
@@ -596,7 +629,7 @@ int of_stream_init(OutputFile *of, OutputStream *ost)
     if (ret < 0)
         return ret;
 
-    ost->initialized = 1;
+    atomic_store(&ost->initialized, 1);
 
     return mux_check_init(mux);
 }
@@ -666,6 +699,7 @@ static void ost_free(OutputStream **post)
     av_frame_free(&ost->filtered_frame);
     av_frame_free(&ost->sq_frame);
     av_frame_free(&ost->last_frame);
+    av_frame_free(&ost->enc_frame);
     av_packet_free(&ost->pkt);
     av_dict_free(&ost->encoder_opts);
 
@@ -749,3 +783,22 @@ int64_t of_filesize(OutputFile *of)
     Muxer *mux = mux_from_of(of);
     return atomic_load(&mux->last_filesize);
 }
+
+size_t of_queue_fill(OutputFile *of)
+{
+    Muxer *mux = mux_from_of(of);
+    size_t ret = 0;
+
+    /* the muxing thread may be started from an encoding thread */
+    ff_mutex_lock(&queue_lock);
+    if (mux->tq)
+        ret = tq_fill_level(mux->tq);
+    ff_mutex_unlock(&queue_lock);
+
+    return ret;
+}
+
+int64_t of_queue_wait_time(OutputStream *ost)
+{
+    return atomic_load(&ms_from_ost(ost)->queue_wait);
+}
@@ -63,6 +63,9 @@ typedef struct MuxStream {
     /* dts of the last packet sent to the muxer, in the stream timebase
      * used for making up missing dts values */
     int64_t last_mux_dts;
+
+    /* time spent sending packets to the muxing thread queue, in microseconds */
+    atomic_int_least64_t queue_wait;
 } MuxStream;
 
 typedef struct Muxer {
@@ -75,6 +78,8 @@ typedef struct Muxer {
 
     pthread_t    thread;
     ThreadQueue *tq;
+    /* set once the muxer thread is running and the muxing queues are flushed */
+    atomic_int   started;
 
     AVDictionary *opts;
 
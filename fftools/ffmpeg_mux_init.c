@@ -462,6 +462,9 @@ static OutputStream *new_output_stream(Muxer *mux, const OptionsContext *o,
         if (!ost->enc_ctx)
             report_and_exit(AVERROR(ENOMEM));
 
+        ost->enc_profile = stage_profile_alloc(STAGE_ENCODE, "enc#%d:%d",
+                                               ost->file_index, ost->index);
+
         av_strlcat(ms->log_name, "/",       sizeof(ms->log_name));
         av_strlcat(ms->log_name, enc->name, sizeof(ms->log_name));
     } else {
@@ -647,8 +650,8 @@ static OutputStream *new_output_stream(Muxer *mux, const OptionsContext *o,
         ost->ist->discard = 0;
         ost->ist->st->discard = ost->ist->user_set_discard;
     }
-    ost->last_mux_dts = AV_NOPTS_VALUE;
-    ost->last_filter_pts = AV_NOPTS_VALUE;
+    atomic_init(&ost->last_mux_dts,    AV_NOPTS_VALUE);
+    atomic_init(&ost->last_filter_pts, AV_NOPTS_VALUE);
 
     MATCH_PER_STREAM_OPT(copy_initial_nonkeyframes, i,
                          ost->copy_initial_nonkeyframes, oc, st);
@@ -1073,7 +1076,7 @@ static OutputStream *new_unknown_stream(Muxer *mux, const OptionsContext *o, Inp
 static OutputStream *new_attachment_stream(Muxer *mux, const OptionsContext *o, InputStream *ist)
 {
     OutputStream *ost = new_output_stream(mux, o, AVMEDIA_TYPE_ATTACHMENT, ist);
-    ost->finished    = 1;
+    atomic_init(&ost->finished, ENCODER_FINISHED);
     return ost;
 }
 
@@ -2391,6 +2394,7 @@ int of_open(const OptionsContext *o, const char *filename)
     }
 
     of->url        = filename;
+    of->profile    = stage_profile_alloc(STAGE_MUX, "mux#%d", of->index);
 
     /* write the header for files with no streams */
     if (of->format->flags & AVFMT_NOSTREAMS && oc->nb_streams == 0) {
@@ -43,6 +43,7 @@
 #include "third_party/ffmpeg/libavutil/avstring.h"
 #include "third_party/ffmpeg/libavutil/avutil.h"
 #include "third_party/ffmpeg/libavutil/bprint.h"
+#include "third_party/ffmpeg/libavutil/buffer.h"
 #include "third_party/ffmpeg/libavutil/channel_layout.h"
 #include "third_party/ffmpeg/libavutil/display.h"
 #include "third_party/ffmpeg/libavutil/intreadwrite.h"
@@ -71,6 +72,8 @@ enum VideoSyncMethod video_sync_method = VSYNC_AUTO;
 float frame_drop_threshold = 0;
 int do_benchmark      = 0;
 int do_benchmark_all  = 0;
+int do_benchmark_stages = 0;
+int use_hugepages     = 0;
 int do_hex_dump       = 0;
 int do_pkt_dump       = 0;
 int copy_ts           = 0;
@@ -84,7 +87,10 @@ int qp_hist           = 0;
 int stdin_interaction = 1;
 float max_error_rate  = 2.0/3;
 char *filter_nbthreads;
+char *filter_thread_type;
 int filter_complex_nbthreads = 0;
+int pipeline_threads = 0;
+int pipeline_queue_size = 8;
 int vstats_version = 2;
 int auto_conversion_filters = 1;
 int64_t stats_period = 500000;
@@ -298,6 +304,13 @@ static int opt_filter_threads(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_filter_thread_type(void *optctx, const char *opt, const char *arg)
+{
+    av_free(filter_thread_type);
+    filter_thread_type = av_strdup(arg);
+    return 0;
+}
+
 static int opt_abort_on(void *optctx, const char *opt, const char *arg)
 {
     static const AVOption opts[] = {
@@ -1276,6 +1289,8 @@ int ffmpeg_parse_options(int argc, char **argv)
         goto fail;
     }
 
+    av_buffer_pool_set_hugepages(use_hugepages);
+
     /* configure terminal and setup signal handlers */
     term_init();
 
@@ -1331,6 +1346,23 @@ static int opt_progress(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_stats_json(void *optctx, const char *opt, const char *arg)
+{
+    AVIOContext *avio = NULL;
+    int ret;
+
+    if (!strcmp(arg, "-"))
+        arg = "pipe:";
+    ret = avio_open2(&avio, arg, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open stats URL \"%s\": %s\n",
+               arg, av_err2str(ret));
+        return ret;
+    }
+    stats_json_avio = avio;
+    return 0;
+}
+
 int opt_timelimit(void *optctx, const char *opt, const char *arg)
 {
 #if HAVE_SETRLIMIT
@@ -1427,8 +1459,14 @@ const OptionDef options[] = {
         "add timings for benchmarking" },
     { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
       "add timings for each task" },
+    { "benchmark_stages", OPT_BOOL | OPT_EXPERT,                     { &do_benchmark_stages },
+      "print per-stage and per-thread timings at exit" },
+    { "hugepages",      OPT_BOOL | OPT_EXPERT,                       { &use_hugepages },
+      "allocate frame buffers with huge pages, on the NUMA node of the allocating thread" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
+    { "stats_json",     HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_stats_json },
+      "write periodic per-stage pipeline statistics as JSON lines", "url" },
     { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
       "enable or disable interaction on standard input" },
     { "timelimit",      HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_timelimit },
@@ -1499,6 +1537,8 @@ const OptionDef options[] = {
         "set stream filtergraph", "filter_graph" },
     { "filter_threads", HAS_ARG,                                     { .func_arg = opt_filter_threads },
         "number of non-complex filter threads" },
+    { "filter_thread_type", HAS_ARG | OPT_EXPERT,                    { .func_arg = opt_filter_thread_type },
+        "set the types of threading used by filtergraphs", "flags" },
     { "filter_script",  HAS_ARG | OPT_STRING | OPT_SPEC | OPT_OUTPUT, { .off = OFFSET(filter_scripts) },
         "read stream filtergraph description from a file", "filename" },
     { "reinit_filter",  HAS_ARG | OPT_INT | OPT_SPEC | OPT_INPUT,    { .off = OFFSET(reinit_filters) },
@@ -1507,6 +1547,10 @@ const OptionDef options[] = {
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_threads", HAS_ARG | OPT_INT,                   { &filter_complex_nbthreads },
         "number of threads for -filter_complex" },
+    { "pipeline_threads", OPT_BOOL | OPT_EXPERT,                     { &pipeline_threads },
+        "run decoders, filtergraphs and encoders in separate threads" },
+    { "pipeline_queue_size", HAS_ARG | OPT_INT | OPT_EXPERT,         { &pipeline_queue_size },
+        "maximum number of frames or packets queued to each pipeline thread", "size" },
     { "lavfi",          HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_script", HAS_ARG | OPT_EXPERT,                 { .func_arg = opt_filter_complex_script },
@@ -16,6 +16,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "third_party/ffmpeg/libavcodec/packet.h"
@@ -90,12 +91,16 @@ void objpool_release(ObjPool *op, void **obj)
     *obj = NULL;
 }
 
+/* pools may be used from several threads */
+static atomic_uint_least64_t frames_allocated;
+
 static void *alloc_packet(void)
 {
     return av_packet_alloc();
 }
 static void *alloc_frame(void)
 {
+    atomic_fetch_add(&frames_allocated, 1);
     return av_frame_alloc();
 }
 
@@ -129,3 +134,8 @@ ObjPool *objpool_alloc_frames(void)
 {
     return objpool_alloc(alloc_frame, reset_frame, free_frame);
 }
+
+uint64_t objpool_frames_allocated(void)
+{
+    return atomic_load(&frames_allocated);
+}
@@ -19,6 +19,8 @@
 #ifndef FFTOOLS_OBJPOOL_H
 #define FFTOOLS_OBJPOOL_H
 
+#include <stdint.h>
+
 typedef struct ObjPool ObjPool;
 
 typedef void* (*ObjPoolCBAlloc)(void);
@@ -34,4 +36,11 @@ ObjPool *objpool_alloc_frames(void);
 int  objpool_get(ObjPool *op, void **obj);
 void objpool_release(ObjPool *op, void **obj);
 
+/**
+ * Get the total number of frames allocated so far by all the pools created
+ * with objpool_alloc_frames(). Once the pools are warmed up, frames are only
+ * recycled, so this value should stop growing.
+ */
+uint64_t objpool_frames_allocated(void);
+
 #endif // FFTOOLS_OBJPOOL_H
@@ -0,0 +1,301 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "third_party/ffmpeg/config.h"
+
+#if !(HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)) && HAVE_GETPROCESSTIMES
+#include <windows.h>
+#endif
+
+#include "third_party/ffmpeg/libavutil/avstring.h"
+#include "third_party/ffmpeg/libavutil/common.h"
+#include "third_party/ffmpeg/libavutil/error.h"
+#include "third_party/ffmpeg/libavutil/log.h"
+#include "third_party/ffmpeg/libavutil/mem.h"
+#include "third_party/ffmpeg/libavutil/time.h"
+
+#include "stage_profile.h"
+
+/* latencies are binned with 4 buckets per power of two, i.e. the percentiles
+ * are accurate to within 25% */
+#define HIST_SIZE 128
+
+typedef struct StagePart {
+    char    *name;
+    uint64_t nb_frames;
+    int64_t  wall;
+} StagePart;
+
+struct StageProfile {
+    char   *name;
+
+    int64_t wall;
+    int64_t cpu;
+    int64_t wait;
+
+    /* start of the currently timed section */
+    int64_t section_wall;
+    int64_t section_cpu;
+    /* time of the sections accounted to the current frame */
+    int64_t frame_wall;
+
+    uint64_t nb_frames;
+    uint64_t hist[HIST_SIZE];
+    int64_t  latency_max;
+
+    /* dedicated thread, if any */
+    char    thread_name[16];
+    int64_t thread_wall;
+    int64_t thread_cpu;
+
+    StagePart *parts;
+    int     nb_parts;
+};
+
+static int64_t thread_cpu_time(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#elif HAVE_GETPROCESSTIMES
+    FILETIME c, e, k, u;
+
+    GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u);
+    return (((int64_t)u.dwHighDateTime << 32 | u.dwLowDateTime) +
+            ((int64_t)k.dwHighDateTime << 32 | k.dwLowDateTime)) / 10;
+#else
+    return 0;
+#endif
+}
+
+static int hist_bucket(int64_t latency)
+{
+    int log2;
+
+    if (latency < 4)
+        return FFMAX(latency, 0);
+
+    log2 = av_log2(FFMIN(latency, INT_MAX));
+    return FFMIN((log2 - 1) * 4 + ((latency >> (log2 - 2)) & 3), HIST_SIZE - 1);
+}
+
+/* the largest latency falling into the bucket */
+static int64_t hist_bucket_max(int bucket)
+{
+    int log2 = bucket / 4 + 1;
+
+    if (bucket < 4)
+        return bucket;
+    return ((int64_t)(4 + bucket % 4 + 1) << (log2 - 2)) - 1;
+}
+
+static int64_t percentile(const StageProfile *sp, int p)
+{
+    uint64_t target = (sp->nb_frames * p + 99) / 100;
+    uint64_t count  = 0;
+
+    for (int i = 0; i < HIST_SIZE; i++) {
+        count += sp->hist[i];
+        if (count >= target)
+            return FFMIN(hist_bucket_max(i), sp->latency_max);
+    }
+    return sp->latency_max;
+}
+
+StageProfile *sp_alloc(const char *name)
+{
+    StageProfile *sp = av_mallocz(sizeof(*sp));
+
+    if (!sp)
+        return NULL;
+
+    sp->name = av_strdup(name);
+    if (!sp->name) {
+        av_freep(&sp);
+        return NULL;
+    }
+
+    sp->section_wall = -1;
+
+    return sp;
+}
+
+void sp_free(StageProfile **psp)
+{
+    StageProfile *sp = *psp;
+
+    if (!sp)
+        return;
+
+    for (int i = 0; i < sp->nb_parts; i++)
+        av_freep(&sp->parts[i].name);
+    av_freep(&sp->parts);
+
+    av_freep(&sp->name);
+    av_freep(psp);
+}
+
+void sp_start(StageProfile *sp)
+{
+    if (!sp)
+        return;
+
+    sp->section_wall = av_gettime_relative();
+    sp->section_cpu  = thread_cpu_time();
+}
+
+void sp_stop(StageProfile *sp)
+{
+    int64_t wall;
+
+    if (!sp || sp->section_wall < 0)
+        return;
+
+    wall = av_gettime_relative() - sp->section_wall;
+
+    sp->wall       += wall;
+    sp->frame_wall += wall;
+    sp->cpu        += thread_cpu_time() - sp->section_cpu;
+
+    sp->section_wall = -1;
+}
+
+void sp_frame_done(StageProfile *sp)
+{
+    if (!sp)
+        return;
+
+    sp->hist[hist_bucket(sp->frame_wall)]++;
+    sp->latency_max = FFMAX(sp->latency_max, sp->frame_wall);
+    sp->nb_frames++;
+
+    sp->frame_wall = 0;
+}
+
+void sp_add_wait(StageProfile *sp, int64_t wait)
+{
+    if (sp)
+        sp->wait += wait;
+}
+
+void sp_thread_start(StageProfile *sp, const char *thread_name)
+{
+    if (!sp)
+        return;
+
+    av_strlcpy(sp->thread_name, thread_name, sizeof(sp->thread_name));
+    sp->thread_wall = av_gettime_relative();
+    sp->thread_cpu  = thread_cpu_time();
+}
+
+void sp_thread_stop(StageProfile *sp)
+{
+    if (!sp || !sp->thread_name[0])
+        return;
+
+    sp->thread_wall = av_gettime_relative() - sp->thread_wall;
+    sp->thread_cpu  = thread_cpu_time()     - sp->thread_cpu;
+}
+
+int sp_add_part(StageProfile *sp, const char *name, uint64_t nb_frames,
+                int64_t wall)
+{
+    StagePart *part = NULL;
+
+    if (!sp)
+        return 0;
+
+    for (int i = 0; i < sp->nb_parts; i++) {
+        if (!strcmp(sp->parts[i].name, name)) {
+            part = &sp->parts[i];
+            break;
+        }
+    }
+
+    if (!part) {
+        char *part_name = av_strdup(name);
+
+        if (!part_name)
+            return AVERROR(ENOMEM);
+
+        part = av_dynarray2_add((void**)&sp->parts, &sp->nb_parts,
+                                sizeof(*sp->parts), NULL);
+        if (!part) {
+            av_freep(&part_name);
+            return AVERROR(ENOMEM);
+        }
+        memset(part, 0, sizeof(*part));
+        part->name = part_name;
+    }
+
+    part->nb_frames += nb_frames;
+    part->wall      += wall;
+
+    return 0;
+}
+
+void sp_log(const StageProfile *sp, void *logctx, int level)
+{
+    if (!sp) {
+        av_log(logctx, level, "%-20s %-16s %8s %10s %10s %10s %9s %9s %9s %9s\n",
+               "stage", "thread", "frames", "wall_ms", "cpu_ms", "wait_ms",
+               "p50_us", "p90_us", "p99_us", "max_us");
+        return;
+    }
+
+    if (!sp->wall && !sp->wait && !sp->nb_frames)
+        return;
+
+    av_log(logctx, level, "%-20s %-16s %8"PRIu64" %10.1f %10.1f %10.1f "
+           "%9"PRId64" %9"PRId64" %9"PRId64" %9"PRId64"\n",
+           sp->name, sp->thread_name[0] ? sp->thread_name : "main",
+           sp->nb_frames, sp->wall / 1000.0, sp->cpu / 1000.0, sp->wait / 1000.0,
+           percentile(sp, 50), percentile(sp, 90), percentile(sp, 99),
+           sp->latency_max);
+
+    for (int i = 0; i < sp->nb_parts; i++) {
+        const StagePart *part = &sp->parts[i];
+
+        av_log(logctx, level, "  %-18.18s %-16s %8"PRIu64" %10.1f %10s %10s "
+               "%9s %9s %9s %9s\n", part->name, "", part->nb_frames,
+               part->wall / 1000.0, "-", "-", "-", "-", "-", "-");
+    }
+}
+
+void sp_log_thread(const StageProfile *sp, void *logctx, int level)
+{
+    if (!sp) {
+        av_log(logctx, level, "%-16s %10s %10s %6s\n",
+               "thread", "wall_ms", "cpu_ms", "load");
+        return;
+    }
+
+    if (!sp->thread_name[0])
+        return;
+
+    av_log(logctx, level, "%-16s %10.1f %10.1f %5.1f%%\n",
+           sp->thread_name, sp->thread_wall / 1000.0, sp->thread_cpu / 1000.0,
+           sp->thread_wall > 0 ? 100.0 * sp->thread_cpu / sp->thread_wall : 0.0);
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFTOOLS_STAGE_PROFILE_H
+#define FFTOOLS_STAGE_PROFILE_H
+
+#include <stdint.h>
+
+/**
+ * Accumulates the wall clock and CPU time spent by one stage of the
+ * processing pipeline (e.g. a decoder), the time it spent waiting for other
+ * stages and the distribution of its per-frame latencies.
+ *
+ * A profile must only be updated from one thread at a time and only be
+ * logged once no thread updates it anymore. The functions updating a
+ * profile accept NULL and do nothing then, so that callers need not check
+ * whether profiling is enabled.
+ */
+typedef struct StageProfile StageProfile;
+
+StageProfile *sp_alloc(const char *name);
+void          sp_free(StageProfile **sp);
+
+/**
+ * Start timing a section of work done by the stage.
+ */
+void sp_start(StageProfile *sp);
+/**
+ * Stop timing the current section. Its duration is accounted to the frame
+ * currently processed by the stage.
+ */
+void sp_stop(StageProfile *sp);
+/**
+ * Mark the end of a frame: the sections timed since the previous frame make
+ * up its latency.
+ */
+void sp_frame_done(StageProfile *sp);
+
+/**
+ * Account time the stage spent blocked on other stages, in microseconds.
+ */
+void sp_add_wait(StageProfile *sp, int64_t wait);
+
+/**
+ * Must be called by a thread dedicated to running the stage right after it
+ * starts and before it terminates, to account the resources used by it.
+ */
+void sp_thread_start(StageProfile *sp, const char *thread_name);
+void sp_thread_stop(StageProfile *sp);
+
+/**
+ * Account work done by a part of the stage, e.g. by a single filter of a
+ * filtergraph, measured by whatever runs the part. The numbers for parts
+ * with the same name are summed up.
+ *
+ * @return 0 on success, a negative error code on failure
+ */
+int sp_add_part(StageProfile *sp, const char *name, uint64_t nb_frames,
+                int64_t wall);
+
+/**
+ * Log the statistics of the stage as a single line followed by a line for
+ * each of its parts, or a header for such lines when sp is NULL. Stages that
+ * did not do anything are skipped.
+ */
+void sp_log(const StageProfile *sp, void *logctx, int level);
+/**
+ * Log the resources used by the thread dedicated to the stage, or a header
+ * for such lines when sp is NULL. Nothing is logged for stages without a
+ * dedicated thread.
+ */
+void sp_log_thread(const StageProfile *sp, void *logctx, int level);
+
+#endif // FFTOOLS_STAGE_PROFILE_H
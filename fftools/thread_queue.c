@@ -243,3 +243,14 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 
     pthread_mutex_unlock(&tq->lock);
 }
+
+size_t tq_fill_level(ThreadQueue *tq)
+{
+    size_t ret;
+
+    pthread_mutex_lock(&tq->lock);
+    ret = av_fifo_can_read(tq->fifo);
+    pthread_mutex_unlock(&tq->lock);
+
+    return ret;
+}
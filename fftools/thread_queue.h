@@ -78,4 +78,11 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * Get the number of items currently stored in the queue, e.g. for reporting
+ * how busy its producer and consumer are. The value may be outdated by the
+ * time it is returned.
+ */
+size_t tq_fill_level(ThreadQueue *tq);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
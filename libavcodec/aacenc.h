@@ -35,6 +35,8 @@
 
 #include "lpc.h"
 
+#define AACENC_MAX_THREADS 32
+
 typedef enum AACCoder {
     AAC_CODER_ANMR = 0,
     AAC_CODER_TWOLOOP,
@@ -152,6 +154,19 @@ typedef struct AACEncContext {
     struct {
         float *samples;
     } buffer;
+
+    /**
+     * Contexts used to process channel elements concurrently with slice
+     * threads. thread[0] is this context, the others are copies with their
+     * own scratch buffers and transforms, sharing the channel elements.
+     */
+    struct AACEncContext *thread[AACENC_MAX_THREADS];
+    int nb_threads;                              ///< number of contexts in thread
+    int element_start_ch[16];                    ///< first channel of each channel element
+    int element_alloc[16];                       ///< psy bit allocation of each channel element, per channel
+    int element_random_state[16];                ///< PNS random state of each channel element
+    int element_coeffs_changed[16];              ///< set if TNS, IS or prediction changed the coefficients of a channel element
+    int coder_cutoff;                            ///< psy model bandwidth chosen by the coder for the last channel element
 } AACEncContext;
 
 void ff_aac_dsp_init_x86(AACEncContext *s);
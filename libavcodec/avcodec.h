@@ -2063,6 +2063,51 @@ typedef struct AVCodecContext {
      *   an error.
      */
     int64_t frame_num;
+
+    /**
+     * Number of frame threads to use when both frame and slice threading are
+     * enabled in thread_type. The threads are then split between this many
+     * frame threads, each decoding its frame with its own slice threads,
+     * which reduces the decoding delay compared to frame threading alone.
+     * thread_count is set to the number of frame threads in that case.
+     *
+     * 0 uses frame threading only. This is only supported by some decoders,
+     * the others ignore this field.
+     *
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int frame_threads;
+
+    /**
+     * A reference to a frame pool allocated with avcodec_frame_pool_alloc().
+     * When set, the default get_buffer2() callback allocates video frames
+     * from buffer pools kept in it, keyed by pixel format, dimensions and
+     * plane layout, instead of pools private to this context. The same frame
+     * pool may be set on any number of decoders, which may run in different
+     * threads; decoders with the same frame parameters then reuse each
+     * other's buffers.
+     *
+     * The reference is owned and freed by libavcodec, it should never be
+     * written to by the caller after avcodec_open2().
+     *
+     * - encoding: unused
+     * - decoding: May be set by the caller before avcodec_open2().
+     */
+    AVBufferRef *frame_pool;
+
+    /**
+     * When set and frame threading is used, decoding starts with two frame
+     * threads and thread_count is the maximum number of frame threads.
+     * Threads are added while the decoding load keeps all of them busy and
+     * made idle again when fewer would do, so that slowly fed decoders do not
+     * hold the memory and decoding delay of all threads. The delay reported in
+     * AVCodecContext.delay is the maximum one.
+     *
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int adaptive_frame_threads;
 } AVCodecContext;
 
 /**
@@ -2484,6 +2529,14 @@ void avsubtitle_free(AVSubtitle *sub);
  */
 int avcodec_default_get_buffer2(AVCodecContext *s, AVFrame *frame, int flags);
 
+/**
+ * Allocate a frame pool that can be shared between several decoders through
+ * AVCodecContext.frame_pool.
+ *
+ * @return a reference to the new pool, NULL on failure
+ */
+AVBufferRef *avcodec_frame_pool_alloc(void);
+
 /**
  * The default callback for AVCodecContext.get_encode_buffer(). It is made public so
  * it can be called by custom get_encode_buffer() implementations for encoders without
@@ -88,6 +88,11 @@
  * encoders do.
  */
 #define FF_CODEC_CAP_EOF_FLUSH              (1 << 10)
+/**
+ * The decoder supports slice threading within each frame thread, see
+ * AVCodecContext.frame_threads.
+ */
+#define FF_CODEC_CAP_FRAME_SLICE_THREADS    (1 << 11)
 
 /**
  * FFCodec.codec_tags termination value
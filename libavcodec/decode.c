@@ -258,6 +258,7 @@ static inline int decode_simple_internal(AVCodecContext *avctx, AVFrame *frame,
     AVPacket     *const pkt = avci->in_pkt;
     const FFCodec *const codec = ffcodec(avctx->codec);
     int got_frame, actual_got_frame;
+    int keep_pkt = 0;
     int ret;
 
     if (!pkt->data && !avci->draining) {
@@ -281,6 +282,9 @@ static inline int decode_simple_internal(AVCodecContext *avctx, AVFrame *frame,
 
     if (HAVE_THREADS && avctx->active_thread_type & FF_THREAD_FRAME) {
         ret = ff_thread_decode_frame(avctx, frame, &got_frame, pkt);
+        /* a frame may be returned before the packet is submitted, the
+         * packet is then passed again on the next call */
+        keep_pkt = !ret && pkt->size;
     } else {
         ret = codec->cb.decode(avctx, frame, &got_frame, pkt);
 
@@ -427,7 +431,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
     if (!got_frame)
         av_frame_unref(frame);
 
-    if (ret >= 0 && avctx->codec->type == AVMEDIA_TYPE_VIDEO)
+    if (ret >= 0 && avctx->codec->type == AVMEDIA_TYPE_VIDEO && !keep_pkt)
         ret = pkt->size;
 
     /* do not stop draining when actual_got_frame != 0 or ret < 0 */
@@ -452,7 +456,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
 
     if (ret >= pkt->size || ret < 0) {
         av_packet_unref(pkt);
-    } else {
+    } else if (!keep_pkt) {
         int consumed = ret;
 
         pkt->data                += consumed;
@@ -46,6 +46,8 @@
 #define MAX_PARTITIONS     (1 << MAX_PARTITION_ORDER)
 #define MAX_LPC_PRECISION  15
 #define MIN_LPC_SHIFT       0
+/* samples past the end of the block read and written by the SIMD LPC encoder */
+#define SAMPLES_PADDING    32
 #define MAX_LPC_SHIFT      15
 
 enum CodingMode {
@@ -85,16 +87,17 @@ typedef struct FlacSubframe {
     int shift;
 
     RiceContext rc;
-    uint32_t rc_udata[FLAC_MAX_BLOCKSIZE];
+    uint32_t *rc_udata;
     uint64_t rc_sums[32][MAX_PARTITIONS];
 
-    int32_t samples[FLAC_MAX_BLOCKSIZE];
-    int32_t residual[FLAC_MAX_BLOCKSIZE+11];
+    /* blocksize samples, followed by SAMPLES_PADDING */
+    int32_t *samples;
+    int32_t *residual;
 } FlacSubframe;
 
 typedef struct FlacFrame {
     FlacSubframe subframes[FLAC_MAX_CHANNELS];
-    int64_t samples_33bps[FLAC_MAX_BLOCKSIZE];
+    int64_t *samples_33bps;
     int blocksize;
     int bs_code[2];
     uint8_t crc8;
@@ -102,6 +105,18 @@ typedef struct FlacFrame {
     int verbatim_only;
 } FlacFrame;
 
+/**
+ * A frame encoded concurrently with others when using threads.
+ */
+typedef struct FlacEncodeJob {
+    struct FlacEncodeContext *s;    ///< copy of the encoder context with its own frame and LPC state
+    AVFrame *frame;
+    uint8_t *buf;                   ///< encoded frame
+    unsigned int buf_size;
+    int out_bytes;
+    int ret;
+} FlacEncodeJob;
+
 typedef struct FlacEncodeContext {
     AVClass *class;
     PutBitContext pb;
@@ -128,6 +143,14 @@ typedef struct FlacEncodeContext {
 
     int flushed;
     int64_t next_pts;
+
+    /* frames encoded concurrently, queued and output in the same order
+     * from jobs[0] to jobs[nb_jobs - 1] */
+    FlacEncodeJob *jobs;
+    int nb_jobs;
+    int nb_queued;      ///< frames queued in jobs[], not encoded yet
+    int nb_encoded;     ///< frames encoded, not output yet
+    int next_output;    ///< index of the next job to output
 } FlacEncodeContext;
 
 
@@ -266,6 +289,86 @@ static av_cold void dprint_compression_options(FlacEncodeContext *s)
 }
 
 
+/**
+ * Allocate the sample buffers of a frame for the configured blocksize.
+ */
+static av_cold int alloc_frame_buffers(FlacEncodeContext *s)
+{
+    FlacFrame *frame = &s->frame;
+    int size = s->max_blocksize + SAMPLES_PADDING;
+
+    frame->samples_33bps = av_calloc(size, sizeof(*frame->samples_33bps));
+    if (!frame->samples_33bps)
+        return AVERROR(ENOMEM);
+    for (int ch = 0; ch < s->channels; ch++) {
+        FlacSubframe *sub = &frame->subframes[ch];
+
+        sub->rc_udata = av_calloc(s->max_blocksize, sizeof(*sub->rc_udata));
+        sub->samples  = av_calloc(size, sizeof(*sub->samples));
+        sub->residual = av_calloc(size, sizeof(*sub->residual));
+        if (!sub->rc_udata || !sub->samples || !sub->residual)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static av_cold void free_frame_buffers(FlacEncodeContext *s)
+{
+    FlacFrame *frame = &s->frame;
+
+    av_freep(&frame->samples_33bps);
+    for (int ch = 0; ch < s->channels; ch++) {
+        av_freep(&frame->subframes[ch].rc_udata);
+        av_freep(&frame->subframes[ch].samples);
+        av_freep(&frame->subframes[ch].residual);
+    }
+}
+
+/**
+ * Allocate a context for each frame to be encoded concurrently. They share
+ * the encoding parameters of the main context, but have their own frame,
+ * bit writer and LPC state.
+ */
+static av_cold int init_jobs(FlacEncodeContext *s)
+{
+    AVCodecContext *avctx = s->avctx;
+
+    s->jobs = av_calloc(avctx->thread_count, sizeof(*s->jobs));
+    if (!s->jobs)
+        return AVERROR(ENOMEM);
+    s->nb_jobs = avctx->thread_count;
+
+    for (int i = 0; i < s->nb_jobs; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+        int ret;
+
+        job->frame = av_frame_alloc();
+        if (!job->frame)
+            return AVERROR(ENOMEM);
+        job->s = av_malloc(sizeof(*job->s));
+        if (!job->s)
+            return AVERROR(ENOMEM);
+
+        *job->s = *s;
+        job->s->md5ctx     = NULL;
+        job->s->md5_buffer = NULL;
+        job->s->jobs       = NULL;
+        job->s->nb_jobs    = 0;
+        memset(&job->s->lpc_ctx, 0, sizeof(job->s->lpc_ctx));
+        ret = alloc_frame_buffers(job->s);
+        if (ret < 0)
+            return ret;
+        ret = ff_lpc_init(&job->s->lpc_ctx, avctx->frame_size,
+                          s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+
 static av_cold int flac_encode_init(AVCodecContext *avctx)
 {
     int freq = avctx->sample_rate;
@@ -465,13 +568,19 @@ static av_cold int flac_encode_init(AVCodecContext *avctx)
 
     ret = ff_lpc_init(&s->lpc_ctx, avctx->frame_size,
                       s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+    if (ret < 0)
+        return ret;
 
     ff_bswapdsp_init(&s->bdsp);
     ff_flacencdsp_init(&s->flac_dsp);
 
     dprint_compression_options(s);
 
-    return ret;
+    /* with threads, the frames are only encoded by the jobs */
+    if (avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1)
+        return init_jobs(s);
+
+    return alloc_frame_buffers(s);
 }
 
 
@@ -1561,9 +1670,9 @@ static void write_frame_footer(FlacEncodeContext *s)
 }
 
 
-static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
+static int write_frame(FlacEncodeContext *s, uint8_t *buf, int buf_size)
 {
-    init_put_bits(&s->pb, avpkt->data, avpkt->size);
+    init_put_bits(&s->pb, buf, buf_size);
     write_frame_header(s);
     write_subframes(s);
     write_frame_footer(s);
@@ -1571,10 +1680,11 @@ static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
 }
 
 
-static int update_md5_sum(FlacEncodeContext *s, const void *samples)
+static int update_md5_sum(FlacEncodeContext *s, const void *samples,
+                          int nb_samples)
 {
     const uint8_t *buf;
-    int buf_size = s->frame.blocksize * s->channels *
+    int buf_size = nb_samples * s->channels *
                    ((s->avctx->bits_per_raw_sample + 7) / 8);
 
     if (s->avctx->bits_per_raw_sample > 16 || HAVE_BIGENDIAN) {
@@ -1595,7 +1705,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++) {
+        for (i = 0; i < nb_samples * s->channels; i++) {
             int32_t v = samples0[i] >> 8;
             AV_WL24(tmp + 3*i, v);
         }
@@ -1606,7 +1716,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++)
+        for (i = 0; i < nb_samples * s->channels; i++)
             AV_WL32(tmp + 4*i, samples0[i]);
         buf = s->md5_buffer;
     }
@@ -1616,6 +1726,161 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
 }
 
 
+/**
+ * Change max_framesize for small final frame.
+ * Must be called before init_frame() for each input frame.
+ */
+static void update_max_framesize(FlacEncodeContext *s, int nb_samples)
+{
+    if (nb_samples < s->frame.blocksize) {
+        s->max_framesize = flac_get_max_frame_size(nb_samples,
+                                                   s->channels,
+                                                   s->avctx->bits_per_raw_sample);
+    }
+}
+
+
+/**
+ * Analyze a frame and choose its coding parameters.
+ * @return size of the encoded frame in bytes or a negative error code
+ */
+static int analyze_frame(FlacEncodeContext *s, const AVFrame *frame)
+{
+    int frame_bytes;
+
+    init_frame(s, frame->nb_samples);
+
+    copy_samples(s, frame->data[0]);
+
+    channel_decorrelation(s);
+
+    remove_wasted_bits(s);
+
+    frame_bytes = encode_frame(s);
+
+    /* Fall back on verbatim mode if the compressed frame is larger than it
+       would be if encoded uncompressed. */
+    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
+        s->frame.verbatim_only = 1;
+        frame_bytes = encode_frame(s);
+        if (frame_bytes < 0)
+            av_log(s->avctx, AV_LOG_ERROR, "Bad frame count\n");
+    }
+
+    return frame_bytes;
+}
+
+
+/**
+ * Update the stream state with an encoded frame and set the packet
+ * properties, in input order.
+ */
+static int finish_frame(FlacEncodeContext *s, AVPacket *avpkt,
+                        const AVFrame *frame, int out_bytes)
+{
+    AVCodecContext *avctx = s->avctx;
+    int ret;
+
+    s->frame_count++;
+    s->sample_count += frame->nb_samples;
+    if ((ret = update_md5_sum(s, frame->data[0], frame->nb_samples)) < 0) {
+        av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
+        return ret;
+    }
+    if (out_bytes > s->max_encoded_framesize)
+        s->max_encoded_framesize = out_bytes;
+    if (out_bytes < s->min_framesize)
+        s->min_framesize = out_bytes;
+
+    s->next_pts = frame->pts + ff_samples_to_time_base(avctx, frame->nb_samples);
+
+    avpkt->pts      = frame->pts;
+    avpkt->duration = frame->duration ? frame->duration :
+                      ff_samples_to_time_base(avctx, frame->nb_samples);
+
+    return ff_encode_reordered_opaque(avctx, avpkt, frame);
+}
+
+
+static int encode_job(AVCodecContext *avctx, void *arg)
+{
+    FlacEncodeJob *job = arg;
+    FlacEncodeContext *s = job->s;
+    int frame_bytes;
+
+    frame_bytes = analyze_frame(s, job->frame);
+    if (frame_bytes < 0)
+        return job->ret = frame_bytes;
+
+    av_fast_malloc(&job->buf, &job->buf_size, frame_bytes);
+    if (!job->buf)
+        return job->ret = AVERROR(ENOMEM);
+
+    job->out_bytes = write_frame(s, job->buf, frame_bytes);
+
+    return job->ret = 0;
+}
+
+
+/**
+ * Queue the input frames, encode them concurrently once a job is queued
+ * for each thread, and return them in order.
+ */
+static int encode_frame_threaded(AVCodecContext *avctx, AVPacket *avpkt,
+                                 const AVFrame *frame, int *got_packet_ptr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacEncodeJob *job;
+    int ret;
+
+    if (frame) {
+        /* frames are queued in the jobs that were already output */
+        job = &s->jobs[s->nb_queued];
+        av_assert1(!s->nb_encoded || s->nb_queued < s->next_output);
+
+        update_max_framesize(s, frame->nb_samples);
+        s->frame.blocksize = frame->nb_samples;
+
+        if ((ret = av_frame_ref(job->frame, frame)) < 0)
+            return ret;
+        job->s->max_framesize = s->max_framesize;
+        s->nb_queued++;
+    }
+
+    if (!s->nb_encoded && (s->nb_queued == s->nb_jobs || (!frame && s->nb_queued))) {
+        for (int i = 0; i < s->nb_queued; i++)
+            s->jobs[i].s->frame_count = s->frame_count + i;
+
+        avctx->execute(avctx, encode_job, s->jobs, NULL, s->nb_queued,
+                       sizeof(*s->jobs));
+
+        s->nb_encoded  = s->nb_queued;
+        s->nb_queued   = 0;
+        s->next_output = 0;
+    }
+
+    if (!s->nb_encoded)
+        return 0;
+
+    job = &s->jobs[s->next_output++];
+    s->nb_encoded--;
+
+    ret = job->ret;
+    if (ret >= 0)
+        ret = ff_get_encode_buffer(avctx, avpkt, job->out_bytes, 0);
+    if (ret >= 0) {
+        memcpy(avpkt->data, job->buf, job->out_bytes);
+        ret = finish_frame(s, avpkt, job->frame, job->out_bytes);
+    }
+    av_frame_unref(job->frame);
+    if (ret < 0)
+        return ret;
+
+    *got_packet_ptr = 1;
+    return 0;
+}
+
+
 static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                              const AVFrame *frame, int *got_packet_ptr)
 {
@@ -1624,6 +1889,12 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
     s = avctx->priv_data;
 
+    if (s->nb_jobs) {
+        ret = encode_frame_threaded(avctx, avpkt, frame, got_packet_ptr);
+        if (ret < 0 || *got_packet_ptr || frame)
+            return ret;
+    }
+
     /* when the last block is reached, update the header in extradata */
     if (!frame) {
         s->max_framesize = s->max_encoded_framesize;
@@ -1646,51 +1917,19 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
         return 0;
     }
 
-    /* change max_framesize for small final frame */
-    if (frame->nb_samples < s->frame.blocksize) {
-        s->max_framesize = flac_get_max_frame_size(frame->nb_samples,
-                                                   s->channels,
-                                                   avctx->bits_per_raw_sample);
-    }
-
-    init_frame(s, frame->nb_samples);
-
-    copy_samples(s, frame->data[0]);
-
-    channel_decorrelation(s);
-
-    remove_wasted_bits(s);
+    update_max_framesize(s, frame->nb_samples);
 
-    frame_bytes = encode_frame(s);
-
-    /* Fall back on verbatim mode if the compressed frame is larger than it
-       would be if encoded uncompressed. */
-    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
-        s->frame.verbatim_only = 1;
-        frame_bytes = encode_frame(s);
-        if (frame_bytes < 0) {
-            av_log(avctx, AV_LOG_ERROR, "Bad frame count\n");
-            return frame_bytes;
-        }
-    }
+    frame_bytes = analyze_frame(s, frame);
+    if (frame_bytes < 0)
+        return frame_bytes;
 
     if ((ret = ff_get_encode_buffer(avctx, avpkt, frame_bytes, 0)) < 0)
         return ret;
 
-    out_bytes = write_frame(s, avpkt);
+    out_bytes = write_frame(s, avpkt->data, avpkt->size);
 
-    s->frame_count++;
-    s->sample_count += frame->nb_samples;
-    if ((ret = update_md5_sum(s, frame->data[0])) < 0) {
-        av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
+    if ((ret = finish_frame(s, avpkt, frame, out_bytes)) < 0)
         return ret;
-    }
-    if (out_bytes > s->max_encoded_framesize)
-        s->max_encoded_framesize = out_bytes;
-    if (out_bytes < s->min_framesize)
-        s->min_framesize = out_bytes;
-
-    s->next_pts = frame->pts + ff_samples_to_time_base(avctx, frame->nb_samples);
 
     av_shrink_packet(avpkt, out_bytes);
 
@@ -1703,9 +1942,23 @@ static av_cold int flac_encode_close(AVCodecContext *avctx)
 {
     FlacEncodeContext *s = avctx->priv_data;
 
+    for (int i = 0; i < s->nb_jobs; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+
+        if (job->s) {
+            ff_lpc_end(&job->s->lpc_ctx);
+            free_frame_buffers(job->s);
+        }
+        av_freep(&job->s);
+        av_frame_free(&job->frame);
+        av_freep(&job->buf);
+    }
+    av_freep(&s->jobs);
+
     av_freep(&s->md5ctx);
     av_freep(&s->md5_buffer);
     ff_lpc_end(&s->lpc_ctx);
+    free_frame_buffers(s);
     return 0;
 }
 
@@ -1754,7 +2007,7 @@ const FFCodec ff_flac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_FLAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(FlacEncodeContext),
     .init           = flac_encode_init,
@@ -1764,5 +2017,5 @@ const FFCodec ff_flac_encoder = {
                                                      AV_SAMPLE_FMT_S32,
                                                      AV_SAMPLE_FMT_NONE },
     .p.priv_class   = &flac_encoder_class,
-    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_EOF_FLUSH,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP,
 };
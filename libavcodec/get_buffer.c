@@ -28,6 +28,7 @@
 #include "third_party/ffmpeg/libavutil/imgutils.h"
 #include "third_party/ffmpeg/libavutil/mem.h"
 #include "third_party/ffmpeg/libavutil/samplefmt.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
 #include "third_party/ffmpeg/libavutil/version.h"
 
 #include "avcodec.h"
@@ -47,6 +48,7 @@ typedef struct FramePool {
     int width, height;
     int stride_align[AV_NUM_DATA_POINTERS];
     int linesize[4];
+    size_t size[4];
     int planes;
     int channels;
     int samples;
@@ -81,6 +83,138 @@ static AVBufferRef *frame_pool_alloc(void)
     return buf;
 }
 
+/**
+ * Set of video FramePools shared between several codec contexts through
+ * AVCodecContext.frame_pool.
+ */
+typedef struct SharedFramePool {
+    AVMutex mutex;
+    AVBufferRef **pools;
+    int        nb_pools;
+} SharedFramePool;
+
+static void shared_frame_pool_free(void *opaque, uint8_t *data)
+{
+    SharedFramePool *shared = (SharedFramePool*)data;
+    int i;
+
+    for (i = 0; i < shared->nb_pools; i++)
+        av_buffer_unref(&shared->pools[i]);
+    av_freep(&shared->pools);
+    ff_mutex_destroy(&shared->mutex);
+    av_freep(&data);
+}
+
+AVBufferRef *avcodec_frame_pool_alloc(void)
+{
+    SharedFramePool *shared = av_mallocz(sizeof(*shared));
+    AVBufferRef *buf;
+
+    if (!shared)
+        return NULL;
+
+    if (ff_mutex_init(&shared->mutex, NULL)) {
+        av_freep(&shared);
+        return NULL;
+    }
+
+    buf = av_buffer_create((uint8_t*)shared, sizeof(*shared),
+                           shared_frame_pool_free, NULL, 0);
+    if (!buf) {
+        ff_mutex_destroy(&shared->mutex);
+        av_freep(&shared);
+        return NULL;
+    }
+
+    return buf;
+}
+
+static int video_pool_init(FramePool *pool)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (!pool->size[i])
+            continue;
+        pool->pools[i] = av_buffer_pool_init(pool->size[i] + 16 + STRIDE_ALIGN - 1,
+                                             CONFIG_MEMORY_POISONING ?
+                                                NULL :
+                                                av_buffer_allocz);
+        if (!pool->pools[i])
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static int video_pool_equal(const FramePool *a, const FramePool *b)
+{
+    int i;
+
+    if (a->format != b->format || a->width != b->width || a->height != b->height)
+        return 0;
+    for (i = 0; i < 4; i++)
+        if (a->linesize[i] != b->linesize[i] || a->size[i] != b->size[i])
+            return 0;
+    return 1;
+}
+
+/**
+ * Replace *pool_buf, whose FramePool has its layout set but no buffer pools
+ * yet, with a matching pool from the shared set, adding it to the set if there
+ * is none. Pools no longer used by any codec context are dropped from the set.
+ */
+static int shared_frame_pool_get(AVBufferRef *shared_buf, AVBufferRef **pool_buf)
+{
+    SharedFramePool *shared = (SharedFramePool*)shared_buf->data;
+    FramePool *pool = (FramePool*)(*pool_buf)->data;
+    AVBufferRef *ref;
+    int i, ret = 0;
+
+    ff_mutex_lock(&shared->mutex);
+
+    for (i = 0; i < shared->nb_pools; i++) {
+        if (video_pool_equal((FramePool*)shared->pools[i]->data, pool)) {
+            ref = av_buffer_ref(shared->pools[i]);
+            if (!ref) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            av_buffer_unref(pool_buf);
+            *pool_buf = ref;
+            goto end;
+        }
+    }
+
+    /* A pool referenced only by the set cannot gain new users outside of the
+     * lock, so it is safe to drop it here. Its buffers still in use are freed
+     * once they are returned. */
+    for (i = 0; i < shared->nb_pools;) {
+        if (av_buffer_get_ref_count(shared->pools[i]) == 1) {
+            av_buffer_unref(&shared->pools[i]);
+            shared->pools[i] = shared->pools[--shared->nb_pools];
+        } else
+            i++;
+    }
+
+    ret = video_pool_init(pool);
+    if (ret < 0)
+        goto end;
+
+    ref = av_buffer_ref(*pool_buf);
+    if (!ref) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    ret = av_dynarray_add_nofree(&shared->pools, &shared->nb_pools, ref);
+    if (ret < 0)
+        av_buffer_unref(&ref);
+
+end:
+    ff_mutex_unlock(&shared->mutex);
+    return ret;
+}
+
 static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
 {
     FramePool *pool = avctx->internal->pool ?
@@ -147,25 +281,23 @@ FF_ENABLE_DEPRECATION_WARNINGS
 
         for (i = 0; i < 4; i++) {
             pool->linesize[i] = linesize[i];
-            if (size[i]) {
-                if (size[i] > INT_MAX - (16 + STRIDE_ALIGN - 1)) {
-                    ret = AVERROR(EINVAL);
-                    goto fail;
-                }
-                pool->pools[i] = av_buffer_pool_init(size[i] + 16 + STRIDE_ALIGN - 1,
-                                                     CONFIG_MEMORY_POISONING ?
-                                                        NULL :
-                                                        av_buffer_allocz);
-                if (!pool->pools[i]) {
-                    ret = AVERROR(ENOMEM);
-                    goto fail;
-                }
+            if (size[i] > INT_MAX - (16 + STRIDE_ALIGN - 1)) {
+                ret = AVERROR(EINVAL);
+                goto fail;
             }
+            pool->size[i] = size[i];
         }
         pool->format = frame->format;
         pool->width  = frame->width;
         pool->height = frame->height;
 
+        if (avctx->frame_pool && av_codec_is_decoder(avctx->codec))
+            ret = shared_frame_pool_get(avctx->frame_pool, &pool_buf);
+        else
+            ret = video_pool_init(pool);
+        if (ret < 0)
+            goto fail;
+
         break;
         }
     case AVMEDIA_TYPE_AUDIO: {
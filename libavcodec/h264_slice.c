@@ -2397,6 +2397,14 @@ static void loop_filter(const H264Context *h, H264SliceContext *sl, int start_x,
     if (h->postpone_filter)
         return;
 
+    if (sl->deblock_in_thread) {
+        /* hand the row over to loop_filter_thread(), only the last row of
+         * the slice may end before the right edge */
+        sl->deblock_end_x = end_x;
+        sl->nb_deblock_rows++;
+        ff_thread_report_progress2(h->avctx, 0, 0, 1);
+    }
+
     if (sl->deblocking_filter) {
         for (mb_x = start_x; mb_x < end_x; mb_x++)
             for (mb_y = end_mb_y - FRAME_MBAFF(h); mb_y <= end_mb_y; mb_y++) {
@@ -2475,6 +2483,10 @@ static void decode_finish_row(const H264Context *h, H264SliceContext *sl)
     int height         =  16      << FRAME_MBAFF(h);
     int deblock_border = (16 + 4) << FRAME_MBAFF(h);
 
+    /* the row is finished by the deblocking thread then */
+    if (sl->deblock_in_thread)
+        return;
+
     if (sl->deblocking_filter) {
         if ((top + height) >= pic_height)
             height += deblock_border;
@@ -2492,7 +2504,9 @@ static void decode_finish_row(const H264Context *h, H264SliceContext *sl)
 
     ff_h264_draw_horiz_band(h, sl, top, height);
 
-    if (h->droppable || h->er.error_occurred)
+    /* slices decoded concurrently finish their rows out of order, the
+     * progress is reported by ff_h264_execute_decode_slices() then */
+    if (h->droppable || h->er.error_occurred || h->nb_slice_ctx_queued > 1)
         return;
 
     ff_thread_report_progress(&h->cur_pic_ptr->tf, top + height - 1,
@@ -2530,7 +2544,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
 
     av_assert0(h->block_offset[15] == (4 * ((scan8[15] - scan8[0]) & 7) << h->pixel_shift) + 4 * sl->linesize * ((scan8[15] - scan8[0]) >> 3));
 
-    if (h->postpone_filter)
+    if (h->postpone_filter || sl->deblock_in_thread)
         sl->deblocking_filter = 0;
 
     sl->is_complex = FRAME_MBAFF(h) || h->picture_structure != PICT_FRAME ||
@@ -2718,6 +2732,109 @@ finish:
     return 0;
 }
 
+/**
+ * Deblock the rows of the slice decoded on sl as loop_filter() hands them
+ * over. A row is deblocked once the next one is decoded, as the intra
+ * prediction of the next row needs the unfiltered samples.
+ */
+static void loop_filter_thread(const H264Context *h, H264SliceContext *fsl,
+                               const H264SliceContext *sl)
+{
+    int start_x = fsl->mb_x;
+    int mb_y    = fsl->mb_y;
+    int row;
+
+    for (row = 0; ; row++) {
+        int end_x = h->mb_width;
+        int nb_rows;
+
+        ff_thread_await_progress2(h->avctx, 1, 1, 2);
+
+        nb_rows = atomic_load(&h->nb_deblock_rows);
+        if (nb_rows >= 0) {
+            if (row >= nb_rows)
+                break;
+            if (row == nb_rows - 1)
+                end_x = sl->deblock_end_x;
+        }
+
+        fsl->mb_y = mb_y;
+        loop_filter(h, fsl, start_x, end_x);
+        if (end_x == h->mb_width)
+            decode_finish_row(h, fsl);
+        ff_thread_report_progress2(h->avctx, 1, 1, 1);
+
+        start_x = 0;
+        mb_y   += 1 + FIELD_OR_MBAFF_PICTURE(h);
+    }
+}
+
+static int decode_slice_deblock_thread(AVCodecContext *avctx, void *arg,
+                                       int jobnr, int threadnr)
+{
+    H264Context *h = avctx->priv_data;
+    H264SliceContext *sl = arg;
+    int ret;
+
+    if (jobnr) {
+        loop_filter_thread(h, &sl[1], &sl[0]);
+        return 0;
+    }
+
+    ret = decode_slice(avctx, &sl[0]);
+
+    /* let the deblocking thread finish the last row */
+    atomic_store(&h->nb_deblock_rows, sl[0].nb_deblock_rows);
+    ff_thread_report_progress2(avctx, 0, 0, 2);
+
+    return ret;
+}
+
+/**
+ * Decode a single slice context while another thread deblocks its rows.
+ */
+static int decode_slice_pipelined(H264Context *h)
+{
+    AVCodecContext *const avctx = h->avctx;
+    H264SliceContext *sl  = &h->slice_ctx[0];
+    H264SliceContext *fsl = &h->slice_ctx[1];
+    int rets[2] = { 0 };
+    int ret;
+
+    fsl->linesize   = h->cur_pic_ptr->f->linesize[0];
+    fsl->uvlinesize = h->cur_pic_ptr->f->linesize[1];
+    ret = alloc_scratch_buffers(fsl, fsl->linesize);
+    if (ret < 0)
+        return ret;
+    ret = ff_slice_thread_allocz_entries(avctx, 2);
+    if (ret < 0)
+        return ret;
+
+    fsl->slice_num              = sl->slice_num;
+    fsl->slice_type             = sl->slice_type;
+    fsl->slice_type_nos         = sl->slice_type_nos;
+    fsl->qscale                 = sl->qscale;
+    fsl->qp_thresh              = sl->qp_thresh;
+    fsl->deblocking_filter      = sl->deblocking_filter;
+    fsl->slice_alpha_c0_offset  = sl->slice_alpha_c0_offset;
+    fsl->slice_beta_offset      = sl->slice_beta_offset;
+    fsl->list_count             = sl->list_count;
+    fsl->mb_field_decoding_flag = sl->mb_field_decoding_flag;
+    fsl->mb_mbaff               = sl->mb_mbaff;
+    fsl->mb_x                   = sl->mb_x;
+    fsl->mb_y                   = sl->mb_y;
+
+    sl->deblock_in_thread = 1;
+    sl->nb_deblock_rows   = 0;
+    atomic_store(&h->nb_deblock_rows, -1);
+
+    avctx->execute2(avctx, decode_slice_deblock_thread, h->slice_ctx, rets, 2);
+
+    sl->deblock_in_thread = 0;
+
+    return rets[0];
+}
+
 /**
  * Call decode_slice() for each context.
  *
@@ -2743,7 +2860,13 @@ int ff_h264_execute_decode_slices(H264Context *h)
         h->slice_ctx[0].next_slice_idx = h->mb_width * h->mb_height;
         h->postpone_filter = 0;
 
-        ret = decode_slice(avctx, &h->slice_ctx[0]);
+        /* deblock on a second slice thread when there is a single slice to
+         * decode */
+        if (h->nb_slice_ctx > 1 && h->slice_ctx[0].deblocking_filter &&
+            !h->enable_er && avctx->active_thread_type & FF_THREAD_SLICE)
+            ret = decode_slice_pipelined(h);
+        else
+            ret = decode_slice(avctx, &h->slice_ctx[0]);
         h->mb_y = h->slice_ctx[0].mb_y;
         if (ret < 0)
             goto finish;
@@ -2792,6 +2915,18 @@ int ff_h264_execute_decode_slices(H264Context *h)
                 }
             }
         }
+
+        /* all the rows above the last slice are complete now, except for
+         * the lines its deblocking may still modify */
+        if (avctx->active_thread_type & FF_THREAD_FRAME &&
+            !h->droppable && !h->er.error_occurred) {
+            int deblock_border = (16 + 4) << FRAME_MBAFF(h);
+            int bottom = 16 * (h->mb_y >> FIELD_PICTURE(h)) - deblock_border;
+
+            if (bottom > 0)
+                ff_thread_report_progress(&h->cur_pic_ptr->tf, bottom - 1,
+                                          h->picture_structure == PICT_BOTTOM_FIELD);
+        }
     }
 
 finish:
@@ -28,6 +28,8 @@
 #ifndef AVCODEC_H264DEC_H
 #define AVCODEC_H264DEC_H
 
+#include <stdatomic.h>
+
 #include "third_party/ffmpeg/libavutil/buffer.h"
 #include "third_party/ffmpeg/libavutil/intreadwrite.h"
 #include "third_party/ffmpeg/libavutil/mem_internal.h"
@@ -186,6 +188,13 @@ typedef struct H264SliceContext {
     int deblocking_filter;          ///< disable_deblocking_filter_idc with 1 <-> 0
     int slice_alpha_c0_offset;
     int slice_beta_offset;
+    /**
+     * Set when the rows of the slice are deblocked by another thread while
+     * it is decoded, see ff_h264_execute_decode_slices().
+     */
+    int deblock_in_thread;
+    int nb_deblock_rows;            ///< number of rows passed to loop_filter()
+    int deblock_end_x;              ///< end of the last row passed to loop_filter()
 
     H264PredWeightTable pwt;
 
@@ -365,6 +374,11 @@ typedef struct H264Context {
      * during normal MB decoding and execute it serially at the end.
      */
     int postpone_filter;
+    /**
+     * Number of rows to deblock in the slice decoded with deblock_in_thread,
+     * -1 while it is being decoded.
+     */
+    atomic_int nb_deblock_rows;
 
     /*
      * Set to 1 when the current picture is IDR, 0 otherwise.
@@ -941,8 +941,12 @@ static int hls_slice_header(HEVCContext *s)
                 sh->entry_point_offset[i] = val + 1; // +1; // +1 to get the size
             }
             if (s->threads_number > 1 && (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1)) {
-                s->enable_parallel_tiles = 0; // TODO: you can enable tiles in parallel here
-                s->threads_number = 1;
+                if (s->ps.pps->entropy_coding_sync_enabled_flag) {
+                    // tiles combined with WPP are decoded serially
+                    s->enable_parallel_tiles = 0;
+                    s->threads_number = 1;
+                } else
+                    s->enable_parallel_tiles = 1;
             } else
                 s->enable_parallel_tiles = 0;
         } else
@@ -2633,6 +2637,149 @@ error:
     return ret;
 }
 
+static int hls_decode_entry_tiles(AVCodecContext *avctxt, void *hevc_lclist,
+                                  int job, int self_id)
+{
+    HEVCLocalContext *lc = ((HEVCLocalContext**)hevc_lclist)[self_id];
+    const HEVCContext *const s = lc->parent;
+    const HEVCPPS *const pps = s->ps.pps;
+    int log2_ctb_size = s->ps.sps->log2_ctb_size;
+    int more_data     = 1;
+    int ctb_addr_ts   = pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int ctb_addr_rs   = s->sh.slice_ctb_addr_rs;
+    int tile          = pps->tile_id[ctb_addr_ts] + job;
+    int ret;
+
+    if (job) {
+        ctb_addr_rs = pps->tile_pos_rs[tile];
+        ctb_addr_ts = pps->ctb_addr_rs_to_ts[ctb_addr_rs];
+        ret = init_get_bits8(&lc->gb, s->data + s->sh.offset[job - 1], s->sh.size[job - 1]);
+        if (ret < 0)
+            goto error;
+    }
+
+    while (more_data && ctb_addr_ts < s->ps.sps->ctb_size &&
+           pps->tile_id[ctb_addr_ts] == tile) {
+        int x_ctb, y_ctb;
+
+        ctb_addr_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << log2_ctb_size;
+        y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << log2_ctb_size;
+        hls_decode_neighbour(lc, x_ctb, y_ctb, ctb_addr_ts);
+
+        ret = ff_hevc_cabac_init(lc, ctb_addr_ts);
+        if (ret < 0)
+            goto error;
+
+        hls_sao_param(lc, x_ctb >> log2_ctb_size, y_ctb >> log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+
+        more_data = hls_coding_quadtree(lc, x_ctb, y_ctb, log2_ctb_size, 0);
+        if (more_data < 0) {
+            ret = more_data;
+            goto error;
+        }
+
+        ctb_addr_ts++;
+    }
+
+    if (!more_data && job != s->sh.num_entry_point_offsets) {
+        av_log(s->avctx, AV_LOG_ERROR, "Slice segment ends in tile %d of %d\n",
+               job + 1, s->sh.num_entry_point_offsets + 1);
+        ret = AVERROR_INVALIDDATA;
+        goto error;
+    }
+
+    return ctb_addr_ts;
+error:
+    s->tab_slice_address[ctb_addr_rs] = -1;
+    return ret;
+}
+
+/**
+ * Decode the tiles of a slice segment in parallel, one tile per entry point,
+ * then run the in-loop filters over the slice segment.
+ */
+static int hls_slice_data_tiles(HEVCContext *s, int *ret)
+{
+    const HEVCPPS *const pps = s->ps.pps;
+    HEVCLocalContext *const lc = s->HEVClc;
+    int ctb_size      = 1 << s->ps.sps->log2_ctb_size;
+    int nb_tiles      = s->sh.num_entry_point_offsets + 1;
+    int ctb_addr_ts   = pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int last_tile     = pps->tile_id[ctb_addr_ts] + nb_tiles - 1;
+    int x_ctb = 0, y_ctb = 0;
+    int ctb_addr_end, i;
+
+    if (last_tile >= pps->num_tile_columns * pps->num_tile_rows) {
+        av_log(s->avctx, AV_LOG_ERROR, "Too many entry points (%d) for the tiles\n",
+               s->sh.num_entry_point_offsets);
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (s->sh.dependent_slice_segment_flag) {
+        int prev_rs;
+
+        if (!ctb_addr_ts) {
+            av_log(s->avctx, AV_LOG_ERROR, "Impossible initial tile.\n");
+            return AVERROR_INVALIDDATA;
+        }
+        prev_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts - 1];
+        if (s->tab_slice_address[prev_rs] != s->sh.slice_addr) {
+            av_log(s->avctx, AV_LOG_ERROR, "Previous slice segment missing\n");
+            return AVERROR_INVALIDDATA;
+        }
+    }
+
+    /* The slice segment is made of whole tiles. Assign all their CTBs to it
+     * beforehand, so that the slice boundaries are derived as in serial
+     * decoding whatever the order in which the tiles are decoded. */
+    for (ctb_addr_end = ctb_addr_ts;
+         ctb_addr_end < s->ps.sps->ctb_size && pps->tile_id[ctb_addr_end] <= last_tile;
+         ctb_addr_end++)
+        s->tab_slice_address[pps->ctb_addr_ts_to_rs[ctb_addr_end]] = s->sh.slice_addr;
+
+    s->deferred_tile_edges = 1;
+    s->avctx->execute2(s->avctx, hls_decode_entry_tiles, s->HEVClcList, ret, nb_tiles);
+    s->deferred_tile_edges = 0;
+
+    for (i = 0; i < nb_tiles; i++)
+        if (ret[i] < 0)
+            return ret[i];
+    ctb_addr_end = ret[nb_tiles - 1];
+
+    /* The neighbouring tiles are all decoded now, finish the boundary
+     * strengths of the edges between them, then filter the CTBs in the same
+     * order as hls_decode_entry() does. */
+    if (!s->sh.disable_deblocking_filter_flag) {
+        for (i = ctb_addr_ts; i < ctb_addr_end; i++) {
+            int ctb_addr_rs = pps->ctb_addr_ts_to_rs[i];
+
+            x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+            y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+            hls_decode_neighbour(lc, x_ctb, y_ctb, i);
+            ff_hevc_deblocking_boundary_strengths_tiles(lc, x_ctb, y_ctb);
+        }
+    }
+
+    for (i = ctb_addr_ts; i < ctb_addr_end; i++) {
+        int ctb_addr_rs = pps->ctb_addr_ts_to_rs[i];
+
+        x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
+    }
+
+    if (x_ctb + ctb_size >= s->ps.sps->width &&
+        y_ctb + ctb_size >= s->ps.sps->height)
+        ff_hevc_hls_filter(lc, x_ctb, y_ctb, ctb_size);
+
+    return ctb_addr_end;
+}
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const uint8_t *data = nal->data;
@@ -2643,7 +2790,8 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     int64_t startheader, cmpt = 0;
     int i, j, res = 0;
 
-    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
+    if (s->ps.pps->entropy_coding_sync_enabled_flag &&
+        s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
         av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
             s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
             s->ps.sps->ctb_width, s->ps.sps->ctb_height
@@ -2710,11 +2858,14 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     if (!ret)
         return AVERROR(ENOMEM);
 
-    if (s->ps.pps->entropy_coding_sync_enabled_flag)
+    if (s->ps.pps->entropy_coding_sync_enabled_flag) {
         s->avctx->execute2(s->avctx, hls_decode_entry_wpp, s->HEVClcList, ret, s->sh.num_entry_point_offsets + 1);
 
-    for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
-        res += ret[i];
+        for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
+            res += ret[i];
+    } else if (s->enable_parallel_tiles) {
+        res = hls_slice_data_tiles(s, ret);
+    }
 
     av_free(ret);
     return res;
@@ -3645,7 +3796,7 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     } else
         s->threads_number = 1;
 
-    if((avctx->active_thread_type & FF_THREAD_FRAME) && avctx->thread_count > 1)
+    if (avctx->active_thread_type & FF_THREAD_FRAME)
         s->threads_type = FF_THREAD_FRAME;
     else
         s->threads_type = FF_THREAD_SLICE;
@@ -3716,7 +3867,8 @@ const FFCodec ff_hevc_decoder = {
     .p.capabilities        = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
                              AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_FRAME_THREADS,
     .caps_internal         = FF_CODEC_CAP_EXPORTS_CROPPING |
-                             FF_CODEC_CAP_ALLOCATE_PROGRESS | FF_CODEC_CAP_INIT_CLEANUP,
+                             FF_CODEC_CAP_ALLOCATE_PROGRESS | FF_CODEC_CAP_INIT_CLEANUP |
+                             FF_CODEC_CAP_FRAME_SLICE_THREADS,
     .p.profiles            = NULL_IF_CONFIG_SMALL(ff_hevc_profiles),
     .hw_configs            = (const AVCodecHWConfigInternal *const []) {
 #if CONFIG_HEVC_DXVA2_HWACCEL
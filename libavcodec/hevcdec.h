@@ -576,6 +576,12 @@ typedef struct HEVCContext {
     HEVCCABACState cabac;
 
     int enable_parallel_tiles;
+    /**
+     * Set while the tiles of a slice segment are decoded in parallel, the
+     * boundary strengths of the edges between tiles are then computed once
+     * all of them are decoded.
+     */
+    int deferred_tile_edges;
     atomic_int wpp_err;
 
     const uint8_t *data;
@@ -700,6 +706,8 @@ void ff_hevc_set_qPy(HEVCLocalContext *lc, int xBase, int yBase,
                      int log2_cb_size);
 void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                                            int log2_trafo_size);
+void ff_hevc_deblocking_boundary_strengths_tiles(HEVCLocalContext *lc,
+                                                 int x_ctb, int y_ctb);
 int ff_hevc_cu_qp_delta_sign_flag(HEVCLocalContext *lc);
 int ff_hevc_cu_qp_delta_abs(HEVCLocalContext *lc);
 int ff_hevc_cu_chroma_qp_offset_flag(HEVCLocalContext *lc);
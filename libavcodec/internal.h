@@ -71,6 +71,11 @@ typedef struct AVCodecInternal {
     AVBufferRef *pool;
 
     void *thread_ctx;
+    /**
+     * Slice threading context, separate from thread_ctx as the frame
+     * threads may use slice threading too.
+     */
+    void *slice_thread_ctx;
 
     /**
      * This packet is used to hold the packet given to decoders
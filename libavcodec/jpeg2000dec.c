@@ -92,6 +92,17 @@ typedef struct Jpeg2000Tile {
     int coord[2][2];                    // border coordinates {{x0, x1}, {y0, y1}}
 } Jpeg2000Tile;
 
+/* Codeblock decoded by a slice thread when a frame has fewer tiles than
+ * threads */
+typedef struct Jpeg2000CblkJob {
+    Jpeg2000Component   *comp;
+    Jpeg2000CodingStyle *codsty;
+    Jpeg2000Band        *band;
+    Jpeg2000Cblk        *cblk;
+    int                 bandpos;
+    int                 coded;          // set if the codeblock has data
+} Jpeg2000CblkJob;
+
 typedef struct Jpeg2000DecoderContext {
     AVClass         *class;
     AVCodecContext  *avctx;
@@ -134,6 +145,11 @@ typedef struct Jpeg2000DecoderContext {
     Jpeg2000Tile    *tile;
     Jpeg2000DSPContext dsp;
 
+    Jpeg2000CblkJob *cblk_jobs;
+    unsigned        cblk_jobs_allocated;
+    uint8_t         *dwt_linebufs;      // one DWT line buffer per slice thread
+    unsigned        dwt_linebufs_allocated;
+
     /*options parameters*/
     int             reduction_factor;
 } Jpeg2000DecoderContext;
@@ -1941,6 +1957,37 @@ static inline void roi_scale_cblk(Jpeg2000Cblk *cblk,
     }
 }
 
+static int decode_cblk_dequant(const Jpeg2000DecoderContext *s,
+                               Jpeg2000T1Context *t1, Jpeg2000Component *comp,
+                               Jpeg2000CodingStyle *codsty, Jpeg2000Band *band,
+                               Jpeg2000Cblk *cblk, int bandpos)
+{
+    int x, y;
+    int ret;
+
+    t1->stride = (1<<codsty->log2_cblk_width) + 2;
+
+    ret = decode_cblk(s, codsty, t1, cblk,
+                      cblk->coord[0][1] - cblk->coord[0][0],
+                      cblk->coord[1][1] - cblk->coord[1][0],
+                      bandpos, comp->roi_shift);
+    if (!ret)
+        return 0;
+    x = cblk->coord[0][0] - band->coord[0][0];
+    y = cblk->coord[1][0] - band->coord[1][0];
+
+    if (comp->roi_shift)
+        roi_scale_cblk(cblk, comp, t1);
+    if (codsty->transform == FF_DWT97)
+        dequantization_float(x, y, cblk, comp, t1, band);
+    else if (codsty->transform == FF_DWT97_INT)
+        dequantization_int_97(x, y, cblk, comp, t1, band);
+    else
+        dequantization_int(x, y, cblk, comp, t1, band);
+
+    return ret;
+}
+
 static inline void tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile *tile)
 {
     Jpeg2000T1Context t1;
@@ -1953,8 +2000,6 @@ static inline void tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile
         Jpeg2000CodingStyle *codsty = tile->codsty + compno;
         int coded = 0;
 
-        t1.stride = (1<<codsty->log2_cblk_width) + 2;
-
         /* Loop on resolution levels */
         for (reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
             Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
@@ -1979,27 +2024,9 @@ static inline void tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile
                     for (cblkno = 0;
                          cblkno < prec->nb_codeblocks_width * prec->nb_codeblocks_height;
                          cblkno++) {
-                        int x, y;
                         Jpeg2000Cblk *cblk = prec->cblk + cblkno;
-                        int ret = decode_cblk(s, codsty, &t1, cblk,
-                                    cblk->coord[0][1] - cblk->coord[0][0],
-                                    cblk->coord[1][1] - cblk->coord[1][0],
-                                    bandpos, comp->roi_shift);
-                        if (ret)
+                        if (decode_cblk_dequant(s, &t1, comp, codsty, band, cblk, bandpos))
                             coded = 1;
-                        else
-                            continue;
-                        x = cblk->coord[0][0] - band->coord[0][0];
-                        y = cblk->coord[1][0] - band->coord[1][0];
-
-                        if (comp->roi_shift)
-                            roi_scale_cblk(cblk, comp, &t1);
-                        if (codsty->transform == FF_DWT97)
-                            dequantization_float(x, y, cblk, comp, &t1, band);
-                        else if (codsty->transform == FF_DWT97_INT)
-                            dequantization_int_97(x, y, cblk, comp, &t1, band);
-                        else
-                            dequantization_int(x, y, cblk, comp, &t1, band);
                    } /* end cblk */
                 } /*end prec */
             } /* end band */
@@ -2079,15 +2106,9 @@ WRITE_FRAME(16, uint16_t)
 
 #undef WRITE_FRAME
 
-static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
-                                int jobnr, int threadnr)
+static void write_tile(const Jpeg2000DecoderContext *s, Jpeg2000Tile *tile,
+                       AVFrame *picture)
 {
-    const Jpeg2000DecoderContext *s = avctx->priv_data;
-    AVFrame *picture = td;
-    Jpeg2000Tile *tile = s->tile + jobnr;
-
-    tile_codeblocks(s, tile);
-
     /* inverse MCT transformation */
     if (tile->codsty[0].mct)
         mct_decode(s, tile);
@@ -2102,6 +2123,141 @@ static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
 
         write_frame_16(s, tile, picture, precision);
     }
+}
+
+static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
+                                int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    AVFrame *picture = td;
+    Jpeg2000Tile *tile = s->tile + jobnr;
+
+    tile_codeblocks(s, tile);
+    write_tile(s, tile, picture);
+
+    return 0;
+}
+
+/**
+ * List the codeblocks of a tile component, or only count them if jobs is
+ * NULL.
+ */
+static int component_cblk_jobs(Jpeg2000Component *comp,
+                               Jpeg2000CodingStyle *codsty,
+                               Jpeg2000CblkJob *jobs)
+{
+    int reslevelno, bandno, precno, cblkno, nb_jobs = 0;
+
+    for (reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
+        Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
+        for (bandno = 0; bandno < rlevel->nbands; bandno++) {
+            Jpeg2000Band *band = rlevel->band + bandno;
+
+            if (band->coord[0][0] == band->coord[0][1] ||
+                band->coord[1][0] == band->coord[1][1])
+                continue;
+
+            for (precno = 0; precno < rlevel->num_precincts_x * rlevel->num_precincts_y; precno++) {
+                Jpeg2000Prec *prec = band->prec + precno;
+                int nb_cblks = prec->nb_codeblocks_width * prec->nb_codeblocks_height;
+
+                for (cblkno = 0; jobs && cblkno < nb_cblks; cblkno++) {
+                    Jpeg2000CblkJob *job = &jobs[nb_jobs + cblkno];
+                    job->comp    = comp;
+                    job->codsty  = codsty;
+                    job->band    = band;
+                    job->cblk    = prec->cblk + cblkno;
+                    job->bandpos = bandno + (reslevelno > 0);
+                }
+                nb_jobs += nb_cblks;
+            }
+        }
+    }
+
+    return nb_jobs;
+}
+
+static int decode_cblk_job(AVCodecContext *avctx, void *arg,
+                           int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    Jpeg2000CblkJob *job = (Jpeg2000CblkJob *)arg + jobnr;
+    Jpeg2000T1Context t1;
+
+    job->coded = !!decode_cblk_dequant(s, &t1, job->comp, job->codsty,
+                                       job->band, job->cblk, job->bandpos);
+    return 0;
+}
+
+typedef struct Jpeg2000DWTJob {
+    DWTContext *dwt;
+    void       *data;
+    int        pass;
+    size_t     linebuf_size;
+} Jpeg2000DWTJob;
+
+static int dwt_slice_job(AVCodecContext *avctx, void *arg,
+                         int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    const Jpeg2000DWTJob *job = arg;
+
+    return ff_dwt_decode_slice(job->dwt, job->data, job->pass, jobnr,
+                               avctx->thread_count,
+                               s->dwt_linebufs + threadnr * job->linebuf_size);
+}
+
+/**
+ * Decode a tile with the slice threads working on its codeblocks and on
+ * the lines of its inverse DWT, for frames with fewer tiles than threads.
+ */
+static int decode_tile_threaded(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile,
+                                AVFrame *picture)
+{
+    AVCodecContext *avctx = s->avctx;
+    int comp_jobs[5] = { 0 };
+    int compno, i;
+
+    for (compno = 0; compno < s->ncomponents; compno++)
+        comp_jobs[compno + 1] = comp_jobs[compno] +
+            component_cblk_jobs(tile->comp + compno, tile->codsty + compno, NULL);
+    if (comp_jobs[s->ncomponents] > INT_MAX / sizeof(*s->cblk_jobs))
+        return AVERROR(ENOMEM);
+    av_fast_malloc(&s->cblk_jobs, &s->cblk_jobs_allocated,
+                   comp_jobs[s->ncomponents] * sizeof(*s->cblk_jobs));
+    if (!s->cblk_jobs)
+        return AVERROR(ENOMEM);
+    for (compno = 0; compno < s->ncomponents; compno++)
+        component_cblk_jobs(tile->comp + compno, tile->codsty + compno,
+                            s->cblk_jobs + comp_jobs[compno]);
+
+    avctx->execute2(avctx, decode_cblk_job, s->cblk_jobs, NULL,
+                    comp_jobs[s->ncomponents]);
+
+    for (compno = 0; compno < s->ncomponents; compno++) {
+        Jpeg2000Component *comp     = tile->comp + compno;
+        Jpeg2000CodingStyle *codsty = tile->codsty + compno;
+        Jpeg2000DWTJob job;
+        int coded = 0;
+
+        for (i = comp_jobs[compno]; i < comp_jobs[compno + 1]; i++)
+            coded |= s->cblk_jobs[i].coded;
+        if (!coded)
+            continue;
+
+        /* inverse DWT, each pass split across the threads */
+        job.dwt          = &comp->dwt;
+        job.data         = codsty->transform == FF_DWT97 ? (void*)comp->f_data : (void*)comp->i_data;
+        job.linebuf_size = ff_dwt_linebuf_size(&comp->dwt);
+        av_fast_malloc(&s->dwt_linebufs, &s->dwt_linebufs_allocated,
+                       job.linebuf_size * avctx->thread_count);
+        if (!s->dwt_linebufs)
+            return AVERROR(ENOMEM);
+        for (job.pass = 0; job.pass < ff_dwt_decode_nb_passes(&comp->dwt); job.pass++)
+            avctx->execute2(avctx, dwt_slice_job, &job, NULL, avctx->thread_count);
+    }
+
+    write_tile(s, tile, picture);
 
     return 0;
 }
@@ -2548,7 +2704,16 @@ static int jpeg2000_decode_frame(AVCodecContext *avctx, AVFrame *picture,
         }
     }
 
-    avctx->execute2(avctx, jpeg2000_decode_tile, picture, NULL, s->numXtiles * s->numYtiles);
+    if (avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1 &&
+        s->numXtiles * s->numYtiles < avctx->thread_count) {
+        /* not enough tiles to keep the threads busy, split each tile */
+        for (int tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++) {
+            if ((ret = decode_tile_threaded(s, s->tile + tileno, picture)) < 0)
+                goto end;
+        }
+    } else {
+        avctx->execute2(avctx, jpeg2000_decode_tile, picture, NULL, s->numXtiles * s->numYtiles);
+    }
 
     jpeg2000_dec_cleanup(s);
 
@@ -2564,6 +2729,18 @@ end:
     return ret;
 }
 
+static av_cold int jpeg2000_decode_close(AVCodecContext *avctx)
+{
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+
+    av_freep(&s->cblk_jobs);
+    s->cblk_jobs_allocated = 0;
+    av_freep(&s->dwt_linebufs);
+    s->dwt_linebufs_allocated = 0;
+
+    return 0;
+}
+
 #define OFFSET(x) offsetof(Jpeg2000DecoderContext, x)
 #define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
 
@@ -2589,8 +2766,10 @@ const FFCodec ff_jpeg2000_decoder = {
     .priv_data_size   = sizeof(Jpeg2000DecoderContext),
     .init             = jpeg2000_decode_init,
     FF_CODEC_DECODE_CB(jpeg2000_decode_frame),
+    .close            = jpeg2000_decode_close,
     .p.priv_class     = &jpeg2000_class,
     .p.max_lowres     = 5,
     .p.profiles       = NULL_IF_CONFIG_SMALL(ff_jpeg2000_profiles),
-    .caps_internal    = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
+    .caps_internal    = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM |
+                        FF_CODEC_CAP_FRAME_SLICE_THREADS,
 };
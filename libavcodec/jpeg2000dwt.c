@@ -322,24 +322,26 @@ static void sr_1d53(unsigned *p, int i0, int i1)
         p[2 * i + 1] += (int)(p[2 * i] + p[2 * i + 2]) >> 1;
 }
 
-static void dwt_decode53(DWTContext *s, int *t)
+/**
+ * Run the horizontal (ver = 0) or vertical (ver = 1) inverse transform of a
+ * decomposition level on the lines [start, end).
+ */
+static void dwt_decode53(DWTContext *s, int *t, int32_t *line,
+                         int lev, int ver, int start, int end)
 {
-    int lev;
-    int w     = s->linelen[s->ndeclevels - 1][0];
-    int32_t *line = s->i_linebuf;
+    int w  = s->linelen[s->ndeclevels - 1][0],
+        lh = s->linelen[lev][0],
+        lv = s->linelen[lev][1],
+        mh = s->mod[lev][0],
+        mv = s->mod[lev][1],
+        lp;
+    int *l;
     line += 3;
 
-    for (lev = 0; lev < s->ndeclevels; lev++) {
-        int lh = s->linelen[lev][0],
-            lv = s->linelen[lev][1],
-            mh = s->mod[lev][0],
-            mv = s->mod[lev][1],
-            lp;
-        int *l;
-
+    if (!ver) {
         // HOR_SD
         l = line + mh;
-        for (lp = 0; lp < lv; lp++) {
+        for (lp = start; lp < end; lp++) {
             int i, j = 0;
             // copy with interleaving
             for (i = mh; i < lh; i += 2, j++)
@@ -352,10 +354,10 @@ static void dwt_decode53(DWTContext *s, int *t)
             for (i = 0; i < lh; i++)
                 t[w * lp + i] = l[i];
         }
-
+    } else {
         // VER_SD
         l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
+        for (lp = start; lp < end; lp++) {
             int i, j = 0;
             // copy with interleaving
             for (i = mv; i < lv; i += 2, j++)
@@ -398,25 +400,23 @@ static void sr_1d97_float(float *p, int i0, int i1)
         p[2 * i + 1] += F_LFTG_ALPHA * (p[2 * i]     + p[2 * i + 2]);
 }
 
-static void dwt_decode97_float(DWTContext *s, float *t)
+static void dwt_decode97_float(DWTContext *s, float *data, float *line,
+                               int lev, int ver, int start, int end)
 {
-    int lev;
-    int w       = s->linelen[s->ndeclevels - 1][0];
-    float *line = s->f_linebuf;
-    float *data = t;
+    int w  = s->linelen[s->ndeclevels - 1][0],
+        lh = s->linelen[lev][0],
+        lv = s->linelen[lev][1],
+        mh = s->mod[lev][0],
+        mv = s->mod[lev][1],
+        lp;
+    float *l;
     /* position at index O of line range [0-5,w+5] cf. extend function */
     line += 5;
 
-    for (lev = 0; lev < s->ndeclevels; lev++) {
-        int lh = s->linelen[lev][0],
-            lv = s->linelen[lev][1],
-            mh = s->mod[lev][0],
-            mv = s->mod[lev][1],
-            lp;
-        float *l;
+    if (!ver) {
         // HOR_SD
         l = line + mh;
-        for (lp = 0; lp < lv; lp++) {
+        for (lp = start; lp < end; lp++) {
             int i, j = 0;
             // copy with interleaving
             for (i = mh; i < lh; i += 2, j++)
@@ -429,10 +429,10 @@ static void dwt_decode97_float(DWTContext *s, float *t)
             for (i = 0; i < lh; i++)
                 data[w * lp + i] = l[i];
         }
-
+    } else {
         // VER_SD
         l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
+        for (lp = start; lp < end; lp++) {
             int i, j = 0;
             // copy with interleaving
             for (i = mv; i < lv; i += 2, j++)
@@ -475,30 +475,23 @@ static void sr_1d97_int(int32_t *p, int i0, int i1)
         p[2 * i + 1] += (I_LFTG_ALPHA * (p[2 * i]     + (int64_t)p[2 * i + 2]) + (1 << 15)) >> 16;
 }
 
-static void dwt_decode97_int(DWTContext *s, int32_t *t)
+static void dwt_decode97_int(DWTContext *s, int32_t *data, int32_t *line,
+                             int lev, int ver, int start, int end)
 {
-    int lev;
-    int w       = s->linelen[s->ndeclevels - 1][0];
-    int h       = s->linelen[s->ndeclevels - 1][1];
-    int i;
-    int32_t *line = s->i_linebuf;
-    int32_t *data = t;
+    int w  = s->linelen[s->ndeclevels - 1][0],
+        lh = s->linelen[lev][0],
+        lv = s->linelen[lev][1],
+        mh = s->mod[lev][0],
+        mv = s->mod[lev][1],
+        lp;
+    int32_t *l;
     /* position at index O of line range [0-5,w+5] cf. extend function */
     line += 5;
 
-    for (i = 0; i < w * h; i++)
-        data[i] *= 1LL << I_PRESHIFT;
-
-    for (lev = 0; lev < s->ndeclevels; lev++) {
-        int lh = s->linelen[lev][0],
-            lv = s->linelen[lev][1],
-            mh = s->mod[lev][0],
-            mv = s->mod[lev][1],
-            lp;
-        int32_t *l;
+    if (!ver) {
         // HOR_SD
         l = line + mh;
-        for (lp = 0; lp < lv; lp++) {
+        for (lp = start; lp < end; lp++) {
             int i, j = 0;
             // rescale with interleaving
             for (i = mh; i < lh; i += 2, j++)
@@ -511,10 +504,10 @@ static void dwt_decode97_int(DWTContext *s, int32_t *t)
             for (i = 0; i < lh; i++)
                 data[w * lp + i] = l[i];
         }
-
+    } else {
         // VER_SD
         l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
+        for (lp = start; lp < end; lp++) {
             int i, j = 0;
             // rescale with interleaving
             for (i = mv; i < lv; i += 2, j++)
@@ -528,9 +521,6 @@ static void dwt_decode97_int(DWTContext *s, int32_t *t)
                 data[w * i + lp] = l[i];
         }
     }
-
-    for (i = 0; i < w * h; i++)
-        data[i] = (data[i] + ((1LL<<I_PRESHIFT)>>1)) >> I_PRESHIFT;
 }
 
 int ff_jpeg2000_dwt_init(DWTContext *s, int border[2][2],
@@ -595,20 +585,61 @@ int ff_dwt_encode(DWTContext *s, void *t)
     return 0;
 }
 
-int ff_dwt_decode(DWTContext *s, void *t)
+int ff_dwt_decode_nb_passes(const DWTContext *s)
 {
     if (s->ndeclevels == 0)
         return 0;
+    /* the 9/7 integer transform scales the coefficients before and after */
+    return 2 * s->ndeclevels + 2 * (s->type == FF_DWT97_INT);
+}
+
+size_t ff_dwt_linebuf_size(const DWTContext *s)
+{
+    int lev = FFMAX(s->ndeclevels - 1, 0);
+
+    return (FFMAX(s->linelen[lev][0], s->linelen[lev][1]) + 12) * sizeof(int32_t);
+}
+
+int ff_dwt_decode_slice(DWTContext *s, void *t, int pass, int slice,
+                        int nb_slices, void *linebuf)
+{
+    int w = s->linelen[s->ndeclevels - 1][0];
+    int h = s->linelen[s->ndeclevels - 1][1];
+    int lev, ver, nb_lines, start, end;
+
+    if (s->type == FF_DWT97_INT) {
+        int32_t *data = t;
+
+        if (pass == 0 || pass == 2 * s->ndeclevels + 1) {
+            start = (int64_t)h *  slice      / nb_slices * w;
+            end   = (int64_t)h * (slice + 1) / nb_slices * w;
+            if (pass == 0) {
+                for (int i = start; i < end; i++)
+                    data[i] *= 1LL << I_PRESHIFT;
+            } else {
+                for (int i = start; i < end; i++)
+                    data[i] = (data[i] + ((1LL<<I_PRESHIFT)>>1)) >> I_PRESHIFT;
+            }
+            return 0;
+        }
+        pass--;
+    }
+
+    lev      = pass >> 1;
+    ver      = pass & 1;
+    nb_lines = s->linelen[lev][!ver];
+    start    = (int64_t)nb_lines *  slice      / nb_slices;
+    end      = (int64_t)nb_lines * (slice + 1) / nb_slices;
 
     switch (s->type) {
     case FF_DWT97:
-        dwt_decode97_float(s, t);
+        dwt_decode97_float(s, t, linebuf, lev, ver, start, end);
         break;
     case FF_DWT97_INT:
-        dwt_decode97_int(s, t);
+        dwt_decode97_int(s, t, linebuf, lev, ver, start, end);
         break;
     case FF_DWT53:
-        dwt_decode53(s, t);
+        dwt_decode53(s, t, linebuf, lev, ver, start, end);
         break;
     default:
         return -1;
@@ -616,6 +647,19 @@ int ff_dwt_decode(DWTContext *s, void *t)
     return 0;
 }
 
+int ff_dwt_decode(DWTContext *s, void *t)
+{
+    void *linebuf = s->type == FF_DWT97 ? (void *)s->f_linebuf : (void *)s->i_linebuf;
+    int nb_passes = ff_dwt_decode_nb_passes(s);
+
+    for (int pass = 0; pass < nb_passes; pass++) {
+        int ret = ff_dwt_decode_slice(s, t, pass, 0, 1, linebuf);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
 void ff_dwt_destroy(DWTContext *s)
 {
     av_freep(&s->f_linebuf);
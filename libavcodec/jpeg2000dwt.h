@@ -27,6 +27,7 @@
  * Discrete wavelet transform
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define FF_DWT_MAX_DECLVLS 32 ///< max number of decomposition levels
@@ -63,6 +64,33 @@ int ff_jpeg2000_dwt_init(DWTContext *s, int border[2][2],
 int ff_dwt_encode(DWTContext *s, void *t);
 int ff_dwt_decode(DWTContext *s, void *t);
 
+/**
+ * Get the number of passes of the inverse transform run by
+ * ff_dwt_decode_slice().
+ */
+int ff_dwt_decode_nb_passes(const DWTContext *s);
+
+/**
+ * Get the size in bytes of the line buffer needed by ff_dwt_decode_slice().
+ */
+size_t ff_dwt_linebuf_size(const DWTContext *s);
+
+/**
+ * Run a part of the inverse transform. The passes must be run in order,
+ * but the slices of a pass work on separate lines and can be run
+ * concurrently, each with its own line buffer. Running all of them is
+ * equivalent to ff_dwt_decode().
+ *
+ * @param s         DWT context
+ * @param t         transformed data, as for ff_dwt_decode()
+ * @param pass      pass to run, in [0, ff_dwt_decode_nb_passes())
+ * @param slice     slice of the pass to run, in [0, nb_slices)
+ * @param nb_slices number of slices the pass is split into
+ * @param linebuf   line buffer of ff_dwt_linebuf_size() bytes
+ */
+int ff_dwt_decode_slice(DWTContext *s, void *t, int pass, int slice,
+                        int nb_slices, void *linebuf);
+
 void ff_dwt_destroy(DWTContext *s);
 
 #endif /* AVCODEC_JPEG2000DWT_H */
@@ -40,6 +40,21 @@
 
 #define IOBUF_SIZE 4096
 
+/* minimum amount of filtered data deflated independently with slice threads,
+ * as in pigz */
+#define BAND_SIZE (128 << 10)
+/* data of the previous band used as dictionary */
+#define DICT_SIZE (32 << 10)
+
+typedef struct PNGEncBand {
+    int y_start, y_end;
+    uint8_t *buf;                ///< raw deflate data of the band
+    unsigned buf_size;
+    int len;
+    uLong adler;                 ///< Adler-32 of the filtered rows
+    uLong in_size;
+} PNGEncBand;
+
 typedef struct APNGFctlChunk {
     uint32_t sequence_number;
     uint32_t width, height;
@@ -60,6 +75,16 @@ typedef struct PNGEncContext {
 
     FFZStream zstream;
     uint8_t buf[IOBUF_SIZE];
+    int buf_len;
+
+    int band_deflate;            ///< deflate bands of rows with the slice threads
+    /* raw deflate streams of the slice threads, compressing bands of rows */
+    FFZStream *thread_zstreams;
+    int nb_thread_zstreams;
+    PNGEncBand *bands;
+    int *bands_ret;              ///< return codes of deflate_band() for each band
+    unsigned bands_size;
+    int nb_bands;
     int dpi;                     ///< Physical pixel density, in dots per inch, if set
     int dpm;                     ///< Physical pixel density, in dots per meter, if set
 
@@ -472,6 +497,180 @@ static int encode_headers(AVCodecContext *avctx, const AVFrame *pict)
     return 0;
 }
 
+/* append to the image data, written in chunks of IOBUF_SIZE */
+static void png_write_image_bytes(AVCodecContext *avctx, const uint8_t *data, int size)
+{
+    PNGEncContext *s = avctx->priv_data;
+
+    while (size > 0) {
+        int len = FFMIN(size, IOBUF_SIZE - s->buf_len);
+
+        memcpy(s->buf + s->buf_len, data, len);
+        s->buf_len += len;
+        data       += len;
+        size       -= len;
+        if (s->buf_len == IOBUF_SIZE) {
+            if (s->bytestream_end - s->bytestream > IOBUF_SIZE + 100)
+                png_write_image_data(avctx, s->buf, IOBUF_SIZE);
+            s->buf_len = 0;
+        }
+    }
+}
+
+static int deflate_band(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s       = avctx->priv_data;
+    const AVFrame *pict    = arg;
+    PNGEncBand *band       = &s->bands[jobnr];
+    z_stream *const zstream = &s->thread_zstreams[threadnr].zstream;
+    int flush    = jobnr == s->nb_bands - 1 ? Z_FINISH : Z_SYNC_FLUSH;
+    int bpp      = s->bits_per_pixel >> 3;
+    int row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
+    const uint8_t *top = NULL;
+    uint8_t *crow_base, *crow_buf, *crow;
+    uint8_t *dict = NULL;
+    int y, ret = 0;
+
+    band->len = 0;
+    crow_base = av_malloc((row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
+    if (!crow_base)
+        return AVERROR(ENOMEM);
+    // pixel data should be aligned, but there's a control byte before it
+    crow_buf = crow_base + 15;
+
+    deflateReset(zstream);
+    zstream->next_out  = band->buf;
+    zstream->avail_out = band->buf_size;
+    band->adler   = adler32(0, NULL, 0);
+    band->in_size = 0;
+
+    /* start from the end of the previous band for a better compression,
+     * filtering its last rows again */
+    if (band->y_start > 0) {
+        int nb_rows = FFMIN((DICT_SIZE + row_size) / (row_size + 1), band->y_start);
+        int dict_len = nb_rows * (row_size + 1);
+
+        dict = av_malloc(dict_len);
+        if (!dict) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        for (y = band->y_start - nb_rows; y < band->y_start; y++) {
+            const uint8_t *ptr = pict->data[0] + y * pict->linesize[0];
+            top  = y ? ptr - pict->linesize[0] : NULL;
+            crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bpp);
+            memcpy(dict + (y - band->y_start + nb_rows) * (row_size + 1), crow, row_size + 1);
+        }
+        deflateSetDictionary(zstream, dict + FFMAX(dict_len - DICT_SIZE, 0),
+                             FFMIN(dict_len, DICT_SIZE));
+        top = pict->data[0] + (band->y_start - 1) * pict->linesize[0];
+    }
+
+    for (y = band->y_start; y < band->y_end; y++) {
+        const uint8_t *ptr = pict->data[0] + y * pict->linesize[0];
+        crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bpp);
+        band->adler    = adler32(band->adler, crow, row_size + 1);
+        band->in_size += row_size + 1;
+        zstream->next_in  = crow;
+        zstream->avail_in = row_size + 1;
+        while (zstream->avail_in > 0) {
+            if (deflate(zstream, Z_NO_FLUSH) != Z_OK || !zstream->avail_out) {
+                ret = AVERROR_EXTERNAL;
+                goto end;
+            }
+        }
+        top = ptr;
+    }
+
+    /* end with a byte aligned empty stored block, so that the bands can be
+     * concatenated, or with the final block */
+    ret = deflate(zstream, flush);
+    if (ret != (flush == Z_FINISH ? Z_STREAM_END : Z_OK) || !zstream->avail_out) {
+        ret = AVERROR_EXTERNAL;
+        goto end;
+    }
+    band->len = band->buf_size - zstream->avail_out;
+    ret = 0;
+
+end:
+    av_free(dict);
+    av_free(crow_base);
+    return ret;
+}
+
+/**
+ * Encode the image data as bands of rows deflated concurrently, joined
+ * into a single zlib stream.
+ */
+static int encode_frame_threaded(AVCodecContext *avctx, const AVFrame *pict,
+                                 int rows_per_band, int nb_bands)
+{
+    PNGEncContext *s = avctx->priv_data;
+    int row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
+    uLong adler  = adler32(0, NULL, 0);
+    uint8_t header[2], trailer[4];
+    int i, level, ret;
+
+    if (nb_bands > s->bands_size) {
+        PNGEncBand *bands = av_realloc_array(s->bands, nb_bands, sizeof(*bands));
+        int *bands_ret;
+
+        if (!bands)
+            return AVERROR(ENOMEM);
+        s->bands = bands;
+        bands_ret = av_realloc_array(s->bands_ret, nb_bands, sizeof(*bands_ret));
+        if (!bands_ret)
+            return AVERROR(ENOMEM);
+        s->bands_ret = bands_ret;
+        memset(s->bands + s->bands_size, 0,
+               (nb_bands - s->bands_size) * sizeof(*s->bands));
+        s->bands_size = nb_bands;
+    }
+
+    for (i = 0; i < nb_bands; i++) {
+        PNGEncBand *band = &s->bands[i];
+        uLong bound;
+
+        band->y_start = i * rows_per_band;
+        band->y_end   = FFMIN(band->y_start + rows_per_band, pict->height);
+        bound = deflateBound(&s->thread_zstreams[0].zstream,
+                             (uLong)(band->y_end - band->y_start) * (row_size + 1));
+        if (bound > INT_MAX - 64)
+            return AVERROR(ENOMEM);
+        av_fast_malloc(&band->buf, &band->buf_size, bound + 64);
+        if (!band->buf)
+            return AVERROR(ENOMEM);
+    }
+
+    s->nb_bands = nb_bands;
+    ret = avctx->execute2(avctx, deflate_band, (void *)pict, s->bands_ret, nb_bands);
+    if (ret < 0)
+        return ret;
+    for (i = 0; i < nb_bands; i++) {
+        if (s->bands_ret[i] < 0)
+            return s->bands_ret[i];
+    }
+
+    /* zlib header as written by deflateInit() */
+    level = avctx->compression_level == FF_COMPRESSION_DEFAULT ? 6 :
+            av_clip(avctx->compression_level, 0, 9);
+    AV_WB16(header, 0x7800 | (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+    AV_WB16(header, AV_RB16(header) + 31 - AV_RB16(header) % 31);
+
+    s->buf_len = 0;
+    png_write_image_bytes(avctx, header, sizeof(header));
+    for (i = 0; i < nb_bands; i++) {
+        png_write_image_bytes(avctx, s->bands[i].buf, s->bands[i].len);
+        adler = adler32_combine(adler, s->bands[i].adler, s->bands[i].in_size);
+    }
+    AV_WB32(trailer, adler);
+    png_write_image_bytes(avctx, trailer, sizeof(trailer));
+    if (s->buf_len > 0 && s->bytestream_end - s->bytestream > s->buf_len + 100)
+        png_write_image_data(avctx, s->buf, s->buf_len);
+
+    return 0;
+}
+
 static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
 {
     PNGEncContext *s       = avctx->priv_data;
@@ -486,6 +685,14 @@ static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
 
     row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
 
+    if (s->nb_thread_zstreams && !s->is_progressive) {
+        int rows_per_band = (BAND_SIZE + row_size) / (row_size + 1);
+        int nb_bands      = (pict->height + rows_per_band - 1) / rows_per_band;
+
+        if (nb_bands > 1)
+            return encode_frame_threaded(avctx, pict, rows_per_band, nb_bands);
+    }
+
     crow_base = av_malloc((row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
     if (!crow_base) {
         ret = AVERROR(ENOMEM);
@@ -1151,6 +1358,20 @@ static av_cold int png_enc_init(AVCodecContext *avctx)
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT
                       ? Z_DEFAULT_COMPRESSION
                       : av_clip(avctx->compression_level, 0, 9);
+
+    if (s->band_deflate &&
+        avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1) {
+        s->thread_zstreams = av_calloc(avctx->thread_count, sizeof(*s->thread_zstreams));
+        if (!s->thread_zstreams)
+            return AVERROR(ENOMEM);
+        for (; s->nb_thread_zstreams < avctx->thread_count; s->nb_thread_zstreams++) {
+            int ret = ff_deflate_init_raw(&s->thread_zstreams[s->nb_thread_zstreams],
+                                          compression_level, avctx);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
     return ff_deflate_init(&s->zstream, compression_level, avctx);
 }
 
@@ -1159,6 +1380,15 @@ static av_cold int png_enc_close(AVCodecContext *avctx)
     PNGEncContext *s = avctx->priv_data;
 
     ff_deflate_end(&s->zstream);
+    for (int i = 0; s->thread_zstreams && i < s->nb_thread_zstreams; i++)
+        ff_deflate_end(&s->thread_zstreams[i]);
+    av_freep(&s->thread_zstreams);
+    s->nb_thread_zstreams = 0;
+    for (int i = 0; i < s->bands_size; i++)
+        av_freep(&s->bands[i].buf);
+    av_freep(&s->bands);
+    av_freep(&s->bands_ret);
+    s->bands_size = 0;
     av_frame_free(&s->last_frame);
     av_frame_free(&s->prev_frame);
     av_freep(&s->last_frame_packet);
@@ -1172,6 +1402,7 @@ static av_cold int png_enc_close(AVCodecContext *avctx)
 static const AVOption options[] = {
     {"dpi", "Set image resolution (in dots per inch)",  OFFSET(dpi), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 0x10000, VE},
     {"dpm", "Set image resolution (in dots per meter)", OFFSET(dpm), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 0x10000, VE},
+    {"band_deflate", "Deflate bands of rows concurrently with slice threads", OFFSET(band_deflate), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, VE},
     { "pred", "Prediction method", OFFSET(filter_type), AV_OPT_TYPE_INT, { .i64 = PNG_FILTER_VALUE_NONE }, PNG_FILTER_VALUE_NONE, PNG_FILTER_VALUE_MIXED, VE, "pred" },
         { "none",  NULL, 0, AV_OPT_TYPE_CONST, { .i64 = PNG_FILTER_VALUE_NONE },  INT_MIN, INT_MAX, VE, "pred" },
         { "sub",   NULL, 0, AV_OPT_TYPE_CONST, { .i64 = PNG_FILTER_VALUE_SUB },   INT_MIN, INT_MAX, VE, "pred" },
@@ -1195,6 +1426,7 @@ const FFCodec ff_png_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_PNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
@@ -1209,7 +1441,7 @@ const FFCodec ff_png_encoder = {
         AV_PIX_FMT_MONOBLACK, AV_PIX_FMT_NONE
     },
     .p.priv_class   = &pngenc_class,
-    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES,
+    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES | FF_CODEC_CAP_INIT_CLEANUP,
 };
 
 const FFCodec ff_apng_encoder = {
@@ -1218,6 +1450,7 @@ const FFCodec ff_apng_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_APNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
@@ -1232,5 +1465,5 @@ const FFCodec ff_apng_encoder = {
         AV_PIX_FMT_NONE
     },
     .p.priv_class   = &pngenc_class,
-    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES,
+    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES | FF_CODEC_CAP_INIT_CLEANUP,
 };
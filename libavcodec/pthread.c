@@ -42,6 +42,7 @@
  * Threading requires more than one thread.
  * Frame threading requires entire frames to be passed to the codec,
  * and introduces extra decoding delay, so is incompatible with low_delay.
+ * Both are used when the user sets frame_threads and the codec supports it.
  *
  * @param avctx The context.
  */
@@ -50,12 +51,19 @@ static void validate_thread_parameters(AVCodecContext *avctx)
     int frame_threading_supported = (avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
                                 && !(avctx->flags  & AV_CODEC_FLAG_LOW_DELAY)
                                 && !(avctx->flags2 & AV_CODEC_FLAG2_CHUNKS);
+    int slice_threading_supported = avctx->codec->capabilities & AV_CODEC_CAP_SLICE_THREADS
+                                && (avctx->thread_type & FF_THREAD_SLICE);
     if (avctx->thread_count == 1) {
         avctx->active_thread_type = 0;
+    } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME) &&
+               slice_threading_supported && avctx->frame_threads > 0 &&
+               ffcodec(avctx->codec)->caps_internal & FF_CODEC_CAP_FRAME_SLICE_THREADS) {
+        /* a single frame thread is plain slice threading */
+        avctx->active_thread_type = avctx->frame_threads > 1 ?
+                                    FF_THREAD_FRAME | FF_THREAD_SLICE : FF_THREAD_SLICE;
     } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
         avctx->active_thread_type = FF_THREAD_FRAME;
-    } else if (avctx->codec->capabilities & AV_CODEC_CAP_SLICE_THREADS &&
-               avctx->thread_type & FF_THREAD_SLICE) {
+    } else if (slice_threading_supported) {
         avctx->active_thread_type = FF_THREAD_SLICE;
     } else if (!(ffcodec(avctx->codec)->caps_internal & FF_CODEC_CAP_AUTO_THREADS)) {
         avctx->thread_count       = 1;
@@ -72,10 +80,10 @@ int ff_thread_init(AVCodecContext *avctx)
 {
     validate_thread_parameters(avctx);
 
-    if (avctx->active_thread_type&FF_THREAD_SLICE)
-        return ff_slice_thread_init(avctx);
-    else if (avctx->active_thread_type&FF_THREAD_FRAME)
+    if (avctx->active_thread_type&FF_THREAD_FRAME)
         return ff_frame_thread_init(avctx);
+    else if (avctx->active_thread_type&FF_THREAD_SLICE)
+        return ff_slice_thread_init(avctx);
 
     return 0;
 }
@@ -83,7 +91,7 @@ int ff_thread_init(AVCodecContext *avctx)
 void ff_thread_free(AVCodecContext *avctx)
 {
     if (avctx->active_thread_type&FF_THREAD_FRAME)
-        ff_frame_thread_free(avctx, avctx->thread_count);
+        ff_frame_thread_free(avctx);
     else
         ff_slice_thread_free(avctx);
 }
@@ -47,6 +47,7 @@
 #include "third_party/ffmpeg/libavutil/mem.h"
 #include "third_party/ffmpeg/libavutil/opt.h"
 #include "third_party/ffmpeg/libavutil/thread.h"
+#include "third_party/ffmpeg/libavutil/time.h"
 
 enum {
     ///< Set when the thread is awaiting a packet.
@@ -104,6 +105,9 @@ typedef struct PerThreadContext {
     int hwaccel_serializing;
     int async_serializing;
 
+    int measure_time;               ///< Set before the thread is started if decode_time is to be measured.
+    int64_t decode_time;            ///< Duration of the last decode() call, only measured with adaptive_frame_threads.
+
     atomic_int debug_threads;       ///< Set if the FF_DEBUG_THREADS option is set.
 } PerThreadContext;
 
@@ -113,6 +117,8 @@ typedef struct PerThreadContext {
 typedef struct FrameThreadContext {
     PerThreadContext *threads;     ///< The contexts for each thread.
     PerThreadContext *prev_thread; ///< The last thread submit_packet() was called on.
+    int nb_threads;                ///< Number of contexts in threads which have been set up.
+    int active_threads;            ///< Number of threads packets are submitted to.
 
     unsigned    pthread_init_cnt;  ///< Number of successfully initialized mutexes/conditions
     pthread_mutex_t buffer_mutex;  ///< Mutex used to protect get/release_buffer().
@@ -125,6 +131,8 @@ typedef struct FrameThreadContext {
     pthread_cond_t async_cond;
     int async_lock;
 
+    int slice_thread_count;        ///< Number of slice threads of each codec thread, 0 if unused.
+
     int next_decoding;             ///< The next context to submit a packet to.
     int next_finished;             ///< The next context to return output from.
 
@@ -133,6 +141,19 @@ typedef struct FrameThreadContext {
                                     * While it is set, ff_thread_en/decode_frame won't return any results.
                                     */
 
+    /**
+     * With AVCodecContext.adaptive_frame_threads, the number of active threads
+     * follows the decoding load measured over at least LOAD_MIN_FRAMES packets.
+     * Only accessed by the user thread; worker threads use measure_time.
+     */
+    int adaptive;
+    int shrink_pending;            ///< Set when the last active thread is to be made idle.
+    int64_t load_start;            ///< Time the load measurement started, 0 if not started.
+    int64_t load_busy;             ///< Decoding time of the frames returned since load_start.
+    int load_frames;               ///< Number of frames returned since load_start.
+    int forced;                    ///< Set when the load is replaced by ff_frame_thread_force_adapt().
+    int forced_delta;              ///< Threads still to be added (> 0) or made idle (< 0) when forced.
+
     /* hwaccel state is temporarily stored here in order to transfer its ownership
      * to the next decoding thread without the need for extra synchronization */
     const AVHWAccel *stash_hwaccel;
@@ -211,7 +232,12 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
 
         av_frame_unref(p->frame);
         p->got_frame = 0;
-        p->result = codec->cb.decode(avctx, p->frame, &p->got_frame, p->avpkt);
+        if (p->measure_time) {
+            int64_t start = av_gettime_relative();
+            p->result = codec->cb.decode(avctx, p->frame, &p->got_frame, p->avpkt);
+            p->decode_time = av_gettime_relative() - start;
+        } else
+            p->result = codec->cb.decode(avctx, p->frame, &p->got_frame, p->avpkt);
 
         if ((p->result < 0 || !p->got_frame) && p->frame->buf[0])
             ff_thread_release_buffer(avctx, p->frame);
@@ -456,12 +482,103 @@ static int submit_packet(PerThreadContext *p, AVCodecContext *user_avctx,
     return 0;
 }
 
+static int init_thread(PerThreadContext *p, int *threads_to_free,
+                       FrameThreadContext *fctx, AVCodecContext *avctx,
+                       const FFCodec *codec, int first);
+
+#define LOAD_MIN_FRAMES 16
+
+/* decoders expect consecutive frames to be decoded by different contexts */
+#define MIN_ACTIVE_THREADS 2
+
+enum {
+    ADAPT_NONE,
+    ADAPT_GROW,     ///< A thread was added, the packet is submitted to it without returning a frame.
+    ADAPT_SHRINK,   ///< The last active thread is made idle, a frame is returned without submitting the packet.
+};
+
+static int add_thread(AVCodecContext *avctx, FrameThreadContext *fctx)
+{
+    int n = fctx->active_threads;
+    int err;
+
+    if (n == fctx->nb_threads) {
+        err = init_thread(&fctx->threads[n], &fctx->nb_threads, fctx,
+                          avctx, ffcodec(avctx->codec), 0);
+        if (err < 0) {
+            av_log(avctx, AV_LOG_WARNING, "Could not add a frame thread, "
+                   "keeping %d threads\n", n);
+            fctx->adaptive = 0;
+            return ADAPT_NONE;
+        }
+    }
+    av_log(avctx, AV_LOG_DEBUG, "Using %d frame threads\n", n + 1);
+    fctx->active_threads = n + 1;
+    fctx->next_decoding  = n;
+    return ADAPT_GROW;
+}
+
+/**
+ * Adjust the number of active threads to the measured decoding load, or as
+ * forced by ff_frame_thread_force_adapt(). The ring of active threads can
+ * only be changed where it wraps around, without reordering the frames being
+ * decoded: a thread is added when the next packet would go to the first
+ * thread, and the last thread is removed when the next packet would go to it.
+ */
+static int adapt_thread_count(AVCodecContext *avctx, FrameThreadContext *fctx)
+{
+    int n = fctx->active_threads;
+    int64_t now;
+
+    if (fctx->shrink_pending && fctx->next_decoding == n - 1) {
+        fctx->shrink_pending = 0;
+        return ADAPT_SHRINK;
+    }
+
+    if (fctx->next_decoding)
+        return ADAPT_NONE;
+
+    if (fctx->forced) {
+        if (fctx->forced_delta > 0 && n < avctx->thread_count) {
+            fctx->forced_delta--;
+            return add_thread(avctx, fctx);
+        }
+        if (fctx->forced_delta < 0 && n > MIN_ACTIVE_THREADS) {
+            fctx->forced_delta++;
+            fctx->shrink_pending = 1;
+        }
+        return ADAPT_NONE;
+    }
+
+    now = av_gettime_relative();
+    if (fctx->load_start && fctx->load_frames < LOAD_MIN_FRAMES)
+        return ADAPT_NONE;
+
+    if (fctx->load_start) {
+        /* the load is the average number of frames decoded at once */
+        int64_t elapsed = FFMAX(now - fctx->load_start, 1);
+        int64_t busy    = fctx->load_busy;
+
+        fctx->load_start = 0;
+        if (n < avctx->thread_count && busy * 10 > elapsed * n * 9)
+            return add_thread(avctx, fctx);
+        if (n > MIN_ACTIVE_THREADS && busy * 4 < elapsed * (n - 1) * 3)
+            fctx->shrink_pending = 1;
+    }
+    fctx->load_start  = now;
+    fctx->load_busy   = 0;
+    fctx->load_frames = 0;
+
+    return ADAPT_NONE;
+}
+
 int ff_thread_decode_frame(AVCodecContext *avctx,
                            AVFrame *picture, int *got_picture_ptr,
                            AVPacket *avpkt)
 {
     FrameThreadContext *fctx = avctx->internal->thread_ctx;
     int finished = fctx->next_finished;
+    int adapt = ADAPT_NONE;
     PerThreadContext *p;
     int err;
 
@@ -469,20 +586,37 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
      * go forward while we are in this function */
     async_unlock(fctx);
 
+    if (fctx->adaptive && !fctx->delaying && avpkt->size)
+        adapt = adapt_thread_count(avctx, fctx);
+
     /*
      * Submit a packet to the next decoding thread.
      */
 
-    p = &fctx->threads[fctx->next_decoding];
-    err = submit_packet(p, avctx, avpkt);
-    if (err)
+    if (adapt != ADAPT_SHRINK) {
+        p = &fctx->threads[fctx->next_decoding];
+        err = submit_packet(p, avctx, avpkt);
+        if (err)
+            goto finish;
+    }
+
+    /*
+     * If a thread was just added, its frame is returned after those of the
+     * other threads, so the packet only fills the pipeline.
+     */
+
+    if (adapt == ADAPT_GROW) {
+        fctx->next_decoding = 0;
+        *got_picture_ptr = 0;
+        err = avpkt->size;
         goto finish;
+    }
 
     /*
      * If we're still receiving the initial packets, don't return a frame.
      */
 
-    if (fctx->next_decoding > (avctx->thread_count-1-(avctx->codec_id == AV_CODEC_ID_FFV1)))
+    if (fctx->next_decoding > (fctx->active_threads-1-(avctx->codec_id == AV_CODEC_ID_FFV1)))
         fctx->delaying = 0;
 
     if (fctx->delaying) {
@@ -514,6 +648,8 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
         *got_picture_ptr = p->got_frame;
         picture->pkt_dts = p->avpkt->dts;
         err = p->result;
+        fctx->load_busy += p->decode_time;
+        fctx->load_frames++;
 
         /*
          * A later call with avkpt->size == 0 may loop over all threads,
@@ -524,23 +660,56 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
         p->got_frame = 0;
         p->result = 0;
 
-        if (finished >= avctx->thread_count) finished = 0;
+        if (finished >= fctx->active_threads) finished = 0;
     } while (!avpkt->size && !*got_picture_ptr && err >= 0 && finished != fctx->next_finished);
 
     update_context_from_thread(avctx, p->avctx, 1);
 
-    if (fctx->next_decoding >= avctx->thread_count) fctx->next_decoding = 0;
+    if (adapt == ADAPT_SHRINK && err < 0) {
+        /* the packet would be dropped along with the error, submit it */
+        int ret = submit_packet(&fctx->threads[fctx->next_decoding], avctx, avpkt);
+        if (ret)
+            err = ret;
+        adapt = ADAPT_NONE;
+    }
+
+    if (adapt == ADAPT_SHRINK) {
+        /* the last thread is idle and its frame was returned in the last
+         * round, drop its references until it is used again */
+        PerThreadContext *idle = &fctx->threads[--fctx->active_threads];
+
+        av_log(avctx, AV_LOG_DEBUG, "Using %d frame threads\n", fctx->active_threads);
+        if (ffcodec(avctx->codec)->flush)
+            ffcodec(avctx->codec)->flush(idle->avctx);
+        fctx->next_decoding = 0;
+    }
+
+    if (fctx->next_decoding >= fctx->active_threads) fctx->next_decoding = 0;
 
     fctx->next_finished = finished;
 
-    /* return the size of the consumed packet if no error occurred */
+    /* return the size of the consumed packet if no error occurred,
+     * the packet is kept by the caller if it was not submitted */
     if (err >= 0)
-        err = avpkt->size;
+        err = adapt == ADAPT_SHRINK ? 0 : avpkt->size;
 finish:
     async_lock(fctx);
     return err;
 }
 
+int ff_frame_thread_force_adapt(AVCodecContext *avctx, int delta)
+{
+    FrameThreadContext *fctx = avctx->internal->thread_ctx;
+
+    if (!(avctx->active_thread_type & FF_THREAD_FRAME) || !fctx->adaptive)
+        return AVERROR(EINVAL);
+
+    fctx->forced        = 1;
+    fctx->forced_delta += delta;
+
+    return fctx->active_threads;
+}
+
 void ff_thread_report_progress(ThreadFrame *f, int n, int field)
 {
     PerThreadContext *p;
@@ -656,15 +825,15 @@ DEFINE_OFFSET_ARRAY(PerThreadContext, per_thread, pthread_init_cnt,
                     (OFF(input_cond), OFF(progress_cond), OFF(output_cond)));
 #undef OFF
 
-void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
+void ff_frame_thread_free(AVCodecContext *avctx)
 {
     FrameThreadContext *fctx = avctx->internal->thread_ctx;
     const FFCodec *codec = ffcodec(avctx->codec);
     int i;
 
-    park_frame_worker_threads(fctx, thread_count);
+    park_frame_worker_threads(fctx, fctx->nb_threads);
 
-    for (i = 0; i < thread_count; i++) {
+    for (i = 0; i < fctx->nb_threads; i++) {
         PerThreadContext *p = &fctx->threads[i];
         AVCodecContext *ctx = p->avctx;
 
@@ -677,6 +846,8 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
 
                 pthread_join(p->thread, NULL);
             }
+            if (ctx->internal->slice_thread_ctx)
+                ff_slice_thread_free(ctx);
             if (codec->close && p->thread_init != UNINITIALIZED)
                 codec->close(ctx);
 
@@ -715,9 +886,9 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
     av_freep(&avctx->internal->thread_ctx);
 }
 
-static av_cold int init_thread(PerThreadContext *p, int *threads_to_free,
-                               FrameThreadContext *fctx, AVCodecContext *avctx,
-                               const FFCodec *codec, int first)
+static int init_thread(PerThreadContext *p, int *threads_to_free,
+                       FrameThreadContext *fctx, AVCodecContext *avctx,
+                       const FFCodec *codec, int first)
 {
     AVCodecContext *copy;
     int err;
@@ -727,7 +898,10 @@ static av_cold int init_thread(PerThreadContext *p, int *threads_to_free,
     copy = av_memdup(avctx, sizeof(*avctx));
     if (!copy)
         return AVERROR(ENOMEM);
-    copy->priv_data = NULL;
+    copy->priv_data     = NULL;
+    copy->slice_offset  = NULL;
+    copy->slice_count   = 0;
+    copy->hw_frames_ctx = NULL;
 
     /* From now on, this PerThreadContext will be cleaned up by
      * ff_frame_thread_free in case of errors. */
@@ -735,12 +909,19 @@ static av_cold int init_thread(PerThreadContext *p, int *threads_to_free,
 
     p->parent = fctx;
     p->avctx  = copy;
+    p->measure_time = fctx->adaptive;
 
     copy->internal = av_mallocz(sizeof(*copy->internal));
     if (!copy->internal)
         return AVERROR(ENOMEM);
     copy->internal->thread_ctx = p;
 
+    if (avctx->hw_frames_ctx) {
+        copy->hw_frames_ctx = av_buffer_ref(avctx->hw_frames_ctx);
+        if (!copy->hw_frames_ctx)
+            return AVERROR(ENOMEM);
+    }
+
     copy->delay = avctx->delay;
 
     if (codec->priv_data_size) {
@@ -767,6 +948,15 @@ static av_cold int init_thread(PerThreadContext *p, int *threads_to_free,
     if (!first)
         copy->internal->is_copy = 1;
 
+    if (fctx->slice_thread_count) {
+        copy->thread_count = fctx->slice_thread_count;
+        err = ff_slice_thread_init(copy);
+        if (err < 0)
+            return err;
+        /* slice threading may have been disabled, frame threading is not */
+        copy->active_thread_type |= FF_THREAD_FRAME;
+    }
+
     copy->internal->last_pkt_props = av_packet_alloc();
     if (!copy->internal->last_pkt_props)
         return AVERROR(ENOMEM);
@@ -799,7 +989,7 @@ int ff_frame_thread_init(AVCodecContext *avctx)
     int thread_count = avctx->thread_count;
     const FFCodec *codec = ffcodec(avctx->codec);
     FrameThreadContext *fctx;
-    int err, i = 0;
+    int err, i;
 
     if (!thread_count) {
         int nb_cpus = av_cpu_count();
@@ -819,6 +1009,20 @@ int ff_frame_thread_init(AVCodecContext *avctx)
     if (!fctx)
         return AVERROR(ENOMEM);
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE) {
+        /* split the threads between frame_threads codec threads, each with
+         * its own slice threads */
+        int frame_threads = FFMIN(avctx->frame_threads, thread_count);
+
+        if (thread_count / frame_threads > 1) {
+            fctx->slice_thread_count = thread_count / frame_threads;
+            thread_count = avctx->thread_count = frame_threads;
+            av_log(avctx, AV_LOG_DEBUG, "Using %d frame threads with %d slice threads each\n",
+                   thread_count, fctx->slice_thread_count);
+        } else
+            avctx->active_thread_type = FF_THREAD_FRAME;
+    }
+
     err = ff_pthread_init(fctx, thread_ctx_offsets);
     if (err < 0) {
         ff_pthread_free(fctx, thread_ctx_offsets);
@@ -829,6 +1033,10 @@ int ff_frame_thread_init(AVCodecContext *avctx)
     fctx->async_lock = 1;
     fctx->delaying = 1;
 
+    fctx->adaptive       = avctx->adaptive_frame_threads;
+    fctx->active_threads = fctx->adaptive ? FFMIN(MIN_ACTIVE_THREADS, thread_count)
+                                          : thread_count;
+
     if (codec->p.type == AVMEDIA_TYPE_VIDEO)
         avctx->delay = avctx->thread_count - 1;
 
@@ -838,11 +1046,11 @@ int ff_frame_thread_init(AVCodecContext *avctx)
         goto error;
     }
 
-    for (; i < thread_count; ) {
+    for (i = 0; i < fctx->active_threads; i++) {
         PerThreadContext *p  = &fctx->threads[i];
         int first = !i;
 
-        err = init_thread(p, &i, fctx, avctx, codec, first);
+        err = init_thread(p, &fctx->nb_threads, fctx, avctx, codec, first);
         if (err < 0)
             goto error;
     }
@@ -850,7 +1058,7 @@ int ff_frame_thread_init(AVCodecContext *avctx)
     return 0;
 
 error:
-    ff_frame_thread_free(avctx, i);
+    ff_frame_thread_free(avctx);
     return err;
 }
 
@@ -861,7 +1069,7 @@ void ff_thread_flush(AVCodecContext *avctx)
 
     if (!fctx) return;
 
-    park_frame_worker_threads(fctx, avctx->thread_count);
+    park_frame_worker_threads(fctx, fctx->nb_threads);
     if (fctx->prev_thread) {
         if (fctx->prev_thread != &fctx->threads[0])
             update_context_from_thread(fctx->threads[0].avctx, fctx->prev_thread->avctx, 0);
@@ -870,8 +1078,13 @@ void ff_thread_flush(AVCodecContext *avctx)
     fctx->next_decoding = fctx->next_finished = 0;
     fctx->delaying = 1;
     fctx->prev_thread = NULL;
-    for (i = 0; i < avctx->thread_count; i++) {
+    fctx->shrink_pending = 0;
+    fctx->load_start = 0;
+    for (i = 0; i < fctx->nb_threads; i++) {
         PerThreadContext *p = &fctx->threads[i];
+
+        if (p->thread_init != INITIALIZED)
+            continue;
         // Make sure decode flush calls with size=0 won't return old frames
         p->got_frame = 0;
         av_frame_unref(p->frame);
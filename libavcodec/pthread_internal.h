@@ -29,7 +29,18 @@ int ff_slice_thread_init(AVCodecContext *avctx);
 void ff_slice_thread_free(AVCodecContext *avctx);
 
 int ff_frame_thread_init(AVCodecContext *avctx);
-void ff_frame_thread_free(AVCodecContext *avctx, int thread_count);
+void ff_frame_thread_free(AVCodecContext *avctx);
+
+/**
+ * Add (delta > 0) or make idle (delta < 0) frame threads of a decoder
+ * opened with adaptive_frame_threads, at the next points where the number
+ * of active threads can change, instead of following the decoding load.
+ * The load is no longer measured afterwards. Only meant for testing.
+ *
+ * @return the current number of active frame threads or a negative error
+ *         code if the number of frame threads is not adaptive
+ */
+int ff_frame_thread_force_adapt(AVCodecContext *avctx, int delta);
 
 #define THREAD_SENTINEL 0 // This forbids putting a mutex/condition variable at the front.
 /**
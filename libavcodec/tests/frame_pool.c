@@ -0,0 +1,191 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "third_party/ffmpeg/libavutil/adler32.h"
+#include "third_party/ffmpeg/libavutil/error.h"
+#include "third_party/ffmpeg/libavutil/frame.h"
+#include "third_party/ffmpeg/libavcodec/avcodec.h"
+
+#define WIDTH     64
+#define HEIGHT    48
+#define NB_FRAMES 6
+
+static int encode_frames(AVPacket **pkts)
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    AVCodecContext *enc;
+    AVFrame *frame;
+    int ret;
+
+    if (!codec)
+        return AVERROR_ENCODER_NOT_FOUND;
+    enc   = avcodec_alloc_context3(codec);
+    frame = av_frame_alloc();
+    if (!enc || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    enc->width     = WIDTH;
+    enc->height    = HEIGHT;
+    enc->pix_fmt   = AV_PIX_FMT_RGB24;
+    enc->time_base = (AVRational){ 1, 25 };
+    if ((ret = avcodec_open2(enc, codec, NULL)) < 0)
+        goto end;
+
+    frame->width  = WIDTH;
+    frame->height = HEIGHT;
+    frame->format = AV_PIX_FMT_RGB24;
+    if ((ret = av_frame_get_buffer(frame, 0)) < 0)
+        goto end;
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        for (int y = 0; y < HEIGHT; y++)
+            for (int x = 0; x < WIDTH * 3; x++)
+                frame->data[0][y * frame->linesize[0] + x] = x * (i + 1) + y * 3;
+        frame->pts = i;
+        pkts[i] = av_packet_alloc();
+        if (!pkts[i]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = avcodec_send_frame(enc, frame)) < 0 ||
+            (ret = avcodec_receive_packet(enc, pkts[i])) < 0)
+            goto end;
+    }
+
+end:
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    return ret;
+}
+
+/* Decode the packets alternately with two decoders, returning the
+ * checksums of the frames and, for each frame, the decoder which got its
+ * buffer first, or -1 if the buffer is new. */
+static int decode_frames(AVPacket **pkts, int shared, uint32_t *sums, int *owner)
+{
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_PNG);
+    AVCodecContext *dec[2] = { NULL };
+    AVBufferRef *pool = NULL;
+    AVFrame *frame;
+    const uint8_t *seen[NB_FRAMES];
+    int ret = 0;
+
+    if (!codec)
+        return AVERROR_DECODER_NOT_FOUND;
+    frame = av_frame_alloc();
+    if (!frame)
+        return AVERROR(ENOMEM);
+    if (shared) {
+        pool = avcodec_frame_pool_alloc();
+        if (!pool) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        dec[i] = avcodec_alloc_context3(codec);
+        if (!dec[i]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if (pool) {
+            dec[i]->frame_pool = av_buffer_ref(pool);
+            if (!dec[i]->frame_pool) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+        }
+        if ((ret = avcodec_open2(dec[i], codec, NULL)) < 0)
+            goto end;
+    }
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        if ((ret = avcodec_send_packet(dec[i & 1], pkts[i])) < 0 ||
+            (ret = avcodec_receive_frame(dec[i & 1], frame)) < 0)
+            goto end;
+
+        sums[i] = av_adler32_update(0, NULL, 0);
+        for (int y = 0; y < frame->height; y++)
+            sums[i] = av_adler32_update(sums[i], frame->data[0] + y * frame->linesize[0],
+                                        frame->width * 3);
+        owner[i] = -1;
+        for (int j = 0; j < i; j++) {
+            if (seen[j] == frame->buf[0]->data) {
+                owner[i] = owner[j] < 0 ? j & 1 : owner[j];
+                break;
+            }
+        }
+        seen[i] = frame->buf[0]->data;
+        av_frame_unref(frame);
+    }
+
+end:
+    for (int i = 0; i < 2; i++)
+        avcodec_free_context(&dec[i]);
+    av_buffer_unref(&pool);
+    av_frame_free(&frame);
+    return ret;
+}
+
+int main(void)
+{
+    AVPacket *pkts[NB_FRAMES] = { NULL };
+    uint32_t sums[2][NB_FRAMES];
+    int owner[2][NB_FRAMES];
+    int ret, errors = 0;
+
+    ret = encode_frames(pkts);
+    if (ret < 0) {
+        fprintf(stderr, "Encoding failed: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    for (int shared = 0; shared < 2; shared++) {
+        ret = decode_frames(pkts, shared, sums[shared], owner[shared]);
+        if (ret < 0) {
+            fprintf(stderr, "Decoding failed: %s\n", av_err2str(ret));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        if (owner[1][i] < 0)
+            printf("frame %d: decoder %d, adler32 0x%08"PRIx32", new buffer\n",
+                   i, i & 1, sums[1][i]);
+        else
+            printf("frame %d: decoder %d, adler32 0x%08"PRIx32", buffer of decoder %d\n",
+                   i, i & 1, sums[1][i], owner[1][i]);
+        if (sums[1][i] != sums[0][i]) {
+            printf("frame %d: differs from the output without a shared pool\n", i);
+            errors++;
+        }
+        if (owner[0][i] >= 0 && owner[0][i] != (i & 1)) {
+            printf("frame %d: buffer of the other decoder without a shared pool\n", i);
+            errors++;
+        }
+    }
+
+    for (int i = 0; i < NB_FRAMES; i++)
+        av_packet_free(&pkts[i]);
+    return !!errors;
+}
@@ -0,0 +1,173 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Decode a raw H.264 stream with adaptive frame threads, adding and removing
+ * threads on a fixed schedule, and print the frames in the framecrc format.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "third_party/ffmpeg/libavutil/adler32.h"
+#include "third_party/ffmpeg/libavutil/error.h"
+#include "third_party/ffmpeg/libavutil/file.h"
+#include "third_party/ffmpeg/libavutil/frame.h"
+#include "third_party/ffmpeg/libavutil/imgutils.h"
+#include "third_party/ffmpeg/libavutil/macros.h"
+#include "third_party/ffmpeg/libavutil/mem.h"
+#include "third_party/ffmpeg/libavcodec/avcodec.h"
+#include "third_party/ffmpeg/libavcodec/pthread_internal.h"
+
+#define MAX_THREADS 4
+
+/* frame threads to add (> 0) or make idle (< 0) after the given packet */
+static const struct {
+    int packet;
+    int delta;
+} schedule[] = {
+    {  30,  2 },
+    { 100, -2 },
+    { 150,  1 },
+    { 200, -1 },
+};
+
+static int output_frames(AVCodecContext *dec, AVFrame *frame, int64_t *nb_frames,
+                         uint8_t **buf, int *buf_size)
+{
+    int ret, size;
+
+    while ((ret = avcodec_receive_frame(dec, frame)) >= 0) {
+        size = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+        if (size < 0)
+            return size;
+        if (size > *buf_size) {
+            av_freep(buf);
+            *buf = av_malloc(size);
+            if (!*buf)
+                return AVERROR(ENOMEM);
+            *buf_size = size;
+        }
+        ret = av_image_copy_to_buffer(*buf, size, (const uint8_t * const *)frame->data,
+                                      frame->linesize, frame->format,
+                                      frame->width, frame->height, 1);
+        if (ret < 0)
+            return ret;
+
+        if (!*nb_frames)
+            printf("#tb 0: 1/25\n#media_type 0: video\n#codec_id 0: rawvideo\n"
+                   "#dimensions 0: %dx%d\n#sar 0: %d/%d\n",
+                   frame->width, frame->height,
+                   frame->sample_aspect_ratio.num, frame->sample_aspect_ratio.den);
+        printf("0, %10"PRId64", %10"PRId64", %8d, %8d, 0x%08"PRIx32"\n",
+               *nb_frames, *nb_frames, 1, size, av_adler32_update(0, *buf, size));
+        (*nb_frames)++;
+        av_frame_unref(frame);
+    }
+
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+int main(int argc, char **argv)
+{
+    const AVCodec *codec;
+    AVCodecParserContext *parser = NULL;
+    AVCodecContext *dec = NULL;
+    AVPacket *pkt = NULL;
+    AVFrame *frame = NULL;
+    uint8_t *data = NULL, *buf = NULL;
+    size_t data_size = 0, pos = 0;
+    int64_t nb_frames = 0;
+    int nb_packets = 0, next = 0, buf_size = 0;
+    int min_threads = MAX_THREADS, max_threads = 0;
+    int ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file>\n", argv[0]);
+        return 1;
+    }
+
+    ret = av_file_map(argv[1], &data, &data_size, 0, NULL);
+    if (ret < 0)
+        goto end;
+
+    codec  = avcodec_find_decoder(AV_CODEC_ID_H264);
+    parser = av_parser_init(AV_CODEC_ID_H264);
+    dec    = codec ? avcodec_alloc_context3(codec) : NULL;
+    pkt    = av_packet_alloc();
+    frame  = av_frame_alloc();
+    if (!codec || !parser || !dec || !pkt || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    dec->thread_count           = MAX_THREADS;
+    dec->thread_type            = FF_THREAD_FRAME;
+    dec->adaptive_frame_threads = 1;
+    if ((ret = avcodec_open2(dec, codec, NULL)) < 0)
+        goto end;
+
+    for (;;) {
+        /* the parser is flushed once all the data is passed */
+        int eof = pos == data_size;
+
+        pos += av_parser_parse2(parser, dec, &pkt->data, &pkt->size,
+                                data + pos, data_size - pos,
+                                AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if (!pkt->size) {
+            if (eof)
+                break;
+            continue;
+        }
+
+        if ((ret = avcodec_send_packet(dec, pkt)) < 0 ||
+            (ret = output_frames(dec, frame, &nb_frames, &buf, &buf_size)) < 0)
+            goto end;
+        nb_packets++;
+
+        ret = ff_frame_thread_force_adapt(dec, 0);
+        if (ret < 0)
+            goto end;
+        min_threads = FFMIN(min_threads, ret);
+        max_threads = FFMAX(max_threads, ret);
+        if (next < FF_ARRAY_ELEMS(schedule) && schedule[next].packet == nb_packets)
+            ff_frame_thread_force_adapt(dec, schedule[next++].delta);
+    }
+
+    if ((ret = avcodec_send_packet(dec, NULL)) < 0 ||
+        (ret = output_frames(dec, frame, &nb_frames, &buf, &buf_size)) < 0)
+        goto end;
+
+    /* the schedule must have gone through both two and four threads */
+    if (min_threads != 2 || max_threads != MAX_THREADS) {
+        fprintf(stderr, "Used between %d and %d frame threads\n",
+                min_threads, max_threads);
+        ret = AVERROR_BUG;
+    }
+
+end:
+    if (ret < 0)
+        fprintf(stderr, "Error: %s\n", av_err2str(ret));
+    av_parser_close(parser);
+    avcodec_free_context(&dec);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    av_freep(&buf);
+    if (data)
+        av_file_unmap(data, data_size);
+    return ret < 0;
+}
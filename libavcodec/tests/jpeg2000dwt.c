@@ -31,6 +31,25 @@
 
 #define MAX_W 256
 
+static int   slice_array [MAX_W * MAX_W];
+static float slice_arrayf[MAX_W * MAX_W];
+
+/* Run the inverse transform in slices, in reverse order to check that
+ * they are independent. */
+static int decode_slices(DWTContext *s, void *t, int nb_slices)
+{
+    void *linebuf = av_malloc(ff_dwt_linebuf_size(s));
+    int pass, slice, ret = 0;
+
+    if (!linebuf)
+        return AVERROR(ENOMEM);
+    for (pass = 0; pass < ff_dwt_decode_nb_passes(s) && ret >= 0; pass++)
+        for (slice = nb_slices - 1; slice >= 0 && ret >= 0; slice--)
+            ret = ff_dwt_decode_slice(s, t, pass, slice, nb_slices, linebuf);
+    av_free(linebuf);
+    return ret;
+}
+
 static int test_dwt(int *array, int *ref, int border[2][2], int decomp_levels, int type, int max_diff) {
     int ret, j;
     DWTContext s1={{{0}}}, *s= &s1;
@@ -46,11 +65,21 @@ static int test_dwt(int *array, int *ref, int border[2][2], int decomp_levels, i
         fprintf(stderr, "ff_dwt_encode failed\n");
         return 1;
     }
+    memcpy(slice_array, array, sizeof(slice_array));
     ret = ff_dwt_decode(s, array);
     if (ret < 0) {
         fprintf(stderr, "ff_dwt_encode failed\n");
         return 1;
     }
+    ret = decode_slices(s, slice_array, 3);
+    if (ret < 0) {
+        fprintf(stderr, "ff_dwt_decode_slice failed\n");
+        return 1;
+    }
+    if (memcmp(slice_array, array, sizeof(slice_array))) {
+        fprintf(stderr, "sliced decode mismatch decomp:%d\n", decomp_levels);
+        return 2;
+    }
     for (j = 0; j<MAX_W * MAX_W; j++) {
         if (FFABS(array[j] - ref[j]) > max_diff) {
             fprintf(stderr, "missmatch at %d (%d != %d) decomp:%d border %d %d %d %d\n",
@@ -85,11 +114,21 @@ static int test_dwtf(float *array, float *ref, int border[2][2], int decomp_leve
         fprintf(stderr, "ff_dwt_encode failed\n");
         return 1;
     }
+    memcpy(slice_arrayf, array, sizeof(slice_arrayf));
     ret = ff_dwt_decode(s, array);
     if (ret < 0) {
         fprintf(stderr, "ff_dwt_encode failed\n");
         return 1;
     }
+    ret = decode_slices(s, slice_arrayf, 3);
+    if (ret < 0) {
+        fprintf(stderr, "ff_dwt_decode_slice failed\n");
+        return 1;
+    }
+    if (memcmp(slice_arrayf, array, sizeof(slice_arrayf))) {
+        fprintf(stderr, "sliced decode mismatch decomp:%d\n", decomp_levels);
+        return 2;
+    }
     for (j = 0; j<MAX_W * MAX_W; j++) {
         if (FFABS(array[j] - ref[j]) > max_diff) {
             fprintf(stderr, "missmatch at %d (%f != %f) decomp:%d border %d %d %d %d\n",
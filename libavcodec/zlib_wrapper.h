@@ -53,6 +53,12 @@ void ff_inflate_end(FFZStream *zstream);
  */
 int ff_deflate_init(FFZStream *zstream, int level, void *logctx);
 
+/**
+ * Like ff_deflate_init(), but for a raw deflate stream without zlib header
+ * and trailer.
+ */
+int ff_deflate_init_raw(FFZStream *zstream, int level, void *logctx);
+
 /**
  * Wrapper around deflateEnd(). It works analogously to ff_inflate_end().
  */
@@ -44,7 +44,7 @@ static const AVFilterPad avfilter_af_anull_outputs[] = {
 const AVFilter ff_af_anull = {
     .name          = "anull",
     .description   = NULL_IF_CONFIG_SMALL("Pass the source unchanged to the output."),
-    .flags         = AVFILTER_FLAG_METADATA_ONLY,
+    .flags         = AVFILTER_FLAG_METADATA_ONLY | AVFILTER_FLAG_GRAPH_THREADS,
     FILTER_INPUTS(avfilter_af_anull_inputs),
     FILTER_OUTPUTS(avfilter_af_anull_outputs),
 };
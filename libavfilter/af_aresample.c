@@ -345,4 +345,5 @@ const AVFilter ff_af_aresample = {
     FILTER_INPUTS(aresample_inputs),
     FILTER_OUTPUTS(aresample_outputs),
     FILTER_QUERY_FUNC(query_formats),
+    .flags         = AVFILTER_FLAG_GRAPH_THREADS,
 };
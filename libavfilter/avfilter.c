@@ -33,6 +33,7 @@
 #include "third_party/ffmpeg/libavutil/pixdesc.h"
 #include "third_party/ffmpeg/libavutil/rational.h"
 #include "third_party/ffmpeg/libavutil/samplefmt.h"
+#include "third_party/ffmpeg/libavutil/time.h"
 
 #define FF_INTERNAL_FIELDS 1
 #include "framequeue.h"
@@ -203,6 +204,15 @@ void avfilter_link_free(AVFilterLink **link)
 
 void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
 {
+    /* filters activated concurrently may share neighbours */
+    if (filter->graph && filter->graph->internal->sched_running) {
+        AVFilterGraphInternal *gi = filter->graph->internal;
+
+        ff_mutex_lock(&gi->ready_lock);
+        filter->ready = FFMAX(filter->ready, priority);
+        ff_mutex_unlock(&gi->ready_lock);
+        return;
+    }
     filter->ready = FFMAX(filter->ready, priority);
 }
 
@@ -214,10 +224,28 @@ static void filter_unblock(AVFilterContext *filter)
 {
     unsigned i;
 
+    /* filters activated concurrently may share successors, their outputs
+     * are then unblocked by the scheduling thread */
+    if (filter->graph && filter->graph->internal->sched_running) {
+        AVFilterGraphInternal *gi = filter->graph->internal;
+
+        ff_mutex_lock(&gi->ready_lock);
+        filter->internal->unblock_pending = 1;
+        ff_mutex_unlock(&gi->ready_lock);
+        return;
+    }
     for (i = 0; i < filter->nb_outputs; i++)
         filter->outputs[i]->frame_blocked_in = 0;
 }
 
+void ff_filter_unblock_pending(AVFilterContext *filter)
+{
+    if (!filter->internal->unblock_pending)
+        return;
+    filter->internal->unblock_pending = 0;
+    filter_unblock(filter);
+}
+
 
 void ff_avfilter_link_set_in_status(AVFilterLink *link, int status, int64_t pts)
 {
@@ -600,8 +628,9 @@ static const AVClass *filter_child_class_iterate(void **iter)
 #define TFLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_RUNTIME_PARAM
 static const AVOption avfilter_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
-        { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, FLAGS, "thread_type" },
+        { .i64 = AVFILTER_THREAD_SLICE | AVFILTER_THREAD_FRAME }, 0, INT_MAX, FLAGS, "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = FLAGS, .unit = "thread_type" },
+        { "frame", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_FRAME }, .flags = FLAGS, .unit = "thread_type" },
     { "enable", "set enable expression", OFFSET(enable_str), AV_OPT_TYPE_STRING, {.str=NULL}, .flags = TFLAGS },
     { "threads", "Allowed number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, FLAGS },
@@ -867,7 +896,12 @@ int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
         return ret;
     }
 
-    if (ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
+    if (ctx->filter->flags & AVFILTER_FLAG_FRAME_THREADS &&
+        ctx->thread_type & ctx->graph->thread_type & AVFILTER_THREAD_FRAME &&
+        ctx->graph->internal->thread_execute && ff_filter_get_nb_threads(ctx) > 1) {
+        /* slices are processed serially within each frame thread */
+        ctx->thread_type = AVFILTER_THREAD_FRAME;
+    } else if (ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
         ctx->thread_type & ctx->graph->thread_type & AVFILTER_THREAD_SLICE &&
         ctx->graph->internal->thread_execute) {
         ctx->thread_type       = AVFILTER_THREAD_SLICE;
@@ -1308,8 +1342,19 @@ int ff_filter_activate(AVFilterContext *filter)
     av_assert1(!(filter->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC &&
                  filter->filter->activate));
     filter->ready = 0;
-    ret = filter->filter->activate ? filter->filter->activate(filter) :
-          ff_filter_activate_default(filter);
+    if (filter->graph->enable_stats) {
+        AVFilterStats *stats = &filter->internal->stats;
+        int64_t start = av_gettime_relative();
+
+        ret = filter->filter->activate ? filter->filter->activate(filter) :
+              ff_filter_activate_default(filter);
+
+        stats->activate_time += av_gettime_relative() - start;
+        stats->nb_activations++;
+    } else {
+        ret = filter->filter->activate ? filter->filter->activate(filter) :
+              ff_filter_activate_default(filter);
+    }
     if (ret == FFERROR_NOT_READY)
         ret = 0;
     return ret;
@@ -1330,6 +1375,30 @@ int ff_inlink_acknowledge_status(AVFilterLink *link, int *rstatus, int64_t *rpts
     return 1;
 }
 
+const AVFilterStats *avfilter_get_stats(AVFilterContext *filter)
+{
+    AVFilterStats *stats = &filter->internal->stats;
+
+    if (!filter->graph || !filter->graph->enable_stats)
+        return NULL;
+
+    stats->frames_in  = 0;
+    stats->frames_out = 0;
+    for (unsigned i = 0; i < filter->nb_inputs; i++)
+        if (filter->inputs[i])
+            stats->frames_in  += filter->inputs[i]->frame_count_out;
+    for (unsigned i = 0; i < filter->nb_outputs; i++)
+        if (filter->outputs[i])
+            stats->frames_out += filter->outputs[i]->frame_count_in;
+
+    return stats;
+}
+
+size_t avfilter_link_get_max_queued_frames(const AVFilterLink *link)
+{
+    return link->fifo.max_queued;
+}
+
 size_t ff_inlink_queued_frames(AVFilterLink *link)
 {
     return ff_framequeue_queued_frames(&link->fifo);
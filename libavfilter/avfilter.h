@@ -131,6 +131,18 @@ enum AVMediaType avfilter_pad_get_type(const AVFilterPad *pads, int pad_idx);
  *   received by the filter on one of its inputs.
  */
 #define AVFILTER_FLAG_METADATA_ONLY         (1 << 3)
+/**
+ * The filter may be activated concurrently with other filters of the same
+ * graph when graph threading (AVFILTER_THREAD_GRAPH) is enabled. This means
+ * that activating it does not touch any state shared with other filter
+ * instances, other than through its own links.
+ */
+#define AVFILTER_FLAG_GRAPH_THREADS         (1 << 4)
+/**
+ * The filter supports multithreading by computing several output frames
+ * concurrently when frame threading (AVFILTER_THREAD_FRAME) is enabled.
+ */
+#define AVFILTER_FLAG_FRAME_THREADS         (1 << 5)
 /**
  * Some filters support a generic "enable" expression option that can be used
  * to enable or disable a filter in the timeline. Filters supporting this
@@ -385,6 +397,21 @@ unsigned avfilter_filter_pad_count(const AVFilter *filter, int is_output);
  * Process multiple parts of the frame concurrently.
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
+/**
+ * Activate filters of the graph that do not depend on each other, e.g. the
+ * branches after a split, concurrently. Only filters flagged with
+ * AVFILTER_FLAG_GRAPH_THREADS are activated concurrently, the others are
+ * always activated alone. Only available with the internal threading
+ * implementation, i.e. when AVFilterGraph.execute is not set.
+ */
+#define AVFILTER_THREAD_GRAPH (1 << 1)
+/**
+ * Process multiple frames concurrently in filters flagged with
+ * AVFILTER_FLAG_FRAME_THREADS. This delays the output of such filters by up
+ * to the number of threads frames. Those filters then do not use slice
+ * threading.
+ */
+#define AVFILTER_THREAD_FRAME (1 << 2)
 
 typedef struct AVFilterInternal AVFilterInternal;
 
@@ -908,6 +935,14 @@ typedef struct AVFilterGraph {
 
     char *aresample_swr_opts; ///< swr options to use for the auto-inserted aresample filters, Access ONLY through AVOptions
 
+    /**
+     * Gather execution statistics for the filters in this graph, see
+     * avfilter_get_stats(). Should be set by the caller before the graph is
+     * run, e.g. through the "stats" option. Gathering statistics adds two
+     * clock reads to every filter activation.
+     */
+    int enable_stats;
+
     /**
      * Private fields
      *
@@ -1454,9 +1489,54 @@ int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const
 int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const char *cmd, const char *arg, int flags, double ts);
 
 
+/**
+ * Execution statistics of a filter instance.
+ *
+ * New fields may be added to the end with a minor version bump.
+ */
+typedef struct AVFilterStats {
+    /**
+     * Number of times the filter was run by the graph scheduler.
+     */
+    uint64_t nb_activations;
+    /**
+     * Wall clock time spent running the filter, in microseconds. Work done
+     * by slice threads on behalf of the filter is included.
+     */
+    int64_t activate_time;
+    /**
+     * Number of frames taken from all inputs of the filter.
+     */
+    int64_t frames_in;
+    /**
+     * Number of frames sent to all outputs of the filter.
+     */
+    int64_t frames_out;
+} AVFilterStats;
+
+/**
+ * Get the execution statistics of a filter.
+ *
+ * @param filter a filter in a graph with AVFilterGraph.enable_stats set
+ * @return the statistics of the filter, owned by it and valid until the
+ *         next call to this function or until the filter is freed; NULL if
+ *         statistics are not gathered for the graph of the filter
+ */
+const AVFilterStats *avfilter_get_stats(AVFilterContext *filter);
+
+/**
+ * Get the highest number of frames queued on a link at any time, i.e. the
+ * number of frames the source filter of the link produced ahead of its
+ * destination filter consuming them.
+ */
+size_t avfilter_link_get_max_queued_frames(const AVFilterLink *link);
+
 /**
  * Dump a graph into a human-readable string representation.
  *
+ * If statistics are gathered for the graph (AVFilterGraph.enable_stats),
+ * they are printed along with each filter.
+ *
  * @param graph    the graph to dump
  * @param options  formatting options; currently ignored
  * @return  a string, or NULL in case of memory allocation failure;
@@ -105,6 +105,11 @@ typedef struct FFFrameQueue {
      */
     int samples_skipped;
 
+    /**
+     * Highest number of frames queued at any time.
+     */
+    size_t max_queued;
+
 } FFFrameQueue;
 
 /**
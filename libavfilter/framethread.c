@@ -0,0 +1,371 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Frame threading helper for filters
+ */
+
+#include <string.h>
+
+#include "third_party/ffmpeg/config.h"
+
+#include "third_party/ffmpeg/libavutil/error.h"
+#include "third_party/ffmpeg/libavutil/frame.h"
+#include "third_party/ffmpeg/libavutil/mem.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
+
+#include "avfilter.h"
+#include "framethread.h"
+#include "internal.h"
+
+enum SlotState {
+    SLOT_FREE,
+    SLOT_QUEUED,    ///< submitted, waiting for a worker
+    SLOT_RUNNING,
+    SLOT_DONE,      ///< ready to be output
+};
+
+typedef struct FrameThreadSlot {
+    void    *job;
+    AVFrame *out;
+    int      ret;
+    enum SlotState state;
+} FrameThreadSlot;
+
+typedef struct FrameThreadWorker {
+    FFFrameThreadContext *ft;
+    int index;
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+} FrameThreadWorker;
+
+struct FFFrameThreadContext {
+    AVFilterContext     *ctx;
+    ff_framethread_func *func;
+    size_t               job_size;
+
+    /* ring of the jobs not output yet, in submission order */
+    FrameThreadSlot *slots;
+    int              nb_slots;
+    int              head;
+    int              nb_pending;
+
+    /* 0 when the jobs are run by ff_framethread_submit() itself */
+    FrameThreadWorker *workers;
+    int                nb_workers;
+    int                exiting;
+
+#if HAVE_THREADS
+    /* protects the slot states, head, nb_pending and exiting */
+    pthread_mutex_t lock;
+    pthread_cond_t  job_cond;
+    pthread_cond_t  done_cond;
+#endif
+};
+
+#if HAVE_THREADS
+static void *frame_worker(void *arg)
+{
+    FrameThreadWorker    *w = arg;
+    FFFrameThreadContext *ft = w->ft;
+
+    pthread_mutex_lock(&ft->lock);
+    while (1) {
+        FrameThreadSlot *slot = NULL;
+        int ret;
+
+        for (int i = 0; i < ft->nb_pending; i++) {
+            FrameThreadSlot *s = &ft->slots[(ft->head + i) % ft->nb_slots];
+
+            if (s->state == SLOT_QUEUED) {
+                slot = s;
+                break;
+            }
+        }
+
+        if (!slot) {
+            /* the pending jobs are run before exiting, so that they can
+             * release their references */
+            if (ft->exiting)
+                break;
+            pthread_cond_wait(&ft->job_cond, &ft->lock);
+            continue;
+        }
+
+        slot->state = SLOT_RUNNING;
+        pthread_mutex_unlock(&ft->lock);
+
+        ret = ft->func(ft->ctx, slot->job, slot->out, w->index);
+
+        pthread_mutex_lock(&ft->lock);
+        slot->ret   = ret;
+        slot->state = SLOT_DONE;
+        pthread_cond_signal(&ft->done_cond);
+    }
+    pthread_mutex_unlock(&ft->lock);
+
+    return NULL;
+}
+
+static void stop_workers(FFFrameThreadContext *ft)
+{
+    pthread_mutex_lock(&ft->lock);
+    ft->exiting = 1;
+    pthread_cond_broadcast(&ft->job_cond);
+    pthread_mutex_unlock(&ft->lock);
+
+    for (int i = 0; i < ft->nb_workers; i++)
+        pthread_join(ft->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&ft->done_cond);
+    pthread_cond_destroy(&ft->job_cond);
+    pthread_mutex_destroy(&ft->lock);
+    ft->nb_workers = 0;
+}
+
+static int start_workers(FFFrameThreadContext *ft, int nb_workers)
+{
+    int ret;
+
+    ft->workers = av_calloc(nb_workers, sizeof(*ft->workers));
+    if (!ft->workers)
+        return AVERROR(ENOMEM);
+
+    if ((ret = pthread_mutex_init(&ft->lock, NULL))) {
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&ft->job_cond, NULL))) {
+        pthread_mutex_destroy(&ft->lock);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&ft->done_cond, NULL))) {
+        pthread_cond_destroy(&ft->job_cond);
+        pthread_mutex_destroy(&ft->lock);
+        return AVERROR(ret);
+    }
+
+    for (int i = 0; i < nb_workers; i++) {
+        FrameThreadWorker *w = &ft->workers[i];
+
+        w->ft    = ft;
+        w->index = i;
+        ret = pthread_create(&w->thread, NULL, frame_worker, w);
+        if (ret) {
+            stop_workers(ft);
+            return AVERROR(ret);
+        }
+        ft->nb_workers++;
+    }
+
+    return 0;
+}
+#endif
+
+int ff_framethread_init(AVFilterContext *ctx, FFFrameThreadContext **pft,
+                        ff_framethread_func *func, size_t job_size,
+                        int nb_threads)
+{
+    FFFrameThreadContext *ft;
+    int nb_workers = 0;
+    int ret;
+
+#if HAVE_THREADS
+    if (ctx->thread_type & AVFILTER_THREAD_FRAME && nb_threads > 1)
+        nb_workers = nb_threads;
+#endif
+
+    ft = av_mallocz(sizeof(*ft));
+    if (!ft)
+        return AVERROR(ENOMEM);
+    ft->ctx      = ctx;
+    ft->func     = func;
+    ft->job_size = job_size;
+
+    /* one more slot than workers, so that a job is ready whenever a worker
+     * finishes one */
+    ft->nb_slots = nb_workers + 1;
+    ft->slots    = av_calloc(ft->nb_slots, sizeof(*ft->slots));
+    if (!ft->slots) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < ft->nb_slots; i++) {
+        ft->slots[i].job = av_mallocz(job_size);
+        if (!ft->slots[i].job) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+#if HAVE_THREADS
+    if (nb_workers) {
+        ret = start_workers(ft, nb_workers);
+        if (ret < 0)
+            goto fail;
+        av_log(ctx, AV_LOG_VERBOSE, "Using %d frame threads\n", nb_workers);
+    }
+#endif
+
+    *pft = ft;
+    return FFMAX(nb_workers, 1);
+fail:
+    ff_framethread_uninit(&ft);
+    return ret;
+}
+
+static void lock(FFFrameThreadContext *ft)
+{
+#if HAVE_THREADS
+    if (ft->nb_workers)
+        pthread_mutex_lock(&ft->lock);
+#endif
+}
+
+static void unlock(FFFrameThreadContext *ft)
+{
+#if HAVE_THREADS
+    if (ft->nb_workers)
+        pthread_mutex_unlock(&ft->lock);
+#endif
+}
+
+/**
+ * Output the finished frames at the head of the ring, waiting for the
+ * first nb_wait ones to be finished.
+ */
+static int output_frames(FFFrameThreadContext *ft, int nb_wait)
+{
+    int ret = 0;
+
+    while (ft->nb_pending) {
+        FrameThreadSlot *slot = &ft->slots[ft->head];
+        AVFrame *out;
+        int err;
+
+        lock(ft);
+#if HAVE_THREADS
+        while (nb_wait > 0 && slot->state != SLOT_DONE)
+            pthread_cond_wait(&ft->done_cond, &ft->lock);
+#endif
+        if (slot->state != SLOT_DONE) {
+            unlock(ft);
+            break;
+        }
+        slot->state = SLOT_FREE;
+        ft->head = (ft->head + 1) % ft->nb_slots;
+        ft->nb_pending--;
+        unlock(ft);
+        nb_wait--;
+
+        out = slot->out;
+        slot->out = NULL;
+        if (slot->ret < 0) {
+            av_frame_free(&out);
+            err = slot->ret;
+        } else {
+            err = ff_filter_frame(ft->ctx->outputs[0], out);
+        }
+        if (err < 0 && ret >= 0)
+            ret = err;
+    }
+
+    return ret;
+}
+
+int ff_framethread_submit(FFFrameThreadContext *ft, const void *job,
+                          AVFrame *out)
+{
+    FrameThreadSlot *slot;
+    int ret, ret2;
+
+    /* make room for the job */
+    ret = output_frames(ft, ft->nb_pending == ft->nb_slots);
+
+    slot = &ft->slots[(ft->head + ft->nb_pending) % ft->nb_slots];
+    slot->out = out;
+    slot->ret = 0;
+    if (job)
+        memcpy(slot->job, job, ft->job_size);
+
+    if (!ft->nb_workers) {
+        if (job)
+            slot->ret = ft->func(ft->ctx, slot->job, out, 0);
+        slot->state = SLOT_DONE;
+        ft->nb_pending++;
+
+        ret2 = output_frames(ft, 0);
+        return ret < 0 ? ret : ret2;
+    }
+
+#if HAVE_THREADS
+    pthread_mutex_lock(&ft->lock);
+    slot->state = job ? SLOT_QUEUED : SLOT_DONE;
+    ft->nb_pending++;
+    if (job)
+        pthread_cond_signal(&ft->job_cond);
+    pthread_mutex_unlock(&ft->lock);
+#endif
+
+    return ret;
+}
+
+int ff_framethread_flush(FFFrameThreadContext *ft)
+{
+    return output_frames(ft, ft->nb_pending);
+}
+
+void ff_framethread_wait(FFFrameThreadContext *ft)
+{
+#if HAVE_THREADS
+    if (!ft->nb_workers)
+        return;
+
+    pthread_mutex_lock(&ft->lock);
+    for (int i = 0; i < ft->nb_pending; i++) {
+        FrameThreadSlot *slot = &ft->slots[(ft->head + i) % ft->nb_slots];
+
+        while (slot->state != SLOT_DONE)
+            pthread_cond_wait(&ft->done_cond, &ft->lock);
+    }
+    pthread_mutex_unlock(&ft->lock);
+#endif
+}
+
+void ff_framethread_uninit(FFFrameThreadContext **pft)
+{
+    FFFrameThreadContext *ft = *pft;
+
+    if (!ft)
+        return;
+
+#if HAVE_THREADS
+    if (ft->nb_workers)
+        stop_workers(ft);
+#endif
+    av_freep(&ft->workers);
+
+    for (int i = 0; ft->slots && i < ft->nb_slots; i++) {
+        av_frame_free(&ft->slots[i].out);
+        av_freep(&ft->slots[i].job);
+    }
+    av_freep(&ft->slots);
+
+    av_freep(pft);
+}
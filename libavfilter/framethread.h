@@ -0,0 +1,109 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_FRAMETHREAD_H
+#define AVFILTER_FRAMETHREAD_H
+
+#include <stddef.h>
+
+#include "avfilter.h"
+
+/**
+ * This API is intended as a helper for filters with one output that spend
+ * most of their time computing each output frame independently of the
+ * previous output frames, e.g. denoisers. It lets such a filter compute
+ * several output frames concurrently while keeping them in order.
+ *
+ * The filter describes the computation of an output frame as a job, a
+ * filter-defined structure holding everything needed for it (typically
+ * references to the input frames), and submits it together with an output
+ * frame allocated beforehand. The job function may then be called from
+ * another thread at any time until the frame is output, so it must not
+ * touch any state of the filter that is modified while jobs are pending
+ * and it must use separate scratch buffers for each worker. It must not
+ * call ff_filter_frame() or allocate frames from the links either.
+ *
+ * The output frames are sent to the first output of the filter with
+ * ff_filter_frame() from ff_framethread_submit() and
+ * ff_framethread_flush(), in submission order.
+ *
+ * Frames are only computed concurrently when the filter uses
+ * AVFILTER_THREAD_FRAME threading, otherwise each job is run by
+ * ff_framethread_submit() itself and the filter may use slice threading
+ * within the job as usual.
+ */
+typedef struct FFFrameThreadContext FFFrameThreadContext;
+
+/**
+ * Compute an output frame.
+ *
+ * @param job    the job as submitted, the function is responsible for
+ *               releasing anything it references, even on failure
+ * @param out    the output frame submitted with the job
+ * @param worker index of the worker running the job, in the range
+ *               [0, number returned by ff_framethread_init()), to select
+ *               scratch buffers
+ * @return 0 on success, a negative AVERROR on failure
+ */
+typedef int (ff_framethread_func)(AVFilterContext *ctx, void *job,
+                                  AVFrame *out, int worker);
+
+/**
+ * Initialize a frame threading context.
+ *
+ * @param job_size    size of the jobs submitted by the filter
+ * @param nb_threads  maximum number of frames to compute concurrently
+ * @return the number of workers, i.e. of frames that may be computed
+ *         concurrently, or a negative AVERROR on failure
+ */
+int ff_framethread_init(AVFilterContext *ctx, FFFrameThreadContext **ft,
+                        ff_framethread_func *func, size_t job_size,
+                        int nb_threads);
+
+/**
+ * Submit the computation of a frame, and output the frames that are
+ * finished. If too many jobs are pending, wait for the oldest one first.
+ *
+ * @param job  the job, copied by this function, or NULL if out is already
+ *             complete, e.g. when the filter is disabled by the timeline;
+ *             it is output in order with the other frames then
+ * @param out  the output frame, ownership is transferred to the context
+ * @return >= 0 on success, or a negative AVERROR from a job or from
+ *         ff_filter_frame(); the job is submitted in any case
+ */
+int ff_framethread_submit(FFFrameThreadContext *ft, const void *job,
+                          AVFrame *out);
+
+/**
+ * Wait for all pending jobs and output their frames, e.g. at EOF.
+ */
+int ff_framethread_flush(FFFrameThreadContext *ft);
+
+/**
+ * Wait for all pending jobs without outputting their frames, e.g. before
+ * changing state read by the jobs in process_command().
+ */
+void ff_framethread_wait(FFFrameThreadContext *ft);
+
+/**
+ * Run the pending jobs, free the frames that were not output and free the
+ * context.
+ */
+void ff_framethread_uninit(FFFrameThreadContext **ft);
+
+#endif /* AVFILTER_FRAMETHREAD_H */
@@ -62,6 +62,28 @@ static int print_link_prop(AVBPrint *buf, AVFilterLink *link)
     return buf->len;
 }
 
+static void print_filter_stats(AVBPrint *buf, AVFilterContext *filter,
+                               unsigned indent)
+{
+    const AVFilterStats *stats = avfilter_get_stats(filter);
+
+    if (!stats)
+        return;
+
+    av_bprint_chars(buf, ' ', indent);
+    av_bprintf(buf, "activations:%"PRIu64" time:%.3fms "
+               "frames in:%"PRId64" out:%"PRId64"\n",
+               stats->nb_activations, stats->activate_time / 1000.0,
+               stats->frames_in, stats->frames_out);
+    for (unsigned i = 0; i < filter->nb_inputs; i++) {
+        AVFilterLink *l = filter->inputs[i];
+        av_bprint_chars(buf, ' ', indent);
+        av_bprintf(buf, "%s:%s max queued:%"SIZE_SPECIFIER"\n",
+                   l->src->name, l->srcpad->name,
+                   avfilter_link_get_max_queued_frames(l));
+    }
+}
+
 static void avfilter_graph_dump_to_buf(AVBPrint *buf, AVFilterGraph *graph)
 {
     unsigned i, j, x, e;
@@ -150,6 +172,7 @@ static void avfilter_graph_dump_to_buf(AVBPrint *buf, AVFilterGraph *graph)
         av_bprintf(buf, "+");
         av_bprint_chars(buf, '-', width);
         av_bprintf(buf, "+\n");
+        print_filter_stats(buf, filter, in_indent);
         av_bprintf(buf, "\n");
     }
 }
@@ -25,6 +25,7 @@
  */
 
 #include "third_party/ffmpeg/libavutil/internal.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "framequeue.h"
@@ -133,6 +134,13 @@ struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
     FFFrameQueueGlobal frame_queues;
+
+    /* graph threading, see ff_graph_thread_activate() */
+    void *sched;
+    /* set while filters are activated concurrently; ready_lock then
+     * protects AVFilterContext.ready and AVFilterInternal.unblock_pending */
+    int sched_running;
+    AVMutex ready_lock;
 };
 
 struct AVFilterInternal {
@@ -141,6 +149,13 @@ struct AVFilterInternal {
     // 1 when avfilter_init_*() was successfully called on this filter
     // 0 otherwise
     int initialized;
+
+    // only updated when AVFilterGraph.enable_stats is set
+    AVFilterStats stats;
+
+    // 1 when frame_blocked_in must be cleared on the outputs once the
+    // filters activated concurrently returned, see ff_graph_thread_activate()
+    int unblock_pending;
 };
 
 static av_always_inline int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
@@ -362,6 +377,12 @@ AVFilterContext *ff_filter_alloc(const AVFilter *filter, const char *inst_name);
 
 int ff_filter_activate(AVFilterContext *filter);
 
+/**
+ * Clear frame_blocked_in on the outputs of a filter if it was requested while
+ * filters were activated concurrently.
+ */
+void ff_filter_unblock_pending(AVFilterContext *filter);
+
 /**
  * Remove a filter from a graph;
  */
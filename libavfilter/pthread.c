@@ -27,6 +27,7 @@
 #include "third_party/ffmpeg/libavutil/macros.h"
 #include "third_party/ffmpeg/libavutil/mem.h"
 #include "third_party/ffmpeg/libavutil/slicethread.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
 
 #include "avfilter.h"
 #include "internal.h"
@@ -37,12 +38,25 @@ typedef struct ThreadContext {
     AVSliceThread *thread;
     avfilter_action_func *func;
 
+    /* filters activated concurrently by graph threading must take turns
+     * executing their slice jobs */
+    AVMutex lock;
+
     /* per-execute parameters */
     AVFilterContext *ctx;
     void *arg;
     int   *rets;
 } ThreadContext;
 
+typedef struct SchedContext {
+    AVSliceThread *thread;
+    int            nb_threads;
+
+    /* filters activated concurrently and their return values */
+    AVFilterContext **batch;
+    int              *rets;
+} SchedContext;
+
 static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
 {
     ThreadContext *c = priv;
@@ -63,12 +77,15 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
 
     if (nb_jobs <= 0)
         return 0;
+
+    ff_mutex_lock(&c->lock);
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
     c->rets        = ret;
 
     avpriv_slicethread_execute(c->thread, nb_jobs, 0);
+    ff_mutex_unlock(&c->lock);
     return 0;
 }
 
@@ -80,8 +97,117 @@ static int thread_init_internal(ThreadContext *c, int nb_threads)
     return FFMAX(nb_threads, 1);
 }
 
+static void sched_worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    SchedContext *s = priv;
+    s->rets[jobnr] = ff_filter_activate(s->batch[jobnr]);
+}
+
+static void sched_uninit(AVFilterGraph *graph)
+{
+    SchedContext *s = graph->internal->sched;
+
+    if (!s)
+        return;
+
+    avpriv_slicethread_free(&s->thread);
+    av_freep(&s->batch);
+    av_freep(&s->rets);
+    av_freep(&graph->internal->sched);
+}
+
+static int sched_init(AVFilterGraph *graph)
+{
+    SchedContext *s;
+    int ret;
+
+    s = graph->internal->sched = av_mallocz(sizeof(*s));
+    if (!s)
+        return AVERROR(ENOMEM);
+
+    ret = avpriv_slicethread_create(&s->thread, s, sched_worker_func, NULL,
+                                    graph->nb_threads);
+    if (ret <= 1) {
+        sched_uninit(graph);
+        return (ret < 0) ? ret : 0;
+    }
+    s->nb_threads = ret;
+
+    s->batch = av_calloc(s->nb_threads, sizeof(*s->batch));
+    s->rets  = av_calloc(s->nb_threads, sizeof(*s->rets));
+    if (!s->batch || !s->rets) {
+        sched_uninit(graph);
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+/**
+ * Check whether two filters must not be activated concurrently. Activating
+ * a filter touches its own links, and through them the readiness of its
+ * neighbours (which is protected by ready_lock) and the output links of its
+ * direct successors. So filters may run concurrently unless they are linked
+ * to each other or one of them is two links downstream of the other.
+ */
+static int filters_conflict(const AVFilterContext *a, const AVFilterContext *b)
+{
+    for (int k = 0; k < 2; k++) {
+        for (unsigned i = 0; i < a->nb_outputs; i++) {
+            const AVFilterContext *next = a->outputs[i]->dst;
+
+            if (next == b)
+                return 1;
+            for (unsigned j = 0; j < next->nb_outputs; j++)
+                if (next->outputs[j]->dst == b)
+                    return 1;
+        }
+        FFSWAP(const AVFilterContext*, a, b);
+    }
+    return 0;
+}
+
+int ff_graph_thread_activate(AVFilterGraph *graph, AVFilterContext *filter)
+{
+    SchedContext *s = graph->internal->sched;
+    int nb_batch = 0;
+
+    s->batch[nb_batch++] = filter;
+    for (unsigned i = 0; i < graph->nb_filters && nb_batch < s->nb_threads; i++) {
+        AVFilterContext *f = graph->filters[i];
+        int j;
+
+        if (f == filter || !f->ready ||
+            !(f->filter->flags & AVFILTER_FLAG_GRAPH_THREADS))
+            continue;
+
+        for (j = 0; j < nb_batch; j++)
+            if (filters_conflict(f, s->batch[j]))
+                break;
+        if (j == nb_batch)
+            s->batch[nb_batch++] = f;
+    }
+
+    if (nb_batch == 1)
+        return ff_filter_activate(filter);
+
+    graph->internal->sched_running = 1;
+    avpriv_slicethread_execute(s->thread, nb_batch, 1);
+    graph->internal->sched_running = 0;
+
+    /* the successors of the batch are not running, unblock them here */
+    for (unsigned i = 0; i < graph->nb_filters; i++)
+        ff_filter_unblock_pending(graph->filters[i]);
+
+    for (int i = 0; i < nb_batch; i++)
+        if (s->rets[i] < 0)
+            return s->rets[i];
+    return 0;
+}
+
 int ff_graph_thread_init(AVFilterGraph *graph)
 {
+    ThreadContext *c;
     int ret;
 
     if (graph->nb_threads == 1) {
@@ -89,7 +215,7 @@ int ff_graph_thread_init(AVFilterGraph *graph)
         return 0;
     }
 
-    graph->internal->thread = av_mallocz(sizeof(ThreadContext));
+    c = graph->internal->thread = av_mallocz(sizeof(ThreadContext));
     if (!graph->internal->thread)
         return AVERROR(ENOMEM);
 
@@ -102,14 +228,31 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     }
     graph->nb_threads = ret;
 
+    ret = ff_mutex_init(&c->lock, NULL);
+    if (ret) {
+        slice_thread_uninit(c);
+        av_freep(&graph->internal->thread);
+        return AVERROR(ret);
+    }
+
     graph->internal->thread_execute = thread_execute;
 
+    if (graph->thread_type & AVFILTER_THREAD_GRAPH) {
+        ret = sched_init(graph);
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 }
 
 void ff_graph_thread_free(AVFilterGraph *graph)
 {
-    if (graph->internal->thread)
+    sched_uninit(graph);
+
+    if (graph->internal->thread) {
         slice_thread_uninit(graph->internal->thread);
+        ff_mutex_destroy(&((ThreadContext*)graph->internal->thread)->lock);
+    }
     av_freep(&graph->internal->thread);
 }
@@ -146,7 +146,8 @@ const AVFilter ff_vf_split = {
     .activate    = activate,
     FILTER_INPUTS(avfilter_vf_split_inputs),
     .outputs     = NULL,
-    .flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_METADATA_ONLY,
+    .flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_METADATA_ONLY |
+                   AVFILTER_FLAG_GRAPH_THREADS,
 };
 
 static const AVFilterPad avfilter_af_asplit_inputs[] = {
@@ -165,5 +166,6 @@ const AVFilter ff_af_asplit = {
     .activate    = activate,
     FILTER_INPUTS(avfilter_af_asplit_inputs),
     .outputs     = NULL,
-    .flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_METADATA_ONLY,
+    .flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_METADATA_ONLY |
+                   AVFILTER_FLAG_GRAPH_THREADS,
 };
@@ -23,6 +23,15 @@
 
 int ff_graph_thread_init(AVFilterGraph *graph);
 
+/**
+ * Activate the given filter, which must be flagged with
+ * AVFILTER_FLAG_GRAPH_THREADS, together with other ready filters that can
+ * run concurrently with it.
+ *
+ * @return 0 or the first error returned by the activated filters
+ */
+int ff_graph_thread_activate(AVFilterGraph *graph, AVFilterContext *filter);
+
 void ff_graph_thread_free(AVFilterGraph *graph);
 
 #endif /* AVFILTER_THREAD_H */
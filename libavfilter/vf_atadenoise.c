@@ -35,6 +35,7 @@
 
 #include "atadenoise.h"
 #include "formats.h"
+#include "framethread.h"
 #include "internal.h"
 #include "video.h"
 
@@ -55,14 +56,14 @@ typedef struct ATADenoiseContext {
     int linesizes[4];
 
     struct FFBufQueue q;
-    void *data[4][SIZE];
-    int linesize[4][SIZE];
     float weights[4][SIZE];
     int size, mid, radius;
     int available;
 
     int (*filter_slice)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
 
+    FFFrameThreadContext *ft;
+
     ATADenoiseDSPContext dsp;
 } ATADenoiseContext;
 
@@ -136,8 +137,14 @@ static av_cold int init(AVFilterContext *ctx)
 
 typedef struct ThreadData {
     AVFrame *in, *out;
+    const uint8_t *data[4][SIZE];
+    int linesize[4][SIZE];
 } ThreadData;
 
+typedef struct ATADenoiseJob {
+    AVFrame *frames[SIZE];      ///< references to the frames of the window
+} ATADenoiseJob;
+
 #define WFILTER_ROW(type, name)                                             \
 static void fweight_row##name(const uint8_t *ssrc, uint8_t *ddst,           \
                               const uint8_t *ssrcf[SIZE],                   \
@@ -352,8 +359,8 @@ static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
         uint8_t *dst = out->data[p] + slice_start * out->linesize[p];
         const int thra = s->thra[p];
         const int thrb = s->thrb[p];
-        const uint8_t **data = (const uint8_t **)s->data[p];
-        const int *linesize = (const int *)s->linesize[p];
+        const uint8_t **data = td->data[p];
+        const int *linesize = td->linesize[p];
         const uint8_t *srcf[SIZE];
 
         if (!((1 << p) & s->planes)) {
@@ -379,6 +386,33 @@ static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
     return 0;
 }
 
+static int atadenoise_frame(AVFilterContext *ctx, void *arg, AVFrame *out, int worker)
+{
+    ATADenoiseContext *s = ctx->priv;
+    ATADenoiseJob *job = arg;
+    ThreadData td;
+
+    for (int i = 0; i < s->size; i++) {
+        AVFrame *frame = job->frames[i];
+
+        for (int p = 0; p < s->nb_planes; p++) {
+            td.data[p][i] = frame->data[p];
+            td.linesize[p][i] = frame->linesize[p];
+        }
+    }
+
+    td.in = job->frames[s->mid]; td.out = out;
+    ff_filter_execute(ctx, s->filter_slice, &td, NULL,
+                           FFMIN3(s->planeheight[1],
+                                  s->planeheight[2],
+                                  ff_filter_get_nb_threads(ctx)));
+
+    for (int i = 0; i < s->size; i++)
+        av_frame_free(&job->frames[i]);
+
+    return 0;
+}
+
 static int config_input(AVFilterLink *inlink)
 {
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
@@ -431,6 +465,13 @@ static int config_input(AVFilterLink *inlink)
     ff_atadenoise_init_x86(&s->dsp, depth, s->algorithm, s->sigma);
 #endif
 
+    if (!s->ft) {
+        ret = ff_framethread_init(ctx, &s->ft, atadenoise_frame, sizeof(ATADenoiseJob),
+                                  ff_filter_get_nb_threads(ctx));
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -439,6 +480,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
     AVFilterContext *ctx = inlink->dst;
     AVFilterLink *outlink = ctx->outputs[0];
     ATADenoiseContext *s = ctx->priv;
+    ATADenoiseJob job, *pjob = NULL;
     AVFrame *out, *in;
     int i;
 
@@ -463,31 +505,25 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
     in = ff_bufqueue_peek(&s->q, s->mid);
 
     if (!ctx->is_disabled) {
-        ThreadData td;
-
         out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
         if (!out) {
             av_frame_free(&buf);
             return AVERROR(ENOMEM);
         }
 
+        /* the job may outlive the frames in the queue */
         for (i = 0; i < s->size; i++) {
-            AVFrame *frame = ff_bufqueue_peek(&s->q, i);
-
-            s->data[0][i] = frame->data[0];
-            s->data[1][i] = frame->data[1];
-            s->data[2][i] = frame->data[2];
-            s->linesize[0][i] = frame->linesize[0];
-            s->linesize[1][i] = frame->linesize[1];
-            s->linesize[2][i] = frame->linesize[2];
+            job.frames[i] = av_frame_clone(ff_bufqueue_peek(&s->q, i));
+            if (!job.frames[i]) {
+                while (i--)
+                    av_frame_free(&job.frames[i]);
+                av_frame_free(&out);
+                av_frame_free(&buf);
+                return AVERROR(ENOMEM);
+            }
         }
-
-        td.in = in; td.out = out;
-        ff_filter_execute(ctx, s->filter_slice, &td, NULL,
-                               FFMIN3(s->planeheight[1],
-                                      s->planeheight[2],
-                                      ff_filter_get_nb_threads(ctx)));
         av_frame_copy_props(out, in);
+        pjob = &job;
     } else {
         out = av_frame_clone(in);
         if (!out) {
@@ -500,7 +536,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
     av_frame_free(&in);
     ff_bufqueue_add(ctx, &s->q, buf);
 
-    return ff_filter_frame(outlink, out);
+    return ff_framethread_submit(s->ft, pjob, out);
 }
 
 static int request_frame(AVFilterLink *outlink)
@@ -512,12 +548,24 @@ static int request_frame(AVFilterLink *outlink)
     ret = ff_request_frame(ctx->inputs[0]);
 
     if (ret == AVERROR_EOF && !ctx->is_disabled && s->available) {
-        AVFrame *buf = av_frame_clone(ff_bufqueue_peek(&s->q, s->available));
-        if (!buf)
-            return AVERROR(ENOMEM);
+        /* submit all the remaining frames at once, nothing would trigger
+         * another call while they are pending otherwise */
+        while (s->available) {
+            AVFrame *buf = av_frame_clone(ff_bufqueue_peek(&s->q, s->available));
+            if (!buf)
+                return AVERROR(ENOMEM);
+
+            ret = filter_frame(ctx->inputs[0], buf);
+            s->available--;
+            if (ret < 0)
+                return ret;
+        }
 
-        ret = filter_frame(ctx->inputs[0], buf);
-        s->available--;
+        ret = ff_framethread_flush(s->ft);
+    } else if (ret == AVERROR_EOF && s->ft) {
+        int err = ff_framethread_flush(s->ft);
+        if (err < 0)
+            return err;
     }
 
     return ret;
@@ -527,6 +575,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     ATADenoiseContext *s = ctx->priv;
 
+    ff_framethread_uninit(&s->ft);
     ff_bufqueue_discard_all(&s->q);
 }
 
@@ -537,8 +586,14 @@ static int process_command(AVFilterContext *ctx,
                            int res_len,
                            int flags)
 {
-    int ret = ff_filter_process_command(ctx, cmd, arg, res, res_len, flags);
+    ATADenoiseContext *s = ctx->priv;
+    int ret;
+
+    /* the pending frames must be denoised with the old parameters */
+    if (s->ft)
+        ff_framethread_wait(s->ft);
 
+    ret = ff_filter_process_command(ctx, cmd, arg, res, res_len, flags);
     if (ret < 0)
         return ret;
 
@@ -572,6 +627,7 @@ const AVFilter ff_vf_atadenoise = {
     FILTER_INPUTS(inputs),
     FILTER_OUTPUTS(outputs),
     FILTER_PIXFMTS_ARRAY(pixel_fmts),
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS |
+                     AVFILTER_FLAG_FRAME_THREADS,
     .process_command = process_command,
 };
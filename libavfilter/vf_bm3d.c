@@ -40,6 +40,7 @@
 #include "filters.h"
 #include "formats.h"
 #include "framesync.h"
+#include "framethread.h"
 #include "internal.h"
 #include "video.h"
 
@@ -57,8 +58,15 @@ typedef struct ThreadData {
     const uint8_t *ref;
     int ref_linesize;
     int plane;
+    int first_slice;
 } ThreadData;
 
+typedef struct BM3DJob {
+    AVFrame *src;
+    AVFrame *ref;               ///< NULL if the source is the reference
+    int disabled;
+} BM3DJob;
+
 typedef struct PosCode {
     int x, y;
 } PosCode;
@@ -114,6 +122,7 @@ typedef struct BM3DContext {
     SliceContext slices[MAX_NB_THREADS];
 
     FFFrameSync fs;
+    FFFrameThreadContext *ft;
     int nb_threads;
 
     void (*get_block_row)(const uint8_t *srcp, int src_linesize,
@@ -122,7 +131,7 @@ typedef struct BM3DContext {
                            const uint8_t *src, int src_stride,
                            int r_y, int r_x);
     void (*do_output)(struct BM3DContext *s, uint8_t *dst, int dst_linesize,
-                      int plane, int nb_jobs);
+                      int plane, int first_slice, int nb_jobs);
     void (*block_filtering)(struct BM3DContext *s,
                             const uint8_t *src, int src_linesize,
                             const uint8_t *ref, int ref_linesize,
@@ -629,7 +638,7 @@ static void final_block_filtering(BM3DContext *s, const uint8_t *src, int src_li
 }
 
 static void do_output(BM3DContext *s, uint8_t *dst, int dst_linesize,
-                      int plane, int nb_jobs)
+                      int plane, int first_slice, int nb_jobs)
 {
     const int height = s->planeheight[plane];
     const int width = s->planewidth[plane];
@@ -640,7 +649,7 @@ static void do_output(BM3DContext *s, uint8_t *dst, int dst_linesize,
             float sum_den = 0.f;
             float sum_num = 0.f;
 
-            for (int k = 0; k < nb_jobs; k++) {
+            for (int k = first_slice; k < first_slice + nb_jobs; k++) {
                 SliceContext *sc = &s->slices[k];
                 float num = sc->num[i * width + j];
                 float den = sc->den[i * width + j];
@@ -655,7 +664,7 @@ static void do_output(BM3DContext *s, uint8_t *dst, int dst_linesize,
 }
 
 static void do_output16(BM3DContext *s, uint8_t *dst, int dst_linesize,
-                        int plane, int nb_jobs)
+                        int plane, int first_slice, int nb_jobs)
 {
     const int height = s->planeheight[plane];
     const int width = s->planewidth[plane];
@@ -667,7 +676,7 @@ static void do_output16(BM3DContext *s, uint8_t *dst, int dst_linesize,
             float sum_den = 0.f;
             float sum_num = 0.f;
 
-            for (int k = 0; k < nb_jobs; k++) {
+            for (int k = first_slice; k < first_slice + nb_jobs; k++) {
                 SliceContext *sc = &s->slices[k];
                 float num = sc->num[i * width + j];
                 float den = sc->den[i * width + j];
@@ -684,9 +693,10 @@ static void do_output16(BM3DContext *s, uint8_t *dst, int dst_linesize,
 static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     BM3DContext *s = ctx->priv;
-    SliceContext *sc = &s->slices[jobnr];
-    const int block_step = s->block_step;
     ThreadData *td = arg;
+    const int slice = td->first_slice + jobnr;
+    SliceContext *sc = &s->slices[slice];
+    const int block_step = s->block_step;
     const uint8_t *src = td->src;
     const uint8_t *ref = td->ref;
     const int src_linesize = td->src_linesize;
@@ -713,33 +723,32 @@ static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
                 i = block_pos_right;
             }
 
-            block_matching(s, ref, ref_linesize, j, i, plane, jobnr);
+            block_matching(s, ref, ref_linesize, j, i, plane, slice);
 
             s->block_filtering(s, src, src_linesize,
-                               ref, ref_linesize, j, i, plane, jobnr);
+                               ref, ref_linesize, j, i, plane, slice);
         }
     }
 
     return 0;
 }
 
-static int filter_frame(AVFilterContext *ctx, AVFrame **out, AVFrame *in, AVFrame *ref)
+static int bm3d_frame(AVFilterContext *ctx, void *arg, AVFrame *out, int worker)
 {
     BM3DContext *s = ctx->priv;
-    AVFilterLink *outlink = ctx->outputs[0];
+    BM3DJob *job = arg;
+    AVFrame *in = job->src;
+    AVFrame *ref = job->ref ? job->ref : job->src;
     int p;
 
-    *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
-    if (!*out)
-        return AVERROR(ENOMEM);
-    av_frame_copy_props(*out, in);
-
     for (p = 0; p < s->nb_planes; p++) {
-        const int nb_jobs = FFMAX(1, FFMIN(s->nb_threads, s->planeheight[p] / s->block_size));
+        /* each frame thread uses the slice context matching its index */
+        const int nb_jobs = ctx->thread_type & AVFILTER_THREAD_FRAME ? 1 :
+                            FFMAX(1, FFMIN(s->nb_threads, s->planeheight[p] / s->block_size));
         ThreadData td;
 
-        if (!((1 << p) & s->planes) || ctx->is_disabled) {
-            av_image_copy_plane((*out)->data[p], (*out)->linesize[p],
+        if (!((1 << p) & s->planes) || job->disabled) {
+            av_image_copy_plane(out->data[p], out->linesize[p],
                                 in->data[p], in->linesize[p],
                                 s->planewidth[p] * (1 + (s->depth > 8)), s->planeheight[p]);
             continue;
@@ -750,14 +759,45 @@ static int filter_frame(AVFilterContext *ctx, AVFrame **out, AVFrame *in, AVFram
         td.ref = ref->data[p];
         td.ref_linesize = ref->linesize[p];
         td.plane = p;
+        td.first_slice = worker;
         ff_filter_execute(ctx, filter_slice, &td, NULL, nb_jobs);
 
-        s->do_output(s, (*out)->data[p], (*out)->linesize[p], p, nb_jobs);
+        s->do_output(s, out->data[p], out->linesize[p], p, worker, nb_jobs);
     }
 
+    av_frame_free(&job->src);
+    av_frame_free(&job->ref);
+
     return 0;
 }
 
+static int filter_frame(AVFilterContext *ctx, AVFrame *in, AVFrame *ref)
+{
+    BM3DContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    BM3DJob job = { .disabled = ctx->is_disabled };
+    AVFrame *out;
+
+    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+    if (!out)
+        return AVERROR(ENOMEM);
+    av_frame_copy_props(out, in);
+    if (s->ref)
+        out->pts = av_rescale_q(in->pts, s->fs.time_base, outlink->time_base);
+
+    job.src = av_frame_clone(in);
+    if (ref != in)
+        job.ref = av_frame_clone(ref);
+    if (!job.src || (ref != in && !job.ref)) {
+        av_frame_free(&job.src);
+        av_frame_free(&job.ref);
+        av_frame_free(&out);
+        return AVERROR(ENOMEM);
+    }
+
+    return ff_framethread_submit(s->ft, &job, out);
+}
+
 #define SQR(x) ((x) * (x))
 
 static int config_input(AVFilterLink *inlink)
@@ -765,6 +805,7 @@ static int config_input(AVFilterLink *inlink)
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     AVFilterContext *ctx = inlink->dst;
     BM3DContext *s = ctx->priv;
+    int ret;
 
     s->nb_threads = FFMIN(ff_filter_get_nb_threads(ctx), MAX_NB_THREADS);
     s->nb_planes = av_pix_fmt_count_planes(inlink->format);
@@ -781,7 +822,6 @@ static int config_input(AVFilterLink *inlink)
         SliceContext *sc = &s->slices[i];
         float iscale = 0.5f / s->block_size;
         float scale = 1.f;
-        int ret;
 
         sc->num = av_calloc(FFALIGN(s->planewidth[0], s->block_size) * FFALIGN(s->planeheight[0], s->block_size), sizeof(float));
         sc->den = av_calloc(FFALIGN(s->planewidth[0], s->block_size) * FFALIGN(s->planeheight[0], s->block_size), sizeof(float));
@@ -830,6 +870,12 @@ static int config_input(AVFilterLink *inlink)
             return AVERROR(ENOMEM);
     }
 
+    if (!s->ft) {
+        ret = ff_framethread_init(ctx, &s->ft, bm3d_frame, sizeof(BM3DJob), s->nb_threads);
+        if (ret < 0)
+            return ret;
+    }
+
     s->do_output = do_output;
     s->do_block_ssd = do_block_ssd;
     s->get_block_row = get_block_row;
@@ -849,22 +895,21 @@ static int activate(AVFilterContext *ctx)
 
     if (!s->ref) {
         AVFrame *frame = NULL;
-        AVFrame *out = NULL;
         int ret, status;
         int64_t pts;
 
         FF_FILTER_FORWARD_STATUS_BACK(ctx->outputs[0], ctx->inputs[0]);
 
         if ((ret = ff_inlink_consume_frame(ctx->inputs[0], &frame)) > 0) {
-            ret = filter_frame(ctx, &out, frame, frame);
+            ret = filter_frame(ctx, frame, frame);
             av_frame_free(&frame);
-            if (ret < 0)
-                return ret;
-            ret = ff_filter_frame(ctx->outputs[0], out);
         }
         if (ret < 0) {
             return ret;
         } else if (ff_inlink_acknowledge_status(ctx->inputs[0], &status, &pts)) {
+            ret = ff_framethread_flush(s->ft);
+            if (ret < 0)
+                return ret;
             ff_outlink_set_status(ctx->outputs[0], status, pts);
             return 0;
         } else {
@@ -873,6 +918,16 @@ static int activate(AVFilterContext *ctx)
             return 0;
         }
     } else {
+        /* framesync sets the output status on its own, so output the
+         * pending frames as soon as an input reached its end */
+        for (int i = 0; i < ctx->nb_inputs; i++) {
+            if (ff_outlink_get_status(ctx->inputs[i])) {
+                int ret = ff_framethread_flush(s->ft);
+                if (ret < 0)
+                    return ret;
+                break;
+            }
+        }
         return ff_framesync_activate(&s->fs);
     }
 }
@@ -881,20 +936,22 @@ static int process_frame(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
     BM3DContext *s = fs->opaque;
-    AVFilterLink *outlink = ctx->outputs[0];
-    AVFrame *out = NULL, *src, *ref;
+    AVFrame *src, *ref;
     int ret;
 
     if ((ret = ff_framesync_get_frame(&s->fs, 0, &src, 0)) < 0 ||
         (ret = ff_framesync_get_frame(&s->fs, 1, &ref, 0)) < 0)
         return ret;
 
-    if ((ret = filter_frame(ctx, &out, src, ref)) < 0)
+    if ((ret = filter_frame(ctx, src, ref)) < 0)
         return ret;
 
-    out->pts = av_rescale_q(src->pts, s->fs.time_base, outlink->time_base);
+    /* no frame may have been output yet with frame threading, so make
+     * framesync request the next input frames */
+    if (ff_outlink_frame_wanted(ctx->outputs[0]))
+        ff_filter_set_ready(ctx, 100);
 
-    return ff_filter_frame(outlink, out);
+    return 0;
 }
 
 static av_cold int init(AVFilterContext *ctx)
@@ -1005,6 +1062,8 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     BM3DContext *s = ctx->priv;
 
+    ff_framethread_uninit(&s->ft);
+
     if (s->ref)
         ff_framesync_uninit(&s->fs);
 
@@ -1054,5 +1113,6 @@ const AVFilter ff_vf_bm3d = {
     .priv_class    = &bm3d_class,
     .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
                      AVFILTER_FLAG_DYNAMIC_INPUTS |
-                     AVFILTER_FLAG_SLICE_THREADS,
+                     AVFILTER_FLAG_SLICE_THREADS |
+                     AVFILTER_FLAG_FRAME_THREADS,
 };
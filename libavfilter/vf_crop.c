@@ -396,4 +396,5 @@ const AVFilter ff_vf_crop = {
     FILTER_OUTPUTS(avfilter_vf_crop_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_GRAPH_THREADS,
 };
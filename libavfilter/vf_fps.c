@@ -389,7 +389,7 @@ const AVFilter ff_vf_fps = {
     .priv_size   = sizeof(FPSContext),
     .priv_class  = &fps_class,
     .activate    = activate,
-    .flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags       = AVFILTER_FLAG_METADATA_ONLY | AVFILTER_FLAG_GRAPH_THREADS,
     FILTER_INPUTS(avfilter_vf_fps_inputs),
     FILTER_OUTPUTS(avfilter_vf_fps_outputs),
 };
@@ -34,11 +34,19 @@
 #include "third_party/ffmpeg/libavutil/pixdesc.h"
 #include "avfilter.h"
 #include "formats.h"
+#include "framethread.h"
 #include "internal.h"
 #include "vf_nlmeans.h"
 #include "vf_nlmeans_init.h"
 #include "video.h"
 
+typedef struct NLMeansWorker {
+    uint32_t *ii_orig;                          // integral image
+    uint32_t *ii;                               // integral image starting after the 0-line and 0-column
+    float *total_weight;                        // total weight for every pixel
+    float *sum;                                 // weighted sum for every pixel
+} NLMeansWorker;
+
 typedef struct NLMeansContext {
     const AVClass *class;
     int nb_planes;
@@ -49,13 +57,12 @@ typedef struct NLMeansContext {
     int patch_size_uv, patch_hsize_uv;          // patch size and half size for chroma planes
     int research_size,    research_hsize;       // research size and half size
     int research_size_uv, research_hsize_uv;    // research size and half size for chroma planes
-    uint32_t *ii_orig;                          // integral image
-    uint32_t *ii;                               // integral image starting after the 0-line and 0-column
     int ii_w, ii_h;                             // width and height of the integral image
     ptrdiff_t ii_lz_32;                         // linesize in 32-bit units of the integral image
-    float *total_weight;                        // total weight for every pixel
-    float *sum;                                 // weighted sum for every pixel
     int linesize;                               // sum and total_weight linesize
+    NLMeansWorker *workers;                     // scratch buffers of every frame thread
+    int nb_workers;
+    FFFrameThreadContext *ft;
     float *weight_lut;                          // lookup table mapping (scaled) patch differences to their associated weights
     uint32_t max_meaningful_diff;               // maximum difference considered (if the patch difference is too high we ignore the pixel)
     NLMeansDSPContext dsp;
@@ -221,61 +228,6 @@ static void compute_ssd_integral_image(const NLMeansDSPContext *dsp,
                                       ii_w, ii_h - endy_safe);
 }
 
-static int config_input(AVFilterLink *inlink)
-{
-    AVFilterContext *ctx = inlink->dst;
-    NLMeansContext *s = ctx->priv;
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
-    const int e = FFMAX(s->research_hsize, s->research_hsize_uv)
-                + FFMAX(s->patch_hsize,    s->patch_hsize_uv);
-
-    s->chroma_w = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
-    s->chroma_h = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
-    s->nb_planes = av_pix_fmt_count_planes(inlink->format);
-
-    /* Allocate the integral image with extra edges of thickness "e"
-     *
-     *   +_+-------------------------------+
-     *   |0|0000000000000000000000000000000|
-     *   +-x-------------------------------+
-     *   |0|\    ^                         |
-     *   |0| ii  | e                       |
-     *   |0|     v                         |
-     *   |0|   +-----------------------+   |
-     *   |0|   |                       |   |
-     *   |0|<->|                       |   |
-     *   |0| e |                       |   |
-     *   |0|   |                       |   |
-     *   |0|   +-----------------------+   |
-     *   |0|                               |
-     *   |0|                               |
-     *   |0|                               |
-     *   +-+-------------------------------+
-     */
-    s->ii_w = inlink->w + e*2;
-    s->ii_h = inlink->h + e*2;
-
-    // align to 4 the linesize, "+1" is for the space of the left 0-column
-    s->ii_lz_32 = FFALIGN(s->ii_w + 1, 4);
-
-    // "+1" is for the space of the top 0-line
-    s->ii_orig = av_calloc(s->ii_h + 1, s->ii_lz_32 * sizeof(*s->ii_orig));
-    if (!s->ii_orig)
-        return AVERROR(ENOMEM);
-
-    // skip top 0-line and left 0-column
-    s->ii = s->ii_orig + s->ii_lz_32 + 1;
-
-    // allocate weighted average for every pixel
-    s->linesize = inlink->w + 100;
-    s->total_weight = av_malloc_array(s->linesize, inlink->h * sizeof(*s->total_weight));
-    s->sum = av_malloc_array(s->linesize, inlink->h * sizeof(*s->sum));
-    if (!s->total_weight || !s->sum)
-        return AVERROR(ENOMEM);
-
-    return 0;
-}
-
 struct thread_data {
     const uint8_t *src;
     ptrdiff_t src_linesize;
@@ -283,6 +235,7 @@ struct thread_data {
     int endx, endy;
     const uint32_t *ii_start;
     int p;
+    NLMeansWorker *w;
 };
 
 static int nlmeans_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -306,8 +259,8 @@ static int nlmeans_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs
 
     for (int y = starty; y < endy; y++) {
         const uint8_t *const src = td->src + y*src_linesize;
-        float *total_weight = s->total_weight + y*s->linesize;
-        float *sum = s->sum + y*s->linesize;
+        float *total_weight = td->w->total_weight + y*s->linesize;
+        float *sum = td->w->sum + y*s->linesize;
         const uint32_t *const iia = ii;
         const uint32_t *const iib = ii + dist_b;
         const uint32_t *const iid = ii + dist_d;
@@ -340,7 +293,8 @@ static void weight_averages(uint8_t *dst, ptrdiff_t dst_linesize,
     }
 }
 
-static int nlmeans_plane(AVFilterContext *ctx, int w, int h, int p, int r,
+static int nlmeans_plane(AVFilterContext *ctx, NLMeansWorker *worker,
+                         int w, int h, int p, int r,
                          uint8_t *dst, ptrdiff_t dst_linesize,
                          const uint8_t *src, ptrdiff_t src_linesize)
 {
@@ -349,10 +303,10 @@ static int nlmeans_plane(AVFilterContext *ctx, int w, int h, int p, int r,
      * themselves overflow the research window */
     const int e = r + p;
     /* focus an integral pointer on the centered image (s1) */
-    const uint32_t *centered_ii = s->ii + e*s->ii_lz_32 + e;
+    const uint32_t *centered_ii = worker->ii + e*s->ii_lz_32 + e;
 
-    memset(s->total_weight, 0, s->linesize * h * sizeof(*s->total_weight));
-    memset(s->sum, 0, s->linesize * h * sizeof(*s->sum));
+    memset(worker->total_weight, 0, s->linesize * h * sizeof(*worker->total_weight));
+    memset(worker->sum, 0, s->linesize * h * sizeof(*worker->sum));
 
     for (int offy = -r; offy <= r; offy++) {
         for (int offx = -r; offx <= r; offx++) {
@@ -366,9 +320,10 @@ static int nlmeans_plane(AVFilterContext *ctx, int w, int h, int p, int r,
                     .endy         = FFMIN(h, h - offy),
                     .ii_start     = centered_ii + offy*s->ii_lz_32 + offx,
                     .p            = p,
+                    .w            = worker,
                 };
 
-                compute_ssd_integral_image(&s->dsp, s->ii, s->ii_lz_32,
+                compute_ssd_integral_image(&s->dsp, worker->ii, s->ii_lz_32,
                                            src, src_linesize,
                                            offx, offy, e, w, h);
                 ff_filter_execute(ctx, nlmeans_slice, &td, NULL,
@@ -378,7 +333,107 @@ static int nlmeans_plane(AVFilterContext *ctx, int w, int h, int p, int r,
     }
 
     weight_averages(dst, dst_linesize, src, src_linesize,
-                    s->total_weight, s->sum, s->linesize, w, h);
+                    worker->total_weight, worker->sum, s->linesize, w, h);
+
+    return 0;
+}
+
+static int nlmeans_frame(AVFilterContext *ctx, void *arg, AVFrame *out, int worker)
+{
+    NLMeansContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    AVFrame *in = *(AVFrame **)arg;
+
+    for (int i = 0; i < s->nb_planes; i++) {
+        const int w = i ? s->chroma_w          : inlink->w;
+        const int h = i ? s->chroma_h          : inlink->h;
+        const int p = i ? s->patch_hsize_uv    : s->patch_hsize;
+        const int r = i ? s->research_hsize_uv : s->research_hsize;
+        nlmeans_plane(ctx, &s->workers[worker], w, h, p, r,
+                      out->data[i], out->linesize[i],
+                      in->data[i],  in->linesize[i]);
+    }
+
+    av_frame_free(&in);
+    return 0;
+}
+
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    NLMeansContext *s = ctx->priv;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+    const int e = FFMAX(s->research_hsize, s->research_hsize_uv)
+                + FFMAX(s->patch_hsize,    s->patch_hsize_uv);
+    int ret;
+
+    s->chroma_w = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
+    s->chroma_h = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
+    s->nb_planes = av_pix_fmt_count_planes(inlink->format);
+
+    /* Allocate the integral image with extra edges of thickness "e"
+     *
+     *   +_+-------------------------------+
+     *   |0|0000000000000000000000000000000|
+     *   +-x-------------------------------+
+     *   |0|\    ^                         |
+     *   |0| ii  | e                       |
+     *   |0|     v                         |
+     *   |0|   +-----------------------+   |
+     *   |0|   |                       |   |
+     *   |0|<->|                       |   |
+     *   |0| e |                       |   |
+     *   |0|   |                       |   |
+     *   |0|   +-----------------------+   |
+     *   |0|                               |
+     *   |0|                               |
+     *   |0|                               |
+     *   +-+-------------------------------+
+     */
+    s->ii_w = inlink->w + e*2;
+    s->ii_h = inlink->h + e*2;
+
+    // align to 4 the linesize, "+1" is for the space of the left 0-column
+    s->ii_lz_32 = FFALIGN(s->ii_w + 1, 4);
+
+    // allocate weighted average for every pixel
+    s->linesize = inlink->w + 100;
+
+    if (!s->ft) {
+        ret = ff_framethread_init(ctx, &s->ft, nlmeans_frame, sizeof(AVFrame *),
+                                  ff_filter_get_nb_threads(ctx));
+        if (ret < 0)
+            return ret;
+
+        s->workers = av_calloc(ret, sizeof(*s->workers));
+        if (!s->workers)
+            return AVERROR(ENOMEM);
+        s->nb_workers = ret;
+    } else {
+        /* the scratch buffers are reallocated for the new dimensions */
+        ff_framethread_wait(s->ft);
+    }
+
+    for (int i = 0; i < s->nb_workers; i++) {
+        NLMeansWorker *w = &s->workers[i];
+
+        av_freep(&w->ii_orig);
+        av_freep(&w->total_weight);
+        av_freep(&w->sum);
+
+        // "+1" is for the space of the top 0-line
+        w->ii_orig = av_calloc(s->ii_h + 1, s->ii_lz_32 * sizeof(*w->ii_orig));
+        if (!w->ii_orig)
+            return AVERROR(ENOMEM);
+
+        // skip top 0-line and left 0-column
+        w->ii = w->ii_orig + s->ii_lz_32 + 1;
+
+        w->total_weight = av_malloc_array(s->linesize, inlink->h * sizeof(*w->total_weight));
+        w->sum = av_malloc_array(s->linesize, inlink->h * sizeof(*w->sum));
+        if (!w->total_weight || !w->sum)
+            return AVERROR(ENOMEM);
+    }
 
     return 0;
 }
@@ -388,26 +443,36 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     AVFilterContext *ctx = inlink->dst;
     NLMeansContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
+    AVFrame *out;
 
-    AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+    /* pass the frame through in order with the ones being denoised */
+    if (ctx->is_disabled)
+        return ff_framethread_submit(s->ft, NULL, in);
+
+    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
         av_frame_free(&in);
         return AVERROR(ENOMEM);
     }
     av_frame_copy_props(out, in);
 
-    for (int i = 0; i < s->nb_planes; i++) {
-        const int w = i ? s->chroma_w          : inlink->w;
-        const int h = i ? s->chroma_h          : inlink->h;
-        const int p = i ? s->patch_hsize_uv    : s->patch_hsize;
-        const int r = i ? s->research_hsize_uv : s->research_hsize;
-        nlmeans_plane(ctx, w, h, p, r,
-                      out->data[i], out->linesize[i],
-                      in->data[i],  in->linesize[i]);
+    return ff_framethread_submit(s->ft, &in, out);
+}
+
+static int request_frame(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    NLMeansContext *s = ctx->priv;
+    int ret;
+
+    ret = ff_request_frame(ctx->inputs[0]);
+    if (ret == AVERROR_EOF && s->ft) {
+        int err = ff_framethread_flush(s->ft);
+        if (err < 0)
+            return err;
     }
 
-    av_frame_free(&in);
-    return ff_filter_frame(outlink, out);
+    return ret;
 }
 
 #define CHECK_ODD_FIELD(field, name) do {                       \
@@ -457,10 +522,16 @@ static av_cold int init(AVFilterContext *ctx)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     NLMeansContext *s = ctx->priv;
+
+    ff_framethread_uninit(&s->ft);
+
     av_freep(&s->weight_lut);
-    av_freep(&s->ii_orig);
-    av_freep(&s->total_weight);
-    av_freep(&s->sum);
+    for (int i = 0; i < s->nb_workers; i++) {
+        av_freep(&s->workers[i].ii_orig);
+        av_freep(&s->workers[i].total_weight);
+        av_freep(&s->workers[i].sum);
+    }
+    av_freep(&s->workers);
 }
 
 static const AVFilterPad nlmeans_inputs[] = {
@@ -474,8 +545,9 @@ static const AVFilterPad nlmeans_inputs[] = {
 
 static const AVFilterPad nlmeans_outputs[] = {
     {
-        .name = "default",
-        .type = AVMEDIA_TYPE_VIDEO,
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .request_frame = request_frame,
     },
 };
 
@@ -489,5 +561,6 @@ const AVFilter ff_vf_nlmeans = {
     FILTER_OUTPUTS(nlmeans_outputs),
     FILTER_PIXFMTS_ARRAY(pix_fmts),
     .priv_class    = &nlmeans_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS |
+                     AVFILTER_FLAG_FRAME_THREADS,
 };
@@ -1121,5 +1121,5 @@ const AVFilter ff_vf_overlay = {
     FILTER_OUTPUTS(avfilter_vf_overlay_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
-                     AVFILTER_FLAG_SLICE_THREADS,
+                     AVFILTER_FLAG_SLICE_THREADS | AVFILTER_FLAG_GRAPH_THREADS,
 };
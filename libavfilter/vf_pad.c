@@ -459,4 +459,5 @@ const AVFilter ff_vf_pad = {
     FILTER_INPUTS(avfilter_vf_pad_inputs),
     FILTER_OUTPUTS(avfilter_vf_pad_outputs),
     FILTER_QUERY_FUNC(query_formats),
+    .flags         = AVFILTER_FLAG_GRAPH_THREADS,
 };
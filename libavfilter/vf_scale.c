@@ -1049,6 +1049,7 @@ const AVFilter ff_vf_scale = {
     FILTER_OUTPUTS(avfilter_vf_scale_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_GRAPH_THREADS,
 };
 
 static const AVFilterPad avfilter_vf_scale2ref_inputs[] = {
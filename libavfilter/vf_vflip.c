@@ -149,5 +149,5 @@ const AVFilter ff_vf_vflip = {
     .priv_class  = &vflip_class,
     FILTER_INPUTS(avfilter_vf_vflip_inputs),
     FILTER_OUTPUTS(avfilter_vf_vflip_outputs),
-    .flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_GRAPH_THREADS,
 };
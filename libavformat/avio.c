@@ -661,6 +661,20 @@ int ffurl_shutdown(URLContext *h, int flags)
     return h->prot->url_shutdown(h, flags);
 }
 
+int ffurl_submit(URLContext *h, AVIORequest **reqs, int nb_reqs)
+{
+    if (!h || !h->prot || !h->prot->url_submit)
+        return AVERROR(ENOSYS);
+    return h->prot->url_submit(h, reqs, nb_reqs);
+}
+
+int ffurl_reap(URLContext *h, AVIORequest **req, int wait)
+{
+    if (!h || !h->prot || !h->prot->url_reap)
+        return AVERROR(ENOSYS);
+    return h->prot->url_reap(h, req, wait);
+}
+
 int ff_check_interrupt(AVIOInterruptCB *cb)
 {
     if (cb && cb->callback)
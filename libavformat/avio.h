@@ -570,6 +570,72 @@ int avio_read(AVIOContext *s, unsigned char *buf, int size);
  */
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size);
 
+/**
+ * A read or write at an absolute position, executed asynchronously by
+ * avio_submit() and returned by avio_reap() once complete.
+ */
+typedef struct AVIORequest {
+    /**
+     * Position in the stream, in bytes, at which the transfer starts.
+     */
+    int64_t pos;
+    /**
+     * Data to write, or where to store the data read. Must stay valid
+     * until the request is returned by avio_reap().
+     */
+    uint8_t *buf;
+    /**
+     * Number of bytes to transfer.
+     */
+    int size;
+    /**
+     * 1 to write buf to the stream, 0 to read into it.
+     */
+    int write;
+    /**
+     * Set by avio_reap(): the number of bytes transferred, which can only
+     * be less than size if the end of the stream was reached, or a negative
+     * AVERROR code. AVERROR_EOF is returned if nothing could be read.
+     */
+    int result;
+    /**
+     * For the caller's use, not touched by libavformat.
+     */
+    void *opaque;
+} AVIORequest;
+
+/**
+ * Queue reads and writes at absolute positions.
+ *
+ * The requests are independent of each other and of the buffered I/O
+ * done through the context: neither the buffer nor the current position
+ * of the context are changed. Protocols supporting it (e.g. file) keep
+ * all the requests in flight at the same time, others complete them
+ * synchronously during this call. Data written through the buffer is
+ * flushed before write requests are queued.
+ *
+ * Every request must be retrieved with avio_reap() before it is reused
+ * or freed, and before the context is closed.
+ *
+ * @param reqs    requests to queue
+ * @param nb_reqs number of requests in reqs
+ * @return 0 if all the requests were queued, a negative AVERROR code if
+ *         none were
+ */
+int avio_submit(AVIOContext *s, AVIORequest **reqs, int nb_reqs);
+
+/**
+ * Retrieve a completed request queued by avio_submit(). Requests complete
+ * in no particular order.
+ *
+ * @param req  set to the completed request, whose result field is set
+ * @param wait if nonzero, block until a request is complete
+ * @return 0 on success, AVERROR(EAGAIN) if wait is 0 and no request is
+ *         complete yet, AVERROR_EOF if no request is outstanding, another
+ *         negative AVERROR code on error
+ */
+int avio_reap(AVIOContext *s, AVIORequest **req, int wait);
+
 /**
  * @name Functions for reading from AVIOContext
  * @{
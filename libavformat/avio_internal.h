@@ -77,6 +77,17 @@ typedef struct FFIOContext {
      * is updated each time a successful writeout ends up further position-wise
      */
     int64_t written_output_size;
+
+    /**
+     * Requests completed synchronously by avio_submit(), for protocols
+     * without asynchronous I/O, until they are returned by avio_reap()
+     */
+    struct AVFifo *completed_requests;
+
+    /**
+     * Number of requests queued to the protocol and not yet reaped
+     */
+    int pending_requests;
 } FFIOContext;
 
 static av_always_inline FFIOContext *ffiocontext(AVIOContext *ctx)
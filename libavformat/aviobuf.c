@@ -22,6 +22,7 @@
 #include "third_party/ffmpeg/libavutil/bprint.h"
 #include "third_party/ffmpeg/libavutil/crc.h"
 #include "third_party/ffmpeg/libavutil/dict.h"
+#include "third_party/ffmpeg/libavutil/fifo.h"
 #include "third_party/ffmpeg/libavutil/internal.h"
 #include "third_party/ffmpeg/libavutil/intreadwrite.h"
 #include "third_party/ffmpeg/libavutil/log.h"
@@ -146,6 +147,8 @@ AVIOContext *avio_alloc_context(
 
 void avio_context_free(AVIOContext **ps)
 {
+    if (*ps)
+        av_fifo_freep2(&ffiocontext(*ps)->completed_requests);
     av_freep(ps);
 }
 
@@ -732,6 +735,108 @@ int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
     return len;
 }
 
+static int transfer_request(AVIOContext *s, AVIORequest *req)
+{
+    int64_t pos = s->seek(s->opaque, req->pos, SEEK_SET);
+    int done = 0;
+
+    if (pos < 0)
+        return pos;
+
+    if (req->write) {
+        int ret;
+        if (!s->write_packet)
+            return AVERROR(EINVAL);
+        ret = s->write_packet(s->opaque, req->buf, req->size);
+        return ret < 0 ? ret : req->size;
+    }
+
+    while (done < req->size) {
+        int ret = read_packet_wrapper(s, req->buf + done, req->size - done);
+        if (ret == AVERROR_EOF || !ret)
+            break;
+        if (ret < 0)
+            return ret;
+        done += ret;
+    }
+    return done ? done : AVERROR_EOF;
+}
+
+int avio_submit(AVIOContext *s, AVIORequest **reqs, int nb_reqs)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    int64_t pos;
+    int ret;
+
+    if (nb_reqs < 0)
+        return AVERROR(EINVAL);
+
+    if (s->write_flag)
+        avio_flush(s);
+
+    ret = ffurl_submit(ffio_geturlcontext(s), reqs, nb_reqs);
+    if (ret != AVERROR(ENOSYS)) {
+        if (ret >= 0)
+            ctx->pending_requests += nb_reqs;
+        return ret;
+    }
+
+    /* The protocol cannot do it, complete the requests here and restore
+     * the position of the underlying stream afterwards. */
+    if (!s->seek)
+        return AVERROR(ENOSYS);
+    if (!ctx->completed_requests) {
+        ctx->completed_requests = av_fifo_alloc2(nb_reqs, sizeof(*reqs),
+                                                 AV_FIFO_FLAG_AUTO_GROW);
+        if (!ctx->completed_requests)
+            return AVERROR(ENOMEM);
+    }
+    if (av_fifo_can_write(ctx->completed_requests) < nb_reqs) {
+        ret = av_fifo_grow2(ctx->completed_requests,
+                            nb_reqs - av_fifo_can_write(ctx->completed_requests));
+        if (ret < 0)
+            return ret;
+    }
+
+    for (int i = 0; i < nb_reqs; i++) {
+        reqs[i]->result = transfer_request(s, reqs[i]);
+        av_fifo_write(ctx->completed_requests, &reqs[i], 1);
+    }
+
+    pos = s->seek(s->opaque, s->pos, SEEK_SET);
+    if (pos < 0)
+        s->error = pos;
+    return 0;
+}
+
+int avio_reap(AVIOContext *s, AVIORequest **req, int wait)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    int ret;
+
+    *req = NULL;
+    if (!ctx->completed_requests ||
+        av_fifo_read(ctx->completed_requests, req, 1) < 0) {
+        if (!ctx->pending_requests)
+            return AVERROR_EOF;
+        ret = ffurl_reap(ffio_geturlcontext(s), req, wait);
+        if (ret < 0)
+            return ret;
+        ctx->pending_requests--;
+    }
+
+    if ((*req)->result > 0) {
+        if ((*req)->write) {
+            ctx->bytes_written += (*req)->result;
+            s->bytes_written    = ctx->bytes_written;
+        } else {
+            ctx->bytes_read    += (*req)->result;
+            s->bytes_read       = ctx->bytes_read;
+        }
+    }
+    return 0;
+}
+
 unsigned int avio_rl16(AVIOContext *s)
 {
     unsigned int val;
@@ -19,12 +19,17 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+/* needed by syscall() */
+#define _DEFAULT_SOURCE
+
 #include "config_components.h"
 
 #include "third_party/ffmpeg/libavutil/avstring.h"
+#include "third_party/ffmpeg/libavutil/fifo.h"
 #include "third_party/ffmpeg/libavutil/file_open.h"
 #include "third_party/ffmpeg/libavutil/internal.h"
 #include "third_party/ffmpeg/libavutil/opt.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -38,9 +43,24 @@
 #endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#if HAVE_LINUX_IO_URING_H
+#include <stdatomic.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 #include "os_support.h"
 #include "url.h"
 
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup) && \
+    defined(__NR_io_uring_enter) && defined(IORING_FEAT_FAST_POLL)
+#define FILE_IO_URING 1
+#else
+#define FILE_IO_URING 0
+#endif
+#define FILE_AIO_THREADS (HAVE_THREADS && HAVE_PREAD)
+#define FILE_AIO_MAX_THREADS 16
+
 /* Some systems may not have S_ISFIFO */
 #ifndef S_ISFIFO
 #  ifdef S_IFIFO
@@ -95,6 +115,8 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int aio_depth;
+    struct FileAIO *aio;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -105,6 +127,7 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio_depth", "maximum number of asynchronous transfers in flight", offsetof(FileContext, aio_depth), AV_OPT_TYPE_INT, { .i64 = 32 }, 1, 4096, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
     { NULL }
 };
 
@@ -215,10 +238,442 @@ static int fd_dup(URLContext *h, int oldfd)
     return newfd;
 }
 
+#if CONFIG_FILE_PROTOCOL
+
+/* Asynchronous transfers, see avio_submit(). They go through an io_uring
+ * instance where the kernel allows it and through a pool of threads doing
+ * pread()/pwrite() otherwise. */
+typedef struct FileAIO {
+    int fd;
+    AVFifo *queue;          ///< requests waiting for the ring or a thread
+    int outstanding;        ///< requests submitted and not yet reaped
+#if FILE_IO_URING
+    int ring_fd;            ///< -1 if the thread pool is used
+    unsigned in_ring;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+#endif
+#if FILE_AIO_THREADS
+    AVFifo *done;
+    pthread_t threads[FILE_AIO_MAX_THREADS];
+    int nb_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    int abort;
+#endif
+} FileAIO;
+
+#if FILE_IO_URING || FILE_AIO_THREADS
+static int fifo_reserve(AVFifo *f, size_t nb_elems)
+{
+    size_t size = av_fifo_can_read(f) + av_fifo_can_write(f);
+    return size < nb_elems ? av_fifo_grow2(f, nb_elems - size) : 0;
+}
+
+/**
+ * Account for a transfer of res bytes (or an error) done for req, the
+ * progress being kept in req->result until the request is complete.
+ *
+ * @return 1 if the request is complete, 0 if the rest must be transferred
+ */
+static int file_aio_complete(AVIORequest *req, int res)
+{
+    if (res == AVERROR(EINTR) || res == AVERROR(EAGAIN))
+        return 0;
+    if (res < 0) {
+        req->result = res;
+        return 1;
+    }
+    if (!res) {
+        if (!req->result)
+            req->result = req->write ? AVERROR(EIO) : AVERROR_EOF;
+        return 1;
+    }
+    req->result += res;
+    return req->result >= req->size;
+}
+#endif
+
+#if FILE_IO_URING
+static void *file_ring_map(int fd, size_t size, off_t offset)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static void file_ring_free(FileAIO *aio)
+{
+    if (aio->sqes)
+        munmap(aio->sqes, aio->sqes_size);
+    if (aio->cq_ring)
+        munmap(aio->cq_ring, aio->cq_ring_size);
+    if (aio->sq_ring)
+        munmap(aio->sq_ring, aio->sq_ring_size);
+    if (aio->ring_fd >= 0)
+        close(aio->ring_fd);
+    aio->ring_fd = -1;
+}
+
+static int file_ring_init(FileAIO *aio, unsigned entries)
+{
+    struct io_uring_params p = { 0 };
+    uint8_t *sq, *cq;
+
+    aio->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (aio->ring_fd < 0) {
+        aio->ring_fd = -1;
+        return AVERROR(errno);
+    }
+    /* IORING_OP_READ and IORING_OP_WRITE predate this feature, and with it
+     * the kernel never drops completions. */
+    if (!(p.features & IORING_FEAT_FAST_POLL)) {
+        file_ring_free(aio);
+        return AVERROR(ENOSYS);
+    }
+
+    aio->sq_entries   = p.sq_entries;
+    aio->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    aio->cq_ring_size = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    aio->sqes_size    = p.sq_entries * sizeof(struct io_uring_sqe);
+    aio->sq_ring = file_ring_map(aio->ring_fd, aio->sq_ring_size, IORING_OFF_SQ_RING);
+    aio->cq_ring = file_ring_map(aio->ring_fd, aio->cq_ring_size, IORING_OFF_CQ_RING);
+    aio->sqes    = file_ring_map(aio->ring_fd, aio->sqes_size,    IORING_OFF_SQES);
+    if (!aio->sq_ring || !aio->cq_ring || !aio->sqes) {
+        int ret = AVERROR(errno);
+        file_ring_free(aio);
+        return ret;
+    }
+
+    sq = aio->sq_ring;
+    cq = aio->cq_ring;
+    aio->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    aio->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    aio->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    aio->sq_array = (unsigned *)(sq + p.sq_off.array);
+    aio->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    aio->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    aio->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    aio->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static int file_ring_enter(FileAIO *aio, unsigned min_complete, unsigned flags)
+{
+    unsigned to_submit = *aio->sq_tail -
+        atomic_load_explicit((atomic_uint *)aio->sq_head, memory_order_acquire);
+    int ret;
+
+    if (!to_submit && !min_complete)
+        return 0;
+    do {
+        ret = syscall(__NR_io_uring_enter, aio->ring_fd, to_submit,
+                      min_complete, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? AVERROR(errno) : ret;
+}
+
+/* Move queued requests into the ring, at most one per submission entry so
+ * that the completion ring, twice as large, cannot overflow. */
+static int file_ring_fill(FileAIO *aio)
+{
+    unsigned tail = *aio->sq_tail;
+    AVIORequest *req;
+
+    while (aio->in_ring < aio->sq_entries &&
+           av_fifo_read(aio->queue, &req, 1) >= 0) {
+        unsigned idx = tail++ & *aio->sq_mask;
+        struct io_uring_sqe *sqe = &aio->sqes[idx];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd        = aio->fd;
+        sqe->off       = req->pos  + req->result;
+        sqe->addr      = (uintptr_t)(req->buf + req->result);
+        sqe->len       = req->size - req->result;
+        sqe->user_data = (uintptr_t)req;
+        aio->sq_array[idx] = idx;
+        aio->in_ring++;
+    }
+    atomic_store_explicit((atomic_uint *)aio->sq_tail, tail, memory_order_release);
+
+    return file_ring_enter(aio, 0, 0);
+}
+
+static int file_ring_reap(FileAIO *aio, AVIORequest **req, int wait)
+{
+    int ret;
+
+    for (;;) {
+        unsigned head = *aio->cq_head;
+
+        if (head != atomic_load_explicit((atomic_uint *)aio->cq_tail,
+                                         memory_order_acquire)) {
+            struct io_uring_cqe *cqe = &aio->cqes[head & *aio->cq_mask];
+            AVIORequest *done = (AVIORequest *)(uintptr_t)cqe->user_data;
+            int complete = file_aio_complete(done, cqe->res);
+
+            atomic_store_explicit((atomic_uint *)aio->cq_head, head + 1,
+                                  memory_order_release);
+            aio->in_ring--;
+            /* There is room for it, it was taken out of the queue. */
+            if (!complete)
+                av_fifo_write(aio->queue, &done, 1);
+            file_ring_fill(aio);
+            if (complete) {
+                *req = done;
+                return 0;
+            }
+            continue;
+        }
+
+        if (!wait)
+            return AVERROR(EAGAIN);
+        ret = file_ring_enter(aio, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0)
+            return ret;
+    }
+}
+#endif /* FILE_IO_URING */
+
+#if FILE_AIO_THREADS
+static void file_aio_transfer(int fd, AVIORequest *req)
+{
+    int ret;
+
+    do {
+        if (req->write)
+            ret = pwrite(fd, req->buf  + req->result, req->size - req->result,
+                         req->pos + req->result);
+        else
+            ret = pread(fd, req->buf  + req->result, req->size - req->result,
+                        req->pos + req->result);
+    } while (!file_aio_complete(req, ret < 0 ? AVERROR(errno) : ret));
+}
+
+static void *file_aio_thread(void *arg)
+{
+    FileAIO *aio = arg;
+    AVIORequest *req;
+
+    pthread_mutex_lock(&aio->lock);
+    for (;;) {
+        while (!aio->abort && av_fifo_read(aio->queue, &req, 1) < 0)
+            pthread_cond_wait(&aio->work_cond, &aio->lock);
+        if (aio->abort)
+            break;
+        pthread_mutex_unlock(&aio->lock);
+
+        file_aio_transfer(aio->fd, req);
+
+        pthread_mutex_lock(&aio->lock);
+        av_fifo_write(aio->done, &req, 1);
+        pthread_cond_signal(&aio->done_cond);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return NULL;
+}
+
+static void file_threads_free(FileAIO *aio)
+{
+    pthread_mutex_lock(&aio->lock);
+    aio->abort = 1;
+    pthread_cond_broadcast(&aio->work_cond);
+    pthread_mutex_unlock(&aio->lock);
+    for (int i = 0; i < aio->nb_threads; i++)
+        pthread_join(aio->threads[i], NULL);
+    aio->nb_threads = 0;
+
+    pthread_cond_destroy(&aio->done_cond);
+    pthread_cond_destroy(&aio->work_cond);
+    pthread_mutex_destroy(&aio->lock);
+    av_fifo_freep2(&aio->done);
+}
+
+static int file_threads_init(FileAIO *aio, int nb_threads)
+{
+    int ret;
+
+    aio->done = av_fifo_alloc2(1, sizeof(AVIORequest *), 0);
+    if (!aio->done)
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&aio->lock, NULL);
+    pthread_cond_init(&aio->work_cond, NULL);
+    pthread_cond_init(&aio->done_cond, NULL);
+
+    for (; aio->nb_threads < nb_threads; aio->nb_threads++) {
+        ret = pthread_create(&aio->threads[aio->nb_threads], NULL,
+                             file_aio_thread, aio);
+        if (ret) {
+            if (aio->nb_threads)
+                break;
+            file_threads_free(aio);
+            return AVERROR(ret);
+        }
+    }
+    return 0;
+}
+
+static int file_threads_reap(FileAIO *aio, AVIORequest **req, int wait)
+{
+    pthread_mutex_lock(&aio->lock);
+    while (av_fifo_read(aio->done, req, 1) < 0) {
+        if (!wait) {
+            pthread_mutex_unlock(&aio->lock);
+            return AVERROR(EAGAIN);
+        }
+        pthread_cond_wait(&aio->done_cond, &aio->lock);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return 0;
+}
+#endif /* FILE_AIO_THREADS */
+
+static void file_aio_free(FileContext *c)
+{
+    FileAIO *aio = c->aio;
+
+    if (!aio)
+        return;
+#if FILE_IO_URING
+    /* Closing the ring waits for the transfers in flight. */
+    if (aio->ring_fd >= 0)
+        file_ring_free(aio);
+#endif
+#if FILE_AIO_THREADS
+    if (aio->done)
+        file_threads_free(aio);
+#endif
+    av_fifo_freep2(&aio->queue);
+    av_freep(&c->aio);
+}
+
+static int file_aio_init(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    FileAIO *aio;
+    int ret = AVERROR(ENOSYS);
+
+    if (!FILE_IO_URING && !FILE_AIO_THREADS)
+        return ret;
+
+    aio = c->aio = av_mallocz(sizeof(*aio));
+    if (!aio)
+        return AVERROR(ENOMEM);
+    aio->fd    = c->fd;
+#if FILE_IO_URING
+    aio->ring_fd = -1;
+#endif
+    aio->queue = av_fifo_alloc2(c->aio_depth, sizeof(AVIORequest *), 0);
+    if (!aio->queue) {
+        file_aio_free(c);
+        return AVERROR(ENOMEM);
+    }
+
+#if FILE_IO_URING
+    ret = file_ring_init(aio, c->aio_depth);
+    if (ret >= 0)
+        return 0;
+    av_log(h, AV_LOG_VERBOSE, "io_uring unavailable (%s), using threads\n",
+           av_err2str(ret));
+#endif
+#if FILE_AIO_THREADS
+    ret = file_threads_init(aio, FFMIN(c->aio_depth, FILE_AIO_MAX_THREADS));
+    if (ret >= 0)
+        return 0;
+#endif
+    file_aio_free(c);
+    return ret;
+}
+
+static int file_submit(URLContext *h, AVIORequest **reqs, int nb_reqs)
+{
+    FileContext *c = h->priv_data;
+    FileAIO *aio = c->aio;
+    int ret;
+
+    if (!aio) {
+        ret = file_aio_init(h);
+        if (ret < 0)
+            return ret;
+        aio = c->aio;
+    }
+
+#if FILE_IO_URING
+    if (aio->ring_fd >= 0) {
+        /* Every outstanding request fits in the queue, so that partial
+         * transfers can always be queued again. */
+        ret = fifo_reserve(aio->queue, aio->outstanding + nb_reqs);
+        if (ret < 0)
+            return ret;
+        for (int i = 0; i < nb_reqs; i++) {
+            reqs[i]->result = 0;
+            av_fifo_write(aio->queue, &reqs[i], 1);
+        }
+        aio->outstanding += nb_reqs;
+        /* Entries the kernel did not take yet are submitted again
+         * by the next call. */
+        file_ring_fill(aio);
+        return 0;
+    }
+#endif
+#if FILE_AIO_THREADS
+    pthread_mutex_lock(&aio->lock);
+    ret = fifo_reserve(aio->queue, aio->outstanding + nb_reqs);
+    if (ret >= 0)
+        ret = fifo_reserve(aio->done, aio->outstanding + nb_reqs);
+    if (ret >= 0) {
+        for (int i = 0; i < nb_reqs; i++) {
+            reqs[i]->result = 0;
+            av_fifo_write(aio->queue, &reqs[i], 1);
+        }
+        aio->outstanding += nb_reqs;
+        pthread_cond_broadcast(&aio->work_cond);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static int file_reap(URLContext *h, AVIORequest **req, int wait)
+{
+    FileContext *c = h->priv_data;
+    FileAIO *aio = c->aio;
+    int ret = AVERROR(ENOSYS);
+
+    if (!aio || !aio->outstanding)
+        return AVERROR_EOF;
+#if FILE_IO_URING
+    if (aio->ring_fd >= 0)
+        ret = file_ring_reap(aio, req, wait);
+#endif
+#if FILE_AIO_THREADS
+    if (aio->done)
+        ret = file_threads_reap(aio, req, wait);
+#endif
+    if (ret >= 0)
+        aio->outstanding--;
+    return ret;
+}
+
+#endif /* CONFIG_FILE_PROTOCOL */
+
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+
+#if CONFIG_FILE_PROTOCOL
+    file_aio_free(c);
+#endif
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -418,6 +873,8 @@ const URLProtocol ff_file_protocol = {
     .url_open_dir        = file_open_dir,
     .url_read_dir        = file_read_dir,
     .url_close_dir       = file_close_dir,
+    .url_submit          = file_submit,
+    .url_reap            = file_reap,
     .default_whitelist   = "file,crypto,data"
 };
 
@@ -150,6 +150,17 @@ typedef struct MOVFragmentIndexItem {
     MOVFragmentStreamInfo * stream_info;
 } MOVFragmentIndexItem;
 
+/**
+ * Per stream totals of a fully scanned fragmented file, stored in the
+ * fragment index cache alongside the fragments.
+ */
+typedef struct MOVFragmentCacheStream {
+    int64_t duration;
+    int64_t data_size;
+    int64_t duration_for_fps;
+    int nb_frames_for_fps;
+} MOVFragmentCacheStream;
+
 typedef struct MOVFragmentIndex {
     int allocated_size;
     int complete;
@@ -163,6 +174,37 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Position in the sample tables of a track whose index is resolved lazily.
+ */
+typedef struct MOVSampleCursor {
+    unsigned int sample;        ///< sample the cursor points to, UINT_MAX if unset
+    unsigned int chunk;         ///< chunk containing the sample
+    unsigned int chunk_sample;  ///< position of the sample in its chunk
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;    ///< next sync sample entry to match
+    unsigned int distance;      ///< samples since the last keyframe
+    int keyframe;
+    int64_t offset;
+    int64_t dts;
+} MOVSampleCursor;
+
+/**
+ * A run of samples of one track that are adjacent in the file, read with a
+ * single request.
+ */
+typedef struct MOVReadBatch {
+    uint8_t *data;
+    unsigned int allocated_size;
+    int64_t pos;              ///< file offset of data
+    int requested;            ///< number of bytes to read at pos
+    int size;                 ///< number of bytes read, 0 if none
+    int state;                ///< owned by the readahead thread unless idle
+    unsigned int next_sample; ///< first sample after the ones in the batch
+} MOVReadBatch;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int pb_is_copied;
@@ -191,6 +233,9 @@ typedef struct MOVStreamContext {
     unsigned int stsz_sample_size; ///< always contains sample size from stsz atom
     unsigned int sample_count;
     int *sample_sizes;
+    const uint8_t *stsz_map;  ///< stsz entries read in place from the mapped input, if set
+    const uint8_t *stco_map;  ///< stco/co64 entries read in place from the mapped input, if set
+    int stco_map_entry_size;  ///< 4 for stco, 8 for co64
     int keyframe_absent;
     unsigned int keyframe_count;
     int *keyframes;
@@ -232,6 +277,15 @@ typedef struct MOVStreamContext {
     int open_key_samples_count;
     uint32_t min_sample_duration;
 
+    int lazy_index;       ///< samples are resolved from the sample tables on demand
+    unsigned int lazy_sample_count;
+    int64_t lazy_first_dts;
+    MOVSampleCursor lazy_cursor;
+    AVIndexEntry lazy_entry; ///< entry of the sample lazy_cursor points to
+
+    MOVReadBatch read_batch[2]; ///< current batch and the one read ahead
+    int read_batch_cur;
+
     int nb_frames_for_fps;
     int64_t duration_for_fps;
 
@@ -287,6 +341,13 @@ typedef struct MOVContext {
     int ignore_editlist;
     int advanced_editlist;
     int advanced_editlist_autodisabled;
+    int lazy_index;
+    int mmap_tables;
+    uint8_t *file_map;    ///< input file mapped for the mmap_tables option
+    size_t file_map_size;
+    int read_batch_size;
+    int read_ahead;
+    struct MOVBatchReader *batch_reader;
     int ignore_chapters;
     int seek_individually;
     int64_t next_root_atom; ///< offset of the next root atom
@@ -299,6 +360,9 @@ typedef struct MOVContext {
     int has_looked_for_mfra;
     int use_tfdt;
     MOVFragmentIndex frag_index;
+    char *frag_index_cache;                    ///< path of the fragment index cache, if any
+    int frag_index_cache_checked;
+    MOVFragmentCacheStream *frag_cache_streams; ///< totals loaded from the cache, until applied
     int atom_depth;
     unsigned int aax_mode;  ///< 'aax' file has been detected
     uint8_t file_key[20];
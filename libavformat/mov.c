@@ -23,11 +23,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#include "third_party/ffmpeg/config.h"
 #include "config_components.h"
 
 #include <inttypes.h>
 #include <limits.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
 #include "third_party/ffmpeg/libavutil/attributes.h"
 #include "third_party/ffmpeg/libavutil/bprint.h"
@@ -40,6 +44,7 @@
 #include "third_party/ffmpeg/libavutil/avassert.h"
 #include "third_party/ffmpeg/libavutil/avstring.h"
 #include "third_party/ffmpeg/libavutil/dict.h"
+#include "third_party/ffmpeg/libavutil/file.h"
 #include "third_party/ffmpeg/libavutil/opt.h"
 #include "third_party/ffmpeg/libavutil/aes.h"
 #include "third_party/ffmpeg/libavutil/aes_ctr.h"
@@ -47,6 +52,7 @@
 #include "third_party/ffmpeg/libavutil/sha.h"
 #include "third_party/ffmpeg/libavutil/spherical.h"
 #include "third_party/ffmpeg/libavutil/stereo3d.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
 #include "third_party/ffmpeg/libavutil/timecode.h"
 #include "third_party/ffmpeg/libavutil/uuid.h"
 #include "third_party/ffmpeg/libavcodec/ac3tab.h"
@@ -64,6 +70,7 @@
 #include "third_party/ffmpeg/libavcodec/get_bits.h"
 #include "id3v1.h"
 #include "mov_chan.h"
+#include "os_support.h"
 #include "replaygain.h"
 
 #if CONFIG_ZLIB
@@ -1407,11 +1414,212 @@ static void fix_frag_index_entries(MOVFragmentIndex *frag_index, int index,
     }
 }
 
+/**
+ * Return the path of the input if it is a local file, NULL otherwise.
+ */
+static const char *mov_local_file(AVFormatContext *s)
+{
+    const char *proto = avio_find_protocol_name(s->url);
+    const char *filename = s->url;
+
+    if ((s->flags & AVFMT_FLAG_CUSTOM_IO) ||
+        !(s->pb->seekable & AVIO_SEEKABLE_NORMAL) ||
+        !proto || strcmp(proto, "file"))
+        return NULL;
+    av_strstart(filename, "file:", &filename);
+    return filename;
+}
+
+#define MOV_FRAG_CACHE_TAG     MKBETAG('F','F','F','I')
+#define MOV_FRAG_CACHE_VERSION 2
+
+/**
+ * Get the size and modification time of the input, the latter in
+ * nanoseconds where the system provides them.
+ */
+static int mov_frag_cache_stat(MOVContext *c, int64_t *size, int64_t *mtime)
+{
+    const char *filename = mov_local_file(c->fc);
+    struct stat st;
+
+    if (!filename || stat(filename, &st) < 0)
+        return AVERROR(ENOSYS);
+    *size  = st.st_size;
+    *mtime = (int64_t)st.st_mtime * 1000000000;
+#if HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    *mtime += st.st_mtim.tv_nsec;
+#endif
+    return 0;
+}
+
+/**
+ * Fill the fragment index from the cache file, if it was written for the
+ * input as it is now. Returns 1 if the index was loaded.
+ */
+static int mov_read_frag_index_cache(MOVContext *c)
+{
+    AVFormatContext *s = c->fc;
+    AVIOContext *f = NULL;
+    MOVFragmentCacheStream *streams = NULL;
+    int64_t size, mtime, prev_offset = -1;
+    unsigned nb_streams, nb_items;
+    int ret;
+
+    if (mov_frag_cache_stat(c, &size, &mtime) < 0)
+        return 0;
+    if (s->io_open(s, &f, c->frag_index_cache, AVIO_FLAG_READ, NULL) < 0)
+        return 0;
+
+    ret = AVERROR_INVALIDDATA;
+    if (avio_rb32(f) != MOV_FRAG_CACHE_TAG ||
+        avio_rb32(f) != MOV_FRAG_CACHE_VERSION ||
+        avio_rb64(f) != size || avio_rb64(f) != mtime)
+        goto fail;
+
+    nb_streams = avio_rb32(f);
+    if (nb_streams != s->nb_streams)
+        goto fail;
+    streams = av_calloc(nb_streams, sizeof(*streams));
+    if (!streams) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (unsigned i = 0; i < nb_streams; i++) {
+        if (avio_rb32(f) != s->streams[i]->id)
+            goto fail;
+        streams[i].duration          = avio_rb64(f);
+        streams[i].data_size         = avio_rb64(f);
+        streams[i].duration_for_fps  = avio_rb64(f);
+        streams[i].nb_frames_for_fps = avio_rb32(f);
+    }
+
+    nb_items = avio_rb32(f);
+    if (!nb_items || avio_feof(f) ||
+        nb_items > (avio_size(f) - avio_tell(f)) / (8 + 24 * nb_streams))
+        goto fail;
+
+    for (unsigned i = 0; i < nb_items; i++) {
+        int64_t moof_offset = avio_rb64(f);
+        MOVFragmentIndexItem *item;
+        int index;
+
+        if (moof_offset <= prev_offset || moof_offset >= size)
+            goto fail;
+        prev_offset = moof_offset;
+
+        index = update_frag_index(c, moof_offset);
+        if (index < 0) {
+            ret = index == -1 ? AVERROR(ENOMEM) : index;
+            goto fail;
+        }
+        item = &c->frag_index.item[index];
+        for (unsigned j = 0; j < nb_streams; j++) {
+            item->stream_info[j].sidx_pts       = avio_rb64(f);
+            item->stream_info[j].first_tfra_pts = avio_rb64(f);
+            item->stream_info[j].tfdt_dts       = avio_rb64(f);
+        }
+    }
+    if (avio_feof(f))
+        goto fail;
+
+    ff_format_io_close(s, &f);
+    c->frag_cache_streams  = streams;
+    c->frag_index.complete = 1;
+    av_log(s, AV_LOG_VERBOSE, "loaded %u fragments from index cache %s\n",
+           nb_items, c->frag_index_cache);
+    return 1;
+
+fail:
+    av_log(s, AV_LOG_VERBOSE, "ignoring fragment index cache %s: %s\n",
+           c->frag_index_cache, av_err2str(ret));
+    ff_format_io_close(s, &f);
+    av_free(streams);
+    for (int i = 0; i < c->frag_index.nb_items; i++)
+        av_freep(&c->frag_index.item[i].stream_info);
+    c->frag_index.nb_items = 0;
+    return 0;
+}
+
+/**
+ * Store the fragment index built by scanning all moof atoms, so that later
+ * opens of the same file can skip the scan.
+ */
+static void mov_write_frag_index_cache(MOVContext *c)
+{
+    AVFormatContext *s = c->fc;
+    MOVFragmentIndex *frag_index = &c->frag_index;
+    AVIOContext *f = NULL;
+    int64_t size, mtime;
+    int ret;
+
+    if (frag_index->complete || !frag_index->nb_items ||
+        (s->flags & AVFMT_FLAG_IGNIDX) ||
+        mov_frag_cache_stat(c, &size, &mtime) < 0)
+        return;
+
+    /* fragments without a stored start time could not be seeked to */
+    for (int i = 0; i < frag_index->nb_items; i++) {
+        MOVFragmentIndexItem *item = &frag_index->item[i];
+        if (item->nb_stream_info != s->nb_streams)
+            return;
+        for (int j = 0; j < item->nb_stream_info; j++)
+            if (item->stream_info[j].index_entry >= 0 &&
+                get_stream_info_time(&item->stream_info[j]) == AV_NOPTS_VALUE) {
+                av_log(s, AV_LOG_VERBOSE, "fragments lack start times, "
+                       "not writing fragment index cache\n");
+                return;
+            }
+    }
+
+    ret = s->io_open(s, &f, c->frag_index_cache, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_WARNING, "could not open fragment index cache %s: %s\n",
+               c->frag_index_cache, av_err2str(ret));
+        return;
+    }
+
+    avio_wb32(f, MOV_FRAG_CACHE_TAG);
+    avio_wb32(f, MOV_FRAG_CACHE_VERSION);
+    avio_wb64(f, size);
+    avio_wb64(f, mtime);
+    avio_wb32(f, s->nb_streams);
+    for (int i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        MOVStreamContext *sc = st->priv_data;
+        avio_wb32(f, st->id);
+        avio_wb64(f, st->duration);
+        avio_wb64(f, sc->data_size);
+        avio_wb64(f, sc->duration_for_fps);
+        avio_wb32(f, sc->nb_frames_for_fps);
+    }
+    avio_wb32(f, frag_index->nb_items);
+    for (int i = 0; i < frag_index->nb_items; i++) {
+        MOVFragmentIndexItem *item = &frag_index->item[i];
+        avio_wb64(f, item->moof_offset);
+        for (int j = 0; j < item->nb_stream_info; j++) {
+            avio_wb64(f, item->stream_info[j].sidx_pts);
+            avio_wb64(f, item->stream_info[j].first_tfra_pts);
+            avio_wb64(f, item->stream_info[j].tfdt_dts);
+        }
+    }
+    avio_flush(f);
+    if (f->error < 0)
+        av_log(s, AV_LOG_WARNING, "error writing fragment index cache %s: %s\n",
+               c->frag_index_cache, av_err2str(f->error));
+    ff_format_io_close(s, &f);
+}
+
 static int mov_read_moof(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     // Set by mov_read_tfhd(). mov_read_trun() will reject files missing tfhd.
     c->fragment.found_tfhd = 0;
 
+    if (c->frag_index_cache && !c->frag_index_cache_checked) {
+        c->frag_index_cache_checked = 1;
+        if (!c->frag_index.nb_items && mov_read_frag_index_cache(c))
+            c->has_looked_for_mfra = 1;
+    }
+
     if (!c->has_looked_for_mfra && c->use_mfra_for > 0) {
         c->has_looked_for_mfra = 1;
         if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
@@ -2048,11 +2256,46 @@ static int mov_read_strf(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return 0;
 }
 
+/**
+ * Return a pointer to the next entries * entry_size bytes of pb inside the
+ * mapped input file, or NULL if the table has to be read into memory.
+ */
+static const uint8_t *mov_map_table(MOVContext *c, AVIOContext *pb, int64_t avail,
+                                    unsigned int entries, int entry_size)
+{
+    int64_t pos = avio_tell(pb);
+    int64_t size = (int64_t)entries * entry_size;
+
+    if (!c->file_map || pb != c->fc->pb || pos < 0 || size > avail ||
+        pos > c->file_map_size || size > c->file_map_size - pos)
+        return NULL;
+    return c->file_map + pos;
+}
+
+static av_always_inline int64_t mov_get_chunk_offset(const MOVStreamContext *sc,
+                                                     unsigned int chunk)
+{
+    if (!sc->stco_map)
+        return sc->chunk_offsets[chunk];
+    if (sc->stco_map_entry_size == 8)
+        return AV_RB64(sc->stco_map + 8 * chunk);
+    return AV_RB32(sc->stco_map + 4 * chunk);
+}
+
+static av_always_inline int mov_get_sample_size(const MOVStreamContext *sc,
+                                                unsigned int sample)
+{
+    if (!sc->stsz_map)
+        return sc->sample_sizes[sample];
+    return AV_RB32(sc->stsz_map + 4 * sample);
+}
+
 static int mov_read_stco(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     AVStream *st;
     MOVStreamContext *sc;
     unsigned int i, entries;
+    int entry_size;
 
     if (c->trak_index < 0) {
         av_log(c->fc, AV_LOG_WARNING, "STCO outside TRAK\n");
@@ -2062,6 +2305,9 @@ static int mov_read_stco(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         return 0;
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
+    /* the sample tables of a lazily indexed track are in use until it is closed */
+    if (sc->lazy_index)
+        return 0;
 
     avio_r8(pb); /* version */
     avio_rb24(pb); /* flags */
@@ -2071,10 +2317,18 @@ static int mov_read_stco(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (!entries)
         return 0;
 
-    if (sc->chunk_offsets) {
+    if (sc->chunk_offsets || sc->stco_map) {
         av_log(c->fc, AV_LOG_WARNING, "Ignoring duplicated STCO atom\n");
         return 0;
     }
+
+    entry_size = atom.type == MKTAG('c','o','6','4') ? 8 : 4;
+    if ((sc->stco_map = mov_map_table(c, pb, atom.size - 8, entries, entry_size))) {
+        sc->stco_map_entry_size = entry_size;
+        sc->chunk_count = entries;
+        return 0;
+    }
+
     av_free(sc->chunk_offsets);
     sc->chunk_count = 0;
     sc->chunk_offsets = av_malloc_array(entries, sizeof(*sc->chunk_offsets));
@@ -2716,6 +2970,8 @@ static int mov_read_stsc(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         return 0;
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
+    if (sc->lazy_index)
+        return 0;
 
     avio_r8(pb); /* version */
     avio_rb24(pb); /* flags */
@@ -2850,6 +3106,8 @@ static int mov_read_stss(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     st = c->fc->streams[c->fc->nb_streams-1];
     sti = ffstream(st);
     sc = st->priv_data;
+    if (sc->lazy_index)
+        return 0;
 
     avio_r8(pb); /* version */
     avio_rb24(pb); /* flags */
@@ -2895,12 +3153,15 @@ static int mov_read_stsz(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     unsigned int i, entries, sample_size, field_size, num_bytes;
     GetBitContext gb;
     unsigned char* buf;
+    const uint8_t *map;
     int ret;
 
     if (c->fc->nb_streams < 1)
         return 0;
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
+    if (sc->lazy_index)
+        return 0;
 
     avio_r8(pb); /* version */
     avio_rb24(pb); /* flags */
@@ -2933,10 +3194,26 @@ static int mov_read_stsz(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         return 0;
     if (entries >= (INT_MAX - 4 - 8 * AV_INPUT_BUFFER_PADDING_SIZE) / field_size)
         return AVERROR_INVALIDDATA;
-    if (sc->sample_sizes)
+    if (sc->sample_sizes || sc->stsz_map)
         av_log(c->fc, AV_LOG_WARNING, "Duplicated STSZ atom\n");
     av_free(sc->sample_sizes);
     sc->sample_count = 0;
+    sc->stsz_map = NULL;
+
+    if (field_size == 32 && (map = mov_map_table(c, pb, atom.size - 12, entries, 4))) {
+        for (i = 0; i < entries; i++) {
+            int size = AV_RB32(map + 4 * i);
+            if (size < 0) {
+                av_log(c->fc, AV_LOG_ERROR, "Invalid sample size %d\n", size);
+                return AVERROR_INVALIDDATA;
+            }
+            sc->data_size += size;
+        }
+        sc->stsz_map = map;
+        sc->sample_count = entries;
+        return 0;
+    }
+
     sc->sample_sizes = av_malloc_array(entries, sizeof(*sc->sample_sizes));
     if (!sc->sample_sizes)
         return AVERROR(ENOMEM);
@@ -2990,6 +3267,8 @@ static int mov_read_stts(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         return 0;
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
+    if (sc->lazy_index)
+        return 0;
 
     avio_r8(pb); /* version */
     avio_rb24(pb); /* flags */
@@ -3542,11 +3821,418 @@ static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, uns
     return *ctts_count;
 }
 
+/* Maximum number of samples the lazy cursor steps over before repositioning. */
+#define MOV_LAZY_INDEX_MAX_STEP 64
+
+static int mov_lazy_index_supported(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!mov->lazy_index || ffstream(st)->nb_index_entries)
+        return 0;
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+        st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    /* uncompressed audio is demuxed per chunk, its index is small anyway */
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+        sc->stts_count == 1 && sc->stts_data[0].duration == 1)
+        return 0;
+    if (!sc->sample_count || !sc->chunk_count || !sc->stsc_count || !sc->stts_count ||
+        sc->stps_count || (sc->rap_group_count && sc->rap_group))
+        return 0;
+    /* every sample has to belong to the demuxed sample description */
+    if (sc->pseudo_stream_id != -1) {
+        for (unsigned int i = 0; i < sc->stsc_count; i++)
+            if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id)
+                return 0;
+    }
+    return 1;
+}
+
+static inline unsigned int mov_lazy_sample_size(const MOVStreamContext *sc, unsigned int sample)
+{
+    return sc->stsz_sample_size > 0 ? sc->stsz_sample_size : mov_get_sample_size(sc, sample);
+}
+
+static inline int mov_lazy_key_off(const MOVStreamContext *sc)
+{
+    return sc->keyframe_count && sc->keyframes[0] > 0;
+}
+
+/* Number of stss entries not greater than value, stss being sorted. */
+static unsigned int mov_stss_count_le(const MOVStreamContext *sc, int64_t value)
+{
+    unsigned int lo = 0, hi = sc->keyframe_count;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if ((unsigned)sc->keyframes[mid] <= value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Same rules as the sample loop of mov_build_index(). */
+static void mov_lazy_cursor_set_keyframe(AVStream *st, MOVSampleCursor *cur)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    cur->keyframe = 0;
+    if (!sc->keyframe_absent && (!sc->keyframe_count ||
+        cur->sample + mov_lazy_key_off(sc) == sc->keyframes[cur->stss_index])) {
+        cur->keyframe = 1;
+        if (cur->stss_index + 1 < sc->keyframe_count)
+            cur->stss_index++;
+    }
+    if (sc->keyframe_absent &&
+        (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (!cur->chunk && !cur->chunk_sample)))
+        cur->keyframe = 1;
+    if (cur->keyframe)
+        cur->distance = 0;
+}
+
+static int mov_lazy_cursor_enter_chunk(MOVStreamContext *sc, MOVSampleCursor *cur)
+{
+    while (cur->chunk_sample >= sc->stsc_data[cur->stsc_index].count) {
+        if (cur->chunk + 1 >= sc->chunk_count)
+            return AVERROR_INVALIDDATA;
+        cur->chunk++;
+        cur->chunk_sample = 0;
+        cur->offset = mov_get_chunk_offset(sc, cur->chunk);
+        while (mov_stsc_index_valid(cur->stsc_index, sc->stsc_count) &&
+               cur->chunk + 1 == sc->stsc_data[cur->stsc_index + 1].first)
+            cur->stsc_index++;
+    }
+    return 0;
+}
+
+static int mov_lazy_cursor_next(AVStream *st, MOVSampleCursor *cur)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int ret;
+
+    cur->offset += mov_lazy_sample_size(sc, cur->sample);
+    cur->dts    += sc->stts_data[cur->stts_index].duration;
+    cur->stts_sample++;
+    if (cur->stts_index + 1 < sc->stts_count &&
+        cur->stts_sample == sc->stts_data[cur->stts_index].count) {
+        cur->stts_sample = 0;
+        cur->stts_index++;
+    }
+    cur->sample++;
+    cur->chunk_sample++;
+    cur->distance++;
+    if ((ret = mov_lazy_cursor_enter_chunk(sc, cur)) < 0)
+        return ret;
+    mov_lazy_cursor_set_keyframe(st, cur);
+    return 0;
+}
+
+/* Position the cursor on an arbitrary sample using the compact tables only. */
+static int mov_lazy_cursor_seek(AVStream *st, MOVSampleCursor *cur, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int key_off = mov_lazy_key_off(sc);
+    int64_t base = 0;
+    unsigned int i, k;
+
+    memset(cur, 0, sizeof(*cur));
+    cur->sample = sample;
+
+    cur->dts = sc->lazy_first_dts;
+    for (i = 0; i + 1 < sc->stts_count && sc->stts_data[i].count &&
+                sample - base >= sc->stts_data[i].count; i++) {
+        cur->dts += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+        base     += sc->stts_data[i].count;
+    }
+    cur->stts_index  = i;
+    cur->stts_sample = sample - base;
+    cur->dts        += (int64_t)cur->stts_sample * sc->stts_data[i].duration;
+
+    base = 0;
+    for (i = 0; i < sc->stsc_count; i++) {
+        int64_t samples = mov_get_stsc_samples(sc, i);
+        if (samples > 0 && sample - base < samples)
+            break;
+        base += FFMAX(samples, 0);
+    }
+    if (i == sc->stsc_count)
+        return AVERROR_INVALIDDATA;
+    cur->stsc_index   = i;
+    cur->chunk        = sc->stsc_data[i].first - 1 + (sample - base) / sc->stsc_data[i].count;
+    cur->chunk_sample = (sample - base) % sc->stsc_data[i].count;
+    if (cur->chunk >= sc->chunk_count)
+        return AVERROR_INVALIDDATA;
+    cur->offset = mov_get_chunk_offset(sc, cur->chunk);
+    for (k = sample - cur->chunk_sample; k < sample; k++)
+        cur->offset += mov_lazy_sample_size(sc, k);
+
+    if (sc->keyframe_count) {
+        k = mov_stss_count_le(sc, (int64_t)sample + key_off - 1);
+        cur->stss_index = FFMIN(k, sc->keyframe_count - 1);
+        k = mov_stss_count_le(sc, (int64_t)sample + key_off);
+        cur->distance = k ? sample + key_off - sc->keyframes[k - 1] : sample;
+    } else {
+        cur->distance = sample;
+    }
+    mov_lazy_cursor_set_keyframe(st, cur);
+    return 0;
+}
+
+/**
+ * Move the cursor to the given sample and set e to its entry. e must be the
+ * entry of the sample the cursor pointed to before.
+ */
+static AVIndexEntry *mov_lazy_cursor_entry(AVStream *st, MOVSampleCursor *cur,
+                                           AVIndexEntry *e, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (sample >= sc->lazy_sample_count)
+        return NULL;
+    if (sample == cur->sample)
+        return e;
+
+    if (cur->sample != UINT_MAX && sample > cur->sample &&
+        sample - cur->sample <= MOV_LAZY_INDEX_MAX_STEP) {
+        while (cur->sample < sample)
+            if (mov_lazy_cursor_next(st, cur) < 0)
+                goto fail;
+    } else if (mov_lazy_cursor_seek(st, cur, sample) < 0) {
+        goto fail;
+    }
+
+    e->pos          = cur->offset;
+    e->timestamp    = cur->dts;
+    e->size         = mov_lazy_sample_size(sc, sample);
+    e->min_distance = cur->distance;
+    e->flags        = cur->keyframe ? AVINDEX_KEYFRAME : 0;
+    return e;
+fail:
+    cur->sample = UINT_MAX;
+    return NULL;
+}
+
+static AVIndexEntry *mov_lazy_get_entry(AVStream *st, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return mov_lazy_cursor_entry(st, &sc->lazy_cursor, &sc->lazy_entry, sample);
+}
+
+/**
+ * Count the samples mov_build_index() would have indexed, checking the
+ * tables the same way but without storing anything per sample.
+ */
+static unsigned int mov_lazy_count_samples(MOVContext *mov, MOVStreamContext *sc,
+                                           uint64_t *stream_size)
+{
+    unsigned int current_sample = 0;
+    unsigned int stsc_index = 0;
+
+    for (unsigned int i = 0; i < sc->chunk_count; i++) {
+        int64_t next_offset = i+1 < sc->chunk_count ? mov_get_chunk_offset(sc, i+1) : INT64_MAX;
+        int64_t current_offset = mov_get_chunk_offset(sc, i);
+        while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+            i + 1 == sc->stsc_data[stsc_index + 1].first)
+            stsc_index++;
+
+        if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+            sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
+            av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+            sc->stsz_sample_size = sc->sample_size;
+        }
+        if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+            av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+            sc->stsz_sample_size = sc->sample_size;
+        }
+
+        for (unsigned int j = 0; j < sc->stsc_data[stsc_index].count; j++) {
+            unsigned int sample_size;
+            if (current_sample >= sc->sample_count) {
+                av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+                return current_sample;
+            }
+            sample_size = mov_lazy_sample_size(sc, current_sample);
+            if (current_offset > INT64_MAX - sample_size) {
+                av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
+                       current_offset, sample_size);
+                return current_sample;
+            }
+            if (sample_size > 0x3FFFFFFF) {
+                av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+                return current_sample;
+            }
+            current_offset += sample_size;
+            *stream_size   += sample_size;
+            current_sample++;
+        }
+    }
+    return current_sample;
+}
+
+/**
+ * Set up a track so that its samples are resolved from stts/stsc/stsz/stco
+ * when read or seeked, instead of being expanded into the generic index.
+ */
+static void mov_lazy_index_init(MOVContext *mov, AVStream *st, int64_t first_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    uint64_t stream_size = 0;
+
+    sc->lazy_sample_count = mov_lazy_count_samples(mov, sc, &stream_size);
+    sc->lazy_first_dts    = first_dts;
+    sc->lazy_cursor.sample = UINT_MAX;
+    sc->lazy_index = 1;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        for (unsigned int i = 0; i < 99 && i < sc->lazy_sample_count; i++)
+            ff_rfps_add_frame(mov->fc, st, mov_lazy_get_entry(st, i)->timestamp);
+    }
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: %u samples indexed lazily\n",
+           st->index, sc->lazy_sample_count);
+}
+
+/**
+ * Lazily indexed counterpart of av_index_search_timestamp().
+ */
+static int mov_lazy_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int nb_samples = sc->lazy_sample_count;
+    int key_off = mov_lazy_key_off(sc);
+    int64_t dts = sc->lazy_first_dts;
+    int64_t a = -1, b = nb_samples, m, k;
+    unsigned int base = 0;
+
+    /* a: last sample with dts <= wanted, b: first sample with dts >= wanted */
+    for (unsigned int i = 0; i < sc->stts_count && base < nb_samples; i++) {
+        unsigned int count = nb_samples - base;
+        int64_t duration = sc->stts_data[i].duration;
+
+        if (i + 1 < sc->stts_count && sc->stts_data[i].count)
+            count = FFMIN(count, sc->stts_data[i].count);
+
+        if (wanted_timestamp < dts) {
+            if (b == nb_samples)
+                b = base;
+            break;
+        }
+        if (!duration) {
+            a = base + count - 1;
+            if (dts == wanted_timestamp && b == nb_samples)
+                b = base;
+        } else {
+            k = av_sat_sub64(wanted_timestamp, dts) / duration;
+            if (k < count) {
+                a = base + k;
+                if (b == nb_samples)
+                    b = base + k + (dts + k * duration != wanted_timestamp);
+                break;
+            }
+            a = base + count - 1;
+        }
+        dts  += count * duration;
+        base += count;
+    }
+
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+    if (!(flags & AVSEEK_FLAG_ANY) && m >= 0 && m < nb_samples) {
+        if (sc->keyframe_absent) {
+            if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+                m = (flags & AVSEEK_FLAG_BACKWARD) || !m ? 0 : nb_samples;
+        } else if (sc->keyframe_count) {
+            if (flags & AVSEEK_FLAG_BACKWARD) {
+                k = mov_stss_count_le(sc, m + key_off);
+                m = k ? (int64_t)(unsigned)sc->keyframes[k - 1] - key_off : -1;
+            } else {
+                k = mov_stss_count_le(sc, m + key_off - 1);
+                m = k < sc->keyframe_count ?
+                    FFMIN((int64_t)(unsigned)sc->keyframes[k] - key_off, nb_samples) : nb_samples;
+            }
+        }
+    }
+    if (m >= nb_samples)
+        return -1;
+    return m;
+}
+
+/**
+ * Expand a lazily indexed track into the generic index, for the code paths
+ * (such as fragments appended to a track) that need it in full.
+ */
+static int mov_lazy_index_materialize(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVCtts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int nb_samples = sc->lazy_sample_count;
+
+    if (!sc->lazy_index)
+        return 0;
+
+    if (av_reallocp_array(&sti->index_entries, nb_samples, sizeof(*sti->index_entries)) < 0) {
+        sti->nb_index_entries = 0;
+        return AVERROR(ENOMEM);
+    }
+    sti->index_entries_allocated_size = nb_samples * sizeof(*sti->index_entries);
+    for (sti->nb_index_entries = 0; sti->nb_index_entries < nb_samples; sti->nb_index_entries++) {
+        const AVIndexEntry *e = mov_lazy_get_entry(st, sti->nb_index_entries);
+        if (!e)
+            break;
+        sti->index_entries[sti->nb_index_entries] = *e;
+    }
+    sc->lazy_index = 0;
+
+    if (ctts_data_old) {
+        // Expand ctts entries such that we have a 1-1 mapping with samples
+        sc->ctts_data = NULL;
+        sc->ctts_count = 0;
+        sc->ctts_allocated_size = 0;
+        for (unsigned int i = 0; i < ctts_count_old && sc->ctts_count < sti->nb_index_entries; i++)
+            for (unsigned int j = 0; j < ctts_data_old[i].count &&
+                                     sc->ctts_count < sti->nb_index_entries; j++)
+                if (add_ctts_entry(&sc->ctts_data, &sc->ctts_count, &sc->ctts_allocated_size,
+                                   1, ctts_data_old[i].duration) < 0) {
+                    av_free(ctts_data_old);
+                    return AVERROR(ENOMEM);
+                }
+        av_free(ctts_data_old);
+        sc->ctts_index  = sc->current_sample;
+        sc->ctts_sample = 0;
+    }
+
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stts_data);
+    sc->stco_map = sc->stsz_map = NULL;
+    return 0;
+}
+
+static AVIndexEntry *mov_get_sample(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+
+    if (sample < 0)
+        return NULL;
+    if (sc->lazy_index)
+        return mov_lazy_get_entry(st, sample);
+    return sample < sti->nb_index_entries ? &sti->index_entries[sample] : NULL;
+}
+
 #define MAX_REORDER_DELAY 16
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
-    FFStream *const sti = ffstream(st);
+    const AVIndexEntry *e;
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -3559,14 +4245,14 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        for (int ind = 0; (e = mov_get_sample(st, ind)) && ctts_ind < msc->ctts_count; ++ind) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = e->timestamp + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4039,6 +4725,9 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     uint64_t stream_size = 0;
     MOVCtts *ctts_data_old = sc->ctts_data;
     unsigned int ctts_count_old = sc->ctts_count;
+    /* lazily indexed tracks only get the edit list start applied */
+    int lazy = mov_lazy_index_supported(mov, st);
+    int advanced_editlist = mov->advanced_editlist && !lazy;
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4063,7 +4752,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             }
         }
 
-        if (multiple_edits && !mov->advanced_editlist) {
+        if (multiple_edits && !advanced_editlist) {
             if (mov->advanced_editlist_autodisabled)
                 av_log(mov->fc, AV_LOG_WARNING, "multiple edit list entries, "
                        "not supported in fragmented MP4 files\n");
@@ -4083,17 +4772,19 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
             sc->time_offset = start_time -  (uint64_t)empty_duration;
             sc->min_corrected_pts = start_time;
-            if (!mov->advanced_editlist)
+            if (!advanced_editlist)
                 current_dts = -sc->time_offset;
         }
 
-        if (!multiple_edits && !mov->advanced_editlist &&
+        if (!multiple_edits && !advanced_editlist &&
             st->codecpar->codec_id == AV_CODEC_ID_AAC && start_time > 0)
             sc->start_pad = start_time;
     }
 
+    if (lazy) {
+        mov_lazy_index_init(mov, st, current_dts - sc->dts_shift);
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
-    if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+    } else if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
         unsigned int current_sample = 0;
         unsigned int stts_sample = 0;
@@ -4144,8 +4835,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
 
         for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
+            int64_t next_offset = i+1 < sc->chunk_count ? mov_get_chunk_offset(sc, i+1) : INT64_MAX;
+            current_offset = mov_get_chunk_offset(sc, i);
             while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
                 i + 1 == sc->stsc_data[stsc_index + 1].first)
                 stsc_index++;
@@ -4191,7 +4882,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
                      keyframe = 1;
                 if (keyframe)
                     distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
+                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : mov_get_sample_size(sc, current_sample);
                 if (current_offset > INT64_MAX - sample_size) {
                     av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
                            current_offset,
@@ -4281,7 +4972,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         // populate index
         for (i = 0; i < sc->chunk_count; i++) {
-            current_offset = sc->chunk_offsets[i];
+            current_offset = mov_get_chunk_offset(sc, i);
             if (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
                 i + 1 == sc->stsc_data[stsc_index + 1].first)
                 stsc_index++;
@@ -4337,14 +5028,15 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
     }
 
-    if (!mov->ignore_editlist && mov->advanced_editlist) {
+    if (!mov->ignore_editlist && advanced_editlist) {
         // Fix index according to edit lists.
         mov_fix_index(mov, st);
     }
 
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+        mov_get_sample(st, 0)) {
+        st->start_time = mov_get_sample(st, 0)->timestamp + sc->dts_shift;
         if (sc->ctts_data) {
             st->start_time += sc->ctts_data[0].duration;
         }
@@ -4598,11 +5290,14 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
+    /* Do not need those anymore, unless samples are resolved from them lazily. */
+    if (!sc->lazy_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        sc->stco_map = sc->stsz_map = NULL;
+    }
     av_freep(&sc->stps_data);
     av_freep(&sc->elst_data);
     av_freep(&sc->rap_group);
@@ -5095,7 +5790,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     int64_t dts, pts = AV_NOPTS_VALUE;
     int data_offset = 0;
     unsigned entries, first_sample_flags = frag->flags;
-    int flags, distance, i;
+    int flags, distance, i, ret;
     int64_t prev_dts = AV_NOPTS_VALUE;
     int next_frag_index = -1, index_entry_pos;
     size_t requested_size;
@@ -5122,6 +5817,8 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
+    if ((ret = mov_lazy_index_materialize(c, st)) < 0)
+        return ret;
 
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
@@ -8040,10 +8737,11 @@ static void mov_read_chapters(AVFormatContext *s)
         cur_pos = avio_tell(sc->pb);
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            AVIndexEntry *sample = mov_get_sample(st, 0);
+
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
-            if (sti->nb_index_entries) {
+            if (sample) {
                 // Retrieve the first frame, if possible
-                AVIndexEntry *sample = &sti->index_entries[0];
                 if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
                     av_log(s, AV_LOG_ERROR, "Failed to retrieve first frame\n");
                     goto finish;
@@ -8209,11 +8907,294 @@ static void mov_free_encryption_index(MOVEncryptionIndex **index) {
     av_freep(index);
 }
 
+enum {
+    MOV_BATCH_IDLE,
+    MOV_BATCH_QUEUED,
+    MOV_BATCH_BUSY,
+};
+
+typedef struct MOVBatchReader {
+    AVFormatContext *s;
+    /**
+     * Unbuffered contexts for the demuxing and the readahead thread, so that
+     * reads cover exactly the requested samples.
+     */
+    AVIOContext *pb;
+    AVIOContext *thread_pb;
+#if HAVE_THREADS
+    int abort;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} MOVBatchReader;
+
+static const AVIndexEntry *mov_batch_get_sample(AVStream *st, MOVSampleCursor *cur,
+                                                AVIndexEntry *e, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (sc->lazy_index)
+        return mov_lazy_cursor_entry(st, cur, e, sample);
+    return mov_get_sample(st, sample);
+}
+
+/**
+ * Set b to the run of adjacent samples starting with the given one, up to
+ * read_batch_size bytes. Returns 0 if the sample alone exceeds that size.
+ */
+static int mov_batch_plan(MOVContext *mov, AVStream *st, unsigned int sample,
+                          MOVReadBatch *b)
+{
+    MOVStreamContext *sc = st->priv_data;
+    /* with a lazy index, plan with a copy of the cursor, so that the one used
+     * for demuxing is not moved ahead of the packets */
+    MOVSampleCursor cur = sc->lazy_cursor;
+    AVIndexEntry entry  = sc->lazy_entry;
+    const AVIndexEntry *e;
+    int64_t end;
+
+    e = mov_batch_get_sample(st, &cur, &entry, sample);
+    if (!e || e->size > mov->read_batch_size)
+        return 0;
+
+    b->pos = e->pos;
+    end    = e->pos + e->size;
+    while ((e = mov_batch_get_sample(st, &cur, &entry, ++sample)) && e->pos == end &&
+           end - b->pos + e->size <= mov->read_batch_size)
+        end += e->size;
+
+    b->requested   = end - b->pos;
+    b->size        = 0;
+    b->next_sample = sample;
+    av_fast_malloc(&b->data, &b->allocated_size, b->requested);
+    if (!b->data) {
+        b->allocated_size = 0;
+        return AVERROR(ENOMEM);
+    }
+    return 1;
+}
+
+static void mov_batch_read(AVIOContext *pb, MOVReadBatch *b)
+{
+    int ret = AVERROR(EIO);
+
+    if (avio_seek(pb, b->pos, SEEK_SET) == b->pos)
+        ret = avio_read(pb, b->data, b->requested);
+    b->size = FFMAX(ret, 0);
+}
+
+static int mov_batch_holds(const MOVReadBatch *b, int size, const AVIndexEntry *sample)
+{
+    return size > 0 && sample->pos >= b->pos &&
+           sample->pos + sample->size <= b->pos + size;
+}
+
+#if HAVE_THREADS
+static void *mov_batch_thread(void *arg)
+{
+    MOVBatchReader *br = arg;
+    AVFormatContext *s = br->s;
+
+    pthread_mutex_lock(&br->lock);
+    while (!br->abort) {
+        MOVReadBatch *b = NULL;
+
+        /* serve the request closest to the start of the file first */
+        for (int i = 0; i < s->nb_streams; i++) {
+            MOVStreamContext *sc = s->streams[i]->priv_data;
+            for (int j = 0; sc && j < FF_ARRAY_ELEMS(sc->read_batch); j++)
+                if (sc->read_batch[j].state == MOV_BATCH_QUEUED &&
+                    (!b || sc->read_batch[j].pos < b->pos))
+                    b = &sc->read_batch[j];
+        }
+        if (!b) {
+            pthread_cond_wait(&br->cond, &br->lock);
+            continue;
+        }
+
+        b->state = MOV_BATCH_BUSY;
+        pthread_mutex_unlock(&br->lock);
+        mov_batch_read(br->thread_pb, b);
+        pthread_mutex_lock(&br->lock);
+        b->state = MOV_BATCH_IDLE;
+        pthread_cond_broadcast(&br->cond);
+    }
+    pthread_mutex_unlock(&br->lock);
+
+    return NULL;
+}
+#endif
+
+/**
+ * Return b to the demuxing thread, waiting for it to be read or dropping the
+ * request if it is only queued and cancel is set.
+ */
+static void mov_batch_sync(MOVContext *mov, MOVReadBatch *b, int cancel)
+{
+#if HAVE_THREADS
+    MOVBatchReader *br = mov->batch_reader;
+
+    if (!br || !br->thread_pb)
+        return;
+    pthread_mutex_lock(&br->lock);
+    if (cancel && b->state == MOV_BATCH_QUEUED)
+        b->state = MOV_BATCH_IDLE;
+    while (b->state != MOV_BATCH_IDLE)
+        pthread_cond_wait(&br->cond, &br->lock);
+    pthread_mutex_unlock(&br->lock);
+#endif
+}
+
+static void mov_batch_queue(MOVContext *mov, MOVReadBatch *b)
+{
+#if HAVE_THREADS
+    MOVBatchReader *br = mov->batch_reader;
+
+    pthread_mutex_lock(&br->lock);
+    b->state = MOV_BATCH_QUEUED;
+    pthread_cond_broadcast(&br->cond);
+    pthread_mutex_unlock(&br->lock);
+#endif
+}
+
+static int mov_batch_start_thread(MOVBatchReader *br)
+{
+#if HAVE_THREADS
+    AVFormatContext *s = br->s;
+    int ret;
+
+    ret = s->io_open(s, &br->thread_pb, s->url, AVIO_FLAG_READ | AVIO_FLAG_DIRECT, NULL);
+    if (ret < 0)
+        return ret;
+
+    if ((ret = pthread_mutex_init(&br->lock, NULL)))
+        goto fail;
+    if ((ret = pthread_cond_init(&br->cond, NULL))) {
+        pthread_mutex_destroy(&br->lock);
+        goto fail;
+    }
+    if ((ret = pthread_create(&br->thread, NULL, mov_batch_thread, br))) {
+        pthread_cond_destroy(&br->cond);
+        pthread_mutex_destroy(&br->lock);
+        goto fail;
+    }
+    return 0;
+fail:
+    ff_format_io_close(s, &br->thread_pb);
+    return AVERROR(ret);
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static int mov_batch_reader_init(AVFormatContext *s)
+{
+    MOVContext *mov = s->priv_data;
+    MOVBatchReader *br;
+    int ret;
+
+    br = av_mallocz(sizeof(*br));
+    if (!br)
+        return AVERROR(ENOMEM);
+    br->s = s;
+
+    ret = s->io_open(s, &br->pb, s->url, AVIO_FLAG_READ | AVIO_FLAG_DIRECT, NULL);
+    if (ret < 0) {
+        av_free(br);
+        return ret;
+    }
+
+    if (mov->read_ahead && (ret = mov_batch_start_thread(br)) < 0)
+        av_log(s, AV_LOG_WARNING, "could not start reading ahead: %s\n", av_err2str(ret));
+
+    mov->batch_reader = br;
+    return 0;
+}
+
+static void mov_batch_reader_close(AVFormatContext *s)
+{
+    MOVContext *mov = s->priv_data;
+    MOVBatchReader *br = mov->batch_reader;
+
+    if (!br)
+        return;
+
+#if HAVE_THREADS
+    if (br->thread_pb) {
+        pthread_mutex_lock(&br->lock);
+        br->abort = 1;
+        pthread_cond_broadcast(&br->cond);
+        pthread_mutex_unlock(&br->lock);
+        pthread_join(br->thread, NULL);
+        pthread_cond_destroy(&br->cond);
+        pthread_mutex_destroy(&br->lock);
+        ff_format_io_close(s, &br->thread_pb);
+    }
+#endif
+    ff_format_io_close(s, &br->pb);
+    av_freep(&mov->batch_reader);
+}
+
+/**
+ * Read a sample out of the batch of adjacent samples of its track holding
+ * it, reading that batch first if needed, so that the data of the other
+ * tracks in between is never read.
+ *
+ * @return 1 if pkt was filled, 0 if the sample has to be read on its own,
+ *         a negative error code otherwise
+ */
+static int mov_read_batched_sample(AVFormatContext *s, AVStream *st,
+                                   int sample_index, const AVIndexEntry *sample,
+                                   AVPacket *pkt)
+{
+    MOVContext *mov = s->priv_data;
+    MOVStreamContext *sc = st->priv_data;
+    MOVBatchReader *br = mov->batch_reader;
+    MOVReadBatch *cur  = &sc->read_batch[ sc->read_batch_cur];
+    MOVReadBatch *next = &sc->read_batch[!sc->read_batch_cur];
+    /* tracks with data in other files go through their own context */
+    AVIOContext *pb = br && sc->pb == s->pb ? br->pb : sc->pb;
+    int readahead = br && br->thread_pb && sc->pb == s->pb;
+    int ret;
+
+    if (!mov_batch_holds(cur, cur->size, sample)) {
+        if (readahead)
+            mov_batch_sync(mov, next, !mov_batch_holds(next, next->requested, sample));
+
+        if (mov_batch_holds(next, next->size, sample)) {
+            sc->read_batch_cur ^= 1;
+            FFSWAP(MOVReadBatch *, cur, next);
+        } else {
+            ret = mov_batch_plan(mov, st, sample_index, cur);
+            if (ret <= 0)
+                return ret;
+            mov_batch_read(pb, cur);
+            /* errors are reported when reading the sample on its own */
+            if (!mov_batch_holds(cur, cur->size, sample))
+                return 0;
+        }
+
+        if (readahead && mov_batch_plan(mov, st, cur->next_sample, next) > 0)
+            mov_batch_queue(mov, next);
+    }
+
+    ret = av_new_packet(pkt, sample->size);
+    if (ret < 0)
+        return ret;
+    memcpy(pkt->data, cur->data + (sample->pos - cur->pos), sample->size);
+    pkt->pos = sample->pos;
+
+    return 1;
+}
+
 static int mov_read_close(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
     int i, j;
 
+    mov_batch_reader_close(s);
+
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *st = s->streams[i];
         MOVStreamContext *sc = st->priv_data;
@@ -8222,6 +9203,8 @@ static int mov_read_close(AVFormatContext *s)
             continue;
 
         av_freep(&sc->ctts_data);
+        av_freep(&sc->read_batch[0].data);
+        av_freep(&sc->read_batch[1].data);
         for (j = 0; j < sc->drefs_count; j++) {
             av_freep(&sc->drefs[j].path);
             av_freep(&sc->drefs[j].dir);
@@ -8292,6 +9275,12 @@ static int mov_read_close(AVFormatContext *s)
     av_freep(&mov->aes_decrypt);
     av_freep(&mov->chapter_tracks);
     av_freep(&mov->avif_info);
+    av_freep(&mov->frag_cache_streams);
+
+    if (mov->file_map)
+        av_file_unmap(mov->file_map, mov->file_map_size);
+    mov->file_map      = NULL;
+    mov->file_map_size = 0;
 
     return 0;
 }
@@ -8431,6 +9420,28 @@ fail:
     return ret;
 }
 
+static void mov_map_file(AVFormatContext *s)
+{
+#if HAVE_MMAP || HAVE_MAPVIEWOFFILE
+    MOVContext *mov = s->priv_data;
+    const char *filename = mov_local_file(s);
+    int ret;
+
+    if (!filename)
+        return;
+
+    /* errors only mean the tables are read the usual way */
+    ret = av_file_map(filename, &mov->file_map, &mov->file_map_size,
+                      AV_LOG_VERBOSE - AV_LOG_ERROR, s);
+    if (ret < 0 || mov->file_map_size != avio_size(s->pb)) {
+        if (mov->file_map)
+            av_file_unmap(mov->file_map, mov->file_map_size);
+        mov->file_map      = NULL;
+        mov->file_map_size = 0;
+    }
+#endif
+}
+
 static int mov_read_header(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
@@ -8447,6 +9458,8 @@ static int mov_read_header(AVFormatContext *s)
 
     mov->fc = s;
     mov->trak_index = -1;
+    if (mov->mmap_tables)
+        mov_map_file(s);
     /* .mov and .mp4 aren't streamable anyway (only progressive download if moov is before mdat) */
     if (pb->seekable & AVIO_SEEKABLE_NORMAL)
         atom.size = avio_size(pb);
@@ -8468,6 +9481,22 @@ static int mov_read_header(AVFormatContext *s)
     }
     av_log(mov->fc, AV_LOG_TRACE, "on_parse_exit_offset=%"PRId64"\n", avio_tell(pb));
 
+    if (mov->frag_cache_streams) {
+        /* the totals of the whole file, as if all fragments had been scanned */
+        for (i = 0; i < s->nb_streams; i++) {
+            AVStream *st = s->streams[i];
+            MOVStreamContext *sc = st->priv_data;
+            MOVFragmentCacheStream *cs = &mov->frag_cache_streams[i];
+            st->duration          = FFMAX(st->duration, cs->duration);
+            sc->data_size         = cs->data_size;
+            sc->duration_for_fps  = cs->duration_for_fps;
+            sc->nb_frames_for_fps = cs->nb_frames_for_fps;
+        }
+        av_freep(&mov->frag_cache_streams);
+    } else if (mov->frag_index_cache) {
+        mov_write_frag_index_cache(mov);
+    }
+
     if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
         if (mov->nb_chapter_tracks > 0 && !mov->ignore_chapters)
             mov_read_chapters(s);
@@ -8638,6 +9667,12 @@ static int mov_read_header(AVFormatContext *s)
         if (mov->frag_index.item[i].moof_offset <= mov->fragment.moof_offset)
             mov->frag_index.item[i].headers_read = 1;
 
+    /* with custom I/O, batches are read through the demuxer's own context */
+    if (mov->read_batch_size && !(s->flags & AVFMT_FLAG_CUSTOM_IO) &&
+        (err = mov_batch_reader_init(s)) < 0)
+        av_log(s, AV_LOG_WARNING, "could not open the input for batched reads: %s\n",
+               av_err2str(err));
+
     return 0;
 }
 
@@ -8648,10 +9683,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int i;
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample;
+        if (msc->pb && (current_sample = mov_get_sample(avst, msc->current_sample))) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) && current_sample->pos < sample->pos) ||
@@ -8759,9 +9793,10 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVContext *mov = s->priv_data;
     MOVStreamContext *sc;
-    AVIndexEntry *sample;
+    AVIndexEntry *sample, lazy_sample;
     AVStream *st = NULL;
     int64_t current_index;
+    int sample_index;
     int ret;
     mov->fc = s;
  retry:
@@ -8774,8 +9809,14 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         goto retry;
     }
     sc = st->priv_data;
+    /* the entry of a lazily indexed track only lives until the next lookup */
+    if (sc->lazy_index) {
+        lazy_sample = *sample;
+        sample = &lazy_sample;
+    }
     /* must be done just before reading, to avoid infinite loop on sample */
     current_index = sc->current_index;
+    sample_index  = sc->current_sample;
     mov_current_sample_inc(sc);
 
     if (mov->next_root_atom) {
@@ -8784,32 +9825,43 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     if (st->discard != AVDISCARD_ALL) {
-        int64_t ret64 = avio_seek(sc->pb, sample->pos, SEEK_SET);
-        if (ret64 != sample->pos) {
-            av_log(mov->fc, AV_LOG_ERROR, "stream %d, offset 0x%"PRIx64": partial file\n",
-                   sc->ffindex, sample->pos);
-            if (should_retry(sc->pb, ret64)) {
-                mov_current_sample_dec(sc);
-            } else if (ret64 < 0) {
-                return (int)ret64;
+        int batched = 0;
+
+        if (mov->read_batch_size && st->codecpar->codec_id != AV_CODEC_ID_EIA_608 &&
+            (st->discard != AVDISCARD_NONKEY || sample->flags & AVINDEX_KEYFRAME)) {
+            batched = mov_read_batched_sample(s, st, sample_index, sample, pkt);
+            if (batched < 0)
+                return batched;
+        }
+
+        if (!batched) {
+            int64_t ret64 = avio_seek(sc->pb, sample->pos, SEEK_SET);
+            if (ret64 != sample->pos) {
+                av_log(mov->fc, AV_LOG_ERROR, "stream %d, offset 0x%"PRIx64": partial file\n",
+                       sc->ffindex, sample->pos);
+                if (should_retry(sc->pb, ret64)) {
+                    mov_current_sample_dec(sc);
+                } else if (ret64 < 0) {
+                    return (int)ret64;
+                }
+                return AVERROR_INVALIDDATA;
             }
-            return AVERROR_INVALIDDATA;
-        }
 
-        if (st->discard == AVDISCARD_NONKEY && !(sample->flags & AVINDEX_KEYFRAME)) {
-            av_log(mov->fc, AV_LOG_DEBUG, "Nonkey frame from stream %d discarded due to AVDISCARD_NONKEY\n", sc->ffindex);
-            goto retry;
-        }
+            if (st->discard == AVDISCARD_NONKEY && !(sample->flags & AVINDEX_KEYFRAME)) {
+                av_log(mov->fc, AV_LOG_DEBUG, "Nonkey frame from stream %d discarded due to AVDISCARD_NONKEY\n", sc->ffindex);
+                goto retry;
+            }
 
-        if (st->codecpar->codec_id == AV_CODEC_ID_EIA_608 && sample->size > 8)
-            ret = get_eia608_packet(sc->pb, pkt, sample->size);
-        else
-            ret = av_get_packet(sc->pb, pkt, sample->size);
-        if (ret < 0) {
-            if (should_retry(sc->pb, ret)) {
-                mov_current_sample_dec(sc);
+            if (st->codecpar->codec_id == AV_CODEC_ID_EIA_608 && sample->size > 8)
+                ret = get_eia608_packet(sc->pb, pkt, sample->size);
+            else
+                ret = av_get_packet(sc->pb, pkt, sample->size);
+            if (ret < 0) {
+                if (should_retry(sc->pb, ret)) {
+                    mov_current_sample_dec(sc);
+                }
+                return ret;
             }
-            return ret;
         }
 #if CONFIG_DV_DEMUXER
         if (mov->dv_demux && sc->dv_audio_container) {
@@ -8854,8 +9906,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-            ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+        const AVIndexEntry *next = mov_get_sample(st, sc->current_sample);
+        int64_t next_dts = next ? next->timestamp : st->duration;
 
         if (next_dts >= pkt->dts)
             pkt->duration = next_dts - pkt->dts;
@@ -8940,7 +9992,6 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
 static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
@@ -8949,7 +10000,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_get_sample(st, sample)->timestamp;
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -8966,7 +10017,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
+    const AVIndexEntry *first;
     int sample, time_sample, ret;
     unsigned int i;
 
@@ -8979,9 +10030,12 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        if (sc->lazy_index)
+            sample = mov_lazy_search_timestamp(st, timestamp, flags);
+        else
+            sample = av_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && (first = mov_get_sample(st, 0)) && timestamp < first->timestamp)
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -9028,9 +10082,8 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    int64_t first_ts = mov_get_sample(st, 0)->timestamp;
+    int64_t ts = mov_get_sample(st, sample)->timestamp;
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -9053,6 +10106,12 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
     if (stream_index >= s->nb_streams)
         return AVERROR_INVALIDDATA;
 
+    /* batches read ahead for the old position are unlikely to be used */
+    for (i = 0; mc->batch_reader && i < s->nb_streams; i++) {
+        MOVStreamContext *sc = s->streams[i]->priv_data;
+        mov_batch_sync(mc, &sc->read_batch[!sc->read_batch_cur], 1);
+    }
+
     st = s->streams[stream_index];
     sti = ffstream(st);
     sample = mov_seek_stream(s, st, sample_time, flags);
@@ -9061,7 +10120,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        int64_t seek_timestamp = mov_get_sample(st, sample)->timestamp;
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -9115,6 +10174,13 @@ static const AVOption mov_options[] = {
         "Modify the AVIndex according to the editlists. Use this option to decode in the order specified by the edits.",
         OFFSET(advanced_editlist), AV_OPT_TYPE_BOOL, {.i64 = 1},
         0, 1, FLAGS},
+    {"lazy_index",
+        "Resolve samples from the sample tables when read or seeked instead of building the full index.",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
+    {"mmap_tables",
+        "Read the sample tables of local files in place from a memory mapping of the file.",
+        OFFSET(mmap_tables), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
     {"use_mfra_for",
@@ -9130,6 +10196,13 @@ static const AVOption mov_options[] = {
         FLAGS, "use_mfra_for" },
     {"use_tfdt", "use tfdt for fragment timestamps", OFFSET(use_tfdt), AV_OPT_TYPE_BOOL, {.i64 = 1},
         0, 1, FLAGS},
+    {"frag_index_cache", "Path of a file caching the fragment index of the input",
+        OFFSET(frag_index_cache), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, FLAGS},
+    {"read_batch_size",
+        "Read adjacent samples of a track with one request of up to this many bytes, skipping the data of other tracks.",
+        OFFSET(read_batch_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1 << 28, FLAGS},
+    {"read_ahead", "Read the next batch of each track on a background thread.",
+        OFFSET(read_ahead), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS},
     { "export_all", "Export unrecognized metadata entries", OFFSET(export_all),
         AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, .flags = FLAGS },
     { "export_xmp", "Export full XMP metadata", OFFSET(export_xmp),
@@ -0,0 +1,192 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "third_party/ffmpeg/libavutil/error.h"
+#include "third_party/ffmpeg/libavutil/mem.h"
+#include "third_party/ffmpeg/libavutil/avformat.h"
+
+#define BLOCK_SIZE 4096
+#define NB_BLOCKS  64
+#define FILE_SIZE  (BLOCK_SIZE * NB_BLOCKS)
+
+static uint8_t pattern(int64_t pos)
+{
+    return pos * 7 + (pos >> 12);
+}
+
+/* Submit the requests in a scrambled order, a few at a time, reap them
+ * all and return the number of requests that failed. */
+static int run(AVIOContext *pb, AVIORequest *reqs, int nb_reqs)
+{
+    AVIORequest *list[NB_BLOCKS + 2];
+    AVIORequest *req;
+    int errors = 0, ret;
+
+    for (int i = 0; i < nb_reqs; i++)
+        list[i] = &reqs[(i * 37) % nb_reqs];
+    for (int i = 0; i < nb_reqs; i += 5) {
+        ret = avio_submit(pb, list + i, FFMIN(5, nb_reqs - i));
+        if (ret < 0) {
+            printf("submit: %s\n", av_err2str(ret));
+            return nb_reqs;
+        }
+    }
+    for (int i = 0; i < nb_reqs; i++) {
+        ret = avio_reap(pb, &req, 1);
+        if (ret < 0) {
+            printf("reap: %s\n", av_err2str(ret));
+            return nb_reqs;
+        }
+        if (req->result != req->size)
+            errors++;
+    }
+    ret = avio_reap(pb, &req, 0);
+    if (ret != AVERROR_EOF)
+        printf("reap after the last request: %s\n", av_err2str(ret));
+    return errors;
+}
+
+static int check(const char *name, AVIOContext *pb, int64_t size)
+{
+    AVIORequest reqs[NB_BLOCKS + 2];
+    uint8_t *buf = av_malloc(FILE_SIZE + 2 * BLOCK_SIZE);
+    uint8_t head[16];
+    int bad = 0, errors;
+
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    avio_read(pb, head, sizeof(head));
+
+    for (int i = 0; i < NB_BLOCKS + 2; i++) {
+        reqs[i] = (AVIORequest){
+            .pos  = (int64_t)i * BLOCK_SIZE - (i == NB_BLOCKS) * BLOCK_SIZE / 2,
+            .buf  = buf + i * BLOCK_SIZE,
+            .size = BLOCK_SIZE,
+        };
+    }
+    errors = run(pb, reqs, NB_BLOCKS);
+    printf("%s: %d reads, %d errors\n", name, NB_BLOCKS, errors);
+
+    for (int64_t pos = 0; pos < size; pos++)
+        bad += buf[pos] != pattern(pos);
+    printf("%s: %d bytes differ\n", name, bad);
+
+    /* Straddling the end of the file, and after it. */
+    run(pb, reqs + NB_BLOCKS, 2);
+    printf("%s: read at the end: %d, %s\n", name, reqs[NB_BLOCKS].result,
+           reqs[NB_BLOCKS].result == BLOCK_SIZE / 2 &&
+           !memcmp(reqs[NB_BLOCKS].buf, buf + FILE_SIZE - BLOCK_SIZE / 2,
+                   BLOCK_SIZE / 2) ? "ok" : "mismatch");
+    printf("%s: read after the end: %s\n", name,
+           av_err2str(reqs[NB_BLOCKS + 1].result));
+
+    /* The buffered position is not moved by the requests. */
+    avio_read(pb, head, sizeof(head));
+    printf("%s: position %"PRId64", %s\n", name, avio_tell(pb),
+           head[0] == pattern(16) && head[15] == pattern(31) ? "ok" : "mismatch");
+
+    av_free(buf);
+    return 0;
+}
+
+typedef struct MemFile {
+    uint8_t *data;
+    int64_t pos;
+} MemFile;
+
+static int mem_read(void *opaque, uint8_t *buf, int size)
+{
+    MemFile *f = opaque;
+    size = FFMIN(size, FILE_SIZE - f->pos);
+    if (size <= 0)
+        return AVERROR_EOF;
+    memcpy(buf, f->data + f->pos, size);
+    f->pos += size;
+    return size;
+}
+
+static int64_t mem_seek(void *opaque, int64_t offset, int whence)
+{
+    MemFile *f = opaque;
+    if (whence == AVSEEK_SIZE)
+        return FILE_SIZE;
+    if (whence != SEEK_SET || offset < 0)
+        return AVERROR(EINVAL);
+    return f->pos = offset;
+}
+
+int main(int argc, char **argv)
+{
+    AVIORequest reqs[NB_BLOCKS];
+    AVIOContext *pb;
+    MemFile mem = { 0 };
+    uint8_t *buf;
+    int ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    buf = av_malloc(FILE_SIZE);
+    if (!buf)
+        return 1;
+    for (int64_t pos = 0; pos < FILE_SIZE; pos++)
+        buf[pos] = pattern(pos);
+
+    ret = avio_open(&pb, argv[1], AVIO_FLAG_WRITE);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", argv[1], av_err2str(ret));
+        return 1;
+    }
+    for (int i = 0; i < NB_BLOCKS; i++) {
+        reqs[i] = (AVIORequest){
+            .pos   = (int64_t)i * BLOCK_SIZE,
+            .buf   = buf + i * BLOCK_SIZE,
+            .size  = BLOCK_SIZE,
+            .write = 1,
+        };
+    }
+    printf("file: %d writes, %d errors\n", NB_BLOCKS, run(pb, reqs, NB_BLOCKS));
+    avio_closep(&pb);
+
+    ret = avio_open(&pb, argv[1], AVIO_FLAG_READ);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", argv[1], av_err2str(ret));
+        return 1;
+    }
+    check("file", pb, FILE_SIZE);
+    avio_closep(&pb);
+
+    /* A custom context, where the requests are completed synchronously. */
+    mem.data = buf;
+    pb = avio_alloc_context(av_malloc(4096), 4096, 0, &mem, mem_read, NULL, mem_seek);
+    if (!pb || !pb->buffer)
+        return 1;
+    check("custom", pb, FILE_SIZE);
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+
+    av_free(buf);
+    return 0;
+}
@@ -95,6 +95,18 @@ typedef struct URLProtocol {
     int (*url_close_dir)(URLContext *h);
     int (*url_delete)(URLContext *h);
     int (*url_move)(URLContext *h_src, URLContext *h_dst);
+    /**
+     * Queue reads and writes at absolute positions, see avio_submit().
+     * This must neither wait for the transfers nor change the position
+     * used by url_read and url_write. Either all the requests are queued
+     * or none is; AVERROR(ENOSYS) lets the caller complete them itself.
+     */
+    int (*url_submit)(URLContext *h, AVIORequest **reqs, int nb_reqs);
+    /**
+     * Return a request queued by url_submit once it is complete,
+     * see avio_reap().
+     */
+    int (*url_reap)(URLContext *h, AVIORequest **req, int wait);
     const char *default_whitelist;
 } URLProtocol;
 
@@ -265,6 +277,20 @@ int ffurl_get_short_seek(URLContext *h);
  */
 int ffurl_shutdown(URLContext *h, int flags);
 
+/**
+ * Queue reads and writes at absolute positions, see avio_submit().
+ *
+ * @return 0 if all the requests were queued, AVERROR(ENOSYS) if the
+ * protocol does not support it, another negative value on error
+ */
+int ffurl_submit(URLContext *h, AVIORequest **reqs, int nb_reqs);
+
+/**
+ * Retrieve a request queued by ffurl_submit() once it is complete,
+ * see avio_reap().
+ */
+int ffurl_reap(URLContext *h, AVIORequest **req, int wait);
+
 /**
  * Check if the user has requested to interrupt a blocking function
  * associated with cb.
@@ -16,16 +16,56 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+/* needed by MAP_ANONYMOUS, madvise() and syscall() */
+#define _DEFAULT_SOURCE
+
 #include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "third_party/ffmpeg/config.h"
+
 #include "third_party/ffmpeg/libavutil/avassert.h"
 #include "third_party/ffmpeg/libavutil/buffer_internal.h"
 #include "third_party/ffmpeg/libavutil/common.h"
 #include "third_party/ffmpeg/libavutil/mem.h"
 #include "third_party/ffmpeg/libavutil/thread.h"
 
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#if defined(__linux__) && HAVE_UNISTD_H
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS) && (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+#define HUGEPAGE_MMAP 1
+#else
+#define HUGEPAGE_MMAP 0
+#endif
+
+#define HUGEPAGE_SIZE (2 << 20)
+
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_2MB)
+#ifdef MAP_HUGE_SHIFT
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#else
+#define MAP_HUGE_2MB 0
+#endif
+#endif
+
+static struct {
+    atomic_uint_least64_t nb_hugetlb;
+    atomic_uint_least64_t nb_thp;
+    atomic_uint_least64_t nb_fallback;
+    atomic_uint_least64_t nb_numa_bound;
+    atomic_uint_least64_t mapped_bytes;
+    atomic_uint_least64_t mapped_bytes_peak;
+} hugepage_stats;
+
+static atomic_int pool_hugepages;
+
 static AVBufferRef *buffer_create(AVBuffer *buf, uint8_t *data, size_t size,
                                   void (*free)(void *opaque, uint8_t *data),
                                   void *opaque, int flags)
@@ -100,6 +140,140 @@ AVBufferRef *av_buffer_allocz(size_t size)
     return ret;
 }
 
+#if HUGEPAGE_MMAP
+/* prefer the NUMA node of the calling thread for the pages of the mapping,
+ * before they are touched */
+static int bind_to_local_node(void *addr, size_t len)
+{
+#if defined(__linux__) && defined(SYS_getcpu) && defined(SYS_mbind)
+    unsigned long nodemask[1024 / (8 * sizeof(unsigned long))] = { 0 };
+    const unsigned bits = 8 * sizeof(*nodemask);
+    unsigned cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0 ||
+        node >= FF_ARRAY_ELEMS(nodemask) * bits - 1)
+        return 0;
+    nodemask[node / bits] = 1UL << node % bits;
+
+    /* MPOL_PREFERRED, so that other nodes are used when this one is full */
+    return !syscall(SYS_mbind, addr, len, 1, nodemask,
+                    FF_ARRAY_ELEMS(nodemask) * bits, 0);
+#else
+    return 0;
+#endif
+}
+
+static uint8_t *hugepage_map(size_t len, int *hugetlb)
+{
+    uint8_t *data;
+
+#ifdef MAP_HUGETLB
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (data != MAP_FAILED) {
+        *hugetlb = 1;
+        return data;
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    {
+        size_t head;
+
+        /* over-allocate to align the mapping on a huge page boundary, as
+         * transparent huge pages are only used for aligned ranges */
+        data = mmap(NULL, len + HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            return NULL;
+
+        head = FFALIGN((uintptr_t)data, HUGEPAGE_SIZE) - (uintptr_t)data;
+        if (head)
+            munmap(data, head);
+        munmap(data + head + len, HUGEPAGE_SIZE - head);
+        data += head;
+
+        if (madvise(data, len, MADV_HUGEPAGE)) {
+            munmap(data, len);
+            return NULL;
+        }
+        *hugetlb = 0;
+        return data;
+    }
+#else
+    return NULL;
+#endif
+}
+
+static void hugepage_free(void *opaque, uint8_t *data)
+{
+    size_t len = (uintptr_t)opaque;
+
+    munmap(data, len);
+    atomic_fetch_sub_explicit(&hugepage_stats.mapped_bytes, len,
+                              memory_order_relaxed);
+}
+#endif
+
+AVBufferRef *av_buffer_alloc_hugepage(size_t size)
+{
+#if HUGEPAGE_MMAP
+    if (size >= HUGEPAGE_SIZE / 2 && size <= SIZE_MAX - 2 * HUGEPAGE_SIZE) {
+        size_t len = FFALIGN(size, HUGEPAGE_SIZE);
+        uint_least64_t mapped, peak;
+        AVBufferRef *ret;
+        uint8_t *data;
+        int hugetlb, bound;
+
+        data = hugepage_map(len, &hugetlb);
+        if (data) {
+            bound = bind_to_local_node(data, len);
+
+            ret = av_buffer_create(data, size, hugepage_free,
+                                   (void *)(uintptr_t)len, 0);
+            if (!ret) {
+                munmap(data, len);
+                return NULL;
+            }
+
+            atomic_fetch_add_explicit(hugetlb ? &hugepage_stats.nb_hugetlb :
+                                                &hugepage_stats.nb_thp,
+                                      1, memory_order_relaxed);
+            if (bound)
+                atomic_fetch_add_explicit(&hugepage_stats.nb_numa_bound, 1,
+                                          memory_order_relaxed);
+
+            mapped = atomic_fetch_add_explicit(&hugepage_stats.mapped_bytes, len,
+                                               memory_order_relaxed) + len;
+            peak   = atomic_load_explicit(&hugepage_stats.mapped_bytes_peak,
+                                          memory_order_relaxed);
+            while (peak < mapped &&
+                   !atomic_compare_exchange_weak_explicit(&hugepage_stats.mapped_bytes_peak,
+                                                          &peak, mapped,
+                                                          memory_order_relaxed,
+                                                          memory_order_relaxed))
+                ;
+
+            return ret;
+        }
+    }
+#endif
+
+    atomic_fetch_add_explicit(&hugepage_stats.nb_fallback, 1,
+                              memory_order_relaxed);
+    return av_buffer_allocz(size);
+}
+
+void av_buffer_hugepage_stats(AVBufferHugepageStats *stats)
+{
+    stats->nb_hugetlb        = atomic_load(&hugepage_stats.nb_hugetlb);
+    stats->nb_thp            = atomic_load(&hugepage_stats.nb_thp);
+    stats->nb_fallback       = atomic_load(&hugepage_stats.nb_fallback);
+    stats->nb_numa_bound     = atomic_load(&hugepage_stats.nb_numa_bound);
+    stats->mapped_bytes      = atomic_load(&hugepage_stats.mapped_bytes);
+    stats->mapped_bytes_peak = atomic_load(&hugepage_stats.mapped_bytes_peak);
+}
+
 AVBufferRef *av_buffer_ref(const AVBufferRef *buf)
 {
     AVBufferRef *ret = av_mallocz(sizeof(*ret));
@@ -273,6 +447,9 @@ AVBufferPool *av_buffer_pool_init2(size_t size, void *opaque,
     pool->pool_free = pool_free;
 
     atomic_init(&pool->refcount, 1);
+#if BUFFER_POOL_LOCK_FREE
+    atomic_init(&pool->free_list, 0);
+#endif
 
     return pool;
 }
@@ -285,23 +462,104 @@ AVBufferPool *av_buffer_pool_init(size_t size, AVBufferRef* (*alloc)(size_t size
 
     ff_mutex_init(&pool->mutex, NULL);
 
+    if (atomic_load_explicit(&pool_hugepages, memory_order_relaxed) &&
+        (!alloc || alloc == av_buffer_alloc || alloc == av_buffer_allocz))
+        alloc = av_buffer_alloc_hugepage;
+
     pool->size     = size;
     pool->alloc    = alloc ? alloc : av_buffer_alloc;
 
     atomic_init(&pool->refcount, 1);
+#if BUFFER_POOL_LOCK_FREE
+    atomic_init(&pool->free_list, 0);
+#endif
 
     return pool;
 }
 
+void av_buffer_pool_set_hugepages(int enable)
+{
+    atomic_store_explicit(&pool_hugepages, !!enable, memory_order_relaxed);
+}
+
+#define INDEX_MASK ((UINT64_C(1) << BUFFER_POOL_INDEX_BITS) - 1)
+
+static BufferPoolEntry *pool_entry(AVBufferPool *pool, unsigned index)
+{
+    int chunk = av_log2(index + 1);
+    return &pool->chunks[chunk][index + 1 - (1U << chunk)];
+}
+
+#if BUFFER_POOL_LOCK_FREE
+static void pool_push(AVBufferPool *pool, BufferPoolEntry *buf)
+{
+    uint_least64_t head = atomic_load_explicit(&pool->free_list,
+                                               memory_order_relaxed);
+    uint_least64_t new_head;
+
+    do {
+        atomic_store_explicit(&buf->next, head & INDEX_MASK,
+                              memory_order_relaxed);
+        new_head = (head & ~INDEX_MASK) | (buf->index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_list,
+                                                    &head, new_head,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+static BufferPoolEntry *pool_pop(AVBufferPool *pool)
+{
+    uint_least64_t head = atomic_load_explicit(&pool->free_list,
+                                               memory_order_acquire);
+    uint_least64_t new_head;
+    BufferPoolEntry *buf;
+
+    do {
+        if (!(head & INDEX_MASK))
+            return NULL;
+
+        /* the entry may be removed concurrently, in which case its next
+         * field may be stale but the tag makes the exchange fail */
+        buf      = pool_entry(pool, (head & INDEX_MASK) - 1);
+        new_head = ((head >> BUFFER_POOL_INDEX_BITS) + 1) << BUFFER_POOL_INDEX_BITS |
+                   atomic_load_explicit(&buf->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_list,
+                                                    &head, new_head,
+                                                    memory_order_acquire,
+                                                    memory_order_acquire));
+
+    return buf;
+}
+#else
+static void pool_push(AVBufferPool *pool, BufferPoolEntry *buf)
+{
+    ff_mutex_lock(&pool->mutex);
+    atomic_store_explicit(&buf->next, pool->free_list, memory_order_relaxed);
+    pool->free_list = buf->index + 1;
+    ff_mutex_unlock(&pool->mutex);
+}
+
+static BufferPoolEntry *pool_pop(AVBufferPool *pool)
+{
+    BufferPoolEntry *buf = NULL;
+
+    ff_mutex_lock(&pool->mutex);
+    if (pool->free_list) {
+        buf = pool_entry(pool, pool->free_list - 1);
+        pool->free_list = atomic_load_explicit(&buf->next, memory_order_relaxed);
+    }
+    ff_mutex_unlock(&pool->mutex);
+
+    return buf;
+}
+#endif
+
 static void buffer_pool_flush(AVBufferPool *pool)
 {
-    while (pool->pool) {
-        BufferPoolEntry *buf = pool->pool;
-        pool->pool = buf->next;
+    BufferPoolEntry *buf;
 
+    while ((buf = pool_pop(pool)))
         buf->free(buf->opaque, buf->data);
-        av_freep(&buf);
-    }
 }
 
 /*
@@ -311,6 +569,8 @@ static void buffer_pool_flush(AVBufferPool *pool)
 static void buffer_pool_free(AVBufferPool *pool)
 {
     buffer_pool_flush(pool);
+    for (int i = 0; i < FF_ARRAY_ELEMS(pool->chunks); i++)
+        av_freep(&pool->chunks[i]);
     ff_mutex_destroy(&pool->mutex);
 
     if (pool->pool_free)
@@ -328,9 +588,7 @@ void av_buffer_pool_uninit(AVBufferPool **ppool)
     pool   = *ppool;
     *ppool = NULL;
 
-    ff_mutex_lock(&pool->mutex);
     buffer_pool_flush(pool);
-    ff_mutex_unlock(&pool->mutex);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
@@ -341,15 +599,35 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     BufferPoolEntry *buf = opaque;
     AVBufferPool *pool = buf->pool;
 
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
+    pool_push(pool, buf);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
 }
 
+/* must be called with the pool mutex held */
+static BufferPoolEntry *pool_alloc_entry(AVBufferPool *pool)
+{
+    BufferPoolEntry *buf;
+    unsigned index = pool->nb_entries;
+    int chunk;
+
+    if (index == INDEX_MASK)
+        return NULL;
+
+    chunk = av_log2(index + 1);
+    if (!pool->chunks[chunk]) {
+        pool->chunks[chunk] = av_calloc(1U << chunk, sizeof(*pool->chunks[chunk]));
+        if (!pool->chunks[chunk])
+            return NULL;
+    }
+    pool->nb_entries++;
+
+    buf = pool_entry(pool, index);
+    buf->index = index;
+    return buf;
+}
+
 /* allocate a new buffer and override its free() callback so that
  * it is returned to the pool on free */
 static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
@@ -364,7 +642,7 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
     if (!ret)
         return NULL;
 
-    buf = av_mallocz(sizeof(*buf));
+    buf = pool_alloc_entry(pool);
     if (!buf) {
         av_buffer_unref(&ret);
         return NULL;
@@ -386,21 +664,21 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
     AVBufferRef *ret;
     BufferPoolEntry *buf;
 
-    ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
+    buf = pool_pop(pool);
     if (buf) {
         memset(&buf->buffer, 0, sizeof(buf->buffer));
         ret = buffer_create(&buf->buffer, buf->data, pool->size,
                             pool_release_buffer, buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
+        if (ret)
             buf->buffer.flags_internal |= BUFFER_FLAG_NO_FREE;
-        }
+        else
+            pool_push(pool, buf);
     } else {
+        /* the allocation callbacks may rely on being serialized */
+        ff_mutex_lock(&pool->mutex);
         ret = pool_alloc_buffer(pool);
+        ff_mutex_unlock(&pool->mutex);
     }
-    ff_mutex_unlock(&pool->mutex);
 
     if (ret)
         atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
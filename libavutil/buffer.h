@@ -107,6 +107,55 @@ AVBufferRef *av_buffer_alloc(size_t size);
  */
 AVBufferRef *av_buffer_allocz(size_t size);
 
+/**
+ * Same as av_buffer_allocz(), except that large buffers are mapped directly
+ * with huge pages when the system provides them, and bound to the NUMA node
+ * of the calling thread. This reduces the TLB misses and the cross-node
+ * traffic when accessing large long-lived buffers such as frame planes, at
+ * the cost of rounding the size of the mapping up to the huge page size.
+ *
+ * Explicitly reserved huge pages (MAP_HUGETLB on Linux) are tried first, then
+ * transparent huge pages. Buffers smaller than half a huge page, and buffers
+ * that cannot be mapped, are allocated with av_buffer_allocz().
+ *
+ * @return an AVBufferRef of given size or NULL when out of memory
+ */
+AVBufferRef *av_buffer_alloc_hugepage(size_t size);
+
+/**
+ * Statistics of the buffers allocated with av_buffer_alloc_hugepage() since
+ * the program started.
+ */
+typedef struct AVBufferHugepageStats {
+    /**
+     * Number of buffers mapped with explicitly reserved huge pages.
+     */
+    uint64_t nb_hugetlb;
+    /**
+     * Number of buffers mapped with transparent huge pages.
+     */
+    uint64_t nb_thp;
+    /**
+     * Number of buffers allocated with av_buffer_allocz() instead.
+     */
+    uint64_t nb_fallback;
+    /**
+     * Number of mapped buffers bound to the NUMA node of the allocating
+     * thread.
+     */
+    uint64_t nb_numa_bound;
+    /**
+     * Size in bytes of the currently mapped buffers, and its maximum.
+     */
+    uint64_t mapped_bytes;
+    uint64_t mapped_bytes_peak;
+} AVBufferHugepageStats;
+
+/**
+ * Get the statistics of av_buffer_alloc_hugepage().
+ */
+void av_buffer_hugepage_stats(AVBufferHugepageStats *stats);
+
 /**
  * Always treat the buffer as read-only, even when it has only one
  * reference.
@@ -284,6 +333,18 @@ AVBufferPool *av_buffer_pool_init2(size_t size, void *opaque,
                                    AVBufferRef* (*alloc)(void *opaque, size_t size),
                                    void (*pool_free)(void *opaque));
 
+/**
+ * Make av_buffer_pool_init() use av_buffer_alloc_hugepage() instead of the
+ * default allocator, av_buffer_alloc() or av_buffer_allocz(), for the pools
+ * created afterwards, e.g. the frame pools of the decoders and filters.
+ *
+ * This is a global setting, intended to be set by the application before
+ * creating any pools.
+ *
+ * @param enable 1 to use av_buffer_alloc_hugepage(), 0 to restore the default
+ */
+void av_buffer_pool_set_hugepages(int enable);
+
 /**
  * Mark the pool as being available for freeing. It will actually be freed only
  * once all the allocated buffers associated with the pool are released. Thus it
@@ -76,7 +76,13 @@ typedef struct BufferPoolEntry {
     void (*free)(void *opaque, uint8_t *data);
 
     AVBufferPool *pool;
-    struct BufferPoolEntry *next;
+
+    /*
+     * Index of this entry in the pool, and index + 1 of the next entry in
+     * the free list, or 0 for the last one.
+     */
+    unsigned index;
+    atomic_uint next;
 
     /*
      * An AVBuffer structure to (re)use as AVBuffer for subsequent uses
@@ -85,9 +91,45 @@ typedef struct BufferPoolEntry {
     AVBuffer buffer;
 } BufferPoolEntry;
 
+/**
+ * Number of low bits of AVBufferPool.free_list holding the index + 1 of the
+ * first free entry. The high bits hold a tag incremented on every removal
+ * from the list, so that a concurrent removal cannot be mistaken for no
+ * change at all when the same entry is back at the top of the list (the
+ * ABA problem).
+ */
+#define BUFFER_POOL_INDEX_BITS 32
+
+/**
+ * The list of free entries is only lock-free when 64-bit atomics are, the
+ * compat atomics for instance are pointer-sized. Otherwise it is protected
+ * by AVBufferPool.mutex.
+ */
+#if defined(ATOMIC_LLONG_LOCK_FREE) && ATOMIC_LLONG_LOCK_FREE == 2
+#define BUFFER_POOL_LOCK_FREE 1
+#else
+#define BUFFER_POOL_LOCK_FREE 0
+#endif
+
 struct AVBufferPool {
+    /*
+     * Serializes the allocation of new buffers and entries, and the list of
+     * free entries when it is not lock-free.
+     */
     AVMutex mutex;
-    BufferPoolEntry *pool;
+#if BUFFER_POOL_LOCK_FREE
+    atomic_uint_least64_t free_list;
+#else
+    unsigned free_list;
+#endif
+
+    /*
+     * The entries are allocated in chunks which are never moved, so that
+     * the entries can be accessed without locking. Chunk k holds 2^k entries,
+     * entry i being in chunk av_log2(i + 1).
+     */
+    BufferPoolEntry *chunks[BUFFER_POOL_INDEX_BITS];
+    unsigned nb_entries;
 
     /*
      * This is used to track when the pool is to be freed.
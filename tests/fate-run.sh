@@ -565,6 +565,41 @@ concat(){
     fi
 }
 
+stats_json(){
+    statsfile="${outdir}/${test}.json"
+    cleanfiles="$cleanfiles $statsfile"
+
+    ffmpeg -stats_json $(target_path $statsfile) "$@" || return
+    # the values depend on the timing, only check the members of the last report
+    grep '"final":true' $statsfile | sed -e 's/:-\{0,1\}[0-9][0-9.]*/:N/g' | tr , '\n'
+}
+
+mov_frag_index_cache(){
+    enc_opts=$1
+
+    file="${outdir}/${test}.mp4"
+    cache="${outdir}/${test}.cache"
+    out="${outdir}/${test}.out"
+    cleanfiles="$cleanfiles $file $cache $out-1 $out-2 $out-3 $out-1.log $out-2.log $out-3.log"
+
+    # fragmented, with neither sidx nor mfra, so that opening scans all moofs
+    ffmpeg $enc_opts -movflags +frag_keyframe+empty_moov+skip_trailer -f mp4 -y $(target_path $file) || return
+    rm -f $cache
+
+    # without a cache, writing it, then loading it
+    for i in 1 2 3; do
+        cache_opts=
+        test $i -gt 1 && cache_opts="-frag_index_cache $(target_path $cache)"
+        run ffprobe${PROGSUF}${EXECSUF} -bitexact -v verbose -show_packets -of compact=p=0:nk=1 \
+            $cache_opts $(target_path $file) > $out-$i 2> $out-$i.log || return
+        run libavformat/tests/seek${EXECSUF} $(target_path $file) $cache_opts >> $out-$i || return
+        test $i = 2 && test -f $cache && echo "cache written"
+    done
+    grep -q "fragments from index cache" $out-3.log && echo "cache loaded"
+    cat $out-1
+    diff -u $out-1 $out-2 && diff -u $out-1 $out-3
+}
+
 venc_data(){
     file=$1
     stream=$2
@@ -129,13 +129,34 @@ fate-acodec-dca2: CMP_SHIFT = -2048
 fate-acodec-dca2: CMP_TARGET = 534
 fate-acodec-dca2: SIZE_TOLERANCE = 1632
 
-FATE_ACODEC-$(call ENCDEC, FLAC, FLAC) += fate-acodec-flac fate-acodec-flac-exact-rice
+FATE_ACODEC-$(call ENCDEC, FLAC, FLAC) += fate-acodec-flac fate-acodec-flac-exact-rice \
+                                          fate-acodec-flac-threads
 fate-acodec-flac: FMT = flac
 fate-acodec-flac: CODEC = flac -compression_level 2
 
 fate-acodec-flac-exact-rice: FMT = flac
 fate-acodec-flac-exact-rice: CODEC = flac -compression_level 2 -exact_rice_parameters 1
 
+# must produce the same stream as fate-acodec-flac
+fate-acodec-flac-threads: FMT = flac
+fate-acodec-flac-threads: CODEC = flac -compression_level 2 -threads 4 -thread_type slice
+
+FATE_ACODEC_AAC_5.1 := fate-acodec-aac-5.1 fate-acodec-aac-5.1-threads \
+                       fate-acodec-aac-5.1-twoloop fate-acodec-aac-5.1-twoloop-threads
+FATE_ACODEC-$(call ENCMUX, AAC, ADTS, WAV_DEMUXER ARESAMPLE_FILTER) += $(FATE_ACODEC_AAC_5.1)
+$(FATE_ACODEC_AAC_5.1): tests/data/asynth-44100-6.wav
+$(FATE_ACODEC_AAC_5.1): SRC = tests/data/asynth-44100-6.wav
+$(FATE_ACODEC_AAC_5.1): CMD = md5 -i $(TARGET_PATH)/$(SRC) -c:a aac $(ENCOPTS) -b:a 1536k -f adts -flags +bitexact -fflags +bitexact -af aresample
+$(FATE_ACODEC_AAC_5.1): CMP = oneline
+
+# the threaded tests must produce the same stream as the single-threaded ones
+fate-acodec-aac-5.1:                 ENCOPTS = -aac_coder fast -threads 1
+fate-acodec-aac-5.1-threads:         ENCOPTS = -aac_coder fast -threads 4 -thread_type slice
+fate-acodec-aac-5.1 fate-acodec-aac-5.1-threads: REF = 18fd460f42023aea9534b4b48bc5c7f2
+fate-acodec-aac-5.1-twoloop:         ENCOPTS = -aac_coder twoloop -threads 1
+fate-acodec-aac-5.1-twoloop-threads: ENCOPTS = -aac_coder twoloop -threads 4 -thread_type slice
+fate-acodec-aac-5.1-twoloop fate-acodec-aac-5.1-twoloop-threads: REF = f5cedf9ac929fa9b358db4c839cbd46b
+
 FATE_ACODEC-$(call ENCDEC, G723_1, G723_1, ARESAMPLE_FILTER) += fate-acodec-g723_1
 fate-acodec-g723_1: tests/data/asynth-8000-1.wav
 fate-acodec-g723_1: SRC = tests/data/asynth-8000-1.wav
@@ -41,6 +41,21 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -auto_conversion_filters -idct simpl
 FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR SINE NEGATE VOLUME, LAVFI_INDEV) += fate-ffmpeg-pipeline_threads
+fate-ffmpeg-pipeline_threads: CMD = framecrc -pipeline_threads -f lavfi -i color=d=1:r=5 -f lavfi -i sine=d=1 -map 0 -vf negate -map 1 -af volume=0.5:precision=fixed -fflags +bitexact
+
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SINE HFLIP VOLUME, LAVFI_INDEV) += fate-ffmpeg-pipeline_queue_size
+fate-ffmpeg-pipeline_queue_size: CMD = framecrc -pipeline_threads -pipeline_queue_size 1 -f lavfi -i testsrc=d=1:r=5 -f lavfi -i sine=d=1 -map 0 -vf hflip -map 1 -af volume=0.5:precision=fixed -fflags +bitexact
+
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SINE HFLIP VOLUME, LAVFI_INDEV NULL_MUXER FILE_PROTOCOL) += fate-ffmpeg-stats_json
+fate-ffmpeg-stats_json: CMD = stats_json -pipeline_threads -f lavfi -i testsrc=d=1:r=5 -f lavfi -i sine=d=1 -map 0 -vf hflip -map 1 -af volume=0.5:precision=fixed -c:v rawvideo -c:a pcm_s16le -f null -
+
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SCALE FORMAT SPLIT HFLIP VFLIP OVERLAY, LAVFI_INDEV) += fate-ffmpeg-filter_thread_type
+fate-ffmpeg-filter_thread_type: CMD = framecrc -auto_conversion_filters -filter_thread_type slice+graph -filter_complex_threads 4 -f lavfi -i testsrc=d=1:r=5 -filter_complex "scale=flags=accurate_rnd+bitexact,format=yuv420p,split=3[a][b][c];[a]hflip[a1];[b]vflip[b1];[a1][b1]overlay=x=W/4[o];[o][c]overlay=y=H/4" -fflags +bitexact
+
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC2 ATADENOISE, LAVFI_INDEV) += fate-ffmpeg-filter_thread_type_frame
+fate-ffmpeg-filter_thread_type_frame: CMD = framecrc -filter_thread_type frame -filter_complex_threads 4 -f lavfi -i testsrc2=d=1:r=10:s=160x120 -filter_complex "atadenoise=s=5:enable=gte(n\,3)" -fflags +bitexact
+
 FATE_SAMPLES_FFMPEG-$(call ENCDEC2, MPEG4, RAWVIDEO, AVI, RAWVIDEO_DEMUXER FRAMECRC_MUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
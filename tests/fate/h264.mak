@@ -230,6 +230,29 @@ FATE_H264-$(call FRAMECRC, FLV, H264, SCALE_FILTER) += fate-h264-brokensps-2580
 FATE_H264-$(call FRAMECRC, MXF, H264, PCM_S24LE_DECODER SCALE_FILTER ARESAMPLE_FILTER) += fate-h264-xavc-4389
 FATE_H264-$(call FRAMECRC, MOV, H264) += fate-h264-attachment-631
 FATE_H264-$(call FRAMECRC, MPEGTS, H264, H264_PARSER MP3_DECODER SCALE_FILTER ARESAMPLE_FILTER) += fate-h264-skip-nokey fate-h264-skip-nointra
+# slice threading: frames with several slices are decoded in parallel and
+# single slices are deblocked on a second thread while they are decoded
+FATE_H264-$(call FRAMECRC, H264, H264, H264_PARSER) += fate-h264-slice-threads-ba1_ft_c
+fate-h264-slice-threads-ba1_ft_c: CMD = threads=4 thread_type=slice framecrc -framerate 19 -i $(TARGET_SAMPLES)/h264-conformance/BA1_FT_C.264
+fate-h264-slice-threads-ba1_ft_c: REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-ba1_ft_c
+
+FATE_H264-$(call FRAMECRC, H264, H264, H264_PARSER) += fate-h264-slice-threads-sva_ba1_b
+fate-h264-slice-threads-sva_ba1_b: CMD = threads=4 thread_type=slice framecrc -i $(TARGET_SAMPLES)/h264-conformance/SVA_BA1_B.264
+fate-h264-slice-threads-sva_ba1_b: REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-sva_ba1_b
+
+# hybrid threading: two frame threads, each with two slice threads
+FATE_H264-$(call FRAMECRC, H264, H264, H264_PARSER) += fate-h264-frame-slice-threads-ba1_ft_c
+fate-h264-frame-slice-threads-ba1_ft_c: CMD = threads=4 thread_type=frame+slice framecrc -frame_threads 2 -framerate 19 -i $(TARGET_SAMPLES)/h264-conformance/BA1_FT_C.264
+fate-h264-frame-slice-threads-ba1_ft_c: REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-ba1_ft_c
+
+# frame threads being added and removed on a fixed schedule must not change
+# the output
+FATE_H264_THREADS-$(call ALLYES, H264_DECODER H264_PARSER) += fate-h264-adaptive-frame-threads
+fate-h264-adaptive-frame-threads: libavcodec/tests/frame_threads$(EXESUF)
+fate-h264-adaptive-frame-threads: CMD = run libavcodec/tests/frame_threads$(EXESUF) $(TARGET_SAMPLES)/h264-conformance/CABA3_TOSHIBA_E.264
+fate-h264-adaptive-frame-threads: REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-caba3_toshiba_e
+FATE_H264-$(HAVE_THREADS) += $(FATE_H264_THREADS-yes)
+
 FATE_H264_FFPROBE-$(call DEMDEC, MATROSKA, H264) += fate-h264-dts_5frames
 FATE_H264_FFPROBE-$(call PARSERDEMDEC, H264, H264, H264) += fate-h264-afd
 
@@ -258,6 +258,19 @@ FATE_HEVC-$(call FRAMECRC, HEVC, HEVC) += fate-hevc-cabac-tudepth
 fate-hevc-small422chroma: CMD = framecrc -flags unaligned -i $(TARGET_SAMPLES)/hevc/food.hevc -pix_fmt yuv422p10le -vf scale
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) += fate-hevc-small422chroma
 
+# tiles decoded in parallel with slice threading
+HEVC_TESTS_TILES_SLICE_THREADS := TILES_A_Cisco_2 TILES_B_Cisco_1
+HEVC_TESTS_TILES_SLICE_THREADS := $(addprefix fate-hevc-slice-threads-, $(HEVC_TESTS_TILES_SLICE_THREADS))
+$(HEVC_TESTS_TILES_SLICE_THREADS): CMD = threads=4 thread_type=slice framecrc -flags unaligned -i $(TARGET_SAMPLES)/hevc-conformance/$(subst fate-hevc-slice-threads-,,$(@)).bit -pix_fmt yuv420p
+$(HEVC_TESTS_TILES_SLICE_THREADS): REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-$(subst fate-hevc-slice-threads-,,$(@))
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER) += $(HEVC_TESTS_TILES_SLICE_THREADS)
+
+# hybrid threading: two frame threads, each decoding the WPP rows with two
+# slice threads
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER) += fate-hevc-frame-slice-threads-WPP_A_ericsson_MAIN_2
+fate-hevc-frame-slice-threads-WPP_A_ericsson_MAIN_2: CMD = threads=4 thread_type=frame+slice framecrc -flags unaligned -frame_threads 2 -i $(TARGET_SAMPLES)/hevc-conformance/WPP_A_ericsson_MAIN_2.bit -pix_fmt yuv420p
+fate-hevc-frame-slice-threads-WPP_A_ericsson_MAIN_2: REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-WPP_A_ericsson_MAIN_2
+
 FATE_SAMPLES_AVCONV += $(FATE_HEVC-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_HEVC_FFPROBE-yes)
 
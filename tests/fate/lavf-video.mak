@@ -1,5 +1,6 @@
 FATE_LAVF_VIDEO_SCALE-$(call ENCDEC,  APNG,       APNG) += apng
 FATE_LAVF_VIDEO_SCALE-$(call ENCDEC,  APNG PNG,   APNG) += apng.png
+FATE_LAVF_VIDEO_SCALE-$(call ENCDEC,  APNG,       APNG) += threads.apng
 FATE_LAVF_VIDEO_SCALE-$(call ENCDEC,  FITS,       FITS) += gray.fits
 FATE_LAVF_VIDEO_SCALE-$(call ENCDEC,  FITS,       FITS) += gray16be.fits
 FATE_LAVF_VIDEO_SCALE-$(call ENCDEC,  FITS,       FITS) += gbrp.fits
@@ -21,6 +22,7 @@ $(FATE_LAVF_VIDEO): $(VREF)
 
 fate-lavf-apng: CMD = lavf_video "-pix_fmt rgb24"
 fate-lavf-apng.png: CMD = lavf_video "-pix_fmt rgb24" "-frames:v 1 -f apng"
+fate-lavf-threads.apng: CMD = lavf_video "-pix_fmt rgb24" "-threads 2 -thread_type slice -band_deflate 1"
 fate-lavf-gray.fits: CMD = lavf_video "-pix_fmt gray"
 fate-lavf-gray16be.fits: CMD = lavf_video "-pix_fmt gray16be"
 fate-lavf-gbrp.fits: CMD = lavf_video "-pix_fmt gbrp"
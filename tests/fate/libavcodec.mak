@@ -94,6 +94,10 @@ fate-libavcodec-avcodec: libavcodec/tests/avcodec$(EXESUF)
 fate-libavcodec-avcodec: CMD = run libavcodec/tests/avcodec$(EXESUF)
 fate-libavcodec-avcodec: CMP = null
 
+FATE_LIBAVCODEC-$(call ALLYES, PNG_ENCODER PNG_DECODER) += fate-libavcodec-frame-pool
+fate-libavcodec-frame-pool: libavcodec/tests/frame_pool$(EXESUF)
+fate-libavcodec-frame-pool: CMD = run libavcodec/tests/frame_pool$(EXESUF)
+
 FATE_LIBAVCODEC-yes += fate-libavcodec-huffman
 fate-libavcodec-huffman: libavcodec/tests/mjpegenc_huffman$(EXESUF)
 fate-libavcodec-huffman: CMD = run libavcodec/tests/mjpegenc_huffman$(EXESUF)
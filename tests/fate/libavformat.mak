@@ -2,6 +2,10 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+FATE_LIBAVFORMAT-$(CONFIG_FILE_PROTOCOL) += fate-aio
+fate-aio: libavformat/tests/aio$(EXESUF)
+fate-aio: CMD = run libavformat/tests/aio$(EXESUF) $(TARGET_PATH)/tests/data/aio.bin
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
@@ -167,4 +167,11 @@ fate-mov-channel-description: CMD = transcode wav $(TARGET_PATH)/tests/data/asyn
 
 FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
 
-fate-mov: $(FATE_MOV) $(FATE_MOV_FFMPEG-yes) $(FATE_MOV_FFPROBE) $(FATE_MOV_FASTSTART) $(FATE_MOV_FFMPEG_FFPROBE-yes)
+FATE_MOV_FFMPEG_FFPROBE_LOCAL-$(call TRANSCODE, MPEG4, MP4 MOV, TESTSRC2_FILTER LAVFI_INDEV) \
+                          += fate-mov-frag-index-cache
+fate-mov-frag-index-cache: libavformat/tests/seek$(EXESUF)
+fate-mov-frag-index-cache: CMD = mov_frag_index_cache "-f lavfi -i testsrc2=d=2:r=10:s=160x120 -c:v mpeg4 -g 5 -threads 1 -fflags +bitexact -flags +bitexact"
+
+FATE_FFMPEG_FFPROBE += $(FATE_MOV_FFMPEG_FFPROBE_LOCAL-yes)
+
+fate-mov: $(FATE_MOV) $(FATE_MOV_FFMPEG-yes) $(FATE_MOV_FFPROBE) $(FATE_MOV_FASTSTART) $(FATE_MOV_FFMPEG_FFPROBE-yes) $(FATE_MOV_FFMPEG_FFPROBE_LOCAL-yes)
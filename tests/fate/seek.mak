@@ -150,6 +150,24 @@ FATE_SEEK_LAVF_CONTAINER := $(FATE_SEEK_LAVF_CONTAINER:%=fate-seek-lavf-%)
 FATE_SEEK_LAVF_CONTAINER := $(filter $(subst fate-,fate-seek-,$(FATE_LAVF_CONTAINER)), $(FATE_SEEK_LAVF_CONTAINER))
 FATE_SEEK += $(FATE_SEEK_LAVF_CONTAINER)
 
+# lavf.mov again with the samples resolved lazily from the sample tables,
+# with the sample tables mapped from the file, and with the samples read in
+# batches, ahead on a background thread
+
+FATE_SEEK_LAVF_MOV_OPTS-lazy-index = -lazy_index 1
+FATE_SEEK_LAVF_MOV_OPTS-mmap       = -lazy_index 1 -mmap_tables 1
+FATE_SEEK_LAVF_MOV_OPTS-batched    = -read_batch_size 65536 -read_ahead 1
+
+define FATE_SEEK_LAVF_MOV_SUITE
+fate-seek-lavf-mov-$(1): fate-lavf-mov libavformat/tests/seek$$(EXESUF)
+fate-seek-lavf-mov-$(1): CMD = run libavformat/tests/seek$$(EXESUF) $$(TARGET_PATH)/tests/data/lavf/lavf.mov $$(FATE_SEEK_LAVF_MOV_OPTS-$(1))
+endef
+
+FATE_SEEK_LAVF_MOV_VARIANTS := $(if $(filter fate-seek-lavf-mov, $(FATE_SEEK_LAVF_CONTAINER)), lazy-index mmap batched)
+$(foreach V,$(FATE_SEEK_LAVF_MOV_VARIANTS),$(eval $(call FATE_SEEK_LAVF_MOV_SUITE,$(V))))
+FATE_SEEK_LAVF_MOV := $(FATE_SEEK_LAVF_MOV_VARIANTS:%=fate-seek-lavf-mov-%)
+FATE_AVCONV += $(FATE_SEEK_LAVF_MOV)
+
 # files from fate-lavf-video
 
 FATE_SEEK_LAVF_VIDEO += gif y4m
@@ -207,4 +225,4 @@ fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
 FATE_AVCONV += $(FATE_SEEK)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAVF_MOV)
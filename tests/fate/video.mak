@@ -201,6 +201,10 @@ fate-interplay-mve-16bit: CMD = framecrc -i $(TARGET_SAMPLES)/interplay-mve/desc
 FATE_VIDEO-$(call FRAMECRC, MXF, JPEG2000, SCALE_FILTER) += fate-jpeg2000-dcinema
 fate-jpeg2000-dcinema: CMD = framecrc -flags +bitexact -c:v jpeg2000 -i $(TARGET_SAMPLES)/jpeg2000/chiens_dcinema2K.mxf -pix_fmt xyz12le -vf scale
 
+FATE_VIDEO-$(call FRAMECRC, MXF, JPEG2000, SCALE_FILTER) += fate-jpeg2000-dcinema-frame-slice-threads
+fate-jpeg2000-dcinema-frame-slice-threads: CMD = threads=4 thread_type=frame+slice framecrc -flags +bitexact -c:v jpeg2000 -frame_threads 2 -i $(TARGET_SAMPLES)/jpeg2000/chiens_dcinema2K.mxf -pix_fmt xyz12le -vf scale
+fate-jpeg2000-dcinema-frame-slice-threads: REF = $(SRC_PATH)/tests/ref/fate/jpeg2000-dcinema
+
 FATE_VIDEO-$(call FRAMECRC, JV, JV, SCALE_FILTER) += fate-jv
 fate-jv: CMD = framecrc -i $(TARGET_SAMPLES)/jv/intro.jv -an -pix_fmt rgb24 -vf scale
 
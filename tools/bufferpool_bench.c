@@ -0,0 +1,147 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the throughput of av_buffer_pool_get() and av_buffer_unref() on a
+ * pool shared by an increasing number of threads.
+ *
+ * Usage: bufferpool_bench [max_threads [iterations [batch]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "third_party/ffmpeg/config.h"
+
+#include "third_party/ffmpeg/libavutil/buffer.h"
+#include "third_party/ffmpeg/libavutil/common.h"
+#include "third_party/ffmpeg/libavutil/thread.h"
+#include "third_party/ffmpeg/libavutil/time.h"
+
+#define MAX_THREADS 64
+#define MAX_BATCH   64
+
+typedef struct BenchThread {
+    AVBufferPool *pool;
+    int iterations;
+    int batch;
+    int failed;
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+} BenchThread;
+
+static void *bench_thread(void *arg)
+{
+    BenchThread *t = arg;
+    AVBufferRef *bufs[MAX_BATCH];
+
+    for (int i = 0; i < t->iterations; i++) {
+        /* hold several buffers at once, as a decoder or filter would */
+        for (int j = 0; j < t->batch; j++) {
+            bufs[j] = av_buffer_pool_get(t->pool);
+            if (!bufs[j]) {
+                t->failed = 1;
+                return NULL;
+            }
+            bufs[j]->data[0] = j;
+        }
+        for (int j = 0; j < t->batch; j++)
+            av_buffer_unref(&bufs[j]);
+    }
+
+    return NULL;
+}
+
+static int run(int nb_threads, int iterations, int batch)
+{
+    BenchThread threads[MAX_THREADS] = { { 0 } };
+    AVBufferPool *pool;
+    int64_t start, elapsed;
+    int failed = 0;
+
+    pool = av_buffer_pool_init(4096, NULL);
+    if (!pool)
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < nb_threads; i++) {
+        threads[i].pool       = pool;
+        threads[i].iterations = iterations;
+        threads[i].batch      = batch;
+    }
+
+    start = av_gettime_relative();
+#if HAVE_THREADS
+    for (int i = 1; i < nb_threads; i++) {
+        if (pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i])) {
+            fprintf(stderr, "Could not create thread %d\n", i);
+            nb_threads = i;
+            failed     = 1;
+            break;
+        }
+    }
+#endif
+    bench_thread(&threads[0]);
+#if HAVE_THREADS
+    for (int i = 1; i < nb_threads; i++)
+        pthread_join(threads[i].thread, NULL);
+#endif
+    elapsed = FFMAX(av_gettime_relative() - start, 1);
+
+    av_buffer_pool_uninit(&pool);
+
+    for (int i = 0; i < nb_threads; i++)
+        failed |= threads[i].failed;
+    if (failed)
+        return AVERROR(ENOMEM);
+
+    printf("%7d %12.1f %14.2f %14.2f\n", nb_threads, elapsed / 1000.0,
+           (double)nb_threads * iterations * batch / elapsed,
+           (double)iterations * batch / elapsed);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    int iterations  = argc > 2 ? atoi(argv[2]) : 1000000;
+    int batch       = argc > 3 ? atoi(argv[3]) : 4;
+
+    if (max_threads < 1 || max_threads > MAX_THREADS ||
+        iterations  < 1 || batch < 1 || batch > MAX_BATCH) {
+        fprintf(stderr, "Usage: %s [max_threads (1-%d) [iterations [batch (1-%d)]]]\n",
+                argv[0], MAX_THREADS, MAX_BATCH);
+        return 1;
+    }
+#if !HAVE_THREADS
+    max_threads = 1;
+#endif
+
+    printf("%7s %12s %14s %14s\n", "threads", "time_ms",
+           "total_Mops/s", "thread_Mops/s");
+
+    for (int nb_threads = 1; nb_threads <= max_threads; nb_threads *= 2) {
+        if (run(nb_threads, iterations, batch) < 0) {
+            fprintf(stderr, "Buffer allocation failed\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,344 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Write a synthetic MP4 file with many long tracks and measure the time
+ * avformat_open_input() and avformat_find_stream_info() take on it with
+ * different mov demuxer options.
+ *
+ * Each track is a 25 fps 4x4 raw video track with 25 samples per chunk and
+ * per-sample size entries, the sample data itself is left sparse.
+ *
+ * Usage: mov_open_bench <file> [hours [tracks [runs]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "third_party/ffmpeg/libavformat/avformat.h"
+#include "third_party/ffmpeg/libavformat/avio.h"
+#include "third_party/ffmpeg/libavutil/common.h"
+#include "third_party/ffmpeg/libavutil/dict.h"
+#include "third_party/ffmpeg/libavutil/error.h"
+#include "third_party/ffmpeg/libavutil/intreadwrite.h"
+#include "third_party/ffmpeg/libavutil/time.h"
+
+#define FPS               25
+#define WIDTH             4
+#define HEIGHT            4
+#define SAMPLE_SIZE       (WIDTH * HEIGHT * 3)
+#define SAMPLES_PER_CHUNK 25
+#define MAX_TRACKS        256
+
+static const char *const configs[][2] = {
+    { "default",                NULL                         },
+    { "lazy_index",             "lazy_index=1"               },
+    { "lazy_index+mmap_tables", "lazy_index=1:mmap_tables=1" },
+};
+
+static int64_t start_atom(AVIOContext *pb, const char *tag)
+{
+    int64_t pos = avio_tell(pb);
+    avio_wb32(pb, 0);
+    avio_wl32(pb, AV_RL32(tag));
+    return pos;
+}
+
+static void end_atom(AVIOContext *pb, int64_t pos)
+{
+    int64_t end = avio_tell(pb);
+    avio_seek(pb, pos, SEEK_SET);
+    avio_wb32(pb, end - pos);
+    avio_seek(pb, end, SEEK_SET);
+}
+
+static void write_matrix(AVIOContext *pb)
+{
+    avio_wb32(pb, 0x00010000); avio_wb32(pb, 0); avio_wb32(pb, 0);
+    avio_wb32(pb, 0); avio_wb32(pb, 0x00010000); avio_wb32(pb, 0);
+    avio_wb32(pb, 0); avio_wb32(pb, 0); avio_wb32(pb, 0x40000000);
+}
+
+static void write_stbl(AVIOContext *pb, int track, int nb_tracks,
+                       unsigned nb_samples, int64_t data_start)
+{
+    unsigned nb_chunks = nb_samples / SAMPLES_PER_CHUNK;
+    int64_t chunk_size = SAMPLES_PER_CHUNK * SAMPLE_SIZE;
+    int co64 = data_start + nb_chunks * nb_tracks * chunk_size > UINT32_MAX;
+    int64_t stbl, atom;
+
+    stbl = start_atom(pb, "stbl");
+
+    atom = start_atom(pb, "stsd");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 1);
+    {
+        int64_t entry = start_atom(pb, "raw ");
+        avio_wb32(pb, 0);
+        avio_wb16(pb, 0);
+        avio_wb16(pb, 1);           /* data reference index */
+        avio_wb16(pb, 0);           /* version */
+        avio_wb16(pb, 0);           /* revision */
+        avio_wb32(pb, 0);           /* vendor */
+        avio_wb32(pb, 0);           /* temporal quality */
+        avio_wb32(pb, 0);           /* spatial quality */
+        avio_wb16(pb, WIDTH);
+        avio_wb16(pb, HEIGHT);
+        avio_wb32(pb, 0x00480000);  /* horizontal resolution */
+        avio_wb32(pb, 0x00480000);  /* vertical resolution */
+        avio_wb32(pb, 0);
+        avio_wb16(pb, 1);           /* frame count */
+        for (int i = 0; i < 32; i++)
+            avio_w8(pb, 0);         /* compressor name */
+        avio_wb16(pb, 24);          /* depth */
+        avio_wb16(pb, 0xffff);      /* color table id */
+        end_atom(pb, entry);
+    }
+    end_atom(pb, atom);
+
+    atom = start_atom(pb, "stts");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 1);
+    avio_wb32(pb, nb_samples);
+    avio_wb32(pb, 1);
+    end_atom(pb, atom);
+
+    atom = start_atom(pb, "stsc");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 1);
+    avio_wb32(pb, 1);
+    avio_wb32(pb, SAMPLES_PER_CHUNK);
+    avio_wb32(pb, 1);
+    end_atom(pb, atom);
+
+    atom = start_atom(pb, "stsz");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_wb32(pb, nb_samples);
+    for (unsigned i = 0; i < nb_samples; i++)
+        avio_wb32(pb, SAMPLE_SIZE);
+    end_atom(pb, atom);
+
+    atom = start_atom(pb, co64 ? "co64" : "stco");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, nb_chunks);
+    for (unsigned i = 0; i < nb_chunks; i++) {
+        int64_t offset = data_start + ((int64_t)i * nb_tracks + track) * chunk_size;
+        if (co64)
+            avio_wb64(pb, offset);
+        else
+            avio_wb32(pb, offset);
+    }
+    end_atom(pb, atom);
+
+    end_atom(pb, stbl);
+}
+
+static void write_trak(AVIOContext *pb, int track, int nb_tracks,
+                       unsigned nb_samples, int64_t data_start)
+{
+    int64_t trak, mdia, minf, atom;
+
+    trak = start_atom(pb, "trak");
+
+    atom = start_atom(pb, "tkhd");
+    avio_wb32(pb, 3);               /* enabled, in movie */
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_wb32(pb, track + 1);
+    avio_wb32(pb, 0);
+    avio_wb32(pb, (int64_t)nb_samples * 1000 / FPS);
+    avio_wb64(pb, 0);
+    avio_wb16(pb, 0);               /* layer */
+    avio_wb16(pb, 0);               /* alternate group */
+    avio_wb16(pb, 0);               /* volume */
+    avio_wb16(pb, 0);
+    write_matrix(pb);
+    avio_wb32(pb, WIDTH  << 16);
+    avio_wb32(pb, HEIGHT << 16);
+    end_atom(pb, atom);
+
+    mdia = start_atom(pb, "mdia");
+
+    atom = start_atom(pb, "mdhd");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_wb32(pb, FPS);
+    avio_wb32(pb, nb_samples);
+    avio_wb16(pb, 0x55c4);          /* und */
+    avio_wb16(pb, 0);
+    end_atom(pb, atom);
+
+    atom = start_atom(pb, "hdlr");
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_wl32(pb, AV_RL32("vide"));
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_wb32(pb, 0);
+    avio_w8(pb, 0);
+    end_atom(pb, atom);
+
+    minf = start_atom(pb, "minf");
+
+    atom = start_atom(pb, "vmhd");
+    avio_wb32(pb, 1);
+    avio_wb64(pb, 0);
+    end_atom(pb, atom);
+
+    atom = start_atom(pb, "dinf");
+    {
+        int64_t dref = start_atom(pb, "dref");
+        avio_wb32(pb, 0);
+        avio_wb32(pb, 1);
+        avio_wb32(pb, 12);
+        avio_wl32(pb, AV_RL32("url "));
+        avio_wb32(pb, 1);           /* self reference */
+        end_atom(pb, dref);
+    }
+    end_atom(pb, atom);
+
+    write_stbl(pb, track, nb_tracks, nb_samples, data_start);
+
+    end_atom(pb, minf);
+    end_atom(pb, mdia);
+    end_atom(pb, trak);
+}
+
+static int write_file(const char *filename, int hours, int nb_tracks)
+{
+    unsigned nb_samples = hours * 3600 * FPS;
+    int64_t data_size = (int64_t)nb_samples * nb_tracks * SAMPLE_SIZE;
+    int64_t data_start, moov;
+    AVIOContext *pb;
+    int ret;
+
+    ret = avio_open(&pb, filename, AVIO_FLAG_WRITE);
+    if (ret < 0)
+        return ret;
+
+    avio_wb32(pb, 20);
+    avio_wl32(pb, AV_RL32("ftyp"));
+    avio_wl32(pb, AV_RL32("isom"));
+    avio_wb32(pb, 0x200);
+    avio_wl32(pb, AV_RL32("isom"));
+
+    /* 64-bit mdat whose payload is only reserved, not written */
+    avio_wb32(pb, 1);
+    avio_wl32(pb, AV_RL32("mdat"));
+    avio_wb64(pb, 16 + data_size);
+    data_start = avio_tell(pb);
+    avio_seek(pb, data_start + data_size, SEEK_SET);
+
+    moov = start_atom(pb, "moov");
+    {
+        int64_t atom = start_atom(pb, "mvhd");
+        avio_wb32(pb, 0);
+        avio_wb32(pb, 0);
+        avio_wb32(pb, 0);
+        avio_wb32(pb, 1000);
+        avio_wb32(pb, (int64_t)nb_samples * 1000 / FPS);
+        avio_wb32(pb, 0x00010000);  /* rate */
+        avio_wb16(pb, 0x0100);      /* volume */
+        avio_wb16(pb, 0);
+        avio_wb64(pb, 0);
+        write_matrix(pb);
+        for (int i = 0; i < 6; i++)
+            avio_wb32(pb, 0);
+        avio_wb32(pb, nb_tracks + 1);
+        end_atom(pb, atom);
+    }
+    for (int i = 0; i < nb_tracks; i++)
+        write_trak(pb, i, nb_tracks, nb_samples, data_start);
+    end_atom(pb, moov);
+
+    ret = pb->error;
+    avio_closep(&pb);
+    return ret;
+}
+
+static int open_file(const char *filename, const char *opts, int64_t *elapsed)
+{
+    AVFormatContext *s = NULL;
+    AVDictionary *dict = NULL;
+    int64_t start;
+    int ret;
+
+    if (opts) {
+        ret = av_dict_parse_string(&dict, opts, "=", ":", 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    start = av_gettime_relative();
+    ret = avformat_open_input(&s, filename, NULL, &dict);
+    if (ret >= 0)
+        ret = avformat_find_stream_info(s, NULL);
+    *elapsed = av_gettime_relative() - start;
+
+    avformat_close_input(&s);
+    av_dict_free(&dict);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = argc > 1 ? argv[1] : NULL;
+    int hours     = argc > 2 ? atoi(argv[2]) : 10;
+    int nb_tracks = argc > 3 ? atoi(argv[3]) : 20;
+    int runs      = argc > 4 ? atoi(argv[4]) : 3;
+    int ret;
+
+    if (!filename || hours < 1 || hours > 1000 ||
+        nb_tracks < 1 || nb_tracks > MAX_TRACKS || runs < 1) {
+        fprintf(stderr, "Usage: %s <file> [hours (1-1000) [tracks (1-%d) [runs]]]\n",
+                argv[0], MAX_TRACKS);
+        return 1;
+    }
+
+    ret = write_file(filename, hours, nb_tracks);
+    if (ret < 0) {
+        fprintf(stderr, "Could not write %s: %s\n", filename, av_err2str(ret));
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%-24s %12s %12s\n", "config", "best_ms", "mean_ms");
+    for (int i = 0; i < FF_ARRAY_ELEMS(configs); i++) {
+        int64_t best = INT64_MAX, total = 0;
+
+        for (int j = 0; j < runs; j++) {
+            int64_t elapsed;
+
+            ret = open_file(filename, configs[i][1], &elapsed);
+            if (ret < 0) {
+                fprintf(stderr, "Could not open %s with %s: %s\n",
+                        filename, configs[i][0], av_err2str(ret));
+                return 1;
+            }
+            best   = FFMIN(best, elapsed);
+            total += elapsed;
+        }
+        printf("%-24s %12.1f %12.1f\n", configs[i][0],
+               best / 1000.0, total / 1000.0 / runs);
+    }
+
+    return 0;
+}